@@ -0,0 +1,41 @@
+#include "base/synchronization/wait_group.h"
+
+#include "base/check.h"
+
+namespace base {
+
+WaitGroup::WaitGroup(int count) : count_(count) {
+  DCHECK(count >= 0);
+}
+
+WaitGroup::~WaitGroup() {
+  DCHECK(count_ == 0);
+}
+
+void WaitGroup::Add(int count) {
+  std::lock_guard<std::mutex> locker(lock_);
+  count_ += count;
+  DCHECK(count_ >= 0);
+}
+
+void WaitGroup::Done() {
+  // Notify while holding the lock: once the count reaches zero the waiter may
+  // return and destroy this object.
+  std::lock_guard<std::mutex> locker(lock_);
+  DCHECK(count_ > 0);
+  if (--count_ == 0) {
+    cond_.notify_all();
+  }
+}
+
+void WaitGroup::Wait() {
+  std::unique_lock<std::mutex> locker(lock_);
+  cond_.wait(locker, [this]() { return count_ == 0; });
+}
+
+bool WaitGroup::IsDone() {
+  std::lock_guard<std::mutex> locker(lock_);
+  return count_ == 0;
+}
+
+}  // namespace base
@@ -0,0 +1,44 @@
+#ifndef MINI_CHROMIUM_BASE_SYNCHRONIZATION_WAIT_GROUP_H_
+#define MINI_CHROMIUM_BASE_SYNCHRONIZATION_WAIT_GROUP_H_
+
+#include <condition_variable>
+#include <mutex>
+
+namespace base {
+
+// Waits for a group of tasks to finish. Add() is called before posting work,
+// each task calls Done() when it completes, and Wait() blocks until the count
+// drops back to zero. Constructing with a count makes it a one-shot latch.
+//
+//   base::WaitGroup wait_group;
+//   for (...) {
+//     wait_group.Add(1);
+//     pool->PostTask([&]() { Work(); wait_group.Done(); });
+//   }
+//   wait_group.Wait();
+class WaitGroup {
+ public:
+  explicit WaitGroup(int count = 0);
+
+  WaitGroup(const WaitGroup&) = delete;
+  WaitGroup& operator=(const WaitGroup&) = delete;
+
+  ~WaitGroup();
+
+  void Add(int count);
+  void Done();
+
+  // Returns immediately if the count is already zero.
+  void Wait();
+  // Returns true if the count is zero, without blocking.
+  bool IsDone();
+
+ private:
+  std::mutex lock_;
+  std::condition_variable cond_;
+  int count_;
+};
+
+}  // namespace base
+
+#endif  // MINI_CHROMIUM_BASE_SYNCHRONIZATION_WAIT_GROUP_H_
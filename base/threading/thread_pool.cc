@@ -0,0 +1,255 @@
+#include "base/threading/thread_pool.h"
+
+#include <algorithm>
+
+#include "base/check.h"
+
+namespace base {
+
+namespace {
+
+// The pool and worker index of the current thread, if it is a worker.
+thread_local ThreadPool* g_current_pool = nullptr;
+thread_local int g_current_worker = -1;
+
+// Chunks per thread used by ParallelFor() when no grain is given, so that
+// uneven chunks still balance out.
+constexpr int kChunksPerThread = 4;
+
+}  // namespace
+
+struct ThreadPool::ParallelForState {
+  const RangeTask* body;
+  int begin;
+  int end;
+  int grain;
+  int chunk_count;
+
+  std::atomic<int> next_chunk;
+  // Helpers currently inside RunChunks().
+  std::atomic<int> active_helpers;
+
+  std::mutex lock;
+  std::condition_variable helpers_done;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : shutdown_(false),
+      pending_tasks_(0),
+      sleeping_workers_(0),
+      executed_tasks_(0),
+      stolen_tasks_(0) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(new Worker());
+  }
+  // Start the threads only after every worker exists, they steal from each
+  // other right away.
+  for (int i = 0; i < num_threads; ++i) {
+    workers_[i]->thread = std::thread(&ThreadPool::WorkerMain, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> locker(lock_);
+    shutdown_ = true;
+  }
+  wake_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+  DCHECK(pending_tasks_ == 0);
+}
+
+// static
+ThreadPool* ThreadPool::GetDefault() {
+  // Leaked on purpose, so that tasks posted during shutdown never race with
+  // the destructor.
+  static ThreadPool* pool = new ThreadPool(0);
+  return pool;
+}
+
+void ThreadPool::PostTask(Task task, TaskPriority priority) {
+  DCHECK(task);
+
+  const int p = static_cast<int>(priority);
+  if (g_current_pool == this) {
+    Worker* worker = workers_[g_current_worker].get();
+    std::lock_guard<std::mutex> locker(worker->lock);
+    worker->queues[p].push_back(std::move(task));
+  } else {
+    std::lock_guard<std::mutex> locker(lock_);
+    DCHECK(!shutdown_);
+    shared_queues_[p].push_back(std::move(task));
+  }
+
+  // Paired with the check in WorkerMain(): a worker increments
+  // |sleeping_workers_| before it rechecks |pending_tasks_|, so at least one
+  // side sees the other.
+  ++pending_tasks_;
+  if (sleeping_workers_ > 0) {
+    std::lock_guard<std::mutex> locker(lock_);
+    wake_.notify_one();
+  }
+}
+
+void ThreadPool::ParallelFor(int begin,
+                             int end,
+                             int grain,
+                             const RangeTask& body,
+                             TaskPriority priority) {
+  if (begin >= end) {
+    return;
+  }
+
+  const int count = end - begin;
+  if (grain <= 0) {
+    grain = std::max(1, count / (num_threads() * kChunksPerThread));
+  }
+  const int chunk_count = (count + grain - 1) / grain;
+  if (chunk_count == 1) {
+    body(begin, end);
+    return;
+  }
+
+  // Helpers may start after this call has returned, so they only share the
+  // state through a shared_ptr and never touch |body| once all chunks are
+  // taken.
+  std::shared_ptr<ParallelForState> state =
+      std::make_shared<ParallelForState>();
+  state->body = &body;
+  state->begin = begin;
+  state->end = end;
+  state->grain = grain;
+  state->chunk_count = chunk_count;
+  state->next_chunk = 0;
+  state->active_helpers = 0;
+
+  const int helpers = std::min(num_threads(), chunk_count - 1);
+  for (int i = 0; i < helpers; ++i) {
+    PostTask(
+        [state]() {
+          ++state->active_helpers;
+          RunChunks(state.get());
+          std::lock_guard<std::mutex> locker(state->lock);
+          if (--state->active_helpers == 0) {
+            state->helpers_done.notify_all();
+          }
+        },
+        priority);
+  }
+
+  RunChunks(state.get());
+
+  // Every chunk has been taken. Wait for the helpers that are still running
+  // one; a helper that starts from now on finds no chunk and exits at once.
+  std::unique_lock<std::mutex> locker(state->lock);
+  state->helpers_done.wait(locker,
+                           [&state]() { return state->active_helpers == 0; });
+}
+
+bool ThreadPool::RunsTasksOnCurrentThread() const {
+  return g_current_pool == this;
+}
+
+void ThreadPool::WorkerMain(int index) {
+  g_current_pool = this;
+  g_current_worker = index;
+
+  Task task;
+  while (true) {
+    if (TakeTask(index, &task)) {
+      task();
+      task = nullptr;
+      ++executed_tasks_;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> locker(lock_);
+    ++sleeping_workers_;
+    wake_.wait(locker,
+               [this]() { return pending_tasks_ > 0 || shutdown_; });
+    --sleeping_workers_;
+    if (shutdown_ && pending_tasks_ == 0) {
+      break;
+    }
+  }
+
+  g_current_pool = nullptr;
+  g_current_worker = -1;
+}
+
+bool ThreadPool::TakeTask(int index, Task* task) {
+  if (pending_tasks_ == 0) {
+    return false;
+  }
+
+  for (int p = 0; p < kNumPriorities; ++p) {
+    if (PopLocal(index, p, task) || PopShared(p, task) ||
+        Steal(index, p, task)) {
+      --pending_tasks_;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::PopLocal(int index, int priority, Task* task) {
+  Worker* worker = workers_[index].get();
+  std::lock_guard<std::mutex> locker(worker->lock);
+  std::deque<Task>& queue = worker->queues[priority];
+  if (queue.empty()) {
+    return false;
+  }
+  *task = std::move(queue.back());
+  queue.pop_back();
+  return true;
+}
+
+bool ThreadPool::PopShared(int priority, Task* task) {
+  std::lock_guard<std::mutex> locker(lock_);
+  std::deque<Task>& queue = shared_queues_[priority];
+  if (queue.empty()) {
+    return false;
+  }
+  *task = std::move(queue.front());
+  queue.pop_front();
+  return true;
+}
+
+bool ThreadPool::Steal(int thief, int priority, Task* task) {
+  const int count = num_threads();
+  for (int i = 1; i < count; ++i) {
+    Worker* victim = workers_[(thief + i) % count].get();
+    std::lock_guard<std::mutex> locker(victim->lock);
+    std::deque<Task>& queue = victim->queues[priority];
+    if (!queue.empty()) {
+      *task = std::move(queue.front());
+      queue.pop_front();
+      ++stolen_tasks_;
+      return true;
+    }
+  }
+  return false;
+}
+
+// static
+void ThreadPool::RunChunks(ParallelForState* state) {
+  while (true) {
+    const int chunk = state->next_chunk++;
+    if (chunk >= state->chunk_count) {
+      break;
+    }
+    const int chunk_begin = state->begin + chunk * state->grain;
+    const int chunk_end = std::min(chunk_begin + state->grain, state->end);
+    (*state->body)(chunk_begin, chunk_end);
+  }
+}
+
+}  // namespace base
@@ -0,0 +1,117 @@
+#ifndef MINI_CHROMIUM_BASE_THREADING_THREAD_POOL_H_
+#define MINI_CHROMIUM_BASE_THREADING_THREAD_POOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace base {
+
+// Tasks of a higher priority are always picked before tasks of a lower
+// priority, both from a worker's own queue and when stealing.
+enum class TaskPriority {
+  // Work that someone is blocked on, e.g. the bands of a ParallelFor().
+  USER_BLOCKING = 0,
+  USER_VISIBLE = 1,
+  // Work nobody waits for, e.g. statistics or cleanup.
+  BEST_EFFORT = 2,
+};
+
+// A fixed-size pool of worker threads with per-worker work-stealing queues.
+//
+// Tasks posted from a worker thread go to the back of that worker's own queue
+// and are popped LIFO, which keeps recursively split work cache-hot. Tasks
+// posted from other threads go to a shared queue. An idle worker first takes
+// from its own queue, then from the shared queue, then steals the oldest task
+// of another worker.
+//
+// Components should share GetDefault() instead of starting their own threads,
+// so that parallel helpers do not oversubscribe the cores.
+class ThreadPool {
+ public:
+  using Task = std::function<void()>;
+  // Processes the half-open range [begin, end).
+  using RangeTask = std::function<void(int begin, int end)>;
+
+  // num_threads <= 0 uses one thread per hardware thread.
+  explicit ThreadPool(int num_threads);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Runs every task that was already posted, then joins the workers.
+  ~ThreadPool();
+
+  // The process-wide pool, created on first use and never destroyed.
+  static ThreadPool* GetDefault();
+
+  void PostTask(Task task,
+                TaskPriority priority = TaskPriority::USER_VISIBLE);
+
+  // Splits [begin, end) into chunks of |grain| items and runs |body| on them
+  // in parallel. The calling thread processes chunks too, and the call
+  // returns once every chunk is done. grain <= 0 picks a chunk size that
+  // gives each thread a few chunks. May be called from a worker thread.
+  void ParallelFor(int begin,
+                   int end,
+                   int grain,
+                   const RangeTask& body,
+                   TaskPriority priority = TaskPriority::USER_BLOCKING);
+
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
+  // True if the current thread is one of this pool's workers.
+  bool RunsTasksOnCurrentThread() const;
+
+  // Counters since the pool was created.
+  int64_t executed_tasks() const { return executed_tasks_; }
+  int64_t stolen_tasks() const { return stolen_tasks_; }
+
+ private:
+  static constexpr int kNumPriorities = 3;
+
+  struct Worker {
+    std::mutex lock;
+    std::deque<Task> queues[kNumPriorities];
+    std::thread thread;
+  };
+
+  struct ParallelForState;
+
+  void WorkerMain(int index);
+
+  // Takes the next task for worker |index|, or returns false if there is no
+  // queued task anywhere.
+  bool TakeTask(int index, Task* task);
+  bool PopLocal(int index, int priority, Task* task);
+  bool PopShared(int priority, Task* task);
+  bool Steal(int thief, int priority, Task* task);
+
+  static void RunChunks(ParallelForState* state);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::mutex lock_;
+  std::condition_variable wake_;
+  // Guarded by |lock_|.
+  std::deque<Task> shared_queues_[kNumPriorities];
+  bool shutdown_;
+
+  // Number of queued tasks in all queues.
+  std::atomic<int> pending_tasks_;
+  std::atomic<int> sleeping_workers_;
+
+  std::atomic<int64_t> executed_tasks_;
+  std::atomic<int64_t> stolen_tasks_;
+};
+
+}  // namespace base
+
+#endif  // MINI_CHROMIUM_BASE_THREADING_THREAD_POOL_H_
@@ -0,0 +1,176 @@
+#include "base/threading/thread_role.h"
+
+#include <stdlib.h>
+
+#include <mutex>
+#include <thread>
+
+#include "base/check.h"
+
+namespace base {
+
+namespace {
+
+constexpr int kRoleCount = static_cast<int>(ThreadRole::COUNT);
+constexpr int kMaxCpus = 64;
+
+// Reserving a CPU on smaller machines costs the encoder too much.
+constexpr int kMinCpusToReserve = 4;
+
+const char* const kRoleNames[] = {
+    "capture", "audio", "encode", "io", "background",
+};
+static_assert(sizeof(kRoleNames) / sizeof(kRoleNames[0]) == kRoleCount,
+              "kRoleNames must match ThreadRole");
+
+const char* const kPriorityNames[] = {
+    "background", "utility", "normal", "display", "realtime_audio",
+};
+
+struct RoleTable {
+  std::mutex lock;
+  bool overridden[kRoleCount] = {};
+  ThreadRoleConfig configs[kRoleCount];
+};
+
+RoleTable* GetRoleTable() {
+  static RoleTable* table = new RoleTable();
+  return table;
+}
+
+int NumberOfCpus() {
+  const unsigned int cpus = std::thread::hardware_concurrency();
+  return cpus > 0 ? static_cast<int>(cpus) : 1;
+}
+
+}  // namespace
+
+ThreadRoleConfig DefaultThreadRoleConfig(ThreadRole role, int num_cpus) {
+  switch (role) {
+    case ThreadRole::CAPTURE:
+      return ThreadRoleConfig(ThreadPriority::DISPLAY, 0);
+    case ThreadRole::AUDIO:
+      return ThreadRoleConfig(ThreadPriority::REALTIME_AUDIO, 0);
+    case ThreadRole::ENCODE: {
+      uint64_t cpu_mask = 0;
+      if (num_cpus >= kMinCpusToReserve && num_cpus <= kMaxCpus) {
+        cpu_mask = (1ULL << (num_cpus - 1)) - 1;
+      }
+      return ThreadRoleConfig(ThreadPriority::UTILITY, cpu_mask);
+    }
+    case ThreadRole::IO:
+      return ThreadRoleConfig(ThreadPriority::NORMAL, 0);
+    case ThreadRole::BACKGROUND:
+    case ThreadRole::COUNT:
+      break;
+  }
+  return ThreadRoleConfig(ThreadPriority::BACKGROUND, 0);
+}
+
+void SetThreadRoleConfig(ThreadRole role, const ThreadRoleConfig& config) {
+  DCHECK(role != ThreadRole::COUNT);
+  RoleTable* table = GetRoleTable();
+  std::lock_guard<std::mutex> lock(table->lock);
+  table->overridden[static_cast<int>(role)] = true;
+  table->configs[static_cast<int>(role)] = config;
+}
+
+ThreadRoleConfig GetThreadRoleConfig(ThreadRole role) {
+  DCHECK(role != ThreadRole::COUNT);
+  RoleTable* table = GetRoleTable();
+  {
+    std::lock_guard<std::mutex> lock(table->lock);
+    if (table->overridden[static_cast<int>(role)]) {
+      return table->configs[static_cast<int>(role)];
+    }
+  }
+  return DefaultThreadRoleConfig(role, NumberOfCpus());
+}
+
+bool SetCurrentThreadRole(ThreadRole role) {
+  return SetCurrentThreadConfig(GetThreadRoleConfig(role));
+}
+
+const char* ThreadRoleToString(ThreadRole role) {
+  DCHECK(role != ThreadRole::COUNT);
+  return kRoleNames[static_cast<int>(role)];
+}
+
+const char* ThreadPriorityToString(ThreadPriority priority) {
+  return kPriorityNames[static_cast<int>(priority)];
+}
+
+bool ThreadPriorityFromString(const std::string& name,
+                              ThreadPriority* priority) {
+  DCHECK(priority);
+  for (size_t i = 0; i < sizeof(kPriorityNames) / sizeof(kPriorityNames[0]);
+       ++i) {
+    if (name == kPriorityNames[i]) {
+      *priority = static_cast<ThreadPriority>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string CpuMaskToString(uint64_t cpu_mask) {
+  std::string result;
+  int cpu = 0;
+  while (cpu < kMaxCpus) {
+    if (!(cpu_mask & (1ULL << cpu))) {
+      ++cpu;
+      continue;
+    }
+    int last = cpu;
+    while (last + 1 < kMaxCpus && (cpu_mask & (1ULL << (last + 1)))) {
+      ++last;
+    }
+    if (!result.empty()) {
+      result.push_back(',');
+    }
+    result.append(std::to_string(cpu));
+    if (last > cpu) {
+      result.push_back('-');
+      result.append(std::to_string(last));
+    }
+    cpu = last + 1;
+  }
+  return result;
+}
+
+bool CpuMaskFromString(const std::string& cpu_list, uint64_t* cpu_mask) {
+  DCHECK(cpu_mask);
+
+  uint64_t mask = 0;
+  const char* p = cpu_list.c_str();
+  while (*p) {
+    char* end = nullptr;
+    const long first = strtol(p, &end, 10);
+    if (end == p || first < 0 || first >= kMaxCpus) {
+      return false;
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      ++p;
+      last = strtol(p, &end, 10);
+      if (end == p || last < first || last >= kMaxCpus) {
+        return false;
+      }
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      mask |= 1ULL << cpu;
+    }
+    if (*p == ',') {
+      ++p;
+    } else if (*p) {
+      return false;
+    }
+  }
+
+  *cpu_mask = mask;
+  return true;
+}
+
+}  // namespace base
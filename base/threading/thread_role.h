@@ -0,0 +1,76 @@
+#ifndef MINI_CHROMIUM_BASE_THREADING_THREAD_ROLE_H_
+#define MINI_CHROMIUM_BASE_THREADING_THREAD_ROLE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace base {
+
+// Scheduling classes, from least to most urgent. They map to thread priorities
+// on Windows and to nice values on Linux.
+enum class ThreadPriority : int {
+  // Work nobody waits for.
+  BACKGROUND = 0,
+  // Throughput work that should yield to latency sensitive threads.
+  UTILITY,
+  NORMAL,
+  // Work that produces frames on a deadline.
+  DISPLAY,
+  // Audio callbacks. Uses SCHED_FIFO on Linux when the process is allowed to.
+  REALTIME_AUDIO,
+};
+
+// What a thread is used for. Threads announce their role when they start and
+// the scheduling settings of the role are applied to them.
+enum class ThreadRole : int {
+  CAPTURE = 0,
+  AUDIO,
+  ENCODE,
+  IO,
+  BACKGROUND,
+  COUNT,
+};
+
+struct ThreadRoleConfig {
+  ThreadPriority priority;
+  // Bit i allows the thread on CPU i. 0 leaves the affinity unchanged.
+  uint64_t cpu_mask;
+
+  ThreadRoleConfig() : priority(ThreadPriority::NORMAL), cpu_mask(0) {}
+  ThreadRoleConfig(ThreadPriority priority, uint64_t cpu_mask)
+      : priority(priority), cpu_mask(cpu_mask) {}
+};
+
+// The built-in settings of |role| for a machine with |num_cpus| CPUs. On four
+// or more CPUs the encoder is kept off the last CPU, which leaves capture and
+// audio a CPU that is never saturated by encoding.
+ThreadRoleConfig DefaultThreadRoleConfig(ThreadRole role, int num_cpus);
+
+// Replaces the settings of |role|. Threads only pick them up when they call
+// SetCurrentThreadRole(), so this should happen before they start.
+void SetThreadRoleConfig(ThreadRole role, const ThreadRoleConfig& config);
+ThreadRoleConfig GetThreadRoleConfig(ThreadRole role);
+
+// Applies the settings of |role| to the calling thread. Returns false if any
+// part could not be applied, e.g. raising the priority without permission;
+// the parts that could be applied stay in effect.
+bool SetCurrentThreadRole(ThreadRole role);
+
+// Applies |config| to the calling thread. Implemented per platform.
+bool SetCurrentThreadConfig(const ThreadRoleConfig& config);
+
+// Names used in configuration files, e.g. "capture" and "display".
+const char* ThreadRoleToString(ThreadRole role);
+const char* ThreadPriorityToString(ThreadPriority priority);
+bool ThreadPriorityFromString(const std::string& name,
+                              ThreadPriority* priority);
+
+// Converts between CPU masks and lists such as "0-3,6". An empty list is the
+// mask 0.
+std::string CpuMaskToString(uint64_t cpu_mask);
+bool CpuMaskFromString(const std::string& cpu_list, uint64_t* cpu_mask);
+
+}  // namespace base
+
+#endif  // MINI_CHROMIUM_BASE_THREADING_THREAD_ROLE_H_
@@ -0,0 +1,90 @@
+#include "base/threading/thread_role.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "build/build_config.h"
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace base {
+
+namespace {
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+
+// Nice values of the priorities. Unprivileged processes can only go up, so
+// UTILITY and BACKGROUND are what keeps the encoder from starving capture when
+// DISPLAY cannot be applied.
+const int kNiceValues[] = {10, 5, 0, -5, -10};
+
+// Low enough to stay below the kernel's own realtime threads.
+constexpr int kRealtimeAudioPriority = 8;
+
+bool SetNice(int nice_value) {
+  // On Linux the nice value is per thread when applied to a thread id.
+  const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+  return setpriority(PRIO_PROCESS, tid, nice_value) == 0;
+}
+
+bool SetPriority(ThreadPriority priority) {
+  sched_param param = {};
+  bool ok = true;
+  if (priority == ThreadPriority::REALTIME_AUDIO) {
+    param.sched_priority = kRealtimeAudioPriority;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) {
+      return true;
+    }
+    // Without CAP_SYS_NICE or an RLIMIT_RTPRIO, fall back to a nice value.
+    ok = false;
+  } else {
+    // Leave SCHED_FIFO if the thread was realtime before.
+    int policy = SCHED_OTHER;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0 &&
+        policy != SCHED_OTHER) {
+      param.sched_priority = 0;
+      pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    }
+  }
+  return SetNice(kNiceValues[static_cast<int>(priority)]) && ok;
+}
+
+bool SetAffinity(uint64_t cpu_mask) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int cpu = 0; cpu < 64; ++cpu) {
+    if (cpu_mask & (1ULL << cpu)) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  // 0 is the calling thread.
+  return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+#else
+
+bool SetPriority(ThreadPriority priority) {
+  return priority == ThreadPriority::NORMAL;
+}
+
+bool SetAffinity(uint64_t cpu_mask) {
+  return false;
+}
+
+#endif
+
+}  // namespace
+
+bool SetCurrentThreadConfig(const ThreadRoleConfig& config) {
+  bool ok = SetPriority(config.priority);
+  if (config.cpu_mask) {
+    ok = SetAffinity(config.cpu_mask) && ok;
+  }
+  return ok;
+}
+
+}  // namespace base
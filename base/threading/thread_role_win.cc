@@ -0,0 +1,39 @@
+#include "base/threading/thread_role.h"
+
+#include <windows.h>
+
+namespace base {
+
+namespace {
+
+const int kThreadPriorities[] = {
+    THREAD_PRIORITY_LOWEST,       THREAD_PRIORITY_BELOW_NORMAL,
+    THREAD_PRIORITY_NORMAL,       THREAD_PRIORITY_ABOVE_NORMAL,
+    THREAD_PRIORITY_TIME_CRITICAL,
+};
+
+}  // namespace
+
+bool SetCurrentThreadConfig(const ThreadRoleConfig& config) {
+  bool ok = !!::SetThreadPriority(
+      ::GetCurrentThread(),
+      kThreadPriorities[static_cast<int>(config.priority)]);
+
+  if (config.cpu_mask) {
+    // Only CPUs the process may use, and only the ones DWORD_PTR can hold on
+    // 32-bit builds.
+    DWORD_PTR process_mask = 0;
+    DWORD_PTR system_mask = 0;
+    if (!::GetProcessAffinityMask(::GetCurrentProcess(), &process_mask,
+                                  &system_mask)) {
+      return false;
+    }
+    const DWORD_PTR thread_mask =
+        static_cast<DWORD_PTR>(config.cpu_mask) & process_mask;
+    ok = thread_mask && ::SetThreadAffinityMask(::GetCurrentThread(),
+                                                thread_mask) != 0 && ok;
+  }
+  return ok;
+}
+
+}  // namespace base
@@ -0,0 +1,119 @@
+﻿#include "capturer/audio_dsp.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace {
+
+const float kS16Scale = 32768.0f;
+
+// 限幅器降低增益的时长
+const double kLimiterAttackSeconds = 0.001;
+
+}  // namespace
+
+void ConvertS16ToFloat(const int16_t* src, float* dst, int count) {
+  const float scale = 1.0f / kS16Scale;
+  for (int i = 0; i < count; ++i) {
+    dst[i] = src[i] * scale;
+  }
+}
+
+void ConvertFloatToS16(const float* src, int16_t* dst, int count) {
+  for (int i = 0; i < count; ++i) {
+    const float value =
+        std::min(std::max(src[i] * kS16Scale, -32768.0f), 32767.0f);
+    dst[i] = static_cast<int16_t>(value);
+  }
+}
+
+void MixSamples(const float* src, float gain, float* dst, int count) {
+  for (int i = 0; i < count; ++i) {
+    dst[i] += src[i] * gain;
+  }
+}
+
+float PeakAbs(const float* samples, int count) {
+  float peak = 0.0f;
+  for (int i = 0; i < count; ++i) {
+    const float value = fabsf(samples[i]);
+    peak = value > peak ? value : peak;
+  }
+  return peak;
+}
+
+float MeanSquare(const float* samples, int count) {
+  if (count <= 0) {
+    return 0.0f;
+  }
+  float sum = 0.0f;
+  for (int i = 0; i < count; ++i) {
+    sum += samples[i] * samples[i];
+  }
+  return sum / count;
+}
+
+void ApplyGainRamp(float* samples, int count, float begin, float end) {
+  const float step = (end - begin) / count;
+  for (int i = 0; i < count; ++i) {
+    samples[i] *= begin + step * i;
+  }
+}
+
+void ApplyGain(float* samples, int count, float gain) {
+  for (int i = 0; i < count; ++i) {
+    samples[i] *= gain;
+  }
+}
+
+PeakLimiter::PeakLimiter(float threshold, double release_seconds)
+    : threshold_(threshold), release_seconds_(release_seconds), gain_(1.0f) {
+}
+
+PeakLimiter::~PeakLimiter() {
+}
+
+void PeakLimiter::Reset() {
+  gain_ = 1.0f;
+}
+
+bool PeakLimiter::Process(float* samples, int count, double block_seconds) {
+  if (count <= 0) {
+    return false;
+  }
+
+  const float peak = PeakAbs(samples, count);
+  const float target = peak > threshold_ ? threshold_ / peak : 1.0f;
+  const float begin = gain_;
+  if (target < begin) {
+    // 这一块的峰值可能在任何位置，很快降到target并保持到块结束
+    const int attack_count = std::min(
+        count,
+        std::max(1, static_cast<int>(count * kLimiterAttackSeconds /
+                                     block_seconds)));
+    // 按原来的增益渐变也会超过阈值时只能立即降到target
+    if (PeakAbs(samples, attack_count) * begin > threshold_) {
+      ApplyGain(samples, count, target);
+    } else {
+      ApplyGainRamp(samples, attack_count, begin, target);
+      ApplyGain(samples + attack_count, count - attack_count, target);
+    }
+    gain_ = target;
+    return true;
+  }
+
+  const float release =
+      static_cast<float>(exp(-block_seconds / release_seconds_));
+  float end = target - (target - begin) * release;
+  // 接近1时直接恢复，避免一直按很小的差值调整
+  if (end > 0.999f) {
+    end = 1.0f;
+  }
+  gain_ = end;
+  if (begin >= 1.0f && end >= 1.0f) {
+    return false;
+  }
+  ApplyGainRamp(samples, count, begin, end);
+  return true;
+}
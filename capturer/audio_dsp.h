@@ -0,0 +1,55 @@
+﻿// 音频处理的基本运算，样本为交错排列的float，满刻度为±1
+//
+// 内层循环没有分支和跨迭代的依赖，编译器可以向量化；都不分配内存，
+// 可以在录音线程中调用。
+
+#ifndef CAPTURER_AUDIO_DSP_H_
+#define CAPTURER_AUDIO_DSP_H_
+
+#include <stdint.h>
+
+// 16位PCM与float互相转换，超出范围的样本直接削波
+void ConvertS16ToFloat(const int16_t* src, float* dst, int count);
+void ConvertFloatToS16(const float* src, int16_t* dst, int count);
+
+// dst += src * gain
+void MixSamples(const float* src, float gain, float* dst, int count);
+
+// 样本绝对值的最大值
+float PeakAbs(const float* samples, int count);
+// 样本平方的平均值，count为0时返回0
+float MeanSquare(const float* samples, int count);
+
+// 增益从begin线性变化到end
+void ApplyGainRamp(float* samples, int count, float begin, float end);
+// 所有样本乘以gain
+void ApplyGain(float* samples, int count, float gain);
+
+// 按块的峰值限幅：峰值超过阈值时在1毫秒内把增益降到阈值以下，
+// 之后按时间常数恢复。这1毫秒内的样本可能仍然超过阈值，
+// 由转换为16位PCM时的削波兜底
+class PeakLimiter {
+ public:
+  // threshold: 线性的阈值
+  // release_seconds: 压低音量后恢复的时间常数
+  PeakLimiter(float threshold, double release_seconds);
+  ~PeakLimiter();
+
+  void Reset();
+
+  // block_seconds: 这一块的时长，返回是否压低了音量
+  bool Process(float* samples, int count, double block_seconds);
+
+  float gain() const { return gain_; }
+
+ private:
+  const float threshold_;
+  const double release_seconds_;
+  float gain_;
+
+  PeakLimiter() = delete;
+  PeakLimiter(const PeakLimiter&) = delete;
+  PeakLimiter& operator=(const PeakLimiter&) = delete;
+};  // class PeakLimiter
+
+#endif  // CAPTURER_AUDIO_DSP_H_
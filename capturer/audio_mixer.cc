@@ -0,0 +1,348 @@
+﻿#include "capturer/audio_mixer.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include "base/check.h"
+#include "capturer/audio_dsp.h"
+#include "logger/logger.h"
+
+namespace {
+
+const char kFilter[] = "AudioMixer";
+
+// 输出最多的声道数
+const int kMaxChannels = 8;
+
+// 采集时间与写入位置的偏差的平滑系数，每收到一段数据更新一次，
+// 过滤回调时间的抖动
+const double kErrorSmoothing = 0.05;
+// 用这么长的时间(秒)消除偏差
+const double kCorrectionSeconds = 2.0;
+// 重采样比例最多修正0.5%，听不出音调变化
+const double kMaxCorrection = 0.005;
+
+// 限幅器的阈值，约-0.2dBFS
+const float kLimiterThreshold = 0.977f;
+// 压低音量后恢复的时间常数(秒)
+const double kLimiterReleaseSeconds = 0.2;
+
+const float kS16Scale = 32768.0f;
+
+int64_t NextPowerOfTwo(int64_t value) {
+  int64_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}  // namespace
+
+struct AudioMixer::Input {
+  std::string name;
+  float gain;
+  std::unique_ptr<AudioSource> source;
+  // Start成功，停止混音时需要停止
+  bool started;
+
+  // 保护以下成员，输入的录音线程写入，混音线程读出
+  std::mutex mutex;
+  // 输出格式的环形缓冲区，按输出的帧序号取模，读出后清零
+  std::vector<float> ring;
+  // 环形缓冲区的帧数，是2的幂
+  int64_t ring_frames;
+  // 混音线程下一次读出的帧序号，写到它之前的数据来不及混音
+  int64_t read_position;
+  // 收到过数据，write_position有效
+  bool has_position;
+  // 下一个重采样得到的帧的序号
+  int64_t write_position;
+  // 下一个重采样得到的帧在这一段输入中的位置，-1为上一段的最后一帧
+  double source_position;
+  // 上一段输入的最后一帧，已经转换为输出的声道数
+  float last_frame[kMaxChannels];
+  double smoothed_error;
+  AudioMixerInputStats stats;
+};
+
+AudioMixer::AudioMixer(const AudioSourceConfig& config,
+                       int latency_ms,
+                       const DataCallback& callback)
+    : PacedAudioSource(config, callback),
+      latency_ms_(latency_ms),
+      latency_frames_(0),
+      resync_frames_(0),
+      limiter_(kLimiterThreshold, kLimiterReleaseSeconds),
+      limited_periods_(0) {
+}
+
+AudioMixer::~AudioMixer() {
+  Stop();
+}
+
+void AudioMixer::AddInput(const std::string& name,
+                          float gain,
+                          const SourceFactory& create) {
+  DCHECK(create);
+
+  std::unique_ptr<Input> input = std::make_unique<Input>();
+  Input* raw_input = input.get();
+  input->source = create([this, raw_input](const uint8_t* data, int len) {
+    HandleInputData(raw_input, data, len);
+  });
+  if (!input->source) {
+    LOG_WARN(kFilter, "不支持的输入: %s", name.c_str());
+    return;
+  }
+  const AudioSourceConfig& input_config = input->source->config();
+  if ((input_config.bits_per_sample != 16 &&
+       input_config.bits_per_sample != 32) ||
+      input_config.channels <= 0 || input_config.samples_per_second == 0) {
+    LOG_WARN(kFilter, "输入%s的格式不支持: %u声道, %uHz, %u位", name.c_str(),
+             input_config.channels, input_config.samples_per_second,
+             input_config.bits_per_sample);
+    return;
+  }
+
+  input->name = name;
+  input->gain = gain;
+  input->started = false;
+  inputs_.push_back(std::move(input));
+}
+
+void AudioMixer::Stop() {
+  // 先停止混音线程，不再调用回调函数，再停止输入
+  PacedAudioSource::Stop();
+  for (const std::unique_ptr<Input>& input : inputs_) {
+    if (!input->started) {
+      continue;
+    }
+    input->source->Stop();
+    input->started = false;
+
+    std::lock_guard<std::mutex> locker(input->mutex);
+    const AudioMixerInputStats& stats = input->stats;
+    LOG_INFO(kFilter,
+             "混音输入%s结束: 来不及混音%lld帧, 溢出%lld帧, 重新对齐%lld次, "
+             "重采样修正%.0fppm",
+             input->name.c_str(), static_cast<long long>(stats.late_frames),
+             static_cast<long long>(stats.overflow_frames),
+             static_cast<long long>(stats.resyncs), stats.correction * 1e6);
+  }
+}
+
+int64_t AudioMixer::delay_us() const {
+  return latency_ms_ * 1000LL;
+}
+
+std::vector<AudioMixerInputStats> AudioMixer::input_stats() const {
+  std::vector<AudioMixerInputStats> stats;
+  for (const std::unique_ptr<Input>& input : inputs_) {
+    std::lock_guard<std::mutex> locker(input->mutex);
+    stats.push_back(input->stats);
+    stats.back().name = input->name;
+  }
+  return stats;
+}
+
+bool AudioMixer::Open() {
+  const int channels = config_.channels;
+  if (channels > kMaxChannels || inputs_.empty() || latency_ms_ <= 0) {
+    LOG_ERROR(kFilter, "混音参数错误: %d声道, %d个输入, 延迟%dms", channels,
+              static_cast<int>(inputs_.size()), latency_ms_);
+    return false;
+  }
+
+  const int64_t sample_rate = config_.samples_per_second;
+  const int period_frames = config_.PeriodBytes() / config_.BytesPerFrame();
+  latency_frames_ = latency_ms_ * sample_rate / 1000;
+  resync_frames_ = std::max<int64_t>(latency_frames_ / 2, period_frames);
+  mix_buffer_.assign(period_frames * channels, 0.0f);
+  limiter_.Reset();
+  limited_periods_ = 0;
+  start_time_ = std::chrono::steady_clock::now();
+
+  int started = 0;
+  for (const std::unique_ptr<Input>& input : inputs_) {
+    // 写入的位置在采集时间附近，读出的位置晚latency加一个输出周期，
+    // 再留出一段输入重采样后的长度和足够的余量
+    const AudioSourceConfig& input_config = input->source->config();
+    const int64_t input_period_frames =
+        static_cast<int64_t>(input_config.period_ms) * sample_rate / 1000;
+    {
+      std::lock_guard<std::mutex> locker(input->mutex);
+      input->ring_frames = NextPowerOfTwo(
+          2 * (latency_frames_ + period_frames + input_period_frames));
+      input->ring.assign(input->ring_frames * channels, 0.0f);
+      input->read_position = -latency_frames_;
+      input->has_position = false;
+      input->write_position = 0;
+      input->source_position = 0;
+      std::fill(input->last_frame, input->last_frame + kMaxChannels, 0.0f);
+      input->smoothed_error = 0;
+      input->stats = AudioMixerInputStats();
+    }
+
+    input->started = input->source->Start();
+    if (input->started) {
+      ++started;
+      LOG_INFO(kFilter, "混音输入%s: %u声道, %uHz, 周期%dms, 增益%.2f",
+               input->name.c_str(), input_config.channels,
+               input_config.samples_per_second, input_config.period_ms,
+               input->gain);
+    } else {
+      LOG_WARN(kFilter, "混音输入%s开始失败", input->name.c_str());
+    }
+  }
+  if (started == 0) {
+    LOG_ERROR(kFilter, "没有可用的混音输入");
+    return false;
+  }
+  return true;
+}
+
+void AudioMixer::HandleInputData(Input* input, const uint8_t* data, int len) {
+  const AudioSourceConfig& input_config = input->source->config();
+  const int input_channels = input_config.channels;
+  const int frame_count = len / input_config.BytesPerFrame();
+  if (frame_count <= 0) {
+    return;
+  }
+  const int channels = config_.channels;
+  const double sample_rate = config_.samples_per_second;
+  const double input_rate = input_config.samples_per_second;
+
+  // 回调时最后一帧刚刚采集到，推算第一帧的采集时间在输出中的位置
+  const double capture_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    start_time_)
+          .count() -
+      frame_count / input_rate - input->source->delay_us() / 1000000.0;
+  const double expected_position = capture_seconds * sample_rate;
+
+  std::lock_guard<std::mutex> locker(input->mutex);
+  AudioMixerInputStats& stats = input->stats;
+  const double error = expected_position - input->write_position;
+  if (!input->has_position || fabs(error) > resync_frames_) {
+    if (input->has_position) {
+      ++stats.resyncs;
+    }
+    input->has_position = true;
+    input->write_position = llround(expected_position);
+    input->source_position = 0;
+    input->smoothed_error = 0;
+    stats.correction = 0;
+  } else {
+    // 写入位置落后于采集时间时多输出一些帧，反之少输出
+    input->smoothed_error += kErrorSmoothing * (error - input->smoothed_error);
+    stats.correction = std::min(
+        std::max(input->smoothed_error / (sample_rate * kCorrectionSeconds),
+                 -kMaxCorrection),
+        kMaxCorrection);
+  }
+  const double step = input_rate / sample_rate / (1.0 + stats.correction);
+
+  // 读取第index帧并转换为输出的声道数，-1为上一段的最后一帧。
+  // 输出单声道时取各声道的平均，否则多出的输出声道重复最后一个输入声道
+  const bool float_input = input_config.bits_per_sample == 32;
+  const int16_t* s16_samples = reinterpret_cast<const int16_t*>(data);
+  const float* float_samples = reinterpret_cast<const float*>(data);
+  auto load_sample = [&](int index) {
+    return float_input ? float_samples[index]
+                       : s16_samples[index] / kS16Scale;
+  };
+  auto load_frame = [&](int index, float* frame) {
+    if (index < 0) {
+      std::copy(input->last_frame, input->last_frame + channels, frame);
+      return;
+    }
+    const int first = index * input_channels;
+    if (channels == 1) {
+      float sum = 0.0f;
+      for (int c = 0; c < input_channels; ++c) {
+        sum += load_sample(first + c);
+      }
+      frame[0] = sum / input_channels;
+      return;
+    }
+    for (int c = 0; c < channels; ++c) {
+      frame[c] = load_sample(first + std::min(c, input_channels - 1));
+    }
+  };
+
+  float left[kMaxChannels];
+  float right[kMaxChannels];
+  int loaded_index = -2;
+  const int64_t mask = input->ring_frames - 1;
+  while (true) {
+    const int index = static_cast<int>(floor(input->source_position));
+    if (index + 1 >= frame_count) {
+      break;
+    }
+    if (index != loaded_index) {
+      load_frame(index, left);
+      load_frame(index + 1, right);
+      loaded_index = index;
+    }
+
+    const int64_t position = input->write_position++;
+    input->source_position += step;
+    if (position < input->read_position) {
+      ++stats.late_frames;
+      continue;
+    }
+    if (position >= input->read_position + input->ring_frames) {
+      ++stats.overflow_frames;
+      continue;
+    }
+    const float fraction =
+        static_cast<float>(input->source_position - step - index);
+    float* target = &input->ring[(position & mask) * channels];
+    for (int c = 0; c < channels; ++c) {
+      target[c] = left[c] + (right[c] - left[c]) * fraction;
+    }
+  }
+  input->source_position -= frame_count;
+  load_frame(frame_count - 1, input->last_frame);
+}
+
+bool AudioMixer::Read(uint8_t* data, int len) {
+  const int channels = config_.channels;
+  const int frame_count = len / config_.BytesPerFrame();
+  const int sample_count = frame_count * channels;
+  DCHECK(sample_count <= static_cast<int>(mix_buffer_.size()));
+
+  float* mix = mix_buffer_.data();
+  std::fill(mix, mix + sample_count, 0.0f);
+  for (const std::unique_ptr<Input>& input : inputs_) {
+    if (!input->started) {
+      continue;
+    }
+
+    // 读出后清零，没有写入的位置就是静音
+    std::lock_guard<std::mutex> locker(input->mutex);
+    const int64_t mask = input->ring_frames - 1;
+    int done = 0;
+    while (done < frame_count) {
+      const int64_t offset = (input->read_position + done) & mask;
+      const int count = static_cast<int>(
+          std::min<int64_t>(frame_count - done, input->ring_frames - offset));
+      float* source = &input->ring[offset * channels];
+      MixSamples(source, input->gain, mix + done * channels, count * channels);
+      std::fill(source, source + count * channels, 0.0f);
+      done += count;
+    }
+    input->read_position += frame_count;
+  }
+
+  if (limiter_.Process(mix, sample_count,
+                       static_cast<double>(frame_count) /
+                           config_.samples_per_second)) {
+    ++limited_periods_;
+  }
+  ConvertFloatToS16(mix, reinterpret_cast<int16_t*>(data), sample_count);
+  return true;
+}
@@ -0,0 +1,104 @@
+﻿// 把多个录音来源混合成一路，如麦克风和系统声音(环回录音)
+//
+// 每个输入的采样率和声道数可以不同，样本可以是16位PCM或者float(如环回录音，
+// 超出满刻度的部分不削波，由限幅器处理)。收到的数据转换为float和输出的声道数，
+// 用线性插值重采样到输出的采样率，按采集时间写入这个输入的环形缓冲区。
+// 混音线程按输出的周期读出latency_ms之前的数据，乘以各自的增益相加，
+// 经过限幅器转换为16位PCM送给回调函数。
+// 输入的时钟与系统时钟有偏差，按采集时间与写入位置的差微调重采样的比例；
+// 偏差太大(丢数据、卡住)时直接跳到采集时间对应的位置，来不及混音的数据丢弃。
+// 环形缓冲区在Start时分配，之后不再分配内存，增加的延迟固定为latency_ms。
+
+#ifndef CAPTURER_AUDIO_MIXER_H_
+#define CAPTURER_AUDIO_MIXER_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "capturer/audio_dsp.h"
+#include "capturer/audio_source.h"
+
+// 一个输入的统计，单位为输出采样率下的帧数
+struct AudioMixerInputStats {
+  std::string name;
+  // 采集时间早于已经混音的位置，来不及混音而丢弃的帧数
+  int64_t late_frames;
+  // 采集时间超出环形缓冲区而丢弃的帧数
+  int64_t overflow_frames;
+  // 偏差太大直接跳到采集时间的次数，不包括第一次收到数据
+  int64_t resyncs;
+  // 当前重采样比例的修正，正数表示输入的时钟偏慢
+  double correction;
+
+  AudioMixerInputStats()
+      : late_frames(0), overflow_frames(0), resyncs(0), correction(0) {}
+};  // struct AudioMixerInputStats
+
+class AudioMixer : public PacedAudioSource {
+ public:
+  // 创建输入的录音来源，callback是混音器接收这个输入的数据的函数
+  using SourceFactory = std::function<std::unique_ptr<AudioSource>(
+      const DataCallback& callback)>;
+
+  // config: 输出的格式和周期
+  // latency_ms: 输出比采集晚的时长，要大于输入的周期加上输出的周期，
+  // 否则输入的数据经常来不及混音
+  AudioMixer(const AudioSourceConfig& config,
+             int latency_ms,
+             const DataCallback& callback);
+  ~AudioMixer() override;
+
+  // 在Start之前添加输入，create返回nullptr时忽略。
+  // Start时开始所有输入，没有一个输入开始成功时返回false
+  // gain: 线性增益，1为原始音量
+  void AddInput(const std::string& name,
+                float gain,
+                const SourceFactory& create);
+
+  // 停止混音线程和所有输入
+  void Stop() override;
+
+  // 回调时最后一帧的采集时间比当前时间早latency_ms
+  int64_t delay_us() const override;
+
+  int input_count() const { return static_cast<int>(inputs_.size()); }
+  // 各输入的统计，可以在录音时调用
+  std::vector<AudioMixerInputStats> input_stats() const;
+  // 限幅器压低过音量的周期数
+  int64_t limited_periods() const { return limited_periods_; }
+
+ protected:
+  bool Open() override;
+  bool Read(uint8_t* data, int len) override;
+
+ private:
+  struct Input;
+
+  // 在输入的录音线程中调用
+  void HandleInputData(Input* input, const uint8_t* data, int len);
+
+  const int latency_ms_;
+  // latency_ms对应的输出帧数
+  int64_t latency_frames_;
+  // 采集时间与写入位置相差超过这么多帧时直接跳到采集时间
+  int64_t resync_frames_;
+
+  std::vector<std::unique_ptr<Input>> inputs_;
+  // 输出第0帧的采集时间
+  std::chrono::steady_clock::time_point start_time_;
+
+  // 以下只在混音线程中访问
+  std::vector<float> mix_buffer_;
+  PeakLimiter limiter_;
+  std::atomic<int64_t> limited_periods_;
+
+  AudioMixer() = delete;
+  AudioMixer(const AudioMixer&) = delete;
+  AudioMixer& operator=(const AudioMixer&) = delete;
+};  // class AudioMixer
+
+#endif  // CAPTURER_AUDIO_MIXER_H_
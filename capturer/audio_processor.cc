@@ -0,0 +1,205 @@
+﻿#include "capturer/audio_processor.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// 四阶巴特沃斯滤波器分成两个二阶节的Q值
+const double kButterworthQ[] = {0.54119610014619698, 1.30656296487637653};
+
+// 每块的时长(毫秒)
+const int kBlockMs = 10;
+
+// 电平检测上升快、下降慢，说话开头不会被噪声门吃掉
+const double kLevelAttackSeconds = 0.005;
+const double kLevelReleaseSeconds = 0.1;
+// 自动增益跟踪的是几个音节的平均电平，不跟着每个音节变化
+const double kSpeechLevelSeconds = 0.3;
+// 噪声门打开快、关闭慢，字尾不会被突然截断
+const double kGateAttackSeconds = 0.002;
+const double kGateReleaseSeconds = 0.15;
+// 自动增益降低音量的速度是提高音量的几倍，突然大声说话时尽快压下来
+const float kAgcDecreaseFactor = 4.0f;
+const double kLimiterReleaseSeconds = 0.1;
+
+// 没有声音时的电平
+const float kSilenceDb = -120.0f;
+// 绝对值小于这个值的滤波器状态清零，避免非规格化浮点数拖慢计算
+const float kDenormalThreshold = 1e-15f;
+
+float DbToGain(float db) {
+  return powf(10.0f, db / 20.0f);
+}
+
+// 一阶平滑，time_constant秒后与target的差距剩下1/e
+float Smooth(float current,
+             float target,
+             double block_seconds,
+             double time_constant) {
+  const float coefficient =
+      static_cast<float>(exp(-block_seconds / time_constant));
+  return target + (current - target) * coefficient;
+}
+
+}  // namespace
+
+AudioProcessor::AudioProcessor(const AudioProcessorConfig& config,
+                               int channels,
+                               int sample_rate)
+    : config_(config),
+      channels_(channels),
+      sample_rate_(sample_rate),
+      block_frames_(std::max(1, sample_rate * kBlockMs / 1000)),
+      level_db_(kSilenceDb),
+      speech_level_db_(kSilenceDb),
+      gate_gain_(1.0f),
+      agc_gain_db_(0.0f),
+      gain_(1.0f),
+      limiter_(DbToGain(config.limiter_threshold_db), kLimiterReleaseSeconds),
+      limited_blocks_(0) {
+  // RBJ Audio EQ Cookbook中的高通滤波器
+  const double w0 = 2 * kPi * config_.high_pass_hz / std::max(sample_rate, 1);
+  for (int stage = 0; stage < kHighPassStages; ++stage) {
+    const double cos_w0 = cos(w0);
+    const double alpha = sin(w0) / (2 * kButterworthQ[stage]);
+    const double a0 = 1 + alpha;
+    Biquad& biquad = high_pass_[stage];
+    biquad.b0 = static_cast<float>((1 + cos_w0) / 2 / a0);
+    biquad.b1 = static_cast<float>(-(1 + cos_w0) / a0);
+    biquad.b2 = biquad.b0;
+    biquad.a1 = static_cast<float>(-2 * cos_w0 / a0);
+    biquad.a2 = static_cast<float>((1 - alpha) / a0);
+  }
+
+  if (channels_ > 0 && channels_ <= kMaxChannels) {
+    buffer_.resize(block_frames_ * channels_);
+  }
+  Reset();
+}
+
+AudioProcessor::~AudioProcessor() {
+}
+
+void AudioProcessor::Process(int16_t* samples, int frame_count) {
+  if (buffer_.empty()) {
+    return;
+  }
+
+  float* block = buffer_.data();
+  for (int offset = 0; offset < frame_count; offset += block_frames_) {
+    const int frames = std::min(block_frames_, frame_count - offset);
+    int16_t* data = samples + offset * channels_;
+    ConvertS16ToFloat(data, block, frames * channels_);
+    ProcessBlock(block, frames);
+    ConvertFloatToS16(block, data, frames * channels_);
+  }
+}
+
+void AudioProcessor::Reset() {
+  for (int stage = 0; stage < kHighPassStages; ++stage) {
+    std::fill(z1_[stage], z1_[stage] + kMaxChannels, 0.0f);
+    std::fill(z2_[stage], z2_[stage] + kMaxChannels, 0.0f);
+  }
+  level_db_ = kSilenceDb;
+  speech_level_db_ = kSilenceDb;
+  gate_gain_ = 1.0f;
+  agc_gain_db_ = 0.0f;
+  gain_ = 1.0f;
+  limiter_.Reset();
+}
+
+float AudioProcessor::gate_gain_db() const {
+  return 20.0f * log10f(gate_gain_);
+}
+
+void AudioProcessor::ProcessBlock(float* samples, int frame_count) {
+  const int count = frame_count * channels_;
+  const double block_seconds = static_cast<double>(frame_count) / sample_rate_;
+
+  if (config_.high_pass_hz > 0 && config_.high_pass_hz * 2 < sample_rate_) {
+    HighPass(samples, frame_count);
+  }
+
+  // 电平在滤波之后测量，嗡嗡声不会让噪声门打开
+  const float gain = UpdateGain(MeanSquare(samples, count), block_seconds);
+  if (gain_ != 1.0f || gain != 1.0f) {
+    ApplyGainRamp(samples, count, gain_, gain);
+  }
+  gain_ = gain;
+
+  if (config_.limiter && limiter_.Process(samples, count, block_seconds)) {
+    ++limited_blocks_;
+  }
+}
+
+void AudioProcessor::HighPass(float* samples, int frame_count) {
+  // 递归滤波无法按时间向量化，每个声道单独处理，状态保存在寄存器中
+  const int count = frame_count * channels_;
+  for (int stage = 0; stage < kHighPassStages; ++stage) {
+    const Biquad biquad = high_pass_[stage];
+    for (int c = 0; c < channels_; ++c) {
+      float z1 = z1_[stage][c];
+      float z2 = z2_[stage][c];
+      for (int i = c; i < count; i += channels_) {
+        const float x = samples[i];
+        const float y = biquad.b0 * x + z1;
+        z1 = biquad.b1 * x - biquad.a1 * y + z2;
+        z2 = biquad.b2 * x - biquad.a2 * y;
+        samples[i] = y;
+      }
+      z1_[stage][c] = fabsf(z1) < kDenormalThreshold ? 0.0f : z1;
+      z2_[stage][c] = fabsf(z2) < kDenormalThreshold ? 0.0f : z2;
+    }
+  }
+}
+
+float AudioProcessor::UpdateGain(float mean_square, double block_seconds) {
+  const float block_db = 10.0f * log10f(mean_square + 1e-12f);
+  level_db_ = Smooth(level_db_, block_db, block_seconds,
+                     block_db > level_db_ ? kLevelAttackSeconds
+                                          : kLevelReleaseSeconds);
+
+  float gate_gain = 1.0f;
+  if (config_.noise_gate) {
+    float target_db = 0.0f;
+    if (level_db_ < config_.gate_threshold_db) {
+      target_db = std::max(
+          (level_db_ - config_.gate_threshold_db) * (config_.gate_ratio - 1),
+          -config_.gate_range_db);
+    }
+    const float target = DbToGain(target_db);
+    gate_gain_ = Smooth(gate_gain_, target, block_seconds,
+                        target > gate_gain_ ? kGateAttackSeconds
+                                            : kGateReleaseSeconds);
+    gate_gain = gate_gain_;
+  }
+
+  float agc_gain = 1.0f;
+  if (config_.agc) {
+    // 说话的间隙不跟踪电平，否则会把底噪放大
+    if (level_db_ > config_.gate_threshold_db) {
+      speech_level_db_ =
+          speech_level_db_ <= kSilenceDb
+              ? level_db_
+              : Smooth(speech_level_db_, level_db_, block_seconds,
+                       kSpeechLevelSeconds);
+      const float desired =
+          std::min(std::max(config_.agc_target_db - speech_level_db_,
+                            config_.agc_min_gain_db),
+                   config_.agc_max_gain_db);
+      float max_step =
+          static_cast<float>(config_.agc_max_change_db * block_seconds);
+      if (desired < agc_gain_db_) {
+        max_step *= kAgcDecreaseFactor;
+      }
+      agc_gain_db_ +=
+          std::min(std::max(desired - agc_gain_db_, -max_step), max_step);
+    }
+    agc_gain = DbToGain(agc_gain_db_);
+  }
+  return gate_gain * agc_gain;
+}
@@ -0,0 +1,132 @@
+﻿// 录音的实时处理：高通滤波、噪声门、自动增益和限幅
+//
+// 按顺序处理：
+//   高通滤波: 两个二阶节级联成四阶巴特沃斯高通，去掉电源的嗡嗡声和
+//             低频的风噪、碰麦声，截止频率100Hz时50Hz衰减24dB
+//   噪声门: 电平低于阈值时向下扩展，压低说话间隙的底噪，最多衰减gate_range_db
+//   自动增益: 只在电平高于噪声门阈值(有人说话)时跟踪说话的平均电平，
+//             把音量慢慢调到目标值
+//   限幅: 自动增益放大后的峰值压到阈值以下
+// 数据按10毫秒分块，电平和增益每块更新一次，块内线性变化。
+// 缓冲区在构造时分配，Process不分配内存，可以在录音线程中调用。
+
+#ifndef CAPTURER_AUDIO_PROCESSOR_H_
+#define CAPTURER_AUDIO_PROCESSOR_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "capturer/audio_dsp.h"
+
+struct AudioProcessorConfig {
+  // 高通滤波的截止频率(Hz)，0表示不滤波
+  float high_pass_hz;
+
+  // 噪声门的阈值(dBFS，按RMS)，电平每低1dB，输出再降低gate_ratio - 1 dB
+  bool noise_gate;
+  float gate_threshold_db;
+  float gate_ratio;
+  float gate_range_db;
+
+  // 自动增益的目标电平(dBFS，按RMS)和增益范围，
+  // 增益每秒最多变化agc_max_change_db
+  bool agc;
+  float agc_target_db;
+  float agc_min_gain_db;
+  float agc_max_gain_db;
+  float agc_max_change_db;
+
+  // 限幅的阈值(dBFS)
+  bool limiter;
+  float limiter_threshold_db;
+
+  AudioProcessorConfig()
+      : high_pass_hz(100.0f),
+        noise_gate(true),
+        gate_threshold_db(-50.0f),
+        gate_ratio(3.0f),
+        gate_range_db(24.0f),
+        agc(true),
+        agc_target_db(-20.0f),
+        agc_min_gain_db(-12.0f),
+        agc_max_gain_db(24.0f),
+        agc_max_change_db(10.0f),
+        limiter(true),
+        limiter_threshold_db(-1.0f) {}
+};  // struct AudioProcessorConfig
+
+class AudioProcessor {
+ public:
+  // 最多的声道数
+  static const int kMaxChannels = 8;
+
+  // channels: 声道数，超过kMaxChannels时不处理
+  AudioProcessor(const AudioProcessorConfig& config,
+                 int channels,
+                 int sample_rate);
+  ~AudioProcessor();
+
+  // 原地处理交错排列的16位PCM
+  void Process(int16_t* samples, int frame_count);
+
+  // 清除滤波器和电平的状态，如更换了录音来源
+  void Reset();
+
+  // 当前噪声门和自动增益的增益(dB)，调试和统计用
+  float gate_gain_db() const;
+  float agc_gain_db() const { return agc_gain_db_; }
+  // 限幅器压低过音量的块数
+  int64_t limited_blocks() const { return limited_blocks_; }
+
+ private:
+  // 高通滤波的二阶节数
+  static const int kHighPassStages = 2;
+
+  // 二阶节的系数，已经除以a0
+  struct Biquad {
+    float b0;
+    float b1;
+    float b2;
+    float a1;
+    float a2;
+  };
+
+  // 处理不超过一块的数据
+  void ProcessBlock(float* samples, int frame_count);
+  void HighPass(float* samples, int frame_count);
+  // 按这一块的电平更新噪声门和自动增益，返回两者合起来的线性增益
+  float UpdateGain(float mean_square, double block_seconds);
+
+  const AudioProcessorConfig config_;
+  const int channels_;
+  const int sample_rate_;
+  // 每块的帧数
+  const int block_frames_;
+
+  Biquad high_pass_[kHighPassStages];
+  // 每个二阶节、每个声道的滤波器状态(直接II型转置)
+  float z1_[kHighPassStages][kMaxChannels];
+  float z2_[kHighPassStages][kMaxChannels];
+
+  // 平滑后的电平(dBFS)，噪声门按它判断是否有人说话
+  float level_db_;
+  // 说话时更慢地平滑的电平，自动增益按它调整
+  float speech_level_db_;
+  float gate_gain_;
+  float agc_gain_db_;
+  // 上一块结束时的总增益，这一块从它开始线性变化
+  float gain_;
+
+  PeakLimiter limiter_;
+  int64_t limited_blocks_;
+
+  // 一块float样本
+  std::vector<float> buffer_;
+
+  AudioProcessor() = delete;
+  AudioProcessor(const AudioProcessor&) = delete;
+  AudioProcessor& operator=(const AudioProcessor&) = delete;
+};  // class AudioProcessor
+
+#endif  // CAPTURER_AUDIO_PROCESSOR_H_
@@ -0,0 +1,91 @@
+﻿#include "capturer/audio_source.h"
+
+#include <chrono>
+#include <vector>
+
+#include "base/check.h"
+#include "base/threading/thread_role.h"
+
+PacedAudioSource::PacedAudioSource(const AudioSourceConfig& config,
+                                   const DataCallback& callback)
+    : AudioSource(config, callback),
+      stopping_(false),
+      paused_(false),
+      periods_(0),
+      late_periods_(0) {
+}
+
+PacedAudioSource::~PacedAudioSource() {
+  // 派生类应该已经调用过Stop
+  DCHECK(!thread_.joinable());
+}
+
+bool PacedAudioSource::Start() {
+  DCHECK(!thread_.joinable());
+  if (config_.bits_per_sample != 16 || config_.PeriodBytes() <= 0 ||
+      !Open()) {
+    return false;
+  }
+
+  stopping_ = false;
+  paused_ = false;
+  periods_ = 0;
+  late_periods_ = 0;
+  thread_ = std::thread(&PacedAudioSource::Run, this);
+  return true;
+}
+
+void PacedAudioSource::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+}
+
+void PacedAudioSource::Pause() {
+  paused_ = true;
+}
+
+void PacedAudioSource::Resume() {
+  paused_ = false;
+}
+
+void PacedAudioSource::Run() {
+  base::SetCurrentThreadRole(base::ThreadRole::AUDIO);
+
+  std::vector<uint8_t> buffer(config_.PeriodBytes());
+  // 周期的帧数是取整后的，按送出的帧数计算时间，避免声音比实际时间慢
+  const int64_t period_frames = config_.PeriodBytes() / config_.BytesPerFrame();
+  const std::chrono::microseconds period(
+      period_frames * 1000000 / config_.samples_per_second);
+  const auto start = std::chrono::steady_clock::now();
+  for (int64_t index = 1;; ++index) {
+    // 一个周期的数据在周期结束时才全部采集到，与录音设备的行为一致
+    const auto deadline =
+        start + std::chrono::microseconds(index * period_frames * 1000000 /
+                                          config_.samples_per_second);
+    {
+      std::unique_lock<std::mutex> locker(mutex_);
+      if (cond_.wait_until(locker, deadline, [this]() { return stopping_; })) {
+        break;
+      }
+    }
+    if (std::chrono::steady_clock::now() - deadline > period) {
+      ++late_periods_;
+    }
+
+    if (!Read(buffer.data(), static_cast<int>(buffer.size()))) {
+      break;
+    }
+    if (!paused_) {
+      callback_(buffer.data(), static_cast<int>(buffer.size()));
+    }
+    ++periods_;
+  }
+}
@@ -0,0 +1,125 @@
+﻿// 录音的数据来源
+//
+// 数据按周期送给回调函数，每个周期period_ms毫秒。周期越短，从采集到送去编码
+// 的延迟越低，回调越频繁。实现：
+//   VoiceCapturer: Windows的waveIn，buffer_count个缓冲区轮流交给设备
+//   AudioSourceSynthetic: 生成测试音或噪声
+//   AudioSourceWav: 按实际时间回放WAV文件
+// 后两种不依赖录音设备，可以在非Windows平台上测试录音的处理流程。
+
+#ifndef CAPTURER_AUDIO_SOURCE_H_
+#define CAPTURER_AUDIO_SOURCE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct AudioSourceConfig {
+  uint16_t channels;
+  uint32_t samples_per_second;
+  // 16位的PCM，或者32位的float(满刻度为±1，只有allow_float时才会出现)
+  uint16_t bits_per_sample;
+  // 每个周期的时长(毫秒)
+  int period_ms;
+  // 同时交给录音设备的缓冲区个数，总的缓冲时长为period_ms * buffer_count，
+  // 处理数据偶尔卡住时不会丢失声音。没有录音设备的来源忽略这个参数
+  int buffer_count;
+  // 数据本来就是float的来源可以不转换，直接送出32位float，超出满刻度的样本
+  // 不削波。只有AudioSourceLoopback支持，混音器的输入使用，其他来源忽略
+  bool allow_float;
+
+  AudioSourceConfig()
+      : channels(2),
+        samples_per_second(44100),
+        bits_per_sample(16),
+        period_ms(40),
+        buffer_count(6),
+        allow_float(false) {}
+
+  int BytesPerFrame() const { return channels * (bits_per_sample / 8); }
+  // 一个周期的字节数，按帧对齐
+  int PeriodBytes() const {
+    return static_cast<int>(static_cast<int64_t>(samples_per_second) *
+                            period_ms / 1000) *
+           BytesPerFrame();
+  }
+};  // struct AudioSourceConfig
+
+class AudioSource {
+ public:
+  // 处理声音数据的回调函数，在录音线程里调用
+  using DataCallback = std::function<void(const uint8_t* data, int len)>;
+
+  AudioSource(const AudioSourceConfig& config, const DataCallback& callback)
+      : config_(config), callback_(callback) {}
+  virtual ~AudioSource() {}
+
+  // 开始录音，没有录音设备或者打不开文件时返回false。
+  // Start和Stop在同一个线程中调用
+  virtual bool Start() = 0;
+  // 停止录音，返回后不会再调用回调函数
+  virtual void Stop() = 0;
+  // 暂停时采集到的数据直接丢弃
+  virtual void Pause() = 0;
+  virtual void Resume() = 0;
+
+  // 回调时最后一帧的采集时间比当前时间早多少(微秒)，
+  // 录音设备和生成数据的来源为0，混音器等有缓冲的来源为缓冲的时长
+  virtual int64_t delay_us() const { return 0; }
+
+  const AudioSourceConfig& config() const { return config_; }
+
+ protected:
+  AudioSourceConfig config_;
+  DataCallback callback_;
+
+ private:
+  AudioSource(const AudioSource&) = delete;
+  AudioSource& operator=(const AudioSource&) = delete;
+};  // class AudioSource
+
+// 没有硬件时钟的数据来源：在自己的线程中按实际时间产生数据，
+// 第n个周期在 开始时间 + 已送出的帧数 / 采样率 送出，误差不会累积。
+// 派生类的析构函数要先调用Stop，录音线程会调用派生类的Read
+class PacedAudioSource : public AudioSource {
+ public:
+  ~PacedAudioSource() override;
+
+  bool Start() override;
+  void Stop() override;
+  void Pause() override;
+  void Resume() override;
+
+  // 已经送出的周期数
+  int64_t periods() const { return periods_; }
+  // 醒来时已经晚于预定时间一个周期以上的次数
+  int64_t late_periods() const { return late_periods_; }
+
+ protected:
+  PacedAudioSource(const AudioSourceConfig& config,
+                   const DataCallback& callback);
+
+  // 在Start中调用，失败时返回false
+  virtual bool Open() { return true; }
+  // 填充一个周期的数据，没有更多数据时返回false，录音线程结束
+  virtual bool Read(uint8_t* data, int len) = 0;
+
+ private:
+  // 录音线程
+  void Run();
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stopping_;
+
+  std::atomic<bool> paused_;
+  std::atomic<int64_t> periods_;
+  std::atomic<int64_t> late_periods_;
+};  // class PacedAudioSource
+
+#endif  // CAPTURER_AUDIO_SOURCE_H_
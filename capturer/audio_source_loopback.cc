@@ -0,0 +1,300 @@
+﻿#include "capturer/audio_source_loopback.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <windows.h>
+#include <audioclient.h>
+#include <mmdeviceapi.h>
+#include <mmreg.h>
+#include <wrl/client.h>
+
+#include "base/check.h"
+#include "base/threading/thread_role.h"
+#include "capturer/audio_dsp.h"
+#include "logger/logger.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace {
+
+const char kFilter[] = "AudioSourceLoopback";
+
+// REFERENCE_TIME的单位是100纳秒
+const REFERENCE_TIME kReferenceTimePerMs = 10000;
+
+// 打开默认播放设备
+HRESULT CreateAudioClient(ComPtr<IAudioClient>* client) {
+  ComPtr<IMMDeviceEnumerator> enumerator;
+  HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr,
+                                CLSCTX_ALL, IID_PPV_ARGS(&enumerator));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  ComPtr<IMMDevice> device;
+  hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  return device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr,
+                          reinterpret_cast<void**>(client->GetAddressOf()));
+}
+
+// WAVEFORMATEXTENSIBLE的SubFormat的第一个字段就是对应的格式
+WORD FormatTag(const WAVEFORMATEX* format) {
+  if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE &&
+      format->cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)) {
+    return LOWORD(reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format)
+                      ->SubFormat.Data1);
+  }
+  return format->wFormatTag;
+}
+
+// 只支持共享模式下常见的32位float和16位PCM
+bool IsSupportedFormat(const WAVEFORMATEX* format, bool* float_samples) {
+  const WORD tag = FormatTag(format);
+  if (tag == WAVE_FORMAT_IEEE_FLOAT && format->wBitsPerSample == 32) {
+    *float_samples = true;
+    return true;
+  }
+  if (tag == WAVE_FORMAT_PCM && format->wBitsPerSample == 16) {
+    *float_samples = false;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+struct AudioSourceLoopback::Device {
+  ComPtr<IAudioClient> client;
+  ComPtr<IAudioCaptureClient> capture;
+};
+
+AudioSourceLoopback::AudioSourceLoopback(const AudioSourceConfig& config,
+                                         const DataCallback& callback)
+    : AudioSource(config, callback),
+      has_mix_format_(false),
+      float_samples_(false),
+      stopping_(false),
+      opened_(false),
+      open_result_(false),
+      paused_(false) {
+  // 调用线程可能已经按单线程套间初始化了COM，这时返回RPC_E_CHANGED_MODE，
+  // 仍然可以使用COM，只是不需要调用CoUninitialize
+  const HRESULT init_result = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+  ComPtr<IAudioClient> client;
+  WAVEFORMATEX* format = nullptr;
+  if (SUCCEEDED(CreateAudioClient(&client)) &&
+      SUCCEEDED(client->GetMixFormat(&format))) {
+    if (IsSupportedFormat(format, &float_samples_)) {
+      config_.channels = format->nChannels;
+      config_.samples_per_second = format->nSamplesPerSec;
+      config_.bits_per_sample = float_samples_ && config.allow_float ? 32 : 16;
+      has_mix_format_ = true;
+    } else {
+      LOG_ERROR(kFilter, "不支持的混音格式: 格式%u, %u位", FormatTag(format),
+                format->wBitsPerSample);
+    }
+    CoTaskMemFree(format);
+  } else {
+    LOG_WARN(kFilter, "取不到默认播放设备的混音格式");
+  }
+
+  if (SUCCEEDED(init_result)) {
+    CoUninitialize();
+  }
+}
+
+AudioSourceLoopback::~AudioSourceLoopback() {
+  Stop();
+}
+
+bool AudioSourceLoopback::Start() {
+  DCHECK(!thread_.joinable());
+  if (!has_mix_format_ || config_.PeriodBytes() <= 0) {
+    return false;
+  }
+
+  stopping_ = false;
+  opened_ = false;
+  open_result_ = false;
+  paused_ = false;
+  thread_ = std::thread(&AudioSourceLoopback::Run, this);
+
+  std::unique_lock<std::mutex> locker(mutex_);
+  cond_.wait(locker, [this]() { return opened_; });
+  if (!open_result_) {
+    locker.unlock();
+    thread_.join();
+    return false;
+  }
+  return true;
+}
+
+void AudioSourceLoopback::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+}
+
+void AudioSourceLoopback::Pause() {
+  paused_ = true;
+}
+
+void AudioSourceLoopback::Resume() {
+  paused_ = false;
+}
+
+void AudioSourceLoopback::Run() {
+  const HRESULT init_result = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+  if (!base::SetCurrentThreadRole(base::ThreadRole::AUDIO)) {
+    LOG_WARN(kFilter, "设置录音线程的优先级失败");
+  }
+
+  const bool opened = SUCCEEDED(init_result) && OpenAndStart();
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    opened_ = true;
+    open_result_ = opened;
+  }
+  cond_.notify_all();
+
+  if (opened) {
+    // 设备的缓冲区有period_ms * buffer_count，每半个周期取一次数据
+    const std::chrono::milliseconds interval(
+        std::max(1, config_.period_ms / 2));
+    std::unique_lock<std::mutex> locker(mutex_);
+    while (!cond_.wait_for(locker, interval, [this]() { return stopping_; })) {
+      locker.unlock();
+      const bool read = ReadPackets();
+      locker.lock();
+      if (!read) {
+        break;
+      }
+    }
+    device_->client->Stop();
+  }
+
+  Close();
+  if (SUCCEEDED(init_result)) {
+    CoUninitialize();
+  }
+}
+
+bool AudioSourceLoopback::OpenAndStart() {
+  device_ = std::make_unique<Device>();
+  ComPtr<IAudioClient>& client = device_->client;
+  HRESULT hr = CreateAudioClient(&client);
+  if (FAILED(hr)) {
+    LOG_ERROR(kFilter, "打开默认播放设备失败: 0x%08lx", hr);
+    return false;
+  }
+
+  // 构造之后默认播放设备可能改变，格式不同时不能继续
+  WAVEFORMATEX* format = nullptr;
+  hr = client->GetMixFormat(&format);
+  if (FAILED(hr)) {
+    LOG_ERROR(kFilter, "取得混音格式失败: 0x%08lx", hr);
+    return false;
+  }
+  bool float_samples = false;
+  const bool same_format = IsSupportedFormat(format, &float_samples) &&
+                           float_samples == float_samples_ &&
+                           format->nChannels == config_.channels &&
+                           format->nSamplesPerSec == config_.samples_per_second;
+  if (same_format) {
+    const REFERENCE_TIME buffer_duration =
+        kReferenceTimePerMs * config_.period_ms * config_.buffer_count;
+    hr = client->Initialize(AUDCLNT_SHAREMODE_SHARED,
+                            AUDCLNT_STREAMFLAGS_LOOPBACK, buffer_duration, 0,
+                            format, nullptr);
+  }
+  CoTaskMemFree(format);
+  if (!same_format) {
+    LOG_ERROR(kFilter, "默认播放设备的混音格式已经改变");
+    return false;
+  }
+  if (FAILED(hr)) {
+    LOG_ERROR(kFilter, "初始化环回录音失败: 0x%08lx", hr);
+    return false;
+  }
+
+  UINT32 buffer_frames = 0;
+  hr = client->GetBufferSize(&buffer_frames);
+  if (SUCCEEDED(hr)) {
+    hr = client->GetService(IID_PPV_ARGS(&device_->capture));
+  }
+  if (SUCCEEDED(hr)) {
+    buffer_.resize(buffer_frames * config_.BytesPerFrame());
+    hr = client->Start();
+  }
+  if (FAILED(hr)) {
+    LOG_ERROR(kFilter, "开始环回录音失败: 0x%08lx", hr);
+    return false;
+  }
+  LOG_INFO(kFilter, "开始环回录音: %u声道, %uHz, %s, 送出%u位, 缓冲区%u帧",
+           config_.channels, config_.samples_per_second,
+           float_samples_ ? "float" : "16位", config_.bits_per_sample,
+           buffer_frames);
+  return true;
+}
+
+bool AudioSourceLoopback::ReadPackets() {
+  IAudioCaptureClient* capture = device_->capture.Get();
+  const int channels = config_.channels;
+  const int sample_bytes = config_.bits_per_sample / 8;
+  const UINT32 max_frames =
+      static_cast<UINT32>(buffer_.size() / config_.BytesPerFrame());
+
+  UINT32 packet_frames = 0;
+  HRESULT hr = capture->GetNextPacketSize(&packet_frames);
+  while (SUCCEEDED(hr) && packet_frames > 0) {
+    BYTE* data = nullptr;
+    UINT32 frames = 0;
+    DWORD flags = 0;
+    hr = capture->GetBuffer(&data, &frames, &flags, nullptr, nullptr);
+    if (FAILED(hr)) {
+      break;
+    }
+
+    const int count = static_cast<int>(std::min(frames, max_frames)) * channels;
+    if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
+      memset(buffer_.data(), 0, count * sample_bytes);
+    } else if (float_samples_ && config_.bits_per_sample == 16) {
+      ConvertFloatToS16(reinterpret_cast<const float*>(data),
+                        reinterpret_cast<int16_t*>(buffer_.data()), count);
+    } else {
+      // 与设备的格式相同，float不削波，由混音器的限幅器处理
+      memcpy(buffer_.data(), data, count * sample_bytes);
+    }
+    capture->ReleaseBuffer(frames);
+
+    if (!paused_ && count > 0) {
+      callback_(buffer_.data(), count * sample_bytes);
+    }
+    hr = capture->GetNextPacketSize(&packet_frames);
+  }
+
+  // 切换默认播放设备时返回AUDCLNT_E_DEVICE_INVALIDATED，结束录音
+  if (FAILED(hr)) {
+    LOG_ERROR(kFilter, "环回录音失败: 0x%08lx", hr);
+    return false;
+  }
+  return true;
+}
+
+void AudioSourceLoopback::Close() {
+  device_.reset();
+}
@@ -0,0 +1,68 @@
+﻿// 用WASAPI的环回录音录制系统播放的声音，只在Windows上编译
+//
+// 格式与默认播放设备的混音格式相同(声道数和采样率)，转换为16位PCM；
+// 混音格式是float并且config.allow_float时直接送出float，由混音器限幅。
+// 环回录音没有数据就绪的事件，录音线程每半个周期查询一次；
+// 没有播放声音时设备不返回数据，混音器把这段时间当作静音。
+
+#ifndef CAPTURER_AUDIO_SOURCE_LOOPBACK_H_
+#define CAPTURER_AUDIO_SOURCE_LOOPBACK_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "capturer/audio_source.h"
+
+class AudioSourceLoopback : public AudioSource {
+ public:
+  // config中的声道数、采样率和样本格式被默认播放设备的混音格式代替，
+  // 取不到混音格式时Start返回false
+  AudioSourceLoopback(const AudioSourceConfig& config,
+                      const DataCallback& callback);
+  ~AudioSourceLoopback() override;
+
+  bool Start() override;
+  void Stop() override;
+  void Pause() override;
+  void Resume() override;
+
+ private:
+  // 录音线程，COM对象都在这个线程中创建和释放
+  void Run();
+  // 打开设备并开始录音，结果通知Start
+  bool OpenAndStart();
+  // 取出设备中所有的数据，转换格式后送给回调函数
+  bool ReadPackets();
+  // 释放COM对象
+  void Close();
+
+  // 设备的混音格式
+  bool has_mix_format_;
+  bool float_samples_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stopping_;
+  // Start等待录音线程打开设备
+  bool opened_;
+  bool open_result_;
+
+  std::atomic<bool> paused_;
+
+  // COM接口，只在录音线程中访问，头文件中不引入WASAPI的头文件
+  struct Device;
+  std::unique_ptr<Device> device_;
+  // 转换为config_格式的数据
+  std::vector<uint8_t> buffer_;
+
+  AudioSourceLoopback() = delete;
+  AudioSourceLoopback(const AudioSourceLoopback&) = delete;
+  AudioSourceLoopback& operator=(const AudioSourceLoopback&) = delete;
+};  // class AudioSourceLoopback
+
+#endif  // CAPTURER_AUDIO_SOURCE_LOOPBACK_H_
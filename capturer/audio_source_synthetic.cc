@@ -0,0 +1,56 @@
+﻿#include "capturer/audio_source_synthetic.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+const double kToneFrequency = 440.0;
+// 每秒开头响的时长(毫秒)
+const int kToneDurationMs = 100;
+// 幅度约为满刻度的-12dB，避免编码和重采样时削波
+const double kAmplitude = 8192.0;
+
+}  // namespace
+
+AudioSourceSynthetic::AudioSourceSynthetic(const AudioSourceConfig& config,
+                                           Waveform waveform,
+                                           const DataCallback& callback)
+    : PacedAudioSource(config, callback),
+      waveform_(waveform),
+      frames_(0),
+      noise_state_(0x12345678) {
+}
+
+AudioSourceSynthetic::~AudioSourceSynthetic() {
+  Stop();
+}
+
+bool AudioSourceSynthetic::Read(uint8_t* data, int len) {
+  const int channels = config_.channels;
+  const int64_t sample_rate = config_.samples_per_second;
+  const int frame_count = len / config_.BytesPerFrame();
+  int16_t* samples = reinterpret_cast<int16_t*>(data);
+
+  for (int i = 0; i < frame_count; ++i, ++frames_) {
+    int16_t value = 0;
+    if (waveform_ == Waveform::NOISE) {
+      // xorshift32
+      noise_state_ ^= noise_state_ << 13;
+      noise_state_ ^= noise_state_ >> 17;
+      noise_state_ ^= noise_state_ << 5;
+      value = static_cast<int16_t>(
+          (static_cast<int32_t>(noise_state_ >> 16) - 32768) / 4);
+    } else if (frames_ % sample_rate < sample_rate * kToneDurationMs / 1000) {
+      const double t = static_cast<double>(frames_) / sample_rate;
+      value = static_cast<int16_t>(kAmplitude *
+                                   sin(2.0 * kPi * kToneFrequency * t));
+    }
+    for (int c = 0; c < channels; ++c) {
+      samples[i * channels + c] = value;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,36 @@
+﻿#ifndef CAPTURER_AUDIO_SOURCE_SYNTHETIC_H_
+#define CAPTURER_AUDIO_SOURCE_SYNTHETIC_H_
+
+#include "capturer/audio_source.h"
+
+// 生成测试音或者白噪声，代替录音设备测试录音的处理流程
+class AudioSourceSynthetic : public PacedAudioSource {
+ public:
+  enum class Waveform {
+    // 440Hz的正弦波，每秒开头响100毫秒，可以用来检查音画同步
+    TONE = 0,
+    // 白噪声，编码器无法压缩，用来测试最坏情况下的编码负载
+    NOISE,
+  };
+
+  AudioSourceSynthetic(const AudioSourceConfig& config,
+                       Waveform waveform,
+                       const DataCallback& callback);
+  ~AudioSourceSynthetic() override;
+
+ protected:
+  bool Read(uint8_t* data, int len) override;
+
+ private:
+  Waveform waveform_;
+  // 已经生成的帧数(每帧包含所有声道的一个样本)
+  int64_t frames_;
+  // 噪声的随机数状态
+  uint32_t noise_state_;
+
+  AudioSourceSynthetic() = delete;
+  AudioSourceSynthetic(const AudioSourceSynthetic&) = delete;
+  AudioSourceSynthetic& operator=(const AudioSourceSynthetic&) = delete;
+};  // class AudioSourceSynthetic
+
+#endif  // CAPTURER_AUDIO_SOURCE_SYNTHETIC_H_
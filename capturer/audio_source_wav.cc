@@ -0,0 +1,162 @@
+﻿#include "capturer/audio_source_wav.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "build/build_config.h"
+#include "logger/logger.h"
+
+#if defined(OS_WIN)
+#include "base/strings/utf_string_conversions.h"
+#endif
+
+namespace {
+
+const char kFilter[] = "AudioSourceWav";
+
+const uint16_t kWaveFormatPcm = 1;
+
+FILE* OpenFile(const std::string& path) {
+#if defined(OS_WIN)
+  return _wfopen(base::UTF8ToWide(path).c_str(), L"rb");
+#else
+  return fopen(path.c_str(), "rb");
+#endif
+}
+
+// WAV文件中的整数都是小端序
+uint32_t ReadLE32(const uint8_t* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) |
+         (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint16_t ReadLE16(const uint8_t* data) {
+  return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+}  // namespace
+
+AudioSourceWav::AudioSourceWav(const AudioSourceConfig& config,
+                               const std::string& path,
+                               bool loop,
+                               const DataCallback& callback)
+    : PacedAudioSource(config, callback),
+      path_(path),
+      loop_(loop),
+      file_(nullptr),
+      data_offset_(0),
+      data_size_(0),
+      position_(0) {
+}
+
+AudioSourceWav::~AudioSourceWav() {
+  Stop();
+  if (file_) {
+    fclose(file_);
+  }
+}
+
+bool AudioSourceWav::Open() {
+  if (file_) {
+    fclose(file_);
+  }
+  file_ = OpenFile(path_);
+  if (!file_) {
+    LOG_ERROR(kFilter, "打开文件失败: %s", path_.c_str());
+    return false;
+  }
+  if (!ParseHeader()) {
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  position_ = 0;
+  return true;
+}
+
+bool AudioSourceWav::ParseHeader() {
+  uint8_t riff[12];
+  if (fread(riff, 1, sizeof(riff), file_) != sizeof(riff) ||
+      memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+    LOG_ERROR(kFilter, "不是WAV文件: %s", path_.c_str());
+    return false;
+  }
+
+  bool has_format = false;
+  int64_t offset = sizeof(riff);
+  while (true) {
+    uint8_t chunk[8];
+    if (fread(chunk, 1, sizeof(chunk), file_) != sizeof(chunk)) {
+      LOG_ERROR(kFilter, "没有找到data块: %s", path_.c_str());
+      return false;
+    }
+    const uint32_t chunk_size = ReadLE32(chunk + 4);
+    offset += sizeof(chunk);
+
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      uint8_t format[16];
+      if (chunk_size < sizeof(format) ||
+          fread(format, 1, sizeof(format), file_) != sizeof(format)) {
+        return false;
+      }
+      const uint16_t format_tag = ReadLE16(format);
+      const uint16_t channels = ReadLE16(format + 2);
+      const uint32_t sample_rate = ReadLE32(format + 4);
+      const uint16_t bits_per_sample = ReadLE16(format + 14);
+      if (format_tag != kWaveFormatPcm || channels != config_.channels ||
+          sample_rate != config_.samples_per_second ||
+          bits_per_sample != config_.bits_per_sample) {
+        LOG_ERROR(kFilter,
+                  "不支持的格式: %s, 格式%u, %u声道, %uHz, %u位，"
+                  "需要PCM, %u声道, %uHz, %u位",
+                  path_.c_str(), format_tag, channels, sample_rate,
+                  bits_per_sample, config_.channels,
+                  config_.samples_per_second, config_.bits_per_sample);
+        return false;
+      }
+      has_format = true;
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (!has_format) {
+        LOG_ERROR(kFilter, "data块在fmt块之前: %s", path_.c_str());
+        return false;
+      }
+      data_offset_ = offset;
+      // 按帧对齐，忽略最后不完整的帧
+      data_size_ = chunk_size - chunk_size % config_.BytesPerFrame();
+      return data_size_ > 0;
+    }
+
+    // 块的大小是奇数时有一个填充字节
+    offset += chunk_size + (chunk_size & 1);
+    if (fseek(file_, static_cast<long>(offset), SEEK_SET) != 0) {
+      return false;
+    }
+  }
+}
+
+bool AudioSourceWav::Read(uint8_t* data, int len) {
+  int filled = 0;
+  while (filled < len) {
+    if (position_ >= data_size_) {
+      if (!loop_) {
+        return false;
+      }
+      position_ = 0;
+    }
+    if (fseek(file_, static_cast<long>(data_offset_ + position_), SEEK_SET) !=
+        0) {
+      return false;
+    }
+
+    const size_t size = static_cast<size_t>(
+        std::min<int64_t>(len - filled, data_size_ - position_));
+    const size_t read = fread(data + filled, 1, size, file_);
+    if (read == 0) {
+      return false;
+    }
+    filled += static_cast<int>(read);
+    position_ += read;
+  }
+  return true;
+}
@@ -0,0 +1,45 @@
+﻿#ifndef CAPTURER_AUDIO_SOURCE_WAV_H_
+#define CAPTURER_AUDIO_SOURCE_WAV_H_
+
+#include <stdio.h>
+
+#include <string>
+
+#include "capturer/audio_source.h"
+
+// 按实际时间回放WAV文件，代替录音设备测试录音的处理流程。
+// 只支持16位PCM，声道数和采样率要与config相同，不做转换
+class AudioSourceWav : public PacedAudioSource {
+ public:
+  // path: UTF-8编码的文件路径
+  // loop: 到文件结尾时从头开始，否则结束录音
+  AudioSourceWav(const AudioSourceConfig& config,
+                 const std::string& path,
+                 bool loop,
+                 const DataCallback& callback);
+  ~AudioSourceWav() override;
+
+ protected:
+  bool Open() override;
+  bool Read(uint8_t* data, int len) override;
+
+ private:
+  // 解析RIFF头，找到fmt和data块，检查格式
+  bool ParseHeader();
+
+  std::string path_;
+  bool loop_;
+
+  FILE* file_;
+  // data块在文件中的位置和大小
+  int64_t data_offset_;
+  int64_t data_size_;
+  // 下一次读取的位置，相对于data块的开头
+  int64_t position_;
+
+  AudioSourceWav() = delete;
+  AudioSourceWav(const AudioSourceWav&) = delete;
+  AudioSourceWav& operator=(const AudioSourceWav&) = delete;
+};  // class AudioSourceWav
+
+#endif  // CAPTURER_AUDIO_SOURCE_WAV_H_
@@ -3,11 +3,23 @@
 
 #include <stdint.h>
 
+#include <vector>
+
+// 画面中发生变化的矩形区域，单位为像素
+struct DirtyRect {
+  int left;
+  int top;
+  int right;
+  int bottom;
+};  // struct DirtyRect
+
 struct AVData {
   enum Type {
     UNKNOWN = 0,
     AUDIO,
     VIDEO,
+    // 鼠标轨迹数据，格式见capturer/cursor_track.h
+    CURSOR,
   };
 
   Type type;
@@ -17,15 +29,26 @@ struct AVData {
   int width;
   int height;
 
+  // 采集时间，音频和视频为媒体时钟(capturer/media_clock.h)上的微秒数，
+  // 音频为第一个样本的采集时间
   uint64_t timestamp;
 
+  // 视频帧与上一帧相比发生变化的区域比例，0~1
+  float change_ratio;
+  // 这一帧(段)之前时间轴不连续，如暂停后恢复
+  bool discontinuity;
+  // 与上一帧相比发生变化的区域，change_ratio为1时为空
+  std::vector<DirtyRect> dirty_rects;
+
   AVData()
       : type(UNKNOWN),
         data(nullptr),
         len(0),
         width(0),
         height(0),
-        timestamp(0) {}
+        timestamp(0),
+        change_ratio(1.0f),
+        discontinuity(false) {}
 
   ~AVData() {
     if (data) {
@@ -0,0 +1,205 @@
+﻿#include "capturer/cursor_capturer.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/check.h"
+#include "logger/logger.h"
+
+namespace {
+
+const char kFilter[] = "CursorCapturer";
+
+// 创建32位自顶向下的DIB
+HBITMAP CreateBitmap32(HDC hdc, int width, int height, uint8_t** bits) {
+  BITMAPINFO bitmap_info;
+  ZeroMemory(&bitmap_info, sizeof(bitmap_info));
+  bitmap_info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+  bitmap_info.bmiHeader.biWidth = width;
+  bitmap_info.bmiHeader.biHeight = -height;
+  bitmap_info.bmiHeader.biPlanes = 1;
+  bitmap_info.bmiHeader.biBitCount = 32;
+  bitmap_info.bmiHeader.biCompression = BI_RGB;
+  return CreateDIBSection(hdc, &bitmap_info, DIB_RGB_COLORS,
+                          reinterpret_cast<void**>(bits), NULL, 0);
+}
+
+// 将光标分别绘制在黑色和白色背景上
+bool RenderCursor(HDC hdc, HCURSOR cursor, int width, int height,
+                  uint32_t background, std::vector<uint8_t>* pixels) {
+  uint8_t* bits = nullptr;
+  HBITMAP bitmap = CreateBitmap32(hdc, width, height, &bits);
+  if (!bitmap || !bits) {
+    return false;
+  }
+
+  HGDIOBJ old_bitmap = SelectObject(hdc, bitmap);
+  uint32_t* bits32 = reinterpret_cast<uint32_t*>(bits);
+  for (int i = 0; i < width * height; ++i) {
+    bits32[i] = background;
+  }
+
+  BOOL res = DrawIconEx(hdc, 0, 0, cursor, width, height, 0, NULL, DI_NORMAL);
+  GdiFlush();
+  if (res) {
+    pixels->assign(bits, bits + width * height * 4);
+  }
+
+  SelectObject(hdc, old_bitmap);
+  DeleteObject(bitmap);
+  return res != FALSE;
+}
+
+}  // namespace
+
+CursorCapturer::CursorCapturer()
+    : origin_x_(0),
+      origin_y_(0),
+      next_shape_id_(1),
+      has_last_state_(false) {
+}
+
+CursorCapturer::~CursorCapturer() {
+}
+
+bool CursorCapturer::Capture(uint64_t timestamp, AVData** av_data) {
+  DCHECK(av_data);
+  *av_data = nullptr;
+
+  CURSORINFO cursor_info;
+  ZeroMemory(&cursor_info, sizeof(CURSORINFO));
+  cursor_info.cbSize = sizeof(CURSORINFO);
+  if (!GetCursorInfo(&cursor_info)) {
+    return false;
+  }
+
+  std::vector<uint8_t> records;
+
+  CursorState state;
+  state.timestamp = timestamp;
+  state.x = cursor_info.ptScreenPos.x - origin_x_;
+  state.y = cursor_info.ptScreenPos.y - origin_y_;
+  state.visible =
+      (cursor_info.flags & CURSOR_SHOWING) != 0 && cursor_info.hCursor != NULL;
+
+  if (state.visible) {
+    auto it = shape_ids_.find(cursor_info.hCursor);
+    if (it != shape_ids_.end()) {
+      state.shape_id = it->second;
+    } else {
+      CursorShape shape;
+      if (ExtractShape(cursor_info.hCursor, &shape)) {
+        shape.id = next_shape_id_++;
+        shape_ids_[cursor_info.hCursor] = shape.id;
+        state.shape_id = shape.id;
+        CursorTrack::AppendShapeRecord(timestamp, shape, &records);
+      } else {
+        LOG_WARN(kFilter, "获取光标形状失败");
+        state.visible = false;
+      }
+    }
+  }
+
+  const bool changed = !has_last_state_ ||
+                       state.visible != last_state_.visible ||
+                       (state.visible &&
+                        (state.x != last_state_.x ||
+                         state.y != last_state_.y ||
+                         state.shape_id != last_state_.shape_id));
+  if (!changed) {
+    return true;
+  }
+
+  has_last_state_ = true;
+  last_state_ = state;
+  CursorTrack::AppendPositionRecord(state, &records);
+
+  AVData* tmp = new AVData();
+  tmp->type = AVData::CURSOR;
+  tmp->len = static_cast<int>(records.size());
+  tmp->data = new uint8_t[tmp->len];
+  tmp->timestamp = timestamp;
+  memcpy(tmp->data, records.data(), records.size());
+
+  *av_data = tmp;
+  return true;
+}
+
+bool CursorCapturer::ExtractShape(HCURSOR cursor, CursorShape* shape) {
+  DCHECK(shape);
+
+  ICONINFO icon_info;
+  if (!GetIconInfo(cursor, &icon_info)) {
+    return false;
+  }
+
+  BITMAP bitmap = {0};
+  int width = 0;
+  int height = 0;
+  if (icon_info.hbmColor &&
+      GetObject(icon_info.hbmColor, sizeof(BITMAP), &bitmap)) {
+    width = bitmap.bmWidth;
+    height = bitmap.bmHeight;
+  } else if (icon_info.hbmMask &&
+             GetObject(icon_info.hbmMask, sizeof(BITMAP), &bitmap)) {
+    // 单色光标的mask包含AND和XOR两部分
+    width = bitmap.bmWidth;
+    height = bitmap.bmHeight / 2;
+  }
+
+  shape->hotspot_x = static_cast<int>(icon_info.xHotspot);
+  shape->hotspot_y = static_cast<int>(icon_info.yHotspot);
+
+  if (icon_info.hbmMask) {
+    DeleteObject(icon_info.hbmMask);
+  }
+  if (icon_info.hbmColor) {
+    DeleteObject(icon_info.hbmColor);
+  }
+
+  if (width <= 0 || height <= 0) {
+    return false;
+  }
+
+  HDC screen_dc = GetDC(NULL);
+  HDC memory_dc = CreateCompatibleDC(screen_dc);
+
+  // 分别在黑色和白色背景上绘制光标，通过两者的差值还原alpha，
+  // 这样彩色、带mask和单色光标都可以用同一种方式处理
+  std::vector<uint8_t> on_black;
+  std::vector<uint8_t> on_white;
+  bool res =
+      RenderCursor(memory_dc, cursor, width, height, 0xFF000000, &on_black) &&
+      RenderCursor(memory_dc, cursor, width, height, 0xFFFFFFFF, &on_white);
+
+  DeleteDC(memory_dc);
+  ReleaseDC(NULL, screen_dc);
+
+  if (!res) {
+    return false;
+  }
+
+  shape->width = width;
+  shape->height = height;
+  shape->pixels.resize(width * height * 4);
+  for (int i = 0; i < width * height; ++i) {
+    const uint8_t* black = &on_black[i * 4];
+    const uint8_t* white = &on_white[i * 4];
+    uint8_t* dst = &shape->pixels[i * 4];
+
+    // 反色像素在白色背景上比黑色背景上更暗，按不透明处理
+    int alpha = 255 - (static_cast<int>(white[1]) - static_cast<int>(black[1]));
+    alpha = alpha < 0 ? 0 : (alpha > 255 ? 255 : alpha);
+    for (int c = 0; c < 3; ++c) {
+      dst[c] = alpha == 0
+                   ? 0
+                   : static_cast<uint8_t>(
+                         (std::min)(255, black[c] * 255 / alpha));
+    }
+    dst[3] = static_cast<uint8_t>(alpha);
+  }
+
+  return true;
+}
@@ -0,0 +1,45 @@
+﻿#ifndef CAPTURER_CURSOR_CAPTURER_H_
+#define CAPTURER_CURSOR_CAPTURER_H_
+
+#include <windows.h>
+
+#include <map>
+
+#include "capturer/av_data.h"
+#include "capturer/cursor_track.h"
+
+// 采集光标的位置和形状，生成鼠标轨迹记录
+// 只在光标发生变化时生成记录，画面中不再需要绘制光标
+class CursorCapturer {
+ public:
+  CursorCapturer();
+  ~CursorCapturer();
+
+  // 截屏区域左上角在虚拟屏幕中的坐标，默认为主显示器(0, 0)
+  void set_origin(int x, int y) {
+    origin_x_ = x;
+    origin_y_ = y;
+  }
+
+  // 光标发生变化时av_data为CURSOR类型的轨迹记录，没有变化时为nullptr
+  bool Capture(uint64_t timestamp, AVData** av_data);
+
+ private:
+  // 将光标转换成BGRA格式的图像
+  bool ExtractShape(HCURSOR cursor, CursorShape* shape);
+
+  int origin_x_;
+  int origin_y_;
+
+  // 已经记录过的光标形状
+  std::map<HCURSOR, uint32_t> shape_ids_;
+  uint32_t next_shape_id_;
+
+  bool has_last_state_;
+  CursorState last_state_;
+
+  CursorCapturer(const CursorCapturer&) = delete;
+  CursorCapturer& operator=(const CursorCapturer&) = delete;
+};  // class CursorCapturer
+
+#endif  // CAPTURER_CURSOR_CAPTURER_H_
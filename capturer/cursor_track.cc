@@ -0,0 +1,295 @@
+﻿#include "capturer/cursor_track.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/check.h"
+#include "build/build_config.h"
+
+#if defined(OS_WIN)
+#include "base/strings/utf_string_conversions.h"
+#endif
+
+namespace {
+
+const size_t kMagicLen = 8;
+// 类型 + 时间戳
+const size_t kRecordHeaderLen = 1 + 8;
+const size_t kPositionPayloadLen = 4 + 4 + 1 + 4;
+const size_t kShapePayloadLen = 4 + 4 + 4 + 4 + 4;
+
+// 单个光标形状的最大尺寸，防止读取到损坏的文件时分配过多内存
+const uint32_t kMaxShapeSize = 256;
+
+FILE* OpenFile(const std::string& path, const char* mode) {
+#if defined(OS_WIN)
+  std::wstring wide_mode(mode, mode + strlen(mode));
+  return _wfopen(base::UTF8ToWide(path).c_str(), wide_mode.c_str());
+#else
+  return fopen(path.c_str(), mode);
+#endif
+}
+
+void AppendUint8(uint8_t value, std::vector<uint8_t>* out) {
+  out->push_back(value);
+}
+
+void AppendUint32(uint32_t value, std::vector<uint8_t>* out) {
+  for (int i = 0; i < 4; ++i) {
+    out->push_back(static_cast<uint8_t>(value >> (i * 8)));
+  }
+}
+
+void AppendUint64(uint64_t value, std::vector<uint8_t>* out) {
+  for (int i = 0; i < 8; ++i) {
+    out->push_back(static_cast<uint8_t>(value >> (i * 8)));
+  }
+}
+
+uint32_t ReadUint32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) |
+         (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t ReadUint64(const uint8_t* p) {
+  return static_cast<uint64_t>(ReadUint32(p)) |
+         (static_cast<uint64_t>(ReadUint32(p + 4)) << 32);
+}
+
+}  // namespace
+
+const char CursorTrack::kMagic[] = "SRCURSOR";
+const uint32_t CursorTrack::kVersion = 1;
+
+// static
+void CursorTrack::AppendPositionRecord(const CursorState& state,
+                                       std::vector<uint8_t>* out) {
+  DCHECK(out);
+  AppendUint8(kPositionRecord, out);
+  AppendUint64(state.timestamp, out);
+  AppendUint32(static_cast<uint32_t>(state.x), out);
+  AppendUint32(static_cast<uint32_t>(state.y), out);
+  AppendUint8(state.visible ? 1 : 0, out);
+  AppendUint32(state.shape_id, out);
+}
+
+// static
+void CursorTrack::AppendShapeRecord(uint64_t timestamp,
+                                    const CursorShape& shape,
+                                    std::vector<uint8_t>* out) {
+  DCHECK(out);
+  DCHECK(shape.pixels.size() ==
+         static_cast<size_t>(shape.width) * shape.height * 4);
+  AppendUint8(kShapeRecord, out);
+  AppendUint64(timestamp, out);
+  AppendUint32(shape.id, out);
+  AppendUint32(static_cast<uint32_t>(shape.hotspot_x), out);
+  AppendUint32(static_cast<uint32_t>(shape.hotspot_y), out);
+  AppendUint32(static_cast<uint32_t>(shape.width), out);
+  AppendUint32(static_cast<uint32_t>(shape.height), out);
+  out->insert(out->end(), shape.pixels.begin(), shape.pixels.end());
+}
+
+CursorTrackWriter::CursorTrackWriter() : file_(nullptr) {}
+
+CursorTrackWriter::~CursorTrackWriter() {
+  Close();
+}
+
+bool CursorTrackWriter::Open(const std::string& path) {
+  DCHECK(!file_);
+
+  file_ = OpenFile(path, "wb");
+  if (!file_) {
+    return false;
+  }
+
+  std::vector<uint8_t> header(CursorTrack::kMagic,
+                              CursorTrack::kMagic + kMagicLen);
+  AppendUint32(CursorTrack::kVersion, &header);
+  return Write(header.data(), static_cast<int>(header.size()));
+}
+
+bool CursorTrackWriter::Write(const uint8_t* data, int len) {
+  if (!file_ || !data || len <= 0) {
+    return false;
+  }
+  return fwrite(data, 1, len, file_) == static_cast<size_t>(len);
+}
+
+void CursorTrackWriter::Close() {
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+CursorTrackReader::CursorTrackReader() {}
+
+CursorTrackReader::~CursorTrackReader() {}
+
+bool CursorTrackReader::Open(const std::string& path) {
+  FILE* file = OpenFile(path, "rb");
+  if (!file) {
+    return false;
+  }
+
+  std::vector<uint8_t> buffer;
+  uint8_t chunk[64 * 1024];
+  size_t n = 0;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    buffer.insert(buffer.end(), chunk, chunk + n);
+  }
+  fclose(file);
+
+  return Parse(buffer);
+}
+
+const CursorState* CursorTrackReader::StateAt(uint64_t timestamp) const {
+  auto it = std::upper_bound(
+      states_.begin(), states_.end(), timestamp,
+      [](uint64_t t, const CursorState& state) { return t < state.timestamp; });
+  if (it == states_.begin()) {
+    return nullptr;
+  }
+  return &*(--it);
+}
+
+const CursorShape* CursorTrackReader::Shape(uint32_t shape_id) const {
+  auto it = shapes_.find(shape_id);
+  return it == shapes_.end() ? nullptr : &it->second;
+}
+
+bool CursorTrackReader::Parse(const std::vector<uint8_t>& buffer) {
+  states_.clear();
+  shapes_.clear();
+
+  if (buffer.size() < kMagicLen + 4 ||
+      memcmp(buffer.data(), CursorTrack::kMagic, kMagicLen) != 0 ||
+      ReadUint32(buffer.data() + kMagicLen) != CursorTrack::kVersion) {
+    return false;
+  }
+
+  const uint8_t* p = buffer.data() + kMagicLen + 4;
+  const uint8_t* end = buffer.data() + buffer.size();
+  while (end - p >= static_cast<ptrdiff_t>(kRecordHeaderLen)) {
+    const uint8_t type = p[0];
+    const uint64_t timestamp = ReadUint64(p + 1);
+    p += kRecordHeaderLen;
+
+    if (type == CursorTrack::kPositionRecord) {
+      if (end - p < static_cast<ptrdiff_t>(kPositionPayloadLen)) {
+        return false;
+      }
+      CursorState state;
+      state.timestamp = timestamp;
+      state.x = static_cast<int32_t>(ReadUint32(p));
+      state.y = static_cast<int32_t>(ReadUint32(p + 4));
+      state.visible = p[8] != 0;
+      state.shape_id = ReadUint32(p + 9);
+      states_.push_back(state);
+      p += kPositionPayloadLen;
+    } else if (type == CursorTrack::kShapeRecord) {
+      if (end - p < static_cast<ptrdiff_t>(kShapePayloadLen)) {
+        return false;
+      }
+      CursorShape shape;
+      shape.id = ReadUint32(p);
+      shape.hotspot_x = static_cast<int32_t>(ReadUint32(p + 4));
+      shape.hotspot_y = static_cast<int32_t>(ReadUint32(p + 8));
+      const uint32_t width = ReadUint32(p + 12);
+      const uint32_t height = ReadUint32(p + 16);
+      p += kShapePayloadLen;
+
+      if (width > kMaxShapeSize || height > kMaxShapeSize) {
+        return false;
+      }
+      const size_t pixel_len = static_cast<size_t>(width) * height * 4;
+      if (static_cast<size_t>(end - p) < pixel_len) {
+        return false;
+      }
+      shape.width = static_cast<int>(width);
+      shape.height = static_cast<int>(height);
+      shape.pixels.assign(p, p + pixel_len);
+      p += pixel_len;
+
+      shapes_[shape.id] = std::move(shape);
+    } else {
+      return false;
+    }
+  }
+
+  // 记录按时间顺序写入，这里保证查找时的顺序
+  std::stable_sort(states_.begin(), states_.end(),
+                   [](const CursorState& a, const CursorState& b) {
+                     return a.timestamp < b.timestamp;
+                   });
+  return true;
+}
+
+CursorCompositor::CursorCompositor(const CursorTrackReader* reader)
+    : reader_(reader) {
+  DCHECK(reader_);
+}
+
+CursorCompositor::~CursorCompositor() {}
+
+void CursorCompositor::Compose(uint64_t timestamp,
+                               uint8_t* frame,
+                               int width,
+                               int height,
+                               int stride) {
+  const CursorState* state = reader_->StateAt(timestamp);
+  if (!state || !state->visible) {
+    return;
+  }
+
+  const CursorShape* shape = reader_->Shape(state->shape_id);
+  if (!shape) {
+    return;
+  }
+
+  Blend(*shape, state->x - shape->hotspot_x, state->y - shape->hotspot_y,
+        frame, width, height, stride);
+}
+
+// static
+void CursorCompositor::Blend(const CursorShape& shape,
+                             int x,
+                             int y,
+                             uint8_t* frame,
+                             int width,
+                             int height,
+                             int stride) {
+  DCHECK(frame);
+
+  const int left = std::max(x, 0);
+  const int top = std::max(y, 0);
+  const int right = std::min(x + shape.width, width);
+  const int bottom = std::min(y + shape.height, height);
+
+  for (int row = top; row < bottom; ++row) {
+    const uint8_t* src =
+        shape.pixels.data() + ((row - y) * shape.width + (left - x)) * 4;
+    uint8_t* dst = frame + row * stride + left * 4;
+    for (int col = left; col < right; ++col, src += 4, dst += 4) {
+      const uint32_t alpha = src[3];
+      if (alpha == 0) {
+        continue;
+      }
+      if (alpha == 255) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        continue;
+      }
+      const uint32_t inv = 255 - alpha;
+      dst[0] = static_cast<uint8_t>((src[0] * alpha + dst[0] * inv + 127) / 255);
+      dst[1] = static_cast<uint8_t>((src[1] * alpha + dst[1] * inv + 127) / 255);
+      dst[2] = static_cast<uint8_t>((src[2] * alpha + dst[2] * inv + 127) / 255);
+    }
+  }
+}
@@ -0,0 +1,139 @@
+﻿// 鼠标轨迹
+//
+// 鼠标不绘制到画面时，光标的位置和形状变化单独记录为一个带时间戳的轨迹文件，
+// 与视频文件同名，后缀为.cursor。导出时再按需将光标合成到画面中。
+//
+// 文件格式（整数均为小端序）：
+//   文件头：   "SRCURSOR"(8字节) + 版本号(uint32)
+//   记录：     类型(uint8) + 时间戳(uint64，毫秒) + 数据
+//     kPositionRecord: x(int32) y(int32) visible(uint8) shape_id(uint32)
+//     kShapeRecord:    shape_id(uint32) hotspot_x(int32) hotspot_y(int32)
+//                      width(uint32) height(uint32) BGRA像素(width*height*4)
+// 同一个shape_id的形状只记录一次，位置记录引用之前记录过的形状。
+
+#ifndef CAPTURER_CURSOR_TRACK_H_
+#define CAPTURER_CURSOR_TRACK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// 光标形状
+struct CursorShape {
+  uint32_t id;
+  // 热点相对于形状左上角的偏移
+  int hotspot_x;
+  int hotspot_y;
+  int width;
+  int height;
+  // BGRA像素，alpha未预乘
+  std::vector<uint8_t> pixels;
+
+  CursorShape() : id(0), hotspot_x(0), hotspot_y(0), width(0), height(0) {}
+};  // struct CursorShape
+
+// 某一时刻的光标状态
+struct CursorState {
+  uint64_t timestamp;
+  // 热点坐标，相对于截屏区域左上角
+  int x;
+  int y;
+  bool visible;
+  uint32_t shape_id;
+
+  CursorState()
+      : timestamp(0), x(0), y(0), visible(false), shape_id(0) {}
+};  // struct CursorState
+
+class CursorTrack {
+ public:
+  enum RecordType : uint8_t {
+    kPositionRecord = 1,
+    kShapeRecord = 2,
+  };
+
+  static const char kMagic[];
+  static const uint32_t kVersion;
+
+  // 将记录序列化后追加到out中
+  static void AppendPositionRecord(const CursorState& state,
+                                   std::vector<uint8_t>* out);
+  static void AppendShapeRecord(uint64_t timestamp,
+                                const CursorShape& shape,
+                                std::vector<uint8_t>* out);
+};  // class CursorTrack
+
+// 写入轨迹文件，记录数据由CursorCapturer生成
+class CursorTrackWriter {
+ public:
+  CursorTrackWriter();
+  ~CursorTrackWriter();
+
+  // path: UTF-8编码的文件路径
+  bool Open(const std::string& path);
+  bool Write(const uint8_t* data, int len);
+  void Close();
+
+ private:
+  FILE* file_;
+
+  CursorTrackWriter(const CursorTrackWriter&) = delete;
+  CursorTrackWriter& operator=(const CursorTrackWriter&) = delete;
+};  // class CursorTrackWriter
+
+// 读取轨迹文件，用于导出时合成光标
+class CursorTrackReader {
+ public:
+  CursorTrackReader();
+  ~CursorTrackReader();
+
+  bool Open(const std::string& path);
+
+  // 获取timestamp时刻的光标状态，timestamp之前没有任何记录时返回nullptr
+  const CursorState* StateAt(uint64_t timestamp) const;
+  const CursorShape* Shape(uint32_t shape_id) const;
+
+ private:
+  bool Parse(const std::vector<uint8_t>& buffer);
+
+  // 按时间戳排序
+  std::vector<CursorState> states_;
+  std::map<uint32_t, CursorShape> shapes_;
+
+  CursorTrackReader(const CursorTrackReader&) = delete;
+  CursorTrackReader& operator=(const CursorTrackReader&) = delete;
+};  // class CursorTrackReader
+
+// 将光标合成到BGRA画面中，只在导出时需要
+class CursorCompositor {
+ public:
+  explicit CursorCompositor(const CursorTrackReader* reader);
+  ~CursorCompositor();
+
+  // 将timestamp时刻的光标绘制到frame中，没有可见光标时不修改画面
+  void Compose(uint64_t timestamp,
+               uint8_t* frame,
+               int width,
+               int height,
+               int stride);
+
+  static void Blend(const CursorShape& shape,
+                    int x,
+                    int y,
+                    uint8_t* frame,
+                    int width,
+                    int height,
+                    int stride);
+
+ private:
+  const CursorTrackReader* reader_;
+
+  CursorCompositor() = delete;
+  CursorCompositor(const CursorCompositor&) = delete;
+  CursorCompositor& operator=(const CursorCompositor&) = delete;
+};  // class CursorCompositor
+
+#endif  // CAPTURER_CURSOR_TRACK_H_
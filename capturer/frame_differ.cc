@@ -0,0 +1,161 @@
+﻿#include "capturer/frame_differ.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/check.h"
+
+FrameDiffer::FrameDiffer()
+    : width_(0),
+      height_(0),
+      stride_(0),
+      tile_columns_(0),
+      tile_rows_(0) {
+}
+
+FrameDiffer::~FrameDiffer() {
+}
+
+float FrameDiffer::Compare(const uint8_t* data,
+                           int width,
+                           int height,
+                           int stride) {
+  DCHECK(data && width > 0 && height > 0 && stride >= width * 4);
+
+  const bool size_changed =
+      width != width_ || height != height_ || stride != stride_;
+  if (size_changed) {
+    width_ = width;
+    height_ = height;
+    stride_ = stride;
+    tile_columns_ = (width + kTileSize - 1) / kTileSize;
+    tile_rows_ = (height + kTileSize - 1) / kTileSize;
+  }
+
+  const size_t tile_count = static_cast<size_t>(tile_columns_) * tile_rows_;
+  const size_t frame_size = static_cast<size_t>(stride) * height;
+  if (size_changed || previous_.size() != frame_size) {
+    previous_.assign(data, data + frame_size);
+    dirty_tiles_.assign(tile_count, 1);
+    return 1.0f;
+  }
+
+  dirty_tiles_.assign(tile_count, 0);
+
+  size_t dirty_count = 0;
+  for (int tile_y = 0; tile_y < tile_rows_; ++tile_y) {
+    const int top = tile_y * kTileSize;
+    const int bottom = std::min(top + kTileSize, height);
+    uint8_t* dirty_row = &dirty_tiles_[tile_y * tile_columns_];
+
+    for (int y = top; y < bottom; ++y) {
+      const uint8_t* cur = data + y * stride;
+      const uint8_t* prev = previous_.data() + y * stride;
+
+      // 整行没有变化时不需要逐块比较
+      if (memcmp(cur, prev, width * 4) == 0) {
+        continue;
+      }
+
+      for (int tile_x = 0; tile_x < tile_columns_; ++tile_x) {
+        if (dirty_row[tile_x]) {
+          continue;
+        }
+        const int left = tile_x * kTileSize * 4;
+        const int len = std::min(kTileSize * 4, width * 4 - left);
+        if (memcmp(cur + left, prev + left, len) != 0) {
+          dirty_row[tile_x] = 1;
+          ++dirty_count;
+        }
+      }
+    }
+
+    // 只拷贝发生变化的行
+    if (std::find(dirty_row, dirty_row + tile_columns_, 1) !=
+        dirty_row + tile_columns_) {
+      memcpy(previous_.data() + top * stride, data + top * stride,
+             static_cast<size_t>(bottom - top) * stride);
+    }
+  }
+
+  return static_cast<float>(dirty_count) / static_cast<float>(tile_count);
+}
+
+void FrameDiffer::GetDirtyRects(int max_rects,
+                                std::vector<DirtyRect>* rects) const {
+  DCHECK(rects && max_rects > 0);
+  rects->clear();
+
+  // 按块为单位合并：先找出每一行中连续的变化块，
+  // 与上一行起止位置相同的合并成一个矩形
+  struct Run {
+    int begin;
+    int end;
+    size_t rect_index;
+  };
+  std::vector<Run> previous_runs;
+  std::vector<Run> current_runs;
+
+  int min_x = tile_columns_;
+  int min_y = tile_rows_;
+  int max_x = -1;
+  int max_y = -1;
+
+  for (int tile_y = 0; tile_y < tile_rows_; ++tile_y) {
+    current_runs.clear();
+    const uint8_t* dirty_row = &dirty_tiles_[tile_y * tile_columns_];
+
+    int tile_x = 0;
+    while (tile_x < tile_columns_) {
+      if (!dirty_row[tile_x]) {
+        ++tile_x;
+        continue;
+      }
+
+      const int begin = tile_x;
+      while (tile_x < tile_columns_ && dirty_row[tile_x]) {
+        ++tile_x;
+      }
+
+      min_x = std::min(min_x, begin);
+      max_x = std::max(max_x, tile_x - 1);
+      min_y = std::min(min_y, tile_y);
+      max_y = tile_y;
+
+      auto it = std::find_if(
+          previous_runs.begin(), previous_runs.end(), [&](const Run& run) {
+            return run.begin == begin && run.end == tile_x;
+          });
+      if (it != previous_runs.end()) {
+        (*rects)[it->rect_index].bottom = (tile_y + 1) * kTileSize;
+        current_runs.push_back({begin, tile_x, it->rect_index});
+      } else {
+        rects->push_back({begin * kTileSize, tile_y * kTileSize,
+                          tile_x * kTileSize, (tile_y + 1) * kTileSize});
+        current_runs.push_back({begin, tile_x, rects->size() - 1});
+      }
+    }
+
+    previous_runs.swap(current_runs);
+  }
+
+  if (static_cast<int>(rects->size()) > max_rects) {
+    rects->clear();
+    rects->push_back({min_x * kTileSize, min_y * kTileSize,
+                      (max_x + 1) * kTileSize, (max_y + 1) * kTileSize});
+  }
+
+  // 最后一列、最后一行的块可能超出画面
+  for (DirtyRect& rect : *rects) {
+    rect.right = std::min(rect.right, width_);
+    rect.bottom = std::min(rect.bottom, height_);
+  }
+}
+
+void FrameDiffer::Reset() {
+  previous_.clear();
+  width_ = 0;
+  height_ = 0;
+  stride_ = 0;
+}
@@ -0,0 +1,51 @@
+﻿// 统计相邻两帧画面的变化
+
+#ifndef CAPTURER_FRAME_DIFFER_H_
+#define CAPTURER_FRAME_DIFFER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "capturer/av_data.h"
+
+// 画面按kTileSize划分成块，块内只要有像素变化就认为整块发生了变化
+class FrameDiffer {
+ public:
+  static const int kTileSize = 32;
+
+  FrameDiffer();
+  ~FrameDiffer();
+
+  // 与上一帧比较，并将当前帧保存为下一次比较的参考帧
+  // 返回变化的块占所有块的比例，第一帧或画面尺寸变化时返回1
+  float Compare(const uint8_t* data, int width, int height, int stride);
+
+  // 丢弃参考帧，下一帧视为完全变化
+  void Reset();
+
+  int tile_columns() const { return tile_columns_; }
+  int tile_rows() const { return tile_rows_; }
+
+  // 每个块是否发生变化，按行排列，共tile_columns() * tile_rows()个
+  const std::vector<uint8_t>& dirty_tiles() const { return dirty_tiles_; }
+
+  // 将上一次Compare得到的变化块合并成矩形
+  // 矩形数量超过max_rects时只返回包含所有变化块的一个矩形
+  void GetDirtyRects(int max_rects, std::vector<DirtyRect>* rects) const;
+
+ private:
+  std::vector<uint8_t> previous_;
+  int width_;
+  int height_;
+  int stride_;
+
+  int tile_columns_;
+  int tile_rows_;
+  std::vector<uint8_t> dirty_tiles_;
+
+  FrameDiffer(const FrameDiffer&) = delete;
+  FrameDiffer& operator=(const FrameDiffer&) = delete;
+};  // class FrameDiffer
+
+#endif  // CAPTURER_FRAME_DIFFER_H_
@@ -0,0 +1,82 @@
+﻿#include "capturer/media_clock.h"
+
+#include <chrono>
+
+namespace {
+
+int64_t SteadyClockMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+MediaClock::MediaClock() : MediaClock(SteadyClockMicroseconds) {}
+
+MediaClock::MediaClock(const TickSource& tick_source)
+    : tick_source_(tick_source),
+      started_(false),
+      paused_(false),
+      start_ticks_(0),
+      pause_ticks_(0),
+      paused_us_(0) {}
+
+MediaClock::~MediaClock() {}
+
+void MediaClock::Start() {
+  const int64_t ticks = tick_source_();
+  std::lock_guard<std::mutex> locker(mutex_);
+  started_ = true;
+  paused_ = false;
+  start_ticks_ = ticks;
+  pause_ticks_ = 0;
+  paused_us_ = 0;
+}
+
+void MediaClock::Pause() {
+  const int64_t ticks = tick_source_();
+  std::lock_guard<std::mutex> locker(mutex_);
+  if (!started_ || paused_) {
+    return;
+  }
+  paused_ = true;
+  pause_ticks_ = ticks;
+}
+
+void MediaClock::Resume() {
+  const int64_t ticks = tick_source_();
+  std::lock_guard<std::mutex> locker(mutex_);
+  if (!started_ || !paused_) {
+    return;
+  }
+  paused_ = false;
+  paused_us_ += ticks - pause_ticks_;
+}
+
+int64_t MediaClock::Now() const {
+  const int64_t ticks = tick_source_();
+  std::lock_guard<std::mutex> locker(mutex_);
+  return NowLocked(ticks);
+}
+
+bool MediaClock::paused() const {
+  std::lock_guard<std::mutex> locker(mutex_);
+  return paused_;
+}
+
+int64_t MediaClock::paused_duration() const {
+  const int64_t ticks = tick_source_();
+  std::lock_guard<std::mutex> locker(mutex_);
+  return paused_ ? paused_us_ + ticks - pause_ticks_ : paused_us_;
+}
+
+int64_t MediaClock::NowLocked(int64_t ticks) const {
+  if (!started_) {
+    return 0;
+  }
+  if (paused_) {
+    ticks = pause_ticks_;
+  }
+  return ticks - start_ticks_ - paused_us_;
+}
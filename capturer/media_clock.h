@@ -0,0 +1,54 @@
+﻿// 音视频共用的媒体时钟
+
+#ifndef CAPTURER_MEDIA_CLOCK_H_
+#define CAPTURER_MEDIA_CLOCK_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <mutex>
+
+// 以微秒为单位的单调时钟，从Start开始计时，不包含暂停的时长。
+// 截屏和录音在采集到数据时用同一个时钟打时间戳，音视频的时间轴因此一致，
+// 录音设备时钟与系统时钟的偏差由编码端的AudioClockSync补偿。
+// 可以在多个线程中同时调用。
+class MediaClock {
+ public:
+  // 返回单调递增的微秒数，用于测试时替换系统时钟
+  using TickSource = std::function<int64_t()>;
+
+  MediaClock();
+  explicit MediaClock(const TickSource& tick_source);
+  ~MediaClock();
+
+  // 从0开始计时，清除暂停状态
+  void Start();
+  void Pause();
+  void Resume();
+
+  // 当前的媒体时间(微秒)，Start之前返回0，暂停时停在暂停的时刻
+  int64_t Now() const;
+
+  bool paused() const;
+  // 累计暂停的时长(微秒)，包括正在进行的暂停
+  int64_t paused_duration() const;
+
+ private:
+  int64_t NowLocked(int64_t ticks) const;
+
+  TickSource tick_source_;
+
+  mutable std::mutex mutex_;
+  bool started_;
+  bool paused_;
+  int64_t start_ticks_;
+  // 这一次暂停开始的时刻
+  int64_t pause_ticks_;
+  // 已结束的暂停的总时长
+  int64_t paused_us_;
+
+  MediaClock(const MediaClock&) = delete;
+  MediaClock& operator=(const MediaClock&) = delete;
+};  // class MediaClock
+
+#endif  // CAPTURER_MEDIA_CLOCK_H_
@@ -1,5 +1,7 @@
 ﻿#include "capturer/picture_capturer.h"
 
+#if defined(OS_WIN)
+
 // https://www.coder.work/article/1221121
 void PictureCapturer::DrawMouseIcon(HDC hdc) {
   POINT point;
@@ -35,3 +37,4 @@ void PictureCapturer::DrawMouseIcon(HDC hdc) {
     DrawIcon(hdc, point.x, point.y, hcursor);
   }
 }
+#endif  // defined(OS_WIN)
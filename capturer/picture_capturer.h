@@ -1,21 +1,33 @@
 ﻿#ifndef SCREEN_RECORD_SRC_CAPTURER_PICTURE_CAPTURER_H_
 #define SCREEN_RECORD_SRC_CAPTURER_PICTURE_CAPTURER_H_
 
-#include <windows.h>
-
+#include "build/build_config.h"
 #include "capturer/av_data.h"
 
+#if defined(OS_WIN)
+#include <windows.h>
+#endif
+
 class PictureCapturer {
  public:
-  PictureCapturer() { }
+  PictureCapturer() : draw_mouse_(true) { }
   virtual ~PictureCapturer() { }
 
   // DXGI截屏会存在屏幕没有发生变化而不截屏的情况
   // 这种情况是正常的，但是av_data会为nullptr
   virtual bool CaptureScreen(AVData** av_data) = 0;
 
+  // 是否将鼠标绘制到画面中
+  // 鼠标单独记录时（见CursorCapturer）不需要绘制，画面保持不含鼠标
+  void set_draw_mouse(bool draw_mouse) { draw_mouse_ = draw_mouse; }
+  bool draw_mouse() const { return draw_mouse_; }
+
  protected:
+#if defined(OS_WIN)
   void DrawMouseIcon(HDC hdc);
+#endif
+
+  bool draw_mouse_;
 };  // class PictureCapturer
 
 #endif  // SCREEN_RECORD_SRC_CAPTURER_PICTURE_CAPTURER_H_
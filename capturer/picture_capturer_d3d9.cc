@@ -35,7 +35,7 @@ bool PictureCapturerD3D9::CaptureScreen(AVData** av_data) {
 
   // 绘制鼠标
   HDC hdc = NULL;
-  if (dest_target_->GetDC(&hdc) == D3D_OK) {
+  if (draw_mouse_ && dest_target_->GetDC(&hdc) == D3D_OK) {
     DrawMouseIcon(hdc);
     dest_target_->ReleaseDC(hdc);
   }
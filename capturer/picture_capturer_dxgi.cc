@@ -47,6 +47,12 @@ bool PictureCapturerDXGI::CaptureScreen(AVData** av_data) {
     return false;
   }
 
+  // 不绘制鼠标时，只有鼠标变化的帧与上一帧相同，不需要再截取
+  if (!draw_mouse_ && frame_info.LastPresentTime.QuadPart == 0) {
+    desk_dupl_->ReleaseFrame();
+    return true;
+  }
+
   acquired_desktop_image_.Reset();
   hr = dxgi_resource->QueryInterface(acquired_desktop_image_.GetAddressOf());
   if (FAILED(hr)) {
@@ -59,7 +65,7 @@ bool PictureCapturerDXGI::CaptureScreen(AVData** av_data) {
       shared_image_.Get(), acquired_desktop_image_.Get());
 
   // 绘制鼠标
-  if (GetMouse(&frame_info) && pointer_info_.visible) {
+  if (draw_mouse_ && GetMouse(&frame_info) && pointer_info_.visible) {
     DrawMouse();
   }
 
@@ -71,7 +71,9 @@ bool PictureCapturerGdi::CaptureScreen(AVData** av_data) {
   }
 
   // 绘制鼠标
-  DrawMouseIcon(memory_dc_);
+  if (draw_mouse_) {
+    DrawMouseIcon(memory_dc_);
+  }
 
   AVData* tmp = new AVData();
   tmp->type = AVData::VIDEO;
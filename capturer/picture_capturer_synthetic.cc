@@ -0,0 +1,36 @@
+﻿#include "capturer/picture_capturer_synthetic.h"
+
+#include <string.h>
+
+#include "base/check.h"
+
+#if defined(OS_WIN)
+PictureCapturerSynthetic::PictureCapturerSynthetic()
+    : PictureCapturerSynthetic(GetSystemMetrics(SM_CXSCREEN),
+                               GetSystemMetrics(SM_CYSCREEN)) {
+}
+#endif
+
+PictureCapturerSynthetic::PictureCapturerSynthetic(int width, int height)
+    : desktop_(width, height) {
+}
+
+PictureCapturerSynthetic::~PictureCapturerSynthetic() {
+}
+
+bool PictureCapturerSynthetic::CaptureScreen(AVData** av_data) {
+  DCHECK(av_data);
+
+  desktop_.NextFrame();
+
+  AVData* tmp = new AVData();
+  tmp->type = AVData::VIDEO;
+  tmp->width = desktop_.width();
+  tmp->height = desktop_.height();
+  tmp->len = tmp->width * tmp->height * 4;
+  tmp->data = new uint8_t[tmp->len];
+  memcpy(tmp->data, desktop_.pixels(), tmp->len);
+
+  *av_data = tmp;
+  return true;
+}
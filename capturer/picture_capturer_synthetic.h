@@ -0,0 +1,35 @@
+﻿#ifndef CAPTURER_PICTURE_CAPTURER_SYNTHETIC_H_
+#define CAPTURER_PICTURE_CAPTURER_SYNTHETIC_H_
+
+#include "capturer/picture_capturer.h"
+#include "capturer/synthetic_desktop.h"
+
+// 把SyntheticDesktop生成的画面作为截屏结果，
+// 用于测量编码参数对文件大小和CPU占用的影响
+class PictureCapturerSynthetic : public PictureCapturer {
+ public:
+  using Phase = SyntheticDesktop::Phase;
+
+#if defined(OS_WIN)
+  // 使用主显示器的尺寸
+  PictureCapturerSynthetic();
+#endif
+  PictureCapturerSynthetic(int width, int height);
+  ~PictureCapturerSynthetic() override;
+
+  bool CaptureScreen(AVData** av_data) override;
+
+  // 下一帧所处的阶段
+  Phase CurrentPhase() const { return desktop_.CurrentPhase(); }
+
+  // 跳过中间的帧，直到下一帧处于phase阶段
+  void SkipTo(Phase phase) { desktop_.SkipTo(phase); }
+
+ private:
+  SyntheticDesktop desktop_;
+
+  PictureCapturerSynthetic(const PictureCapturerSynthetic&) = delete;
+  PictureCapturerSynthetic& operator=(const PictureCapturerSynthetic&) = delete;
+};  // class PictureCapturerSynthetic
+
+#endif  // CAPTURER_PICTURE_CAPTURER_SYNTHETIC_H_
@@ -0,0 +1,241 @@
+﻿#include "capturer/picture_capturer_x11.h"
+
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xfixes.h>
+
+#include "base/check.h"
+
+namespace {
+
+// XShmAttach失败时X服务器异步返回错误，默认的错误处理会退出进程
+bool g_shm_attach_failed = false;
+
+int HandleShmAttachError(Display* /*display*/, XErrorEvent* /*event*/) {
+  g_shm_attach_failed = true;
+  return 0;
+}
+
+Display* OpenDisplay(const std::string& display_name) {
+  return XOpenDisplay(display_name.empty() ? nullptr : display_name.c_str());
+}
+
+// 按行复制32位的XImage，XImage每行可能有对齐
+bool CopyImage(const XImage* image, uint8_t* data, int width, int height) {
+  if (image->bits_per_pixel != 32) {
+    return false;
+  }
+
+  const int stride = width * 4;
+  for (int y = 0; y < height; ++y) {
+    memcpy(data + y * stride, image->data + y * image->bytes_per_line,
+           stride);
+  }
+  return true;
+}
+
+}  // namespace
+
+struct PictureCapturerX11::ShmSegment {
+  XShmSegmentInfo info;
+  // X服务器已经连接了共享内存，销毁前需要断开
+  bool attached;
+};
+
+PictureCapturerX11::PictureCapturerX11(const std::string& display_name)
+    : display_(nullptr),
+      root_window_(0),
+      width_(0),
+      height_(0),
+      shm_image_(nullptr),
+      has_xfixes_(false) {
+  display_ = OpenDisplay(display_name);
+  if (!display_) {
+    return;
+  }
+
+  const int screen = DefaultScreen(display_);
+  root_window_ = RootWindow(display_, screen);
+  width_ = DisplayWidth(display_, screen);
+  height_ = DisplayHeight(display_, screen);
+
+  if (XShmQueryExtension(display_) && !CreateShmImage()) {
+    DestroyShmImage();
+  }
+
+  int event_base = 0;
+  int error_base = 0;
+  has_xfixes_ = XFixesQueryExtension(display_, &event_base, &error_base);
+}
+
+PictureCapturerX11::~PictureCapturerX11() {
+  DestroyShmImage();
+  if (display_) {
+    XCloseDisplay(display_);
+  }
+}
+
+// static
+bool PictureCapturerX11::GetScreenSize(const std::string& display_name,
+                                       int* width,
+                                       int* height) {
+  DCHECK(width && height);
+
+  Display* display = OpenDisplay(display_name);
+  if (!display) {
+    return false;
+  }
+
+  const int screen = DefaultScreen(display);
+  *width = DisplayWidth(display, screen);
+  *height = DisplayHeight(display, screen);
+  XCloseDisplay(display);
+  return true;
+}
+
+bool PictureCapturerX11::CreateShmImage() {
+  const int screen = DefaultScreen(display_);
+  shm_segment_ = std::make_unique<ShmSegment>();
+  XShmSegmentInfo* info = &shm_segment_->info;
+  info->shmid = -1;
+  info->shmaddr = reinterpret_cast<char*>(-1);
+  shm_segment_->attached = false;
+
+  shm_image_ = XShmCreateImage(display_, DefaultVisual(display_, screen),
+                               DefaultDepth(display_, screen), ZPixmap,
+                               nullptr, info, width_, height_);
+  if (!shm_image_ || shm_image_->bits_per_pixel != 32) {
+    return false;
+  }
+
+  info->shmid = shmget(IPC_PRIVATE,
+                       shm_image_->bytes_per_line * shm_image_->height,
+                       IPC_CREAT | 0600);
+  if (info->shmid < 0) {
+    return false;
+  }
+  info->shmaddr = static_cast<char*>(shmat(info->shmid, nullptr, 0));
+  if (info->shmaddr == reinterpret_cast<char*>(-1)) {
+    return false;
+  }
+  shm_image_->data = info->shmaddr;
+  info->readOnly = False;
+
+  g_shm_attach_failed = false;
+  XErrorHandler old_handler = XSetErrorHandler(HandleShmAttachError);
+  const bool attached = XShmAttach(display_, info);
+  XSync(display_, False);
+  XSetErrorHandler(old_handler);
+
+  // 双方都连接之后删除，进程退出时系统自动回收
+  shmctl(info->shmid, IPC_RMID, nullptr);
+  info->shmid = -1;
+  shm_segment_->attached = attached && !g_shm_attach_failed;
+  return shm_segment_->attached;
+}
+
+void PictureCapturerX11::DestroyShmImage() {
+  if (!shm_segment_) {
+    return;
+  }
+
+  XShmSegmentInfo* info = &shm_segment_->info;
+  if (shm_segment_->attached) {
+    XShmDetach(display_, info);
+    XSync(display_, False);
+  }
+  if (info->shmaddr != reinterpret_cast<char*>(-1)) {
+    shmdt(info->shmaddr);
+  }
+  if (info->shmid >= 0) {
+    shmctl(info->shmid, IPC_RMID, nullptr);
+  }
+  if (shm_image_) {
+    // 数据在共享内存中，不能由XDestroyImage释放
+    shm_image_->data = nullptr;
+    XDestroyImage(shm_image_);
+    shm_image_ = nullptr;
+  }
+  shm_segment_.reset();
+}
+
+bool PictureCapturerX11::CaptureScreen(AVData** av_data) {
+  DCHECK(av_data);
+
+  if (!display_) {
+    return false;
+  }
+
+  AVData* tmp = new AVData();
+  tmp->type = AVData::VIDEO;
+  tmp->len = width_ * height_ * 4;
+  tmp->width = width_;
+  tmp->height = height_;
+  tmp->data = new uint8_t[tmp->len];
+
+  bool res = false;
+  if (shm_image_) {
+    res = XShmGetImage(display_, root_window_, shm_image_, 0, 0, AllPlanes) &&
+          CopyImage(shm_image_, tmp->data, width_, height_);
+  } else {
+    XImage* image = XGetImage(display_, root_window_, 0, 0, width_, height_,
+                              AllPlanes, ZPixmap);
+    if (image) {
+      res = CopyImage(image, tmp->data, width_, height_);
+      XDestroyImage(image);
+    }
+  }
+  if (!res) {
+    delete tmp;
+    return false;
+  }
+
+  // 绘制鼠标
+  if (draw_mouse_ && has_xfixes_) {
+    DrawCursor(tmp->data, width_ * 4);
+  }
+
+  *av_data = tmp;
+  return true;
+}
+
+void PictureCapturerX11::DrawCursor(uint8_t* data, int stride) {
+  XFixesCursorImage* cursor = XFixesGetCursorImage(display_);
+  if (!cursor) {
+    return;
+  }
+
+  // 鼠标图像是预乘alpha的ARGB，每个像素存放在unsigned long的低32位
+  const int left = cursor->x - cursor->xhot;
+  const int top = cursor->y - cursor->yhot;
+  for (int y = 0; y < cursor->height; ++y) {
+    const int dst_y = top + y;
+    if (dst_y < 0 || dst_y >= height_) {
+      continue;
+    }
+    for (int x = 0; x < cursor->width; ++x) {
+      const int dst_x = left + x;
+      if (dst_x < 0 || dst_x >= width_) {
+        continue;
+      }
+
+      const uint32_t argb =
+          static_cast<uint32_t>(cursor->pixels[y * cursor->width + x]);
+      const uint32_t alpha = argb >> 24;
+      if (alpha == 0) {
+        continue;
+      }
+      uint8_t* pixel = data + dst_y * stride + dst_x * 4;
+      for (int i = 0; i < 3; ++i) {
+        const uint32_t src = (argb >> (i * 8)) & 0xFF;
+        pixel[i] = static_cast<uint8_t>(src + pixel[i] * (255 - alpha) / 255);
+      }
+    }
+  }
+  XFree(cursor);
+}
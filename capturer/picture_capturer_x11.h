@@ -0,0 +1,56 @@
+﻿// 截取X11桌面的画面，只在Linux上编译
+//
+// MIT-SHM扩展可用时通过共享内存读取画面，否则(如远程显示)用XGetImage。
+// 鼠标由XFixes取得图像后绘制到画面中。
+
+#ifndef CAPTURER_PICTURE_CAPTURER_X11_H_
+#define CAPTURER_PICTURE_CAPTURER_X11_H_
+
+#include <memory>
+#include <string>
+
+#include "capturer/picture_capturer.h"
+
+// Xlib的头文件定义了Status、None等宏，不在头文件中引入
+struct _XDisplay;
+struct _XImage;
+
+class PictureCapturerX11 : public PictureCapturer {
+ public:
+  // display_name: X11显示的名称，如":0"，为空时使用DISPLAY环境变量
+  explicit PictureCapturerX11(const std::string& display_name);
+  ~PictureCapturerX11() override;
+
+  // 取得display_name对应的屏幕的尺寸，无法连接时返回false
+  static bool GetScreenSize(const std::string& display_name,
+                            int* width,
+                            int* height);
+
+  bool CaptureScreen(AVData** av_data) override;
+
+ private:
+  struct ShmSegment;
+
+  // 创建共享内存中的XImage，失败时返回false，改用XGetImage
+  bool CreateShmImage();
+  void DestroyShmImage();
+
+  // 把鼠标按alpha混合到BGRA画面中
+  void DrawCursor(uint8_t* data, int stride);
+
+  _XDisplay* display_;
+  unsigned long root_window_;
+  int width_;
+  int height_;
+
+  std::unique_ptr<ShmSegment> shm_segment_;
+  _XImage* shm_image_;
+
+  bool has_xfixes_;
+
+  PictureCapturerX11() = delete;
+  PictureCapturerX11(const PictureCapturerX11&) = delete;
+  PictureCapturerX11& operator=(const PictureCapturerX11&) = delete;
+};  // class PictureCapturerX11
+
+#endif  // CAPTURER_PICTURE_CAPTURER_X11_H_
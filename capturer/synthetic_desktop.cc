@@ -0,0 +1,229 @@
+﻿#include "capturer/synthetic_desktop.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/check.h"
+
+namespace {
+
+// 每个阶段持续的帧数，按顺序循环
+struct PhaseSpan {
+  SyntheticDesktop::Phase phase;
+  int frames;
+};
+
+const PhaseSpan kSchedule[] = {
+    {SyntheticDesktop::Phase::STATIC, 150},
+    {SyntheticDesktop::Phase::TYPING, 150},
+    {SyntheticDesktop::Phase::STATIC, 90},
+    {SyntheticDesktop::Phase::SCROLLING, 120},
+    {SyntheticDesktop::Phase::SCENE_CHANGE, 1},
+};
+
+const int kGlyphWidth = 8;
+const int kGlyphHeight = 14;
+const int kLineHeight = 18;
+
+const uint32_t kBackgroundColors[] = {
+    0xFF1E3A5F, 0xFF2D2D30, 0xFF3C6E71, 0xFF6A74FF,
+};
+
+int ScheduleLength() {
+  int total = 0;
+  for (const PhaseSpan& span : kSchedule) {
+    total += span.frames;
+  }
+  return total;
+}
+
+}  // namespace
+
+SyntheticDesktop::SyntheticDesktop(int width, int height)
+    : width_(width),
+      height_(height),
+      frame_index_(0),
+      random_state_(0x12345678),
+      scene_index_(0),
+      text_window_({0, 0, 0, 0}),
+      cursor_x_(0),
+      cursor_y_(0) {
+  DCHECK(width_ > 0 && height_ > 0);
+  pixels_.resize(static_cast<size_t>(width_) * height_);
+  DrawScene();
+}
+
+SyntheticDesktop::~SyntheticDesktop() {
+}
+
+// static
+int SyntheticDesktop::CycleFrames() {
+  return ScheduleLength();
+}
+
+SyntheticDesktop::Phase SyntheticDesktop::CurrentPhase() const {
+  int index = static_cast<int>(frame_index_ % ScheduleLength());
+  for (const PhaseSpan& span : kSchedule) {
+    if (index < span.frames) {
+      return span.phase;
+    }
+    index -= span.frames;
+  }
+  return Phase::STATIC;
+}
+
+void SyntheticDesktop::SkipTo(Phase phase) {
+  const int length = ScheduleLength();
+  for (int i = 0; i < length && CurrentPhase() != phase; ++i) {
+    NextFrame();
+  }
+}
+
+void SyntheticDesktop::NextFrame() {
+  switch (CurrentPhase()) {
+    case Phase::STATIC:
+      break;
+
+    case Phase::TYPING:
+      if (cursor_x_ + kGlyphWidth > text_window_.right - 8) {
+        cursor_x_ = text_window_.left + 8;
+        cursor_y_ += kLineHeight;
+      }
+      if (cursor_y_ + kGlyphHeight > text_window_.bottom - 8) {
+        ScrollUp(text_window_, kLineHeight);
+        cursor_y_ -= kLineHeight;
+      }
+      DrawGlyph(cursor_x_, cursor_y_, 0xFFE0E0E0);
+      cursor_x_ += kGlyphWidth + 1;
+      break;
+
+    case Phase::SCROLLING:
+      ScrollUp(text_window_, 6);
+      DrawTextLine(text_window_, text_window_.bottom - kLineHeight - 2);
+      break;
+
+    case Phase::SCENE_CHANGE:
+      ++scene_index_;
+      DrawScene();
+      break;
+  }
+
+  ++frame_index_;
+}
+
+void SyntheticDesktop::DrawScene() {
+  const int color_count = sizeof(kBackgroundColors) / sizeof(uint32_t);
+  FillRect({0, 0, width_, height_},
+           kBackgroundColors[scene_index_ % color_count]);
+
+  // 任务栏
+  FillRect({0, height_ - 40, width_, height_}, 0xFF202020);
+
+  // 几个普通窗口，带标题栏和文字
+  for (int i = 0; i < 3; ++i) {
+    const int w = width_ / 3 + static_cast<int>(Random() % (width_ / 4 + 1));
+    const int h = height_ / 3 + static_cast<int>(Random() % (height_ / 4 + 1));
+    const int x = static_cast<int>(Random() % std::max(width_ - w, 1));
+    const int y = static_cast<int>(Random() % std::max(height_ - 40 - h, 1));
+    Rect window = {x, y, std::min(x + w, width_), std::min(y + h, height_)};
+
+    FillRect(window, 0xFFF3F3F3);
+    FillRect({window.left, window.top, window.right, window.top + 30},
+             0xFF6A74FF);
+    for (int line_y = window.top + 40; line_y + kLineHeight < window.bottom;
+         line_y += kLineHeight) {
+      DrawTextLine(window, line_y);
+    }
+  }
+
+  // 终端窗口，打字和滚动都发生在这里
+  const int w = std::min(std::max(width_ / 3, 64), width_);
+  const int h = std::min(std::max(height_ / 3, 64), height_);
+  const int left = std::max(width_ - w - 20, 0);
+  const int top = std::min(20, height_ - h);
+  text_window_ = {left, top, left + w, top + h};
+  FillRect(text_window_, 0xFF0C0C0C);
+  cursor_x_ = text_window_.left + 8;
+  cursor_y_ = text_window_.top + 8;
+}
+
+void SyntheticDesktop::DrawTextLine(const Rect& window, int y) {
+  if (y < 0 || y >= height_ || window.left < 0 || window.left >= width_) {
+    return;
+  }
+
+  const bool dark = (pixels_[static_cast<size_t>(y) * width_ +
+                             window.left] & 0x00FFFFFF) < 0x00808080;
+  const uint32_t color = dark ? 0xFFCCCCCC : 0xFF202020;
+  FillRect({window.left + 1, y, window.right - 1, y + kLineHeight},
+           pixels_[static_cast<size_t>(y) * width_ + window.left]);
+
+  const int words = 3 + static_cast<int>(Random() % 10);
+  int x = window.left + 8;
+  for (int i = 0; i < words; ++i) {
+    const int letters = 2 + static_cast<int>(Random() % 8);
+    for (int j = 0; j < letters; ++j) {
+      if (x + kGlyphWidth > window.right - 8) {
+        return;
+      }
+      DrawGlyph(x, y + 2, color);
+      x += kGlyphWidth + 1;
+    }
+    x += kGlyphWidth;
+  }
+}
+
+void SyntheticDesktop::DrawGlyph(int x, int y, uint32_t color) {
+  // 随机的点阵，模拟文字的高频细节
+  const uint32_t pattern = Random();
+  for (int row = 0; row < kGlyphHeight; ++row) {
+    if (y + row < 0 || y + row >= height_) {
+      continue;
+    }
+    uint32_t* dst = &pixels_[static_cast<size_t>(y + row) * width_];
+    const uint32_t bits = (pattern >> ((row * 3) % 24)) & 0xFF;
+    for (int col = 0; col < kGlyphWidth; ++col) {
+      if (x + col >= 0 && x + col < width_ && (bits & (1 << col))) {
+        dst[x + col] = color;
+      }
+    }
+  }
+}
+
+void SyntheticDesktop::FillRect(const Rect& rect, uint32_t color) {
+  const int left = std::max(rect.left, 0);
+  const int right = std::min(rect.right, width_);
+  const int top = std::max(rect.top, 0);
+  const int bottom = std::min(rect.bottom, height_);
+  for (int y = top; y < bottom; ++y) {
+    uint32_t* row = &pixels_[static_cast<size_t>(y) * width_];
+    std::fill(row + left, row + right, color);
+  }
+}
+
+void SyntheticDesktop::ScrollUp(const Rect& rect, int lines) {
+  const int left = std::max(rect.left, 0);
+  const int right = std::min(rect.right, width_);
+  const int top = std::max(rect.top, 0);
+  const int bottom = std::min(rect.bottom, height_);
+  if (right <= left || bottom - top <= lines) {
+    return;
+  }
+
+  for (int y = top; y < bottom - lines; ++y) {
+    memmove(&pixels_[static_cast<size_t>(y) * width_ + left],
+            &pixels_[static_cast<size_t>(y + lines) * width_ + left],
+            (right - left) * sizeof(uint32_t));
+  }
+  FillRect({left, bottom - lines, right, bottom},
+           pixels_[static_cast<size_t>(top) * width_ + left]);
+}
+
+uint32_t SyntheticDesktop::Random() {
+  // xorshift32
+  random_state_ ^= random_state_ << 13;
+  random_state_ ^= random_state_ >> 17;
+  random_state_ ^= random_state_ << 5;
+  return random_state_;
+}
@@ -0,0 +1,78 @@
+﻿#ifndef CAPTURER_SYNTHETIC_DESKTOP_H_
+#define CAPTURER_SYNTHETIC_DESKTOP_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+// 生成模拟桌面内容的画面，不依赖真实的屏幕和Windows，
+// 用于测量编码参数对文件大小和CPU占用的影响
+// 画面按固定的顺序循环经过静止、打字、滚动和切换场景几个阶段，
+// 相同的参数每次生成的画面序列完全相同
+class SyntheticDesktop {
+ public:
+  enum class Phase {
+    // 画面不变
+    STATIC = 0,
+    // 每帧只有一小块区域变化
+    TYPING,
+    // 一个窗口的内容整体滚动
+    SCROLLING,
+    // 整个画面变化
+    SCENE_CHANGE,
+  };
+
+  SyntheticDesktop(int width, int height);
+  ~SyntheticDesktop();
+
+  // 一个循环的帧数
+  static int CycleFrames();
+
+  // 按当前阶段更新画面，进入下一帧
+  void NextFrame();
+
+  // 下一帧所处的阶段
+  Phase CurrentPhase() const;
+
+  // 跳过中间的帧，直到下一帧处于phase阶段
+  void SkipTo(Phase phase);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  // 当前画面，BGRA格式，每行width()个像素
+  const uint32_t* pixels() const { return pixels_.data(); }
+
+ private:
+  struct Rect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+  };
+
+  void DrawScene();
+  void DrawTextLine(const Rect& window, int y);
+  void DrawGlyph(int x, int y, uint32_t color);
+  void FillRect(const Rect& rect, uint32_t color);
+  void ScrollUp(const Rect& rect, int lines);
+
+  uint32_t Random();
+
+  int width_;
+  int height_;
+  std::vector<uint32_t> pixels_;
+
+  uint64_t frame_index_;
+  uint32_t random_state_;
+  int scene_index_;
+
+  // 当前场景里打字和滚动的窗口
+  Rect text_window_;
+  int cursor_x_;
+  int cursor_y_;
+
+  SyntheticDesktop(const SyntheticDesktop&) = delete;
+  SyntheticDesktop& operator=(const SyntheticDesktop&) = delete;
+};  // class SyntheticDesktop
+
+#endif  // CAPTURER_SYNTHETIC_DESKTOP_H_
@@ -1,8 +1,7 @@
 ﻿#include "capturer/voice_capturer.h"
 
-#include <thread>
-
 #include "base/check.h"
+#include "base/threading/thread_role.h"
 #include "logger/logger.h"
 
 #define IDM_STOP_CAPTURE            6001
@@ -12,6 +11,9 @@ namespace {
 
 const char kFilter[] = "VoiceCapturer";
 
+// 停止录音时等待录音线程处理消息的最长时间，一般立即返回
+const DWORD kStopTimeoutMs = 1000;
+
 }  // namespace
 
 // static
@@ -19,6 +21,10 @@ DWORD WINAPI VoiceCapturer::HandleVoiceThread(void* param) {
   VoiceCapturer* capturer = static_cast<VoiceCapturer*>(param);
   DCHECK(capturer);
 
+  if (!base::SetCurrentThreadRole(base::ThreadRole::AUDIO)) {
+    LOG_WARN(kFilter, "设置录音线程的优先级失败");
+  }
+
   bool stop_capture = false;
   bool pause_capture = false;
 
@@ -35,14 +41,23 @@ DWORD WINAPI VoiceCapturer::HandleVoiceThread(void* param) {
         capturer->OnReceiveVoiceData(stop_capture, pause_capture,
                                      reinterpret_cast<HWAVEIN>(msg.wParam),
                                      reinterpret_cast<WAVEHDR*>(msg.lParam));
+        // 停止之后每个缓冲区正好返回一次，不再加入录音队列
+        if (stop_capture &&
+            ++capturer->returned_buffers_ ==
+                static_cast<int>(capturer->wave_headers_.size())) {
+          SetEvent(capturer->buffers_event_);
+        }
         break;
 
       case IDM_STOP_CAPTURE:
+        // 这之前收到的缓冲区都已经重新加入录音队列
         stop_capture = true;
+        capturer->returned_buffers_ = 0;
+        SetEvent(capturer->buffers_event_);
         break;
 
       case IDM_PAUSE_CAPTURE:
-        pause_capture = !pause_capture;
+        pause_capture = msg.wParam != 0;
         break;
 
       default:
@@ -66,7 +81,7 @@ void VoiceCapturer::OnReceiveVoiceData(bool stop_capture,
   const int len = (int)wave_header->dwBytesRecorded;
 
   if (len > 0 && !pause_capture) {
-    handle_voice_callback_(data, len);
+    callback_(data, len);
   }
 
   if (!stop_capture) {
@@ -76,30 +91,21 @@ void VoiceCapturer::OnReceiveVoiceData(bool stop_capture,
   }
 }
 
-VoiceCapturer::VoiceCapturer(
-    uint16_t channels,
-    uint32_t samples_per_second,
-    uint16_t bits_per_sample,
-    uint16_t format_type,
-    const std::function<void(const uint8_t* data, int len)>& handle_voice_callback)
-    : device_is_opened_(false),
+VoiceCapturer::VoiceCapturer(const AudioSourceConfig& config,
+                             const DataCallback& callback)
+    : AudioSource(config, callback),
+      device_is_opened_(false),
       is_recording_(false),
       start_thread_id_(0),
-      channels_(channels),
-      samples_per_second_(samples_per_second),
-      bits_per_sample_(bits_per_sample),
-      format_type_(format_type),
       handle_data_thread_id_(0),
       handle_data_thread_handle_(NULL),
+      buffers_event_(NULL),
+      returned_buffers_(0),
       input_format_{},
-      micor_handle_(NULL),
-      handle_voice_callback_(handle_voice_callback) {
-  // 目前只支持WAVE_FORMAT_PCM格式
-  DCHECK(format_type_ == WAVE_FORMAT_PCM) << "只支持WAVE_FORMAT_PCM格式";
-
-  for (int i = 0; i < kWaveHeaderCount; ++i) {
-    wave_buffers_[i] = nullptr;
-  }
+      micor_handle_(NULL) {
+  // 自动重置，每次等待消耗一次通知
+  buffers_event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+  DCHECK(buffers_event_);
 }
 
 VoiceCapturer::~VoiceCapturer() {
@@ -107,23 +113,27 @@ VoiceCapturer::~VoiceCapturer() {
     Stop();
   }
 
-  for (int i = 0; i < kWaveHeaderCount; ++i) {
-    if (wave_buffers_[i]) {
-      delete[] wave_buffers_[i];
-      wave_buffers_[i] = nullptr;
-    }
-  }
+  CloseHandle(buffers_event_);
 }
 
-void VoiceCapturer::Start() {
+bool VoiceCapturer::Start() {
   DCHECK(!is_recording_);
 
   DCHECK(start_thread_id_ == 0);
   start_thread_id_ = GetCurrentThreadId();
 
+  const int buffer_bytes = config_.PeriodBytes();
+  if (config_.bits_per_sample != 16 || buffer_bytes <= 0 ||
+      config_.buffer_count <= 0) {
+    LOG_ERROR(kFilter, "不支持的录音参数: %u位, 周期%dms, %d个缓冲区",
+              config_.bits_per_sample, config_.period_ms,
+              config_.buffer_count);
+    return false;
+  }
+
   if (waveInGetNumDevs() <= 0) {
     LOG_WARN(kFilter, "未找到录音设备");
-    return;
+    return false;
   }
 
   // 创建处理音频数据的线程
@@ -133,17 +143,17 @@ void VoiceCapturer::Start() {
                    &handle_data_thread_id_);
   if (!handle_data_thread_handle_) {
     LOG_ERROR(kFilter, "创建处理音频数据的线程失败");
-    return;
+    return false;
   }
 
   bool res = false;
   MMRESULT result = MMSYSERR_NOERROR;
 
   ZeroMemory(&input_format_, sizeof(WAVEFORMATEX));
-  input_format_.wFormatTag = format_type_;
-  input_format_.nChannels = channels_;
-  input_format_.nSamplesPerSec = samples_per_second_;
-  input_format_.wBitsPerSample = bits_per_sample_;
+  input_format_.wFormatTag = WAVE_FORMAT_PCM;
+  input_format_.nChannels = config_.channels;
+  input_format_.nSamplesPerSec = config_.samples_per_second;
+  input_format_.wBitsPerSample = config_.bits_per_sample;
   input_format_.nBlockAlign =
       input_format_.nChannels * (input_format_.wBitsPerSample / 8);
   input_format_.nAvgBytesPerSec =
@@ -159,12 +169,13 @@ void VoiceCapturer::Start() {
   // 录音设备已打开
   device_is_opened_ = true;
 
-  for (int i = 0; i < kWaveHeaderCount; ++i) {
-    wave_buffers_[i] = new int8_t[samples_per_second_];
-
-    ZeroMemory(&wave_headers_[i], sizeof(WAVEHDR));
-    wave_headers_[i].dwBufferLength = samples_per_second_;
-    wave_headers_[i].lpData = reinterpret_cast<char*>(wave_buffers_[i]);
+  // 每个缓冲区正好一个周期，录满后返回，周期决定了录音的延迟
+  wave_buffers_.assign(config_.buffer_count,
+                       std::vector<int8_t>(buffer_bytes));
+  wave_headers_.assign(config_.buffer_count, WAVEHDR{});
+  for (size_t i = 0; i < wave_headers_.size(); ++i) {
+    wave_headers_[i].dwBufferLength = buffer_bytes;
+    wave_headers_[i].lpData = reinterpret_cast<char*>(wave_buffers_[i].data());
     result =
         waveInPrepareHeader(micor_handle_, &wave_headers_[i], sizeof(WAVEHDR));
     if (result != MMSYSERR_NOERROR) {
@@ -180,7 +191,7 @@ void VoiceCapturer::Start() {
   }
 
   result = waveInStart(micor_handle_);
-  if (res != MMSYSERR_NOERROR) {
+  if (result != MMSYSERR_NOERROR) {
     LOG_ERROR(kFilter, "开始录音失败");
     goto end;
   }
@@ -190,7 +201,7 @@ void VoiceCapturer::Start() {
 
 end:
   if (res) {
-    return;
+    return true;
   }
 
   TerminateThread(handle_data_thread_handle_, 0);
@@ -202,12 +213,9 @@ end:
     micor_handle_ = NULL;
   }
 
-  for (int i = 0; i < kWaveHeaderCount; ++i) {
-    if (wave_buffers_[i]) {
-      delete[] wave_buffers_[i];
-      wave_buffers_[i] = nullptr;
-    }
-  }
+  wave_headers_.clear();
+  wave_buffers_.clear();
+  return false;
 }
 
 void VoiceCapturer::Stop() {
@@ -218,8 +226,13 @@ void VoiceCapturer::Stop() {
     return;
   }
 
-  // 发送消息通知录音结束
+  // 发送消息通知录音结束，等待录音线程处理完之前收到的数据，
+  // 之后返回的缓冲区不会再加入录音队列
+  ResetEvent(buffers_event_);
   PostThreadMessage(handle_data_thread_id_, IDM_STOP_CAPTURE, 0, 0);
+  if (WaitForSingleObject(buffers_event_, kStopTimeoutMs) != WAIT_OBJECT_0) {
+    LOG_WARN(kFilter, "等待录音线程处理停止消息超时");
+  }
 
   MMRESULT result = MMSYSERR_NOERROR;
 
@@ -233,10 +246,13 @@ void VoiceCapturer::Stop() {
     goto end;
   }
 
-  // 等待缓冲区结束
-  std::this_thread::sleep_for(std::chrono::seconds(1));
+  // waveInReset把所有缓冲区标记为完成并返回，等待录音线程处理完，
+  // 最后一段不满缓冲区的数据也会送给回调函数
+  if (WaitForSingleObject(buffers_event_, kStopTimeoutMs) != WAIT_OBJECT_0) {
+    LOG_WARN(kFilter, "等待录音缓冲区返回超时");
+  }
 
-  for (int i = 0; i < kWaveHeaderCount; ++i) {
+  for (size_t i = 0; i < wave_headers_.size(); ++i) {
     result = waveInUnprepareHeader(
         micor_handle_, &wave_headers_[i], sizeof(WAVEHDR));
     if (result != MMSYSERR_NOERROR) {
@@ -255,12 +271,8 @@ end:
   handle_data_thread_handle_ = NULL;
   handle_data_thread_id_ = 0;
 
-  for (int i = 0; i < kWaveHeaderCount; ++i) {
-    if (wave_buffers_[i]) {
-      delete[] wave_buffers_[i];
-      wave_buffers_[i] = nullptr;
-    }
-  }
+  wave_headers_.clear();
+  wave_buffers_.clear();
 
   micor_handle_ = NULL;
   device_is_opened_ = false;
@@ -268,6 +280,13 @@ end:
 }
 
 void VoiceCapturer::Pause() {
+  if (!is_recording_) {
+    return;
+  }
+  PostThreadMessage(handle_data_thread_id_, IDM_PAUSE_CAPTURE, 1, 0);
+}
+
+void VoiceCapturer::Resume() {
   if (!is_recording_) {
     return;
   }
@@ -3,35 +3,31 @@
 
 #include <stdint.h>
 
-#include <functional>
+#include <vector>
 
 #include <windows.h>
 #include <mmreg.h>
 #include <mmsystem.h>
 
-class VoiceCapturer {
+#include "capturer/audio_source.h"
+
+// 用waveIn录音，格式为PCM。config.buffer_count个period_ms的缓冲区
+// 轮流交给录音设备，每个缓冲区录满后调用一次回调函数
+class VoiceCapturer : public AudioSource {
  public:
-  // channels: 声道数
-  // samples_per_second: 每秒采样数
-  // bits_per_sample: 每个样本字节数
-  // format_type: 声音格式
-  // handle_voice_callback: 处理声音数据的回调函数，在另外的线程里被触发
-  explicit VoiceCapturer(
-      uint16_t channels,
-      uint32_t samples_per_second,
-      uint16_t bits_per_sample,
-      uint16_t format_type,
-      const std::function<void(const uint8_t* data, int len)>& handle_voice_callback);
-  ~VoiceCapturer();
+  // callback: 处理声音数据的回调函数，在另外的线程里被触发
+  VoiceCapturer(const AudioSourceConfig& config, const DataCallback& callback);
+  ~VoiceCapturer() override;
 
   // 调用waveInStart开始录音
-  void Start();
+  bool Start() override;
 
   // 停止录音
-  void Stop();
+  void Stop() override;
 
-  // 暂停录音
-  void Pause();
+  // 暂停、恢复录音
+  void Pause() override;
+  void Resume() override;
 
  private:
   static DWORD WINAPI HandleVoiceThread(void* param);
@@ -41,7 +37,11 @@ class VoiceCapturer {
                           HWAVEIN wave_handle,
                           WAVEHDR* wave_header);
 
-  static const int kWaveHeaderCount = 4;
+  // 录音线程处理完停止消息和停止后返回所有缓冲区时各通知一次，
+  // Stop据此等待，不用固定的时间
+  HANDLE buffers_event_;
+  // 停止之后返回的缓冲区个数，只在录音线程中访问
+  int returned_buffers_;
 
   // 录音设备是否已打开
   bool device_is_opened_;
@@ -52,21 +52,14 @@ class VoiceCapturer {
   // 调用Start函数的线程ID，确保在同一个线程调用Start和Stop
   DWORD start_thread_id_;
 
-  uint16_t channels_;
-  uint32_t samples_per_second_;
-  uint16_t bits_per_sample_;
-  uint16_t format_type_;
-
   DWORD handle_data_thread_id_;
   HANDLE handle_data_thread_handle_;
 
   WAVEFORMATEX input_format_;
   HWAVEIN micor_handle_;
 
-  int8_t* wave_buffers_[kWaveHeaderCount];
-  WAVEHDR wave_headers_[kWaveHeaderCount];
-
-  std::function<void(const uint8_t* data, int len)> handle_voice_callback_;
+  std::vector<std::vector<int8_t>> wave_buffers_;
+  std::vector<WAVEHDR> wave_headers_;
 
   VoiceCapturer() = delete;
   VoiceCapturer(const VoiceCapturer&) = delete;
@@ -0,0 +1,241 @@
+﻿// 测试混音器的对齐、时钟偏差修正、限幅和CPU占用
+//
+// 用AudioSourceSynthetic模拟采样率、声道数和周期各不相同的输入，
+// 其中一个输入的实际采样率比标称值快0.1%，模拟时钟有偏差的录音设备。
+// 测试音每秒开头响100毫秒，所有输入同时开始，对齐时混音后每次响的时长仍然是
+// 100毫秒，间隔1秒。再加上一个音量很大的白噪声，检查限幅器。
+// 不依赖录音设备，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/audio_mixer/main.cc capturer/audio_mixer.cc
+//       capturer/audio_source.cc capturer/audio_source_synthetic.cc
+//       logger/logger.cc base/threading/thread_role.cc
+//       base/threading/thread_role_posix.cc <base的源文件> -lpthread
+// 用法: audio_mixer [秒数]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "capturer/audio_mixer.h"
+#include "capturer/audio_source_synthetic.h"
+
+namespace {
+
+const int kOutputRate = 44100;
+const int kOutputChannels = 2;
+const int kOutputPeriodMs = 20;
+const int kLatencyMs = 100;
+
+// 模拟的设备时钟偏差
+const double kDriftPpm = 1000;
+
+// 超过这个幅度认为测试音在响
+const int kToneThreshold = 1000;
+const int kToneDurationMs = 100;
+
+// 实际采样率与标称值不同的输入，混音器按标称值处理
+class DriftingSource : public AudioSource {
+ public:
+  DriftingSource(const AudioSourceConfig& config,
+                 double drift_ppm,
+                 const DataCallback& callback)
+      : AudioSource(config, callback) {
+    AudioSourceConfig actual_config = config;
+    actual_config.samples_per_second = static_cast<uint32_t>(
+        llround(config.samples_per_second * (1 + drift_ppm / 1000000)));
+    source_ = std::make_unique<AudioSourceSynthetic>(
+        actual_config, AudioSourceSynthetic::Waveform::TONE, callback);
+  }
+
+  bool Start() override { return source_->Start(); }
+  void Stop() override { source_->Stop(); }
+  void Pause() override { source_->Pause(); }
+  void Resume() override { source_->Resume(); }
+
+ private:
+  std::unique_ptr<AudioSourceSynthetic> source_;
+};
+
+AudioSourceConfig MakeConfig(int channels, int sample_rate, int period_ms) {
+  AudioSourceConfig config;
+  config.channels = static_cast<uint16_t>(channels);
+  config.samples_per_second = sample_rate;
+  config.period_ms = period_ms;
+  return config;
+}
+
+struct Result {
+  std::vector<int16_t> output;
+  std::vector<AudioMixerInputStats> stats;
+  int64_t limited_periods = 0;
+  double cpu_ms_per_second = 0;
+};
+
+Result Run(double seconds, bool with_noise) {
+  Result result;
+  std::mutex mutex;
+  AudioMixer mixer(MakeConfig(kOutputChannels, kOutputRate, kOutputPeriodMs),
+                   kLatencyMs, [&](const uint8_t* data, int len) {
+                     std::lock_guard<std::mutex> locker(mutex);
+                     const int16_t* samples =
+                         reinterpret_cast<const int16_t*>(data);
+                     result.output.insert(result.output.end(), samples,
+                                          samples + len / 2);
+                   });
+
+  using Callback = AudioSource::DataCallback;
+  mixer.AddInput("48kHz单声道", 0.5f, [](const Callback& callback) {
+    return std::unique_ptr<AudioSource>(new AudioSourceSynthetic(
+        MakeConfig(1, 48000, 10), AudioSourceSynthetic::Waveform::TONE,
+        callback));
+  });
+  mixer.AddInput("22.05kHz立体声", 0.5f, [](const Callback& callback) {
+    return std::unique_ptr<AudioSource>(new AudioSourceSynthetic(
+        MakeConfig(2, 22050, 40), AudioSourceSynthetic::Waveform::TONE,
+        callback));
+  });
+  mixer.AddInput("时钟偏快的32kHz", 0.5f, [](const Callback& callback) {
+    return std::unique_ptr<AudioSource>(
+        new DriftingSource(MakeConfig(2, 32000, 40), kDriftPpm, callback));
+  });
+  if (with_noise) {
+    mixer.AddInput("很响的噪声", 8.0f, [](const Callback& callback) {
+      return std::unique_ptr<AudioSource>(new AudioSourceSynthetic(
+          MakeConfig(2, 44100, 40), AudioSourceSynthetic::Waveform::NOISE,
+          callback));
+    });
+  }
+
+  const clock_t cpu_start = clock();
+  if (!mixer.Start()) {
+    return result;
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  mixer.Stop();
+  result.cpu_ms_per_second =
+      static_cast<double>(clock() - cpu_start) / CLOCKS_PER_SEC * 1000 /
+      seconds;
+  result.stats = mixer.input_stats();
+  result.limited_periods = mixer.limited_periods();
+  return result;
+}
+
+void PrintStats(const Result& result) {
+  for (const AudioMixerInputStats& stats : result.stats) {
+    std::cout << "  " << stats.name << ": 来不及混音" << stats.late_frames
+              << "帧，溢出" << stats.overflow_frames << "帧，重新对齐"
+              << stats.resyncs << "次，重采样修正"
+              << stats.correction * 1000000 << "ppm" << std::endl;
+  }
+  std::cout << "  CPU " << result.cpu_ms_per_second << "ms/s" << std::endl;
+}
+
+// 找出每次测试音的开始和结束(输出的帧序号)，返回时长与期望值的最大差
+// 和相邻开始位置与1秒的最大差
+void CheckTones(const std::vector<int16_t>& output) {
+  const int64_t frames = output.size() / kOutputChannels;
+  // 混音器输出的第0帧对应latency之前的时间
+  const int64_t latency_frames =
+      static_cast<int64_t>(kLatencyMs) * kOutputRate / 1000;
+  // 正弦波过零附近的样本幅度小，静音超过这么多帧才认为结束
+  const int64_t gap_frames = kOutputRate / 100;
+
+  std::vector<int64_t> starts;
+  std::vector<int64_t> ends;
+  int64_t last_loud = -gap_frames - 1;
+  for (int64_t i = 0; i < frames; ++i) {
+    if (abs(output[i * kOutputChannels]) < kToneThreshold) {
+      continue;
+    }
+    if (i - last_loud > gap_frames) {
+      if (!starts.empty()) {
+        ends.push_back(last_loud + 1);
+      }
+      starts.push_back(i);
+    }
+    last_loud = i;
+  }
+  if (!starts.empty()) {
+    ends.push_back(last_loud + 1);
+  }
+
+  // 最后一次可能不完整
+  if (starts.size() > 1) {
+    starts.pop_back();
+    ends.pop_back();
+  }
+  double max_duration_error_ms = 0;
+  double max_interval_error_ms = 0;
+  for (size_t i = 0; i < starts.size(); ++i) {
+    const double duration_ms = (ends[i] - starts[i]) * 1000.0 / kOutputRate;
+    max_duration_error_ms = std::max(max_duration_error_ms,
+                                     fabs(duration_ms - kToneDurationMs));
+    if (i > 0) {
+      const double interval_ms =
+          (starts[i] - starts[i - 1]) * 1000.0 / kOutputRate;
+      max_interval_error_ms =
+          std::max(max_interval_error_ms, fabs(interval_ms - 1000));
+    }
+  }
+
+  std::cout << "  测试音" << starts.size() << "次";
+  if (!starts.empty()) {
+    std::cout << "，第一次在输出的"
+              << (starts[0] - latency_frames) * 1000.0 / kOutputRate
+              << "ms(相对开始混音的时间)";
+  }
+  std::cout << "，时长与" << kToneDurationMs << "ms最多相差"
+            << max_duration_error_ms << "ms，间隔与1秒最多相差"
+            << max_interval_error_ms << "ms" << std::endl;
+}
+
+void CheckClipping(const std::vector<int16_t>& output) {
+  int64_t clipped = 0;
+  for (int16_t sample : output) {
+    if (sample >= 32767 || sample <= -32768) {
+      ++clipped;
+    }
+  }
+  std::cout << "  削波" << clipped << "个样本，占"
+            << (output.empty() ? 0 : clipped * 100.0 / output.size()) << "%"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const double seconds = argc > 1 ? atof(argv[1]) : 10.0;
+  if (seconds <= 0) {
+    std::cout << "用法: audio_mixer [秒数]" << std::endl;
+    return 1;
+  }
+
+  std::cout << "输出" << kOutputRate << "Hz立体声，周期" << kOutputPeriodMs
+            << "ms，延迟" << kLatencyMs << "ms，录" << seconds << "秒"
+            << std::endl;
+
+  std::cout << "三路测试音" << std::endl;
+  const Result tones = Run(seconds, false);
+  if (tones.output.empty()) {
+    std::cout << "混音失败" << std::endl;
+    return 1;
+  }
+  CheckTones(tones.output);
+  PrintStats(tones);
+
+  std::cout << "三路测试音加上增益为8的白噪声" << std::endl;
+  const Result noise = Run(seconds, true);
+  std::cout << "  限幅器压低音量的周期" << noise.limited_periods << "个"
+            << std::endl;
+  CheckClipping(noise.output);
+  PrintStats(noise);
+  return 0;
+}
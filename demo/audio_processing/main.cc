@@ -0,0 +1,214 @@
+﻿// 测试录音处理(高通滤波、噪声门、自动增益和限幅)的效果和CPU占用
+//
+// 生成48kHz立体声的模拟旁白：音量差别很大的几段"说话"(150Hz的谐波，
+// 按每秒4个音节调制)，中间有停顿，全程叠加50Hz的电源嗡嗡声和底噪。
+// 统计处理前后的嗡嗡声、停顿时的底噪、各段说话的音量差别和峰值，
+// 再按录屏的40毫秒周期反复处理，计算占用一个CPU核的比例，要求低于1%。
+// 不依赖录音设备，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/audio_processing/main.cc
+//       capturer/audio_processor.cc capturer/audio_dsp.cc
+// 用法: audio_processing [反复处理的秒数]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "capturer/audio_processor.h"
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+const int kSampleRate = 48000;
+const int kChannels = 2;
+// 录屏时每次送来的数据时长
+const int kPeriodMs = 40;
+
+// 每段说话的电平(dBFS，按RMS)，后面跟着一段停顿
+const double kSpeechLevelsDb[] = {-38, -16, -30, -10, -44, -22, -34, -18};
+const double kSpeechSeconds = 4.0;
+const double kPauseSeconds = 1.0;
+
+const double kHumFrequency = 50.0;
+const double kHumLevelDb = -40.0;
+const double kNoiseLevelDb = -60.0;
+
+// 要求的CPU占用上限(%)
+const double kCpuBudgetPercent = 1.0;
+
+struct Segment {
+  int64_t begin;
+  int64_t end;
+};
+
+double DbToAmplitude(double db) {
+  return pow(10.0, db / 20.0);
+}
+
+double RmsDb(const std::vector<int16_t>& samples, const Segment& segment) {
+  double sum = 0;
+  for (int64_t i = segment.begin * kChannels; i < segment.end * kChannels;
+       ++i) {
+    const double value = samples[i] / 32768.0;
+    sum += value * value;
+  }
+  const double count = static_cast<double>(segment.end - segment.begin) *
+                       kChannels;
+  return 10 * log10(sum / count + 1e-12);
+}
+
+// 用Goertzel算法计算左声道在frequency上的幅度(dBFS)
+double ToneDb(const std::vector<int16_t>& samples,
+              const Segment& segment,
+              double frequency) {
+  const double coefficient = 2 * cos(2 * kPi * frequency / kSampleRate);
+  double s1 = 0;
+  double s2 = 0;
+  for (int64_t i = segment.begin; i < segment.end; ++i) {
+    const double s0 = samples[i * kChannels] / 32768.0 + coefficient * s1 - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  const double power = s1 * s1 + s2 * s2 - coefficient * s1 * s2;
+  const double amplitude =
+      2 * sqrt(std::max(power, 0.0)) / (segment.end - segment.begin);
+  return 20 * log10(amplitude + 1e-12);
+}
+
+// 生成模拟的旁白，返回说话和停顿的位置
+std::vector<int16_t> GenerateNarration(std::vector<Segment>* speech,
+                                       std::vector<Segment>* pauses) {
+  std::mt19937 random(1);
+  std::normal_distribution<double> noise(0.0, DbToAmplitude(kNoiseLevelDb));
+  // 正弦波的RMS是幅度的0.707倍
+  const double hum_amplitude = DbToAmplitude(kHumLevelDb) * sqrt(2.0);
+
+  std::vector<int16_t> samples;
+  int64_t frame = 0;
+  for (double level_db : kSpeechLevelsDb) {
+    const int64_t speech_frames =
+        static_cast<int64_t>(kSpeechSeconds * kSampleRate);
+    const int64_t pause_frames =
+        static_cast<int64_t>(kPauseSeconds * kSampleRate);
+    speech->push_back({frame, frame + speech_frames});
+    pauses->push_back({frame + speech_frames,
+                       frame + speech_frames + pause_frames});
+
+    // 5个谐波的RMS约为单个正弦波的1.8倍，包络的RMS约为0.61
+    const double speech_amplitude =
+        DbToAmplitude(level_db) * sqrt(2.0) / 1.8 / 0.61;
+    for (int64_t i = 0; i < speech_frames + pause_frames; ++i, ++frame) {
+      const double t = static_cast<double>(frame) / kSampleRate;
+      double value = hum_amplitude * sin(2 * kPi * kHumFrequency * t);
+      if (i < speech_frames) {
+        const double envelope = 0.5 - 0.5 * cos(2 * kPi * 4 * t);
+        double voice = 0;
+        for (int harmonic = 1; harmonic <= 5; ++harmonic) {
+          voice += sin(2 * kPi * 150 * harmonic * t) / harmonic;
+        }
+        value += speech_amplitude * envelope * voice;
+      }
+      for (int c = 0; c < kChannels; ++c) {
+        const double sample = (value + noise(random)) * 32768.0;
+        samples.push_back(static_cast<int16_t>(
+            std::min(std::max(sample, -32768.0), 32767.0)));
+      }
+    }
+  }
+  return samples;
+}
+
+// 按录屏的周期送给处理器
+void ProcessInPeriods(AudioProcessor* processor,
+                      std::vector<int16_t>* samples) {
+  const int period_frames = kSampleRate * kPeriodMs / 1000;
+  const int64_t frames = samples->size() / kChannels;
+  for (int64_t offset = 0; offset < frames; offset += period_frames) {
+    const int count =
+        static_cast<int>(std::min<int64_t>(period_frames, frames - offset));
+    processor->Process(samples->data() + offset * kChannels, count);
+  }
+}
+
+void PrintLevels(const char* name,
+                 const std::vector<int16_t>& samples,
+                 const std::vector<Segment>& speech,
+                 const std::vector<Segment>& pauses) {
+  double min_speech_db = 0;
+  double max_speech_db = -200;
+  double max_hum_db = -200;
+  double max_pause_db = -200;
+  for (size_t i = 0; i < speech.size(); ++i) {
+    const double speech_db = RmsDb(samples, speech[i]);
+    min_speech_db = std::min(min_speech_db, speech_db);
+    max_speech_db = std::max(max_speech_db, speech_db);
+    // 停顿开头噪声门还没有关上，跳过前半段
+    const Segment pause = {(pauses[i].begin + pauses[i].end) / 2,
+                           pauses[i].end};
+    max_pause_db = std::max(max_pause_db, RmsDb(samples, pause));
+    max_hum_db = std::max(max_hum_db, ToneDb(samples, pause, kHumFrequency));
+  }
+  int peak = 0;
+  for (int16_t sample : samples) {
+    peak = std::max(peak, abs(static_cast<int>(sample)));
+  }
+
+  std::cout << name << ": 说话" << min_speech_db << "~" << max_speech_db
+            << "dBFS(相差" << max_speech_db - min_speech_db << "dB)，停顿"
+            << max_pause_db << "dBFS，50Hz嗡嗡声" << max_hum_db
+            << "dBFS，峰值" << 20 * log10(peak / 32768.0) << "dBFS"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const double benchmark_seconds = argc > 1 ? atof(argv[1]) : 600.0;
+  if (benchmark_seconds <= 0) {
+    std::cout << "用法: audio_processing [反复处理的秒数]" << std::endl;
+    return 1;
+  }
+
+  std::vector<Segment> speech;
+  std::vector<Segment> pauses;
+  const std::vector<int16_t> input = GenerateNarration(&speech, &pauses);
+  const double input_seconds =
+      static_cast<double>(input.size()) / kChannels / kSampleRate;
+
+  AudioProcessorConfig config;
+  std::vector<int16_t> output = input;
+  AudioProcessor processor(config, kChannels, kSampleRate);
+  ProcessInPeriods(&processor, &output);
+
+  std::cout << kSampleRate << "Hz立体声，" << input_seconds << "秒，每次"
+            << kPeriodMs << "ms" << std::endl;
+  PrintLevels("处理前", input, speech, pauses);
+  PrintLevels("处理后", output, speech, pauses);
+  std::cout << "限幅器压低音量的块" << processor.limited_blocks() << "个"
+            << std::endl;
+
+  // 反复处理同一段数据，每次从原始数据开始
+  std::vector<int16_t> buffer;
+  double audio_seconds = 0;
+  std::chrono::steady_clock::duration elapsed{};
+  while (audio_seconds < benchmark_seconds) {
+    buffer = input;
+    const auto start = std::chrono::steady_clock::now();
+    ProcessInPeriods(&processor, &buffer);
+    elapsed += std::chrono::steady_clock::now() - start;
+    audio_seconds += input_seconds;
+  }
+  const double cpu_percent =
+      std::chrono::duration<double>(elapsed).count() / audio_seconds * 100;
+  std::cout << "处理" << audio_seconds << "秒的声音耗时"
+            << std::chrono::duration<double, std::milli>(elapsed).count()
+            << "ms，占用一个CPU核的" << cpu_percent << "%，要求低于"
+            << kCpuBudgetPercent << "%" << std::endl;
+  return cpu_percent < kCpuBudgetPercent ? 0 : 1;
+}
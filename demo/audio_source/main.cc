@@ -0,0 +1,137 @@
+﻿// 测试录音来源的周期对延迟和CPU占用的影响
+//
+// 用AudioSourceSynthetic(或者指定的WAV文件)按不同的周期录音若干秒，
+// 统计回调相对预定时间的延迟、回调间隔的抖动、晚了一个周期以上的次数，
+// 以及整个进程的CPU时间。录音的延迟至少是一个周期，加上回调的延迟。
+// 不依赖录音设备，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/audio_source/main.cc capturer/audio_source.cc
+//       capturer/audio_source_synthetic.cc capturer/audio_source_wav.cc
+//       logger/logger.cc base/threading/thread_role.cc
+//       base/threading/thread_role_posix.cc <base的源文件> -lpthread
+// 用法: audio_source [秒数] [16位PCM、双声道、44100Hz的WAV文件]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capturer/audio_source_synthetic.h"
+#include "capturer/audio_source_wav.h"
+
+namespace {
+
+// 测试的周期(毫秒)，40毫秒是录屏的默认值，250毫秒相当于原来waveIn的缓冲区
+const int kPeriodsMs[] = {5, 10, 20, 40, 100, 250};
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  int64_t callbacks = 0;
+  int64_t bytes = 0;
+  int64_t late_periods = 0;
+  double mean_delay_us = 0;
+  double max_delay_us = 0;
+  // 相邻两次回调的间隔与周期的差
+  double max_jitter_us = 0;
+  // 每秒声音消耗的CPU时间(毫秒)
+  double cpu_ms_per_second = 0;
+};
+
+Result Run(int period_ms, double seconds, const std::string& wav_path) {
+  AudioSourceConfig config;
+  config.period_ms = period_ms;
+
+  std::mutex mutex;
+  std::vector<Clock::time_point> callback_times;
+  int64_t bytes = 0;
+  auto callback = [&](const uint8_t* /*data*/, int len) {
+    std::lock_guard<std::mutex> locker(mutex);
+    callback_times.push_back(Clock::now());
+    bytes += len;
+  };
+
+  std::unique_ptr<PacedAudioSource> source;
+  if (wav_path.empty()) {
+    source = std::make_unique<AudioSourceSynthetic>(
+        config, AudioSourceSynthetic::Waveform::NOISE, callback);
+  } else {
+    source = std::make_unique<AudioSourceWav>(config, wav_path, true,
+                                              callback);
+  }
+
+  Result result;
+  const clock_t cpu_start = clock();
+  const Clock::time_point start = Clock::now();
+  if (!source->Start()) {
+    return result;
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  source->Stop();
+  const double cpu_seconds =
+      static_cast<double>(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+  // 第n次回调预定在 start + n * 周期 发生，周期按取整后的帧数计算
+  const double period_us = 1000000.0 * config.PeriodBytes() /
+                           config.BytesPerFrame() / config.samples_per_second;
+  double total_delay_us = 0;
+  for (size_t i = 0; i < callback_times.size(); ++i) {
+    const double delay_us =
+        std::chrono::duration<double, std::micro>(callback_times[i] - start)
+            .count() -
+        period_us * (i + 1);
+    total_delay_us += delay_us;
+    result.max_delay_us = std::max(result.max_delay_us, delay_us);
+    if (i > 0) {
+      const double interval_us = std::chrono::duration<double, std::micro>(
+          callback_times[i] - callback_times[i - 1]).count();
+      result.max_jitter_us = std::max(
+          result.max_jitter_us, fabs(interval_us - period_us));
+    }
+  }
+  result.callbacks = static_cast<int64_t>(callback_times.size());
+  result.bytes = bytes;
+  result.late_periods = source->late_periods();
+  if (result.callbacks > 0) {
+    result.mean_delay_us = total_delay_us / result.callbacks;
+  }
+  result.cpu_ms_per_second = cpu_seconds * 1000.0 / seconds;
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const double seconds = argc > 1 ? atof(argv[1]) : 5.0;
+  const std::string wav_path = argc > 2 ? argv[2] : "";
+  if (seconds <= 0) {
+    std::cout << "用法: audio_source [秒数] [WAV文件]" << std::endl;
+    return 1;
+  }
+
+  std::cout << (wav_path.empty() ? std::string("白噪声") : wav_path)
+            << "，每种周期" << seconds << "秒" << std::endl;
+  for (int period_ms : kPeriodsMs) {
+    const Result result = Run(period_ms, seconds, wav_path);
+    if (result.callbacks == 0) {
+      std::cout << "周期" << period_ms << "ms: 录音失败" << std::endl;
+      return 1;
+    }
+    std::cout << "周期" << period_ms << "ms: " << result.callbacks << "次回调，"
+              << result.bytes << "字节，回调平均延迟" << result.mean_delay_us
+              << "us，最大延迟" << result.max_delay_us << "us，最大抖动"
+              << result.max_jitter_us << "us，晚一个周期以上"
+              << result.late_periods << "次，录音延迟约"
+              << period_ms + result.mean_delay_us / 1000 << "ms，CPU "
+              << result.cpu_ms_per_second << "ms/s" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+﻿// 测试音视频时钟同步
+//
+// 模拟一个时钟有偏差的录音设备，在虚拟时间上运行几个小时的录制，
+// 按AVMuxer的方式用AudioClockSync计算补偿，用理想的重采样器代替swresample，
+// 统计音频在输出时间轴上的位置与采集时间的偏差。
+// 中途暂停一次，检查暂停恢复后的处理。
+// 不依赖FFmpeg和系统接口，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/av_sync/main.cc capturer/media_clock.cc
+//       encoder/audio_clock_sync.cc <base的源文件> -lpthread
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include "capturer/media_clock.h"
+#include "encoder/audio_clock_sync.h"
+
+namespace {
+
+const int kSampleRate = 44100;
+// 编码器每帧的样本数
+const int kFrameSize = 1024;
+// 采集时间最大的抖动(微秒)
+const int64_t kMaxJitterUs = 5000;
+
+struct Result {
+  double max_offset_ms;
+  double final_offset_ms;
+  double drift_ppm;
+  int64_t resync_count;
+};
+
+// skew_ppm: 设备时钟的偏差，正数表示设备偏快，实际采样率高于标称值
+// chunk_samples: 每次回调的样本数
+Result Run(double skew_ppm, int chunk_samples, double hours) {
+  // 虚拟时间，微秒
+  int64_t now_us = 0;
+  MediaClock clock([&now_us]() { return now_us; });
+  clock.Start();
+
+  AudioClockSync clock_sync(kSampleRate);
+  std::mt19937 random(12345);
+  std::uniform_int_distribution<int64_t> jitter(0, kMaxJitterUs);
+
+  // 在录制进行到一半时暂停5分钟
+  const int64_t duration_us = static_cast<int64_t>(hours * 3600e6);
+  const int64_t pause_start_us = duration_us / 2;
+  const int64_t pause_end_us = pause_start_us + 300 * 1000000LL;
+  bool paused = false;
+  bool resumed = false;
+  bool resume_handled = false;
+
+  const double device_rate = kSampleRate * (1.0 + skew_ppm / 1e6);
+  int64_t device_samples = 0;
+
+  bool audio_started = false;
+  // 下一帧的时间戳和缓冲区中的样本数，与AVMuxer一致
+  int64_t audio_pts = 0;
+  double fifo_samples = 0.0;
+
+  Result result = {0.0, 0.0, 0.0, 0};
+  while (true) {
+    // 设备采集这一段数据的真实时间
+    const int64_t first_us =
+        llround(device_samples * 1e6 / device_rate);
+    device_samples += chunk_samples;
+    const int64_t last_us = llround(device_samples * 1e6 / device_rate);
+    const int64_t deliver_us = last_us + jitter(random);
+    if (deliver_us > duration_us + (pause_end_us - pause_start_us)) {
+      break;
+    }
+
+    if (!paused && deliver_us >= pause_start_us) {
+      now_us = pause_start_us;
+      clock.Pause();
+      paused = true;
+    }
+    if (paused && !resumed && deliver_us >= pause_end_us) {
+      now_us = pause_end_us;
+      clock.Resume();
+      resumed = true;
+    }
+    now_us = deliver_us;
+
+    // 暂停时收到的数据直接丢弃，与VoiceCapturer一致
+    if (paused && !resumed) {
+      continue;
+    }
+    // 恢复后的第一段数据包含暂停期间的声音，不统计偏差
+    const bool spans_pause = paused && first_us < pause_end_us;
+
+    const int64_t timestamp = std::max<int64_t>(
+        clock.Now() - chunk_samples * 1000000LL / kSampleRate, 0);
+    if (!audio_started) {
+      audio_pts = timestamp * kSampleRate / 1000000;
+      audio_started = true;
+    }
+
+    double input = chunk_samples;
+    const int64_t position = audio_pts + static_cast<int64_t>(fifo_samples);
+    const int64_t correction =
+        clock_sync.Update(timestamp, position, spans_pause && !resume_handled);
+    resume_handled |= spans_pause;
+    if (correction > 0) {
+      audio_pts += correction;
+    } else if (correction < 0) {
+      double drop = static_cast<double>(-correction);
+      const double drained = std::min(drop, fifo_samples);
+      fifo_samples -= drained;
+      drop -= drained;
+      input = std::max(input - drop, 0.0);
+    }
+
+    // 理想的重采样器，按补偿比例增减样本
+    const int64_t chunk_position =
+        audio_pts + static_cast<int64_t>(fifo_samples);
+    fifo_samples += input * (1.0 + clock_sync.compensation());
+    while (fifo_samples >= kFrameSize) {
+      fifo_samples -= kFrameSize;
+      audio_pts += kFrameSize;
+    }
+
+    if (!spans_pause && input == chunk_samples) {
+      // 这一段第一个样本在输出文件中的时间与它实际被采集时的媒体时间之差
+      const int64_t media_us =
+          first_us - (resumed ? pause_end_us - pause_start_us : 0);
+      const double offset_ms =
+          (chunk_position * 1e6 / kSampleRate - media_us) / 1000.0;
+      result.max_offset_ms = std::max(result.max_offset_ms, fabs(offset_ms));
+      result.final_offset_ms = offset_ms;
+    }
+  }
+
+  result.drift_ppm = clock_sync.drift_ppm();
+  result.resync_count = clock_sync.resync_count();
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const double hours = argc > 1 ? atof(argv[1]) : 4.0;
+  if (hours <= 0) {
+    std::cout << "用法: av_sync [小时数]" << std::endl;
+    return 1;
+  }
+
+  const double skews[] = {0.0, 50.0, -120.0, 300.0, -1000.0};
+  const int chunks[] = {441, 11025};
+  for (double skew : skews) {
+    for (int chunk : chunks) {
+      const Result result = Run(skew, chunk, hours);
+      std::cout << "设备时钟偏差: " << skew << "ppm，每次" << chunk
+                << "个样本，录制" << hours << "小时" << std::endl;
+      std::cout << "  最大偏差: " << result.max_offset_ms
+                << "ms，结束时偏差: " << result.final_offset_ms
+                << "ms，估计的时钟偏差: " << result.drift_ppm
+                << "ppm，立即修正: " << result.resync_count << "次"
+                << std::endl;
+    }
+  }
+  return 0;
+}
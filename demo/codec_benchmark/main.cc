@@ -0,0 +1,244 @@
+﻿// 对比各视频编码器在模拟桌面画面上的速度和文件大小
+//
+// 用PictureCapturerSynthetic生成相同的画面序列(静止、打字、滚动、切换场景)，
+// 依次用x264、x265、SVT-AV1和libvpx-vp9编码成mkv，preset和crf都按x264的
+// 含义给出，由VideoEncoder换算成各编码器相近的参数。
+// 参数：宽 高 帧数 preset crf，默认为1920 1080 1022 veryfast 18。
+// 第一个参数为lossless时对比无损编码器(x264 RGB、FFV1、UT Video)，每个编码器
+// 分别测试全关键帧和半秒一个关键帧，按60帧/秒报告能否实时编码，
+// 默认为2560 1440。
+// FFmpeg没有编译进的编码器会被跳过。
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <windows.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "capturer/av_data.h"
+#include "capturer/picture_capturer_synthetic.h"
+#include "encoder/av_config.h"
+#include "encoder/av_muxer.h"
+#include "encoder/muxer_sink.h"
+
+namespace {
+
+const int kFps = 30;
+// 无损编码的目标帧率
+const int kLosslessFps = 60;
+// PictureCapturerSynthetic的画面序列两个循环的长度
+const int kDefaultFrames = 1022;
+
+const int64_t kMicrosecondsPerSecond = 1000000;
+
+struct CodecInfo {
+  AVCodecID codec_id;
+  const char* encoder_name;
+  // 用于输出文件名和结果
+  const char* label;
+  bool lossless;
+  // 关键帧间隔(帧)，0表示10秒
+  int gop_size;
+};  // struct CodecInfo
+
+const CodecInfo kCodecList[] = {
+    {AV_CODEC_ID_H264, "libx264", "libx264", false, 0},
+    {AV_CODEC_ID_HEVC, "libx265", "libx265", false, 0},
+    {AV_CODEC_ID_AV1, "libsvtav1", "libsvtav1", false, 0},
+    {AV_CODEC_ID_VP9, "libvpx-vp9", "libvpx-vp9", false, 0},
+};
+
+// UT Video只有帧内编码
+const CodecInfo kLosslessCodecList[] = {
+    {AV_CODEC_ID_H264, "libx264rgb", "libx264rgb_intra", true, 1},
+    {AV_CODEC_ID_H264, "libx264rgb", "libx264rgb_gop", true,
+     kLosslessFps / 2},
+    {AV_CODEC_ID_FFV1, "ffv1", "ffv1_intra", true, 1},
+    {AV_CODEC_ID_FFV1, "ffv1", "ffv1_gop", true, kLosslessFps / 2},
+    {AV_CODEC_ID_UTVIDEO, "utvideo", "utvideo", true, 1},
+};
+
+using Clock = std::chrono::steady_clock;
+
+// 进程所有线程占用的CPU时间(秒)，包括内核态
+double ProcessCpuSeconds() {
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time,
+                       &kernel_time, &user_time)) {
+    return 0.0;
+  }
+  ULARGE_INTEGER kernel, user;
+  kernel.LowPart = kernel_time.dwLowDateTime;
+  kernel.HighPart = kernel_time.dwHighDateTime;
+  user.LowPart = user_time.dwLowDateTime;
+  user.HighPart = user_time.dwHighDateTime;
+  // FILETIME的单位是100纳秒
+  return (kernel.QuadPart + user.QuadPart) / 1e7;
+}
+
+int64_t FileSize(const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  return file ? static_cast<int64_t>(file.tellg()) : -1;
+}
+
+struct Result {
+  std::string label;
+  double encode_s;
+  double cpu_s;
+  int64_t file_bytes;
+};  // struct Result
+
+// 编码frames帧，失败时返回false
+bool RunCodec(const CodecInfo& codec,
+              int width,
+              int height,
+              int fps,
+              int frames,
+              const std::string& preset,
+              int crf,
+              Result* result) {
+  VideoConfig video_config;
+  video_config.fps = fps;
+  video_config.width = width;
+  video_config.height = height;
+  video_config.input_pixel_format = AV_PIX_FMT_RGB32;
+  video_config.codec_id = codec.codec_id;
+  video_config.encoder_name = codec.encoder_name;
+  video_config.max_gop_size = fps * 10;
+  video_config.min_gop_size = fps / 2;
+  video_config.preset = preset;
+  video_config.crf = crf;
+  if (codec.lossless) {
+    video_config.lossless = true;
+    video_config.max_b_frames = 0;
+    video_config.enable_roi = false;
+  }
+  if (codec.gop_size > 0) {
+    video_config.max_gop_size = codec.gop_size;
+    video_config.min_gop_size = codec.gop_size;
+  }
+
+  const std::string path =
+      std::string("codec_benchmark_") + codec.label + ".mkv";
+  if (!MuxerSink::SupportsCodec(path, std::string(), codec.codec_id)) {
+    return false;
+  }
+
+  PictureCapturerSynthetic capturer(width, height);
+  const double cpu_start = ProcessCpuSeconds();
+  const auto start = Clock::now();
+  {
+    AVMuxer av_muxer(AudioConfig(), video_config, path, false);
+    if (!av_muxer.Initialize() || !av_muxer.Open()) {
+      return false;
+    }
+
+    for (int i = 0; i < frames; ++i) {
+      AVData* av_data = nullptr;
+      if (!capturer.CaptureScreen(&av_data) || !av_data) {
+        return false;
+      }
+      std::unique_ptr<AVData> frame(av_data);
+
+      VideoFrameInfo frame_info;
+      frame_info.change_ratio = frame->change_ratio;
+      for (const DirtyRect& rect : frame->dirty_rects) {
+        frame_info.dirty_rects.push_back(
+            {rect.left, rect.top, rect.right, rect.bottom});
+      }
+      const int64_t time_stamp =
+          static_cast<int64_t>(i) * kMicrosecondsPerSecond / fps;
+      if (!av_muxer.EncodeVideoFrame(frame->data, frame->width,
+                                     frame->height,
+                                     frame->len / frame->height, time_stamp,
+                                     frame_info)) {
+        return false;
+      }
+    }
+  }
+
+  result->label = codec.label;
+  result->encode_s =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  result->cpu_s = ProcessCpuSeconds() - cpu_start;
+  result->file_bytes = FileSize(path);
+  return result->file_bytes > 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const bool lossless = argc > 1 && std::string(argv[1]) == "lossless";
+  // 跳过lossless，其余参数的位置不变
+  if (lossless) {
+    --argc;
+    ++argv;
+  }
+  const int width = argc > 1 ? atoi(argv[1]) : lossless ? 2560 : 1920;
+  const int height = argc > 2 ? atoi(argv[2]) : lossless ? 1440 : 1080;
+  const int frames = argc > 3 ? atoi(argv[3]) : kDefaultFrames;
+  const std::string preset = argc > 4 ? argv[4] : "veryfast";
+  const int crf = argc > 5 ? atoi(argv[5]) : 18;
+  if (width <= 0 || height <= 0 || (width & 1) || (height & 1) ||
+      frames <= 0) {
+    std::cerr << "用法: codec_benchmark [lossless] [宽] [高] [帧数] [preset] "
+                 "[crf]"
+              << std::endl;
+    return 1;
+  }
+
+  const int fps = lossless ? kLosslessFps : kFps;
+  std::cerr << width << "x" << height << "@" << fps << "，" << frames
+            << "帧，preset " << preset;
+  if (!lossless) {
+    std::cerr << "，crf " << crf;
+  }
+  std::cerr << std::endl;
+
+  std::vector<CodecInfo> codecs;
+  if (lossless) {
+    codecs.assign(std::begin(kLosslessCodecList),
+                  std::end(kLosslessCodecList));
+  } else {
+    codecs.assign(std::begin(kCodecList), std::end(kCodecList));
+  }
+
+  std::vector<Result> results;
+  for (const CodecInfo& codec : codecs) {
+    Result result;
+    if (!RunCodec(codec, width, height, fps, frames, preset, crf, &result)) {
+      std::cerr << codec.label << ": 不可用，跳过" << std::endl;
+      continue;
+    }
+    results.push_back(result);
+  }
+  if (results.empty()) {
+    return 1;
+  }
+
+  // 以第一个可用的编码器(一般是x264)为基准
+  const Result& base = results.front();
+  const double duration_s = static_cast<double>(frames) / fps;
+  for (const Result& result : results) {
+    const double encode_fps = frames / result.encode_s;
+    std::cerr << result.label << ": 编码" << encode_fps << "帧/秒";
+    // 无损编码用于实时录制，报告相对于目标帧率的余量
+    if (lossless) {
+      std::cerr << "(" << encode_fps / fps << "倍实时)";
+    }
+    std::cerr << "，CPU时间"
+              << result.cpu_s << "秒，文件" << result.file_bytes / 1024
+              << "KB(" << result.file_bytes * 100 / base.file_bytes
+              << "%)，平均码率"
+              << result.file_bytes * 8 / duration_s / 1000 << "kbps"
+              << std::endl;
+  }
+  return 0;
+}
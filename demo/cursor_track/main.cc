@@ -0,0 +1,249 @@
+﻿// 测试鼠标轨迹文件的写入、读取和导出时的光标合成
+//
+// 用SyntheticDesktop生成30fps的画面，模拟录屏时单独记录的鼠标轨迹：光标沿着
+// 超出屏幕边缘的曲线移动，中间停住、切换形状和隐藏，记录方式与CursorCapturer
+// 相同(只在变化时写入位置，每个形状只写入一次)。录制时把当时的光标直接绘制到
+// 画面中作为参照，再用CursorTrackReader读回轨迹、CursorCompositor合成到同样的
+// 画面中，逐帧比较两者是否完全一致，并统计轨迹文件的大小和合成的耗时。
+// 不依赖系统光标，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/cursor_track/main.cc capturer/cursor_track.cc
+//       capturer/synthetic_desktop.cc <base的源文件>
+// 用法: cursor_track [秒数] [轨迹文件路径]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "capturer/cursor_track.h"
+#include "capturer/synthetic_desktop.h"
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+const int kWidth = 1280;
+const int kHeight = 720;
+const int kFps = 30;
+
+// 光标形状的编号，与CursorCapturer一样从1开始
+const uint32_t kArrowShapeId = 1;
+const uint32_t kBeamShapeId = 2;
+
+// 每个周期内光标的动作(秒)：先移动，再停住，然后隐藏一会儿
+const double kCycleSeconds = 4.0;
+const double kStillSeconds = 1.0;
+const double kHiddenSeconds = 0.5;
+
+// 箭头：白色填充、黑色边框，右下方有半透明的阴影
+CursorShape MakeArrow() {
+  CursorShape shape;
+  shape.id = kArrowShapeId;
+  shape.width = 24;
+  shape.height = 32;
+  shape.pixels.assign(shape.width * shape.height * 4, 0);
+  auto inside = [](int x, int y) { return y < 24 && x <= y / 2 + 1; };
+  for (int y = 0; y < shape.height; ++y) {
+    for (int x = 0; x < shape.width; ++x) {
+      uint8_t* pixel = &shape.pixels[(y * shape.width + x) * 4];
+      if (inside(x, y)) {
+        const bool border = !inside(x + 1, y) || !inside(x, y + 1) || x == 0;
+        const uint8_t value = border ? 0 : 255;
+        pixel[0] = pixel[1] = pixel[2] = value;
+        pixel[3] = 255;
+      } else if (x >= 2 && y >= 2 && inside(x - 2, y - 2)) {
+        pixel[3] = 96;
+      }
+    }
+  }
+  return shape;
+}
+
+// 文本光标：不透明的黑色竖线，热点在中间
+CursorShape MakeBeam() {
+  CursorShape shape;
+  shape.id = kBeamShapeId;
+  shape.width = 9;
+  shape.height = 20;
+  shape.hotspot_x = 4;
+  shape.hotspot_y = 10;
+  shape.pixels.assign(shape.width * shape.height * 4, 0);
+  for (int y = 0; y < shape.height; ++y) {
+    for (int x = 0; x < shape.width; ++x) {
+      if (x == 4 || y == 0 || y == shape.height - 1) {
+        shape.pixels[(y * shape.width + x) * 4 + 3] = 255;
+      }
+    }
+  }
+  return shape;
+}
+
+// timestamp时刻的光标状态，坐标会超出屏幕，检查合成时的裁剪
+CursorState StateAt(uint64_t timestamp) {
+  const double t = timestamp / 1000.0;
+  const double cycle_time = fmod(t, kCycleSeconds);
+  const double move_seconds = kCycleSeconds - kStillSeconds - kHiddenSeconds;
+  // 停住时保持在移动结束的位置
+  const double motion_t = floor(t / kCycleSeconds) * move_seconds +
+                          std::min(cycle_time, move_seconds);
+
+  CursorState state;
+  state.timestamp = timestamp;
+  state.x = static_cast<int>(kWidth / 2 +
+                             kWidth * 0.55 * sin(2 * kPi * motion_t / 5.0));
+  state.y = static_cast<int>(kHeight / 2 +
+                             kHeight * 0.55 * sin(2 * kPi * motion_t / 3.3));
+  state.visible = cycle_time < kCycleSeconds - kHiddenSeconds;
+  // 每隔一个周期换成文本光标
+  state.shape_id =
+      static_cast<int64_t>(t / kCycleSeconds) % 2 ? kBeamShapeId
+                                                   : kArrowShapeId;
+  return state;
+}
+
+// 复制SyntheticDesktop的当前画面
+void CopyFrame(const SyntheticDesktop& desktop, std::vector<uint8_t>* frame) {
+  memcpy(frame->data(), desktop.pixels(), frame->size());
+}
+
+uint64_t HashFrame(const std::vector<uint8_t>& frame) {
+  // FNV-1a，按64位读取
+  uint64_t hash = 1469598103934665603ULL;
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(frame.data());
+  for (size_t i = 0; i < frame.size() / 8; ++i) {
+    hash = (hash ^ words[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const double seconds = argc > 1 ? atof(argv[1]) : 20.0;
+  const std::string path = argc > 2 ? argv[2] : "cursor_track.cursor";
+  if (seconds <= 0) {
+    std::cout << "用法: cursor_track [秒数] [轨迹文件路径]" << std::endl;
+    return 1;
+  }
+  const int frame_count = static_cast<int>(seconds * kFps);
+  const int stride = kWidth * 4;
+
+  const CursorShape shapes[] = {MakeArrow(), MakeBeam()};
+  std::vector<uint8_t> frame(kWidth * kHeight * 4);
+  std::vector<uint64_t> expected_hashes;
+  expected_hashes.reserve(frame_count);
+
+  // 录制：按CursorCapturer的方式写入轨迹，同时把光标直接绘制到画面中作为参照
+  CursorTrackWriter writer;
+  if (!writer.Open(path)) {
+    std::cout << "创建轨迹文件失败: " << path << std::endl;
+    return 1;
+  }
+  int position_records = 0;
+  int shape_records = 0;
+  bool written_shapes[] = {false, false};
+  CursorState last_state;
+  bool has_last_state = false;
+  {
+    SyntheticDesktop desktop(kWidth, kHeight);
+    for (int i = 0; i < frame_count; ++i) {
+      desktop.NextFrame();
+      const uint64_t timestamp = static_cast<uint64_t>(i) * 1000 / kFps;
+      const CursorState state = StateAt(timestamp);
+      const CursorShape& shape = shapes[state.shape_id - 1];
+
+      std::vector<uint8_t> records;
+      if (state.visible && !written_shapes[state.shape_id - 1]) {
+        written_shapes[state.shape_id - 1] = true;
+        CursorTrack::AppendShapeRecord(timestamp, shape, &records);
+        ++shape_records;
+      }
+      const bool changed =
+          !has_last_state || state.visible != last_state.visible ||
+          (state.visible &&
+           (state.x != last_state.x || state.y != last_state.y ||
+            state.shape_id != last_state.shape_id));
+      if (changed) {
+        has_last_state = true;
+        last_state = state;
+        CursorTrack::AppendPositionRecord(state, &records);
+        ++position_records;
+      }
+      if (!records.empty() &&
+          !writer.Write(records.data(), static_cast<int>(records.size()))) {
+        std::cout << "写入轨迹文件失败" << std::endl;
+        return 1;
+      }
+
+      CopyFrame(desktop, &frame);
+      if (state.visible) {
+        CursorCompositor::Blend(shape, state.x - shape.hotspot_x,
+                                state.y - shape.hotspot_y, frame.data(),
+                                kWidth, kHeight, stride);
+      }
+      expected_hashes.push_back(HashFrame(frame));
+    }
+  }
+  writer.Close();
+
+  // 导出：读回轨迹，把光标合成到没有光标的画面中
+  const auto read_start = std::chrono::steady_clock::now();
+  CursorTrackReader reader;
+  if (!reader.Open(path)) {
+    std::cout << "读取轨迹文件失败: " << path << std::endl;
+    return 1;
+  }
+  const double read_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - read_start)
+                             .count();
+
+  CursorCompositor compositor(&reader);
+  std::chrono::steady_clock::duration compose_time{};
+  int mismatches = 0;
+  {
+    SyntheticDesktop desktop(kWidth, kHeight);
+    for (int i = 0; i < frame_count; ++i) {
+      desktop.NextFrame();
+      CopyFrame(desktop, &frame);
+      const uint64_t timestamp = static_cast<uint64_t>(i) * 1000 / kFps;
+      const auto compose_start = std::chrono::steady_clock::now();
+      compositor.Compose(timestamp, frame.data(), kWidth, kHeight, stride);
+      compose_time += std::chrono::steady_clock::now() - compose_start;
+      if (HashFrame(frame) != expected_hashes[i]) {
+        if (mismatches == 0) {
+          std::cout << "第" << i << "帧合成的结果与录制时不一致" << std::endl;
+        }
+        ++mismatches;
+      }
+    }
+  }
+
+  FILE* file = fopen(path.c_str(), "rb");
+  long file_size = 0;
+  if (file) {
+    fseek(file, 0, SEEK_END);
+    file_size = ftell(file);
+    fclose(file);
+  }
+
+  std::cout << kWidth << "x" << kHeight << " " << kFps << "fps，" << seconds
+            << "秒，" << frame_count << "帧" << std::endl;
+  std::cout << "轨迹文件: " << path << "，" << file_size << "字节(每分钟"
+            << file_size * 60 / seconds / 1024 << "KB)，位置记录"
+            << position_records << "条，形状记录" << shape_records << "条"
+            << std::endl;
+  std::cout << "读取耗时" << read_ms << "ms，合成平均每帧"
+            << std::chrono::duration<double, std::micro>(compose_time)
+                       .count() /
+                   frame_count
+            << "us" << std::endl;
+  std::cout << "与录制时直接绘制光标的画面不一致的帧: " << mismatches << "/"
+            << frame_count << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+﻿// 测试独立进程编码的数据传递和崩溃恢复
+//
+// 同一个程序既是录屏进程也是编码进程，带--worker参数启动时作为编码进程。
+// 录屏进程用合成的画面代替截屏，直接在共享内存中生成画面，
+// 每帧画面开头记录帧序号和校验和。编码进程不编码，只校验画面，
+// 把收到的帧序号写入分段文件。
+// 第一个编码进程处理一部分画面后崩溃，第二个编码进程处理一部分画面后卡住，
+// 检查录屏进程能否重新启动编码进程，以及收到的帧数加上丢失的帧数是否等于发送的帧数。
+// 需要FFmpeg的头文件，但不需要链接FFmpeg，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. -I<FFmpeg头文件目录> demo/encoder_process/main.cc
+//       encoder/frame_ring.cc encoder/remote_encoder.cc
+//       encoder/remote_encoder_arguments.cc encoder/worker_process.cc
+//       <base的源文件> -lpthread -lrt
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "build/build_config.h"
+#include "encoder/frame_ring.h"
+#include "encoder/remote_encoder.h"
+#include "encoder/remote_encoder_arguments.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 360;
+const int kStride = kWidth * 4;
+const int kFps = 30;
+const int kFrameCount = 600;
+
+const int kSampleRate = 44100;
+const int kChannels = 2;
+// 每帧画面对应的声音
+const int kAudioBytesPerFrame = kSampleRate * kChannels * 2 / kFps;
+
+// 第一个编码进程处理这么多帧后崩溃
+const int kCrashAfterFrames = 150;
+// 第二个编码进程处理这么多帧后卡住
+const int kHangAfterFrames = 100;
+const int kHangTimeoutMs = 2000;
+
+const char kWorkerSwitch[] = "--worker";
+
+uint64_t Checksum(const uint8_t* data, int len) {
+  // FNV-1a
+  uint64_t hash = 1469598103934665603ULL;
+  for (int i = 0; i < len; ++i) {
+    hash = (hash ^ data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// 画面开头8字节为帧序号，接着8字节为之后内容的校验和
+void GenerateFrame(int64_t index, uint8_t* data) {
+  for (int y = 0; y < kHeight; ++y) {
+    memset(data + y * kStride, static_cast<int>((index + y) & 0xff), kStride);
+  }
+  memcpy(data, &index, sizeof(index));
+  const uint64_t checksum = Checksum(data + 16, kStride * kHeight - 16);
+  memcpy(data + 8, &checksum, sizeof(checksum));
+}
+
+std::string GetExecutablePath(const char* argv0) {
+#if defined(OS_WIN)
+  char path[MAX_PATH];
+  GetModuleFileNameA(NULL, path, MAX_PATH);
+  return path;
+#else
+  (void)argv0;
+  char path[4096];
+  const ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (len <= 0) {
+    return argv0;
+  }
+  path[len] = '\0';
+  return path;
+#endif
+}
+
+// 编码进程：校验画面并记录帧序号
+class VerifyDelegate : public RemoteEncoderWorker::Delegate {
+ public:
+  VerifyDelegate(FILE* file, int segment)
+      : file_(file), segment_(segment), frames_(0) {}
+
+  bool OnVideoFrame(const FrameMeta& meta,
+                    const uint8_t* data,
+                    int len) override {
+    if (segment_ == 0 && frames_ == kCrashAfterFrames) {
+      abort();
+    }
+    if (segment_ == 1 && frames_ == kHangAfterFrames) {
+      while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+      }
+    }
+
+    int64_t index = 0;
+    uint64_t checksum = 0;
+    memcpy(&index, data, sizeof(index));
+    memcpy(&checksum, data + 8, sizeof(checksum));
+    if (len != kStride * kHeight || meta.width != kWidth ||
+        checksum != Checksum(data + 16, len - 16)) {
+      fprintf(stderr, "frame %lld corrupted\n", static_cast<long long>(index));
+      return false;
+    }
+
+    // 每帧都写入文件，崩溃时已经处理的帧不会丢失记录
+    fprintf(file_, "v %lld %d\n", static_cast<long long>(index),
+            (meta.flags & FrameMeta::kDiscontinuity) ? 1 : 0);
+    fflush(file_);
+    ++frames_;
+    return true;
+  }
+
+  bool OnAudioFrame(const FrameMeta& meta,
+                    const uint8_t* data,
+                    int len) override {
+    fprintf(file_, "a %lld %d\n", static_cast<long long>(meta.timestamp), len);
+    fflush(file_);
+    return true;
+  }
+
+ private:
+  FILE* file_;
+  int segment_;
+  int frames_;
+};  // class VerifyDelegate
+
+int RunWorker(const std::vector<std::string>& args) {
+  RemoteEncoderArguments arguments;
+  if (!arguments.Parse(args)) {
+    return 2;
+  }
+
+  RemoteEncoderWorker worker(arguments);
+  if (!worker.Open()) {
+    return 3;
+  }
+
+  FILE* file = fopen(arguments.output_path.c_str(), "w");
+  if (!file) {
+    return 3;
+  }
+  VerifyDelegate delegate(file, arguments.segment);
+  const bool result = worker.Run(&delegate);
+  fclose(file);
+  return result ? 0 : 4;
+}
+
+int RunHost(const char* argv0, const std::string& output_path) {
+  RemoteEncoderConfig config;
+  config.worker_path = GetExecutablePath(argv0);
+  config.worker_args.push_back(kWorkerSwitch);
+  config.output_path = output_path;
+  config.can_capture_voice = true;
+  config.audio_config.sample_rate = kSampleRate;
+  config.audio_config.channels = kChannels;
+  config.audio_config.sample_fmt = AV_SAMPLE_FMT_S16;
+  config.video_config.fps = kFps;
+  config.video_config.width = kWidth;
+  config.video_config.height = kHeight;
+  config.video_slot_count = 4;
+  config.audio_slot_count = 8;
+  config.audio_slot_size = 4096;
+  config.hang_timeout_ms = kHangTimeoutMs;
+
+  RemoteEncoder encoder(config);
+  if (!encoder.Start()) {
+    std::cerr << "启动编码进程失败" << std::endl;
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<uint8_t> audio(kAudioBytesPerFrame);
+  int pushed = 0;
+  for (int i = 0; i < kFrameCount; ++i) {
+    const uint64_t timestamp = static_cast<uint64_t>(i) * 1000000 / kFps;
+
+    FrameMeta* meta = nullptr;
+    uint8_t* data = nullptr;
+    if (!encoder.BeginVideoFrame(&meta, &data)) {
+      std::cerr << "发送画面失败" << std::endl;
+      return 1;
+    }
+    GenerateFrame(i, data);
+    meta->type = FrameMeta::kVideo;
+    meta->timestamp = timestamp;
+    meta->width = kWidth;
+    meta->height = kHeight;
+    meta->stride = kStride;
+    meta->change_ratio = 1.0f;
+    encoder.EndVideoFrame(kStride * kHeight);
+    ++pushed;
+
+    if (!encoder.PushAudioFrame(audio.data(), kAudioBytesPerFrame, timestamp,
+                                false)) {
+      std::cerr << "发送声音失败" << std::endl;
+      return 1;
+    }
+  }
+
+  const bool stopped = encoder.Stop(10000);
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+  // 汇总各个分段收到的帧
+  std::set<int64_t> received;
+  int64_t duplicated = 0;
+  for (const std::string& segment : encoder.segments()) {
+    FILE* file = fopen(segment.c_str(), "r");
+    if (!file) {
+      continue;
+    }
+    char type = 0;
+    long long value = 0;
+    int extra = 0;
+    int segment_frames = 0;
+    while (fscanf(file, " %c %lld %d", &type, &value, &extra) == 3) {
+      if (type == 'v') {
+        duplicated += received.insert(value).second ? 0 : 1;
+        ++segment_frames;
+      }
+    }
+    fclose(file);
+    std::cout << segment << ": " << segment_frames << "帧" << std::endl;
+  }
+
+  std::cout << "发送" << pushed << "帧，收到" << received.size() << "帧，丢失"
+            << encoder.lost_frames() << "帧(段)，重复" << duplicated
+            << "帧，重新启动" << encoder.restart_count() << "次，耗时"
+            << seconds << "秒" << std::endl;
+
+  const bool ok = stopped && duplicated == 0 &&
+                  encoder.restart_count() == 2 &&
+                  static_cast<int64_t>(received.size()) + encoder.lost_frames() ==
+                      pushed;
+  std::cout << (ok ? "通过" : "失败") << std::endl;
+  return ok ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  if (!args.empty() && args[0] == kWorkerSwitch) {
+    return RunWorker(args);
+  }
+
+  const std::string output_path =
+      args.empty() ? std::string("encoder_process.txt") : args[0];
+  return RunHost(argv[0], output_path);
+}
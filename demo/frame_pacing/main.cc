@@ -0,0 +1,85 @@
+﻿// 测试FramePacer的节拍精度
+//
+// 用合成的截屏负载（复制一帧1920x1080的BGRA画面）代替真实截屏，
+// 偶尔模拟一次超过帧间隔的截屏，统计实际帧率和唤醒抖动。
+// 不依赖系统截屏接口，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/frame_pacing/main.cc
+//       screen_record/src/util/frame_pacer.cc <base的源文件> -lpthread
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "screen_record/src/util/frame_pacer.h"
+
+namespace {
+
+const int kWidth = 1920;
+const int kHeight = 1080;
+
+// 合成的截屏负载：生成一帧画面并复制一次
+class SyntheticCapture {
+ public:
+  SyntheticCapture()
+      : source_(kWidth * kHeight * 4), frame_(kWidth * kHeight * 4) {}
+
+  void Capture(int64_t index) {
+    uint8_t value = static_cast<uint8_t>(index);
+    for (int y = 0; y < kHeight; y += 8) {
+      memset(source_.data() + y * kWidth * 4, value++, kWidth * 4);
+    }
+    memcpy(frame_.data(), source_.data(), frame_.size());
+  }
+
+ private:
+  std::vector<uint8_t> source_;
+  std::vector<uint8_t> frame_;
+};
+
+void Run(int fps, double seconds, int overrun_period) {
+  std::cout << "目标帧率: " << fps << "，时长: " << seconds << "秒";
+  if (overrun_period > 0) {
+    std::cout << "，每" << overrun_period << "帧模拟一次超时";
+  }
+  std::cout << std::endl;
+
+  SyntheticCapture capture;
+  FramePacer pacer(fps);
+  pacer.Start();
+
+  const int64_t total_frames = static_cast<int64_t>(fps * seconds);
+  const auto interval = std::chrono::nanoseconds(1000000000 / fps);
+  for (int64_t i = 0; i < total_frames; ++i) {
+    pacer.WaitForNextFrame();
+    capture.Capture(i);
+    if (overrun_period > 0 && i % overrun_period == overrun_period - 1) {
+      // 截屏耗时达到帧间隔的3.5倍，超过追赶的上限，会跳过错过的帧
+      std::this_thread::sleep_for(interval * 7 / 2);
+    }
+  }
+
+  const FramePacer::Stats& stats = pacer.stats();
+  const double error = (stats.delivered_fps - fps) / fps * 100.0;
+  std::cout << "  " << pacer.FormatStats() << std::endl;
+  std::cout << "  帧率误差: " << error << "%" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int fps = argc > 1 ? atoi(argv[1]) : 60;
+  const double seconds = argc > 2 ? atof(argv[2]) : 10.0;
+  if (fps <= 0 || seconds <= 0) {
+    std::cout << "用法: frame_pacing [帧率] [秒数]" << std::endl;
+    return 1;
+  }
+
+  Run(fps, seconds, 0);
+  Run(fps, seconds, fps);
+  return 0;
+}
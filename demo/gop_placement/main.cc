@@ -0,0 +1,195 @@
+﻿// 对比固定间隔的关键帧和按画面变化决定的关键帧
+//
+// 用SyntheticDesktop生成1920x1080、30fps的桌面画面(静止、打字、滚动、切换场景
+// 循环)，FrameDiffer统计每帧的变化比例，中间模拟一次暂停恢复，分别交给：
+//   之前: 固定30帧一个关键帧，加上编码器自身的场景切换检测(按FFmpeg默认的
+//         keyint_min=25，大面积变化时插入关键帧，近似x264的scenecut)
+//   现在: GopController，参数与录屏相同(最长10秒，最短半秒，阈值0.5)
+// 统计关键帧的数量、落在静止画面上的关键帧、场景切换和暂停恢复的位置是否是
+// 关键帧，以及最长的GOP。只比较关键帧的位置，不编码，
+// 不依赖FFmpeg，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/gop_placement/main.cc
+//       capturer/synthetic_desktop.cc capturer/frame_differ.cc
+//       encoder/gop_controller.cc <base的源文件>
+// 用法: gop_placement [循环次数]
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "capturer/frame_differ.h"
+#include "capturer/synthetic_desktop.h"
+#include "encoder/av_config.h"
+#include "encoder/gop_controller.h"
+
+namespace {
+
+const int kWidth = 1920;
+const int kHeight = 1080;
+const int kFps = 30;
+
+// 之前VideoEncoder固定的关键帧间隔
+const int kFixedGopSize = 30;
+// FFmpeg中AVCodecContext::keyint_min的默认值
+const int kDefaultKeyIntMin = 25;
+
+// 在第二个循环的打字阶段模拟一次暂停恢复
+const int kPauseFrame = SyntheticDesktop::CycleFrames() + 200;
+
+struct FrameStats {
+  float change_ratio;
+  bool discontinuity;
+  bool scene_change;
+};  // struct FrameStats
+
+// 按关键帧的位置统计
+struct GopStats {
+  int key_frames;
+  // 画面与上一帧完全相同时的关键帧，只增加码率
+  int static_key_frames;
+  // 切换场景的帧编码成关键帧的次数
+  int scene_change_hits;
+  // 暂停恢复后的第一帧是关键帧
+  bool discontinuity_hit;
+  int longest_gop;
+  // 第一个循环中关键帧的位置
+  std::vector<int> first_cycle_positions;
+
+  GopStats()
+      : key_frames(0),
+        static_key_frames(0),
+        scene_change_hits(0),
+        discontinuity_hit(false),
+        longest_gop(0) {}
+};  // struct GopStats
+
+// 之前的做法：固定间隔，加上编码器按画面变化插入的关键帧，不知道暂停恢复
+class FixedGop {
+ public:
+  FixedGop() : frames_since_key_frame_(0), frame_count_(0) {}
+
+  bool ShouldForceKeyFrame(const VideoFrameInfo& frame_info) {
+    bool key_frame = frame_count_ == 0 ||
+                     frames_since_key_frame_ + 1 >= kFixedGopSize ||
+                     (frames_since_key_frame_ + 1 >= kDefaultKeyIntMin &&
+                      frame_info.change_ratio >= 0.5f);
+    ++frame_count_;
+    frames_since_key_frame_ = key_frame ? 0 : frames_since_key_frame_ + 1;
+    return key_frame;
+  }
+
+ private:
+  int frames_since_key_frame_;
+  int64_t frame_count_;
+};  // class FixedGop
+
+std::vector<FrameStats> AnalyzeFrames(int frame_count) {
+  SyntheticDesktop desktop(kWidth, kHeight);
+  FrameDiffer differ;
+  std::vector<FrameStats> frames;
+  frames.reserve(frame_count);
+  for (int i = 0; i < frame_count; ++i) {
+    const bool scene_change =
+        desktop.CurrentPhase() == SyntheticDesktop::Phase::SCENE_CHANGE;
+    desktop.NextFrame();
+    FrameStats stats;
+    stats.change_ratio =
+        differ.Compare(reinterpret_cast<const uint8_t*>(desktop.pixels()),
+                       kWidth, kHeight, kWidth * 4);
+    stats.discontinuity = i == kPauseFrame;
+    stats.scene_change = scene_change;
+    frames.push_back(stats);
+  }
+  return frames;
+}
+
+template <typename Controller>
+GopStats Run(Controller* controller, const std::vector<FrameStats>& frames) {
+  GopStats stats;
+  int last_key_frame = 0;
+  for (size_t i = 0; i < frames.size(); ++i) {
+    VideoFrameInfo frame_info;
+    frame_info.change_ratio = frames[i].change_ratio;
+    frame_info.discontinuity = frames[i].discontinuity;
+    if (!controller->ShouldForceKeyFrame(frame_info)) {
+      continue;
+    }
+
+    const int index = static_cast<int>(i);
+    ++stats.key_frames;
+    stats.longest_gop = std::max(stats.longest_gop, index - last_key_frame);
+    last_key_frame = index;
+    if (frames[i].change_ratio == 0.0f) {
+      ++stats.static_key_frames;
+    }
+    if (frames[i].scene_change) {
+      ++stats.scene_change_hits;
+    }
+    if (frames[i].discontinuity) {
+      stats.discontinuity_hit = true;
+    }
+    if (index < SyntheticDesktop::CycleFrames()) {
+      stats.first_cycle_positions.push_back(index);
+    }
+  }
+  stats.longest_gop = std::max(
+      stats.longest_gop, static_cast<int>(frames.size()) - last_key_frame);
+  return stats;
+}
+
+void Print(const char* name,
+           const GopStats& stats,
+           int scene_changes,
+           double minutes) {
+  std::cout << name << ": 关键帧" << stats.key_frames << "个(每分钟"
+            << stats.key_frames / minutes << "个)，其中画面静止时"
+            << stats.static_key_frames << "个；场景切换"
+            << stats.scene_change_hits << "/" << scene_changes
+            << "次是关键帧；暂停恢复后"
+            << (stats.discontinuity_hit ? "是" : "不是")
+            << "关键帧；最长GOP " << stats.longest_gop << "帧" << std::endl;
+  std::cout << "  第一个循环的关键帧:";
+  for (int position : stats.first_cycle_positions) {
+    std::cout << " " << position;
+  }
+  std::cout << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int cycles = argc > 1 ? atoi(argv[1]) : 4;
+  if (cycles < 2) {
+    std::cout << "用法: gop_placement [循环次数，至少为2]" << std::endl;
+    return 1;
+  }
+
+  const int frame_count = SyntheticDesktop::CycleFrames() * cycles;
+  const std::vector<FrameStats> frames = AnalyzeFrames(frame_count);
+  int scene_changes = 0;
+  int static_frames = 0;
+  for (const FrameStats& frame : frames) {
+    scene_changes += frame.scene_change ? 1 : 0;
+    static_frames += frame.change_ratio == 0.0f ? 1 : 0;
+  }
+  const double minutes = static_cast<double>(frame_count) / kFps / 60;
+  std::cout << kWidth << "x" << kHeight << " " << kFps << "fps，"
+            << frame_count << "帧(" << minutes * 60 << "秒)，画面静止的帧"
+            << static_frames << "个，场景切换" << scene_changes << "次，第"
+            << kPauseFrame << "帧暂停恢复" << std::endl;
+
+  FixedGop fixed_gop;
+  Print("之前", Run(&fixed_gop, frames), scene_changes, minutes);
+
+  // 与录屏的参数相同，见ApplyProfileToVideoConfig
+  VideoConfig video_config;
+  video_config.max_gop_size = kFps * 10;
+  video_config.min_gop_size = kFps / 2;
+  GopController gop_controller(video_config);
+  Print("现在", Run(&gop_controller, frames), scene_changes, minutes);
+  return 0;
+}
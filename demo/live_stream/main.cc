@@ -0,0 +1,334 @@
+﻿// 测试直播的端到端延迟
+//
+// 按实时的节奏生成画面，把生成时间编码成画面顶部的黑白方块，用低延迟的编码参数
+// 通过LiveSink发送到本机的地址，同时在另一个线程中接收、解码，从画面中读出生成
+// 时间，统计从生成画面到解码出画面的延迟。同时录制到live_stream.mp4。
+// 参数：时长(秒) 发送地址 接收地址 接收端每10秒暂停的时长(毫秒)，默认为
+//   30 udp://127.0.0.1:23000 udp://127.0.0.1:23000 0
+// 使用srt时接收端作为listener，如：
+//   live_stream 30 srt://127.0.0.1:9000 "srt://127.0.0.1:9000?mode=listener" 0
+// 接收端暂停时可以看到发送队列丢帧，延迟在恢复后回到正常水平而不是一直增加。
+// 接收端没有收到数据或者读不出生成时间时返回1。
+// 也可以只发送，用ffplay观看：
+//   ffplay -fflags nobuffer "srt://127.0.0.1:9000?mode=listener"
+// 需要FFmpeg和x264，可以在非Windows平台上编译：
+//   g++ -std=c++14 -O2 -I. demo/live_stream/main.cc encoder/*.cc
+//       base/threading/thread_pool.cc base/threading/thread_role*.cc
+//       <base的源文件> -lavformat -lavcodec -lswscale -lswresample -lavutil
+//       -lpthread
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "encoder/av_config.h"
+#include "encoder/av_muxer.h"
+#include "encoder/ffmpeg.h"
+#include "encoder/live_sink.h"
+#include "encoder/packet_bus.h"
+
+namespace {
+
+const int kWidth = 1280;
+const int kHeight = 720;
+const int kFps = 30;
+const int64_t kBitRate = 4000000;
+
+const int kSampleRate = 44100;
+const int kChannels = 2;
+
+const int64_t kMicrosecondsPerSecond = 1000000;
+
+// 时间戳编码成画面顶部的32个方块，每个方块表示一位
+const int kStampBits = 32;
+const int kStampBlockSize = 32;
+
+// 直播发送队列的时长上限
+const int64_t kMaxQueueUs = 500000;
+// 开始的这段时间内接收端还在探测流的参数，不计入统计
+const int64_t kWarmupUs = 2 * kMicrosecondsPerSecond;
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point g_start_time = Clock::now();
+
+int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                               g_start_time)
+      .count();
+}
+
+// 背景上一块每帧都变化的区域，顶部是黑白方块表示的时间戳
+void DrawFrame(int64_t index, uint32_t stamp, std::vector<uint8_t>* frame) {
+  uint8_t* data = frame->data();
+  const int stride = kWidth * 4;
+  memset(data, 0x80, frame->size());
+
+  for (int bit = 0; bit < kStampBits; ++bit) {
+    const int value = (stamp >> bit) & 1 ? 0xff : 0x00;
+    for (int y = 0; y < kStampBlockSize; ++y) {
+      memset(data + y * stride + bit * kStampBlockSize * 4, value,
+             kStampBlockSize * 4);
+    }
+  }
+
+  uint32_t seed = static_cast<uint32_t>(index) * 2654435761u;
+  for (int y = 200; y < 400; ++y) {
+    uint8_t* p = data + y * stride + 200 * 4;
+    for (int x = 0; x < 400 * 4; ++x) {
+      seed = seed * 1664525u + 1013904223u;
+      p[x] = static_cast<uint8_t>(seed >> 24);
+    }
+  }
+}
+
+// 从解码后的亮度平面中读出时间戳
+uint32_t ReadStamp(const AVFrame* frame) {
+  uint32_t stamp = 0;
+  for (int bit = 0; bit < kStampBits; ++bit) {
+    const int x = bit * kStampBlockSize + kStampBlockSize / 2;
+    const int y = kStampBlockSize / 2;
+    if (frame->data[0][y * frame->linesize[0] + x] > 0x80) {
+      stamp |= 1u << bit;
+    }
+  }
+  return stamp;
+}
+
+struct ReceiverResult {
+  std::vector<int64_t> latencies_us;
+  int64_t frames;
+  bool opened;
+
+  ReceiverResult() : frames(0), opened(false) {}
+};  // struct ReceiverResult
+
+int InterruptCallback(void* opaque) {
+  return static_cast<std::atomic<bool>*>(opaque)->load() ? 1 : 0;
+}
+
+void ReceiveThread(const std::string& url,
+                   int stall_ms,
+                   std::atomic<bool>* stop,
+                   ReceiverResult* result) {
+  AVFormatContext* format_context = avformat_alloc_context();
+  format_context->interrupt_callback.callback = &InterruptCallback;
+  format_context->interrupt_callback.opaque = stop;
+
+  // 不为探测流的参数缓存数据
+  AVDictionary* options = nullptr;
+  av_dict_set(&options, "fflags", "nobuffer", 0);
+  av_dict_set(&options, "probesize", "32768", 0);
+  av_dict_set(&options, "analyzeduration", "500000", 0);
+  int ret = avformat_open_input(&format_context, url.c_str(), nullptr,
+                                &options);
+  av_dict_free(&options);
+  if (ret < 0) {
+    return;
+  }
+  if (avformat_find_stream_info(format_context, nullptr) < 0) {
+    avformat_close_input(&format_context);
+    return;
+  }
+
+  const int video_index = av_find_best_stream(
+      format_context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  const AVCodec* codec =
+      video_index >= 0
+          ? avcodec_find_decoder(
+                format_context->streams[video_index]->codecpar->codec_id)
+          : nullptr;
+  AVCodecContext* codec_context =
+      codec ? avcodec_alloc_context3(codec) : nullptr;
+  if (!codec_context ||
+      avcodec_parameters_to_context(
+          codec_context, format_context->streams[video_index]->codecpar) < 0) {
+    avcodec_free_context(&codec_context);
+    avformat_close_input(&format_context);
+    return;
+  }
+  // 解码一帧立即输出一帧
+  codec_context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+  codec_context->thread_count = 1;
+  if (avcodec_open2(codec_context, codec, nullptr) < 0) {
+    avcodec_free_context(&codec_context);
+    avformat_close_input(&format_context);
+    return;
+  }
+  result->opened = true;
+
+  AVPacket* packet = av_packet_alloc();
+  AVFrame* frame = av_frame_alloc();
+  int64_t next_stall_us = NowUs() + 10 * kMicrosecondsPerSecond;
+  while (!stop->load() && av_read_frame(format_context, packet) >= 0) {
+    if (packet->stream_index == video_index &&
+        avcodec_send_packet(codec_context, packet) >= 0) {
+      while (avcodec_receive_frame(codec_context, frame) >= 0) {
+        const int64_t now_us = NowUs();
+        const int64_t stamp = ReadStamp(frame);
+        ++result->frames;
+        if (stamp >= kWarmupUs && now_us >= stamp) {
+          result->latencies_us.push_back(now_us - stamp);
+        }
+      }
+    }
+    av_packet_unref(packet);
+
+    if (stall_ms > 0 && NowUs() >= next_stall_us) {
+      // 模拟网络拥塞，接收端一段时间不读取数据
+      std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms));
+      next_stall_us = NowUs() + 10 * kMicrosecondsPerSecond;
+    }
+  }
+
+  av_frame_free(&frame);
+  av_packet_free(&packet);
+  avcodec_free_context(&codec_context);
+  avformat_close_input(&format_context);
+}
+
+int64_t Percentile(const std::vector<int64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const size_t index = std::min(
+      sorted.size() - 1, static_cast<size_t>(sorted.size() * p / 100.0));
+  return sorted[index];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int seconds = argc > 1 ? atoi(argv[1]) : 30;
+  const std::string send_url = argc > 2 ? argv[2] : "udp://127.0.0.1:23000";
+  const std::string receive_url =
+      argc > 3 ? argv[3] : "udp://127.0.0.1:23000";
+  const int stall_ms = argc > 4 ? atoi(argv[4]) : 0;
+  if (seconds <= 0 || stall_ms < 0) {
+    std::cout << "用法: live_stream [时长] [发送地址] [接收地址] "
+                 "[接收端暂停ms]"
+              << std::endl;
+    return 1;
+  }
+
+  avformat_network_init();
+
+  // 接收端先开始监听，srt的caller才能连接上
+  std::atomic<bool> stop(false);
+  ReceiverResult receiver_result;
+  std::thread receiver(&ReceiveThread, receive_url, stall_ms, &stop,
+                       &receiver_result);
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+  AudioConfig audio_config;
+  audio_config.channels = kChannels;
+  audio_config.sample_rate = kSampleRate;
+  audio_config.sample_fmt = AV_SAMPLE_FMT_S16;
+  audio_config.channel_layout = AV_CH_LAYOUT_STEREO;
+
+  VideoConfig video_config;
+  video_config.fps = kFps;
+  video_config.width = kWidth;
+  video_config.height = kHeight;
+  video_config.input_pixel_format = AV_PIX_FMT_RGB32;
+  video_config.codec_id = AV_CODEC_ID_H264;
+  video_config.preset = "veryfast";
+  video_config.low_latency = true;
+  video_config.bit_rate = kBitRate;
+  video_config.max_gop_size = kFps * 2;
+  video_config.min_gop_size = kFps / 2;
+
+  std::unique_ptr<AVMuxer> av_muxer = std::make_unique<AVMuxer>(
+      audio_config, video_config, "live_stream.mp4", true);
+  if (!av_muxer->Initialize()) {
+    std::cout << "初始化编码器失败" << std::endl;
+    stop = true;
+    receiver.join();
+    return 1;
+  }
+  LiveSinkConfig live_config;
+  live_config.url = send_url;
+  live_config.bit_rate = kBitRate + 256000;
+  PacketSinkOptions live_options;
+  live_options.max_queued_us = kMaxQueueUs;
+  av_muxer->AddSink(std::make_unique<LiveSink>(live_config), live_options);
+  if (!av_muxer->Open()) {
+    std::cout << "打开输出失败" << std::endl;
+    stop = true;
+    receiver.join();
+    return 1;
+  }
+
+  std::cout << "直播" << seconds << "秒: " << send_url << " -> "
+            << receive_url << std::endl;
+
+  // 按实时的节奏生成画面，声音每帧一段
+  std::vector<uint8_t> frame(kWidth * kHeight * 4);
+  std::vector<uint8_t> silence(kSampleRate / kFps * kChannels * 2);
+  const int64_t total_frames = static_cast<int64_t>(seconds) * kFps;
+  const int64_t first_frame_us = NowUs();
+  for (int64_t i = 0; i < total_frames; ++i) {
+    const int64_t due_us = first_frame_us + i * kMicrosecondsPerSecond / kFps;
+    const int64_t wait_us = due_us - NowUs();
+    if (wait_us > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+    }
+
+    const int64_t stamp = NowUs();
+    av_muxer->EncodeAudioFrame(silence.data(),
+                               static_cast<int>(silence.size()), stamp, false);
+    DrawFrame(i, static_cast<uint32_t>(stamp), &frame);
+    VideoFrameInfo frame_info;
+    frame_info.change_ratio = 0.1f;
+    av_muxer->EncodeVideoFrame(frame.data(), kWidth, kHeight, kWidth * 4,
+                               stamp, frame_info);
+  }
+
+  // 等待最后几帧到达接收端
+  const PacketBus* packet_bus = av_muxer->packet_bus();
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  for (size_t i = 0; i < packet_bus->sink_count(); ++i) {
+    const PacketSinkStats stats = packet_bus->sink_stats(static_cast<int>(i));
+    std::cout << packet_bus->sink_name(static_cast<int>(i)) << ": 写入"
+              << stats.written_packets << "，丢弃" << stats.dropped_packets
+              << "，队列最大" << stats.max_queued_bytes / 1024 << "KB"
+              << (stats.failed ? "，失败" : "") << std::endl;
+  }
+  stop = true;
+  receiver.join();
+  av_muxer.reset();
+
+  if (!receiver_result.opened) {
+    std::cout << "接收端没有收到数据" << std::endl;
+    return 1;
+  }
+
+  std::vector<int64_t> latencies = receiver_result.latencies_us;
+  std::sort(latencies.begin(), latencies.end());
+  int64_t sum = 0;
+  for (int64_t latency : latencies) {
+    sum += latency;
+  }
+  std::cout << "发送" << total_frames << "帧，解码" << receiver_result.frames
+            << "帧" << std::endl;
+  if (latencies.empty()) {
+    std::cout << "没有从画面中读出生成时间，无法统计延迟" << std::endl;
+    return 1;
+  }
+  std::cout << "延迟(ms): 平均"
+            << sum / static_cast<double>(latencies.size()) / 1000.0
+            << "，中位数" << Percentile(latencies, 50) / 1000.0 << "，P95 "
+            << Percentile(latencies, 95) / 1000.0 << "，最大"
+            << latencies.back() / 1000.0 << std::endl;
+  return 0;
+}
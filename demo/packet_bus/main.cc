@@ -0,0 +1,196 @@
+﻿// 测试一次编码同时写入多个输出
+//
+// 用合成的画面和静音模拟录屏，AVMuxer的编码数据同时写入mp4、mkv、MPEG-TS
+// 和一个每个数据包都等待一段时间的慢输出，统计编码耗时和各输出写入、丢弃的
+// 数据包，检查慢输出不会拖慢编码和其它输出。
+// 参数：录制时长(秒) 慢输出每个数据包的延迟(毫秒) MPEG-TS的地址，
+// 默认为30 20 packet_bus.ts。结果输出到stderr，地址为pipe:1时MPEG-TS写到
+// stdout，如：packet_bus 30 20 pipe:1 | ffplay -
+// 需要FFmpeg和x264，可以在非Windows平台上编译：
+//   g++ -std=c++14 -O2 -I. demo/packet_bus/main.cc encoder/*.cc
+//       base/threading/thread_pool.cc base/threading/thread_role*.cc
+//       <base的源文件> -lavformat -lavcodec -lswscale -lswresample -lavutil
+//       -lpthread
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "encoder/av_config.h"
+#include "encoder/av_muxer.h"
+#include "encoder/muxer_sink.h"
+#include "encoder/packet_bus.h"
+
+namespace {
+
+const int kWidth = 1280;
+const int kHeight = 720;
+const int kFps = 30;
+
+const int kSampleRate = 44100;
+const int kChannels = 2;
+// 每段声音10毫秒
+const int kAudioChunkSamples = kSampleRate / 100;
+
+const int64_t kMicrosecondsPerSecond = 1000000;
+
+// 慢输出的队列上限，比默认值小，容易观察到丢弃
+const int64_t kSlowQueueBytes = 4 * 1024 * 1024;
+
+using Clock = std::chrono::steady_clock;
+
+// 模拟写入很慢的磁盘或者网络
+class SlowSink : public PacketSink {
+ public:
+  SlowSink(const std::string& url, int delay_ms)
+      : muxer_sink_(url, std::string()), delay_ms_(delay_ms) {}
+
+  std::string name() const override { return muxer_sink_.name(); }
+  bool Open(const std::vector<PacketStream>& streams) override {
+    return muxer_sink_.Open(streams);
+  }
+  bool Write(const AVPacket* packet) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms_));
+    return muxer_sink_.Write(packet);
+  }
+  bool Close() override { return muxer_sink_.Close(); }
+
+ private:
+  MuxerSink muxer_sink_;
+  const int delay_ms_;
+};  // class SlowSink
+
+// 一条移动的色带加上一块每帧都变化的区域，模拟有少量变化的桌面
+void DrawFrame(int64_t index, std::vector<uint8_t>* frame) {
+  uint8_t* data = frame->data();
+  const int stride = kWidth * 4;
+  memset(data, 0xf0, frame->size());
+
+  const int bar = static_cast<int>(index * 8 % kWidth);
+  for (int y = 0; y < kHeight; ++y) {
+    uint8_t* p = data + y * stride + bar * 4;
+    const int width = std::min(64, kWidth - bar);
+    memset(p, static_cast<int>(y & 0xff), width * 4);
+  }
+
+  uint32_t seed = static_cast<uint32_t>(index) * 2654435761u;
+  for (int y = 100; y < 200; ++y) {
+    uint8_t* p = data + y * stride + 100 * 4;
+    for (int x = 0; x < 200 * 4; ++x) {
+      seed = seed * 1664525u + 1013904223u;
+      p[x] = static_cast<uint8_t>(seed >> 24);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int record_seconds = argc > 1 ? atoi(argv[1]) : 30;
+  const int slow_delay_ms = argc > 2 ? atoi(argv[2]) : 20;
+  const std::string ts_url = argc > 3 ? argv[3] : "packet_bus.ts";
+  if (record_seconds <= 0 || slow_delay_ms < 0) {
+    std::cerr << "用法: packet_bus [录制时长] [慢输出延迟ms] [MPEG-TS地址]"
+              << std::endl;
+    return 1;
+  }
+
+  AudioConfig audio_config;
+  audio_config.channels = kChannels;
+  audio_config.sample_rate = kSampleRate;
+  audio_config.sample_fmt = AV_SAMPLE_FMT_S16;
+  audio_config.channel_layout = AV_CH_LAYOUT_STEREO;
+
+  VideoConfig video_config;
+  video_config.fps = kFps;
+  video_config.width = kWidth;
+  video_config.height = kHeight;
+  video_config.input_pixel_format = AV_PIX_FMT_RGB32;
+  video_config.codec_id = AV_CODEC_ID_H264;
+  video_config.max_gop_size = kFps * 2;
+  video_config.min_gop_size = kFps / 2;
+
+  std::unique_ptr<AVMuxer> av_muxer = std::make_unique<AVMuxer>(
+      audio_config, video_config, "packet_bus.mp4", true);
+  if (!av_muxer->Initialize()) {
+    std::cerr << "初始化编码器失败" << std::endl;
+    return 1;
+  }
+  av_muxer->AddSink(
+      std::make_unique<MuxerSink>("packet_bus.mkv", std::string()),
+      PacketSinkOptions());
+  av_muxer->AddSink(std::make_unique<MuxerSink>(ts_url, "mpegts"),
+                    PacketSinkOptions());
+  PacketSinkOptions slow_options;
+  slow_options.max_queued_bytes = kSlowQueueBytes;
+  av_muxer->AddSink(
+      std::make_unique<SlowSink>("packet_bus_slow.mkv", slow_delay_ms),
+      slow_options);
+  if (!av_muxer->Open()) {
+    std::cerr << "打开输出失败" << std::endl;
+    return 1;
+  }
+
+  std::cerr << "录制" << record_seconds << "秒，慢输出每个数据包延迟"
+            << slow_delay_ms << "ms" << std::endl;
+
+  std::vector<uint8_t> frame(kWidth * kHeight * 4);
+  std::vector<uint8_t> silence(kAudioChunkSamples * kChannels * 2);
+  int64_t audio_samples = 0;
+  double max_frame_ms = 0.0;
+  const auto encode_start = Clock::now();
+  const int64_t total_frames = static_cast<int64_t>(record_seconds) * kFps;
+  for (int64_t i = 0; i < total_frames; ++i) {
+    const int64_t time_stamp = i * kMicrosecondsPerSecond / kFps;
+    while (audio_samples * kMicrosecondsPerSecond / kSampleRate <=
+           time_stamp) {
+      av_muxer->EncodeAudioFrame(
+          silence.data(), static_cast<int>(silence.size()),
+          audio_samples * kMicrosecondsPerSecond / kSampleRate, false);
+      audio_samples += kAudioChunkSamples;
+    }
+
+    DrawFrame(i, &frame);
+    VideoFrameInfo frame_info;
+    frame_info.change_ratio = 0.05f;
+    const auto frame_start = Clock::now();
+    av_muxer->EncodeVideoFrame(frame.data(), kWidth, kHeight, kWidth * 4,
+                               time_stamp, frame_info);
+    max_frame_ms = std::max(
+        max_frame_ms, std::chrono::duration<double, std::milli>(
+                          Clock::now() - frame_start)
+                          .count());
+  }
+  const double encode_s =
+      std::chrono::duration<double>(Clock::now() - encode_start).count();
+
+  // 队列中剩下的数据在析构时写完，这里统计的是编码结束时的情况
+  const PacketBus* packet_bus = av_muxer->packet_bus();
+  std::cerr << "编码" << total_frames << "帧耗时" << encode_s
+            << "秒，单帧最长" << max_frame_ms << "ms" << std::endl;
+  for (size_t i = 0; i < packet_bus->sink_count(); ++i) {
+    const PacketSinkStats stats = packet_bus->sink_stats(static_cast<int>(i));
+    std::cerr << packet_bus->sink_name(static_cast<int>(i)) << ": 写入"
+              << stats.written_packets << "，丢弃" << stats.dropped_packets
+              << "，队列最大" << stats.max_queued_bytes / 1024 << "KB"
+              << (stats.failed ? "，失败" : "") << std::endl;
+  }
+
+  const auto stop_start = Clock::now();
+  av_muxer.reset();
+  std::cerr << "结束耗时"
+            << std::chrono::duration<double, std::milli>(Clock::now() -
+                                                         stop_start)
+                   .count()
+            << "ms" << std::endl;
+  return 0;
+}
@@ -0,0 +1,182 @@
+﻿// 测试编码负载反复变化时QualityController的调整
+//
+// 按录屏的流程模拟编码线程：截屏每帧、录音每40毫秒向DataQueue中放入一个数据，
+// 编码线程依次取出，画面按当前阶段的耗时"编码"，crf每提高1耗时减少4%，
+// 编码完一帧后用队列中的画面帧数调用QualityController::Update。
+// 负载在轻、重、很重之间交替，逐秒输出积压的帧数、crf和丢帧，检查负载升高时
+// 积压能被控制住，负载降低后画质能恢复。使用模拟的时间，不真的等待，
+// 结果每次都相同，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/quality_control/main.cc
+//       encoder/quality_controller.cc <base的源文件>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#include "capturer/av_data.h"
+#include "encoder/av_config.h"
+#include "encoder/quality_controller.h"
+#include "screen_record/src/data_queue.h"
+
+namespace {
+
+const int kFps = 30;
+const int kWidth = 1920;
+const int kHeight = 1080;
+// 录音的周期和每个周期的字节数(44100Hz、双声道、16位)
+const int kAudioPeriodMs = 40;
+const int kAudioBytes = 44100 * 2 * 2 * kAudioPeriodMs / 1000;
+const double kAudioEncodeMs = 0.2;
+
+// 与录屏的设置相同，见SettingManager::MakeVideoConfig
+const int kCrf = 18;
+const int kAdaptiveCrfRange = 8;
+const int kMaxFrameSkip = 2;
+// crf每提高1编码耗时减少的比例
+const double kCrfSpeedup = 0.04;
+
+const uint32_t kMaxQueueSize = 1024 * 1024 * 1024;
+
+// 负载的阶段：持续时间(秒)和crf为kCrf时每帧的编码耗时(毫秒)
+struct LoadPhase {
+  const char* name;
+  double seconds;
+  double encode_ms;
+};  // struct LoadPhase
+
+const LoadPhase kPhases[] = {
+    {"轻", 10, 15}, {"重", 10, 42}, {"轻", 10, 15}, {"很重", 8, 75},
+    {"轻", 12, 15}, {"重", 5, 42},  {"轻", 5, 15},  {"重", 5, 42},
+    {"轻", 15, 15},
+};
+
+const LoadPhase& PhaseAt(double seconds) {
+  double end = 0;
+  for (const LoadPhase& phase : kPhases) {
+    end += phase.seconds;
+    if (seconds < end) {
+      return phase;
+    }
+  }
+  return kPhases[sizeof(kPhases) / sizeof(kPhases[0]) - 1];
+}
+
+double TotalSeconds() {
+  double total = 0;
+  for (const LoadPhase& phase : kPhases) {
+    total += phase.seconds;
+  }
+  return total;
+}
+
+AVData* NewData(AVData::Type type, int len, double time_ms) {
+  AVData* av_data = new AVData();
+  av_data->type = type;
+  av_data->len = len;
+  av_data->data = new uint8_t[1];
+  av_data->timestamp = static_cast<uint64_t>(time_ms * 1000);
+  return av_data;
+}
+
+}  // namespace
+
+int main() {
+  VideoConfig video_config;
+  video_config.fps = kFps;
+  video_config.width = kWidth;
+  video_config.height = kHeight;
+  video_config.crf = kCrf;
+  video_config.adaptive_quality = true;
+  video_config.max_crf = kCrf + kAdaptiveCrfRange;
+  video_config.max_frame_skip = kMaxFrameSkip;
+  // 模拟libx264，可以在录制过程中调整crf
+  QualityController controller(video_config, true);
+
+  // 队列中的数据只用来计数，不需要真实的画面
+  std::unique_ptr<DataQueue<kMaxQueueSize>> queue =
+      std::make_unique<DataQueue<kMaxQueueSize>>();
+  const int frame_bytes = kWidth * kHeight * 4;
+  const double frame_interval_ms = 1000.0 / kFps;
+  const double total_ms = TotalSeconds() * 1000;
+
+  int64_t next_frame = 0;
+  int64_t next_audio = 0;
+  // 把time_ms之前采集到的数据放入队列
+  auto capture_until = [&](double time_ms) {
+    while (true) {
+      const double frame_time = next_frame * frame_interval_ms;
+      const double audio_time = next_audio * kAudioPeriodMs;
+      const double next_time = std::min(frame_time, audio_time);
+      if (next_time > time_ms || next_time >= total_ms) {
+        break;
+      }
+      if (frame_time <= audio_time) {
+        queue->Push(NewData(AVData::VIDEO, frame_bytes, frame_time),
+                    []() { return false; });
+        ++next_frame;
+      } else {
+        queue->Push(NewData(AVData::AUDIO, kAudioBytes, audio_time),
+                    []() { return false; });
+        ++next_audio;
+      }
+    }
+  };
+
+  std::cout << "时间(秒) 负载 积压(帧) 队列(MB) crf 丢帧 负载比" << std::endl;
+  double now_ms = 0;
+  int max_backlog = 0;
+  int64_t encoded_frames = 0;
+  double next_report_ms = 1000;
+  while (now_ms < total_ms || queue->TotalSize() > 0) {
+    capture_until(now_ms);
+    if (queue->TotalSize() == 0) {
+      // 队列为空，等到下一个数据
+      now_ms = std::min(next_frame * frame_interval_ms,
+                        static_cast<double>(next_audio * kAudioPeriodMs));
+      continue;
+    }
+
+    AVData* av_data = nullptr;
+    queue->Pop(&av_data);
+    if (av_data->type == AVData::AUDIO) {
+      now_ms += kAudioEncodeMs;
+    } else if (controller.ShouldDropFrame()) {
+      // 丢弃的帧不编码
+    } else {
+      const LoadPhase& phase = PhaseAt(now_ms / 1000);
+      const double encode_ms =
+          phase.encode_ms *
+          pow(1 - kCrfSpeedup, controller.decision().crf - kCrf);
+      now_ms += encode_ms;
+      ++encoded_frames;
+      capture_until(now_ms);
+      const int backlog = static_cast<int>(queue->VideoCount());
+      max_backlog = std::max(max_backlog, backlog);
+      controller.Update(encode_ms, backlog);
+    }
+    delete av_data;
+
+    while (now_ms >= next_report_ms && next_report_ms <= total_ms) {
+      const LoadPhase& phase = PhaseAt(next_report_ms / 1000 - 0.001);
+      std::cout << next_report_ms / 1000 << " " << phase.name << " "
+                << queue->VideoCount() << " "
+                << queue->TotalSize() / (1024 * 1024) << " "
+                << controller.decision().crf << " "
+                << controller.decision().frame_skip << " "
+                << controller.load() << std::endl;
+      next_report_ms += 1000;
+    }
+  }
+
+  std::cout << "截屏" << next_frame << "帧，编码" << encoded_frames
+            << "帧，丢帧" << controller.dropped_frames() << "帧，最多积压"
+            << max_backlog << "帧，降低画质" << controller.degrade_count()
+            << "次，恢复" << controller.recover_count() << "次，结束时crf "
+            << controller.decision().crf << "，丢帧"
+            << controller.decision().frame_skip << std::endl;
+  return 0;
+}
@@ -0,0 +1,171 @@
+﻿// 测试回放缓冲区
+//
+// 用合成的画面和静音模拟一段较长的录屏，编码数据只送入回放缓冲区，
+// 然后把缓冲区中最近的一段分别保存为mp4和mkv，统计缓冲区占用的内存和保存的耗时。
+// 保存失败或者耗时超过1秒时返回1。
+// 参数：录制时长(秒) 回放时长(秒) 内存上限(MB)，默认为180 120 512。
+// 需要FFmpeg和x264，可以在非Windows平台上编译：
+//   g++ -std=c++14 -O2 -I. demo/replay_buffer/main.cc encoder/*.cc
+//       base/threading/thread_pool.cc <base的源文件>
+//       -lavformat -lavcodec -lswscale -lswresample -lavutil -lpthread
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "encoder/av_config.h"
+#include "encoder/av_muxer.h"
+#include "encoder/replay_buffer.h"
+
+namespace {
+
+const int kWidth = 1280;
+const int kHeight = 720;
+const int kFps = 30;
+
+const int kSampleRate = 44100;
+const int kChannels = 2;
+// 每段声音10毫秒
+const int kAudioChunkSamples = kSampleRate / 100;
+
+const int64_t kMicrosecondsPerSecond = 1000000;
+
+// 保存2分钟的回放要求的最长耗时
+const double kMaxSaveMs = 1000.0;
+
+using Clock = std::chrono::steady_clock;
+
+// 一条移动的色带加上一块每帧都变化的区域，模拟有少量变化的桌面
+void DrawFrame(int64_t index, std::vector<uint8_t>* frame) {
+  uint8_t* data = frame->data();
+  const int stride = kWidth * 4;
+  memset(data, 0xf0, frame->size());
+
+  const int bar = static_cast<int>(index * 8 % kWidth);
+  for (int y = 0; y < kHeight; ++y) {
+    uint8_t* p = data + y * stride + bar * 4;
+    const int width = std::min(64, kWidth - bar);
+    memset(p, static_cast<int>(y & 0xff), width * 4);
+  }
+
+  uint32_t seed = static_cast<uint32_t>(index) * 2654435761u;
+  for (int y = 100; y < 200; ++y) {
+    uint8_t* p = data + y * stride + 100 * 4;
+    for (int x = 0; x < 200 * 4; ++x) {
+      seed = seed * 1664525u + 1013904223u;
+      p[x] = static_cast<uint8_t>(seed >> 24);
+    }
+  }
+}
+
+int64_t FileSize(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return -1;
+  }
+  fseek(file, 0, SEEK_END);
+  const int64_t size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int record_seconds = argc > 1 ? atoi(argv[1]) : 180;
+  const int replay_seconds = argc > 2 ? atoi(argv[2]) : 120;
+  const int max_megabytes = argc > 3 ? atoi(argv[3]) : 512;
+  if (record_seconds <= 0 || replay_seconds <= 0 || max_megabytes <= 0) {
+    std::cout << "用法: replay_buffer [录制时长] [回放时长] [内存上限MB]"
+              << std::endl;
+    return 1;
+  }
+
+  AudioConfig audio_config;
+  audio_config.channels = kChannels;
+  audio_config.sample_rate = kSampleRate;
+  audio_config.sample_fmt = AV_SAMPLE_FMT_S16;
+  audio_config.channel_layout = AV_CH_LAYOUT_STEREO;
+
+  VideoConfig video_config;
+  video_config.fps = kFps;
+  video_config.width = kWidth;
+  video_config.height = kHeight;
+  video_config.input_pixel_format = AV_PIX_FMT_RGB32;
+  video_config.codec_id = AV_CODEC_ID_H264;
+  video_config.max_gop_size = kFps * 10;
+  video_config.min_gop_size = kFps / 2;
+
+  ReplayBufferConfig replay_config;
+  replay_config.max_duration_us = replay_seconds * kMicrosecondsPerSecond;
+  replay_config.max_bytes = max_megabytes * 1024LL * 1024;
+  ReplayBuffer replay_buffer(replay_config);
+
+  // 音频编码器由文件格式决定，mp4和mkv都使用AAC
+  std::unique_ptr<AVMuxer> av_muxer = std::make_unique<AVMuxer>(
+      audio_config, video_config, "replay.mp4", true);
+  av_muxer->set_replay_buffer(&replay_buffer);
+  if (!av_muxer->Initialize() || !av_muxer->Open()) {
+    std::cout << "初始化编码器失败" << std::endl;
+    return 1;
+  }
+
+  std::cout << "录制" << record_seconds << "秒，保留最近" << replay_seconds
+            << "秒，内存上限" << max_megabytes << "MB" << std::endl;
+
+  std::vector<uint8_t> frame(kWidth * kHeight * 4);
+  std::vector<uint8_t> silence(kAudioChunkSamples * kChannels * 2);
+  int64_t peak_bytes = 0;
+  int64_t audio_samples = 0;
+  const auto encode_start = Clock::now();
+  const int64_t total_frames = static_cast<int64_t>(record_seconds) * kFps;
+  for (int64_t i = 0; i < total_frames; ++i) {
+    const int64_t time_stamp = i * kMicrosecondsPerSecond / kFps;
+    while (audio_samples * kMicrosecondsPerSecond / kSampleRate <=
+           time_stamp) {
+      av_muxer->EncodeAudioFrame(
+          silence.data(), static_cast<int>(silence.size()),
+          audio_samples * kMicrosecondsPerSecond / kSampleRate, false);
+      audio_samples += kAudioChunkSamples;
+    }
+
+    DrawFrame(i, &frame);
+    VideoFrameInfo frame_info;
+    frame_info.change_ratio = 0.05f;
+    av_muxer->EncodeVideoFrame(frame.data(), kWidth, kHeight, kWidth * 4,
+                               time_stamp, frame_info);
+    peak_bytes = std::max(peak_bytes, replay_buffer.buffered_bytes());
+  }
+  const double encode_s =
+      std::chrono::duration<double>(Clock::now() - encode_start).count();
+
+  std::cout << "编码耗时" << encode_s << "秒，缓冲"
+            << replay_buffer.buffered_duration_us() / 1000000.0 << "秒，"
+            << replay_buffer.buffered_bytes() / 1024 << "KB，峰值"
+            << peak_bytes / 1024 << "KB，丢弃"
+            << replay_buffer.dropped_packets() << "个数据包" << std::endl;
+
+  bool passed = true;
+  for (const char* path : {"replay.mp4", "replay.mkv"}) {
+    const auto save_start = Clock::now();
+    const bool result = replay_buffer.Save(path);
+    const double save_ms = std::chrono::duration<double, std::milli>(
+                               Clock::now() - save_start)
+                               .count();
+    std::cout << "保存" << path << (result ? "成功" : "失败") << "，耗时"
+              << save_ms << "ms，文件" << FileSize(path) / 1024 << "KB"
+              << (save_ms > kMaxSaveMs ? "，超过1秒" : "") << std::endl;
+    passed = passed && result && save_ms <= kMaxSaveMs;
+  }
+
+  av_muxer.reset();
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+﻿// 测试多码率输出的CPU占用
+//
+// 用合成的画面模拟1080p的录屏，先用一个AVMuxer加上720p、480p两路多码率输出
+// 编码一遍，再用三个独立的AVMuxer分别从RGB画面转换、缩小和编码一遍，
+// 对比两种方式的耗时和进程占用的CPU时间，并检查各路的关键帧是否对齐。
+// 参数：录制时长(秒)，默认为10。结果输出到stderr。
+// 需要FFmpeg和x264，可以在非Windows平台上编译：
+//   g++ -std=c++14 -O2 -I. demo/simulcast/main.cc encoder/*.cc
+//       base/threading/thread_pool.cc base/threading/thread_role*.cc
+//       <base的源文件> -lavformat -lavcodec -lswscale -lswresample -lavutil
+//       -lpthread
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "build/build_config.h"
+#include "encoder/av_config.h"
+#include "encoder/av_muxer.h"
+#include "encoder/ffmpeg.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+const int kWidth = 1920;
+const int kHeight = 1080;
+const int kFps = 30;
+const int kRenditionHeights[] = {720, 480};
+
+const int64_t kMicrosecondsPerSecond = 1000000;
+
+using Clock = std::chrono::steady_clock;
+
+// 进程所有线程占用的CPU时间(秒)，包括内核态
+double ProcessCpuSeconds() {
+#if defined(OS_WIN)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time,
+                       &kernel_time, &user_time)) {
+    return 0.0;
+  }
+  ULARGE_INTEGER kernel, user;
+  kernel.LowPart = kernel_time.dwLowDateTime;
+  kernel.HighPart = kernel_time.dwHighDateTime;
+  user.LowPart = user_time.dwLowDateTime;
+  user.HighPart = user_time.dwHighDateTime;
+  // FILETIME的单位是100纳秒
+  return (kernel.QuadPart + user.QuadPart) / 1e7;
+#else
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0.0;
+  }
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+// 滚动的文字行加上一块移动的窗口，模拟有少量变化的桌面
+void DrawFrame(int64_t index, std::vector<uint8_t>* frame) {
+  uint8_t* data = frame->data();
+  const int stride = kWidth * 4;
+  for (int y = 0; y < kHeight; ++y) {
+    const int line = static_cast<int>((y + index * 2) % 24);
+    memset(data + y * stride, line < 16 && (y / 24) % 3 ? 0x30 : 0xf0,
+           stride);
+  }
+
+  const int left = static_cast<int>(index * 6 % (kWidth - 400));
+  uint32_t seed = static_cast<uint32_t>(index) * 2654435761u;
+  for (int y = 300; y < 600; ++y) {
+    uint8_t* p = data + y * stride + left * 4;
+    for (int x = 0; x < 400 * 4; ++x) {
+      seed = seed * 1664525u + 1013904223u;
+      p[x] = static_cast<uint8_t>(seed >> 24);
+    }
+  }
+}
+
+VideoConfig MakeVideoConfig() {
+  VideoConfig video_config;
+  video_config.fps = kFps;
+  video_config.width = kWidth;
+  video_config.height = kHeight;
+  video_config.input_pixel_format = AV_PIX_FMT_RGB32;
+  video_config.codec_id = AV_CODEC_ID_H264;
+  video_config.preset = "veryfast";
+  video_config.max_gop_size = kFps * 2;
+  video_config.min_gop_size = kFps / 2;
+  return video_config;
+}
+
+// 与AVMuxer::AddRendition计算宽度的方法一致
+int RenditionWidth(int height) {
+  return static_cast<int>(static_cast<int64_t>(kWidth) * height / kHeight) &
+         ~1;
+}
+
+struct RunResult {
+  double wall_s;
+  double cpu_s;
+};  // struct RunResult
+
+// 每一帧送入所有的muxers，返回耗时和CPU时间
+RunResult Encode(const std::vector<AVMuxer*>& muxers, int64_t total_frames) {
+  std::vector<uint8_t> frame(kWidth * kHeight * 4);
+  const double cpu_start = ProcessCpuSeconds();
+  const auto start = Clock::now();
+  for (int64_t i = 0; i < total_frames; ++i) {
+    DrawFrame(i, &frame);
+    const int64_t time_stamp = i * kMicrosecondsPerSecond / kFps;
+    VideoFrameInfo frame_info;
+    frame_info.change_ratio = 0.06f;
+    // 每5秒切换一次场景，检查强制的关键帧在各路都对齐
+    if (i > 0 && i % (kFps * 5) == 0) {
+      frame_info.change_ratio = 1.0f;
+    }
+    for (AVMuxer* muxer : muxers) {
+      muxer->EncodeVideoFrame(frame.data(), kWidth, kHeight, kWidth * 4,
+                              time_stamp, frame_info);
+    }
+  }
+  for (AVMuxer* muxer : muxers) {
+    muxer->Flush();
+  }
+  RunResult result;
+  result.wall_s = std::chrono::duration<double>(Clock::now() - start).count();
+  result.cpu_s = ProcessCpuSeconds() - cpu_start;
+  return result;
+}
+
+// 返回文件中视频关键帧的时间戳(微秒)
+std::vector<int64_t> ReadKeyFrames(const std::string& path) {
+  std::vector<int64_t> key_frames;
+  AVFormatContext* format_context = nullptr;
+  if (avformat_open_input(&format_context, path.c_str(), nullptr, nullptr) <
+      0) {
+    return key_frames;
+  }
+  AVPacket packet = {0};
+  while (av_read_frame(format_context, &packet) >= 0) {
+    const AVStream* stream = format_context->streams[packet.stream_index];
+    if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+        (packet.flags & AV_PKT_FLAG_KEY)) {
+      key_frames.push_back(av_rescale_q(packet.pts, stream->time_base,
+                                        {1, kMicrosecondsPerSecond}));
+    }
+    av_packet_unref(&packet);
+  }
+  avformat_close_input(&format_context);
+  return key_frames;
+}
+
+void PrintResult(const char* name, const RunResult& result) {
+  std::cerr << name << ": 耗时" << result.wall_s << "秒，CPU时间"
+            << result.cpu_s << "秒" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int record_seconds = argc > 1 ? atoi(argv[1]) : 10;
+  if (record_seconds <= 0) {
+    std::cerr << "用法: simulcast [录制时长]" << std::endl;
+    return 1;
+  }
+  const int64_t total_frames = static_cast<int64_t>(record_seconds) * kFps;
+  const VideoConfig video_config = MakeVideoConfig();
+
+  // 一次转换，逐级缩小，各路在自己的线程中编码
+  std::vector<std::string> ladder_paths = {"simulcast_1080p.mp4"};
+  RunResult ladder_result;
+  {
+    AVMuxer av_muxer(AudioConfig(), video_config, ladder_paths[0], false);
+    if (!av_muxer.Initialize()) {
+      std::cerr << "初始化编码器失败" << std::endl;
+      return 1;
+    }
+    for (int height : kRenditionHeights) {
+      ladder_paths.push_back("simulcast_" + std::to_string(height) + "p.mp4");
+      if (!av_muxer.AddRendition(height, ladder_paths.back())) {
+        std::cerr << "增加" << height << "p输出失败" << std::endl;
+        return 1;
+      }
+    }
+    if (!av_muxer.Open()) {
+      std::cerr << "打开输出失败" << std::endl;
+      return 1;
+    }
+    ladder_result = Encode({&av_muxer}, total_frames);
+  }
+
+  // 每一路都从RGB画面开始，相当于运行多个独立的录屏
+  std::vector<std::unique_ptr<AVMuxer>> independent_muxers;
+  std::vector<AVMuxer*> muxers;
+  std::vector<int> heights = {kHeight};
+  heights.insert(heights.end(), std::begin(kRenditionHeights),
+                 std::end(kRenditionHeights));
+  for (int height : heights) {
+    VideoConfig config = video_config;
+    config.output_width = RenditionWidth(height);
+    config.output_height = height;
+    std::unique_ptr<AVMuxer> av_muxer = std::make_unique<AVMuxer>(
+        AudioConfig(), config,
+        "independent_" + std::to_string(height) + "p.mp4", false);
+    if (!av_muxer->Initialize() || !av_muxer->Open()) {
+      std::cerr << "打开" << height << "p的编码器失败" << std::endl;
+      return 1;
+    }
+    muxers.push_back(av_muxer.get());
+    independent_muxers.push_back(std::move(av_muxer));
+  }
+  const RunResult independent_result = Encode(muxers, total_frames);
+  independent_muxers.clear();
+
+  std::cerr << kWidth << "x" << kHeight << "，" << total_frames << "帧"
+            << std::endl;
+  PrintResult("多码率输出", ladder_result);
+  PrintResult("独立编码", independent_result);
+  if (independent_result.cpu_s > 0) {
+    std::cerr << "CPU时间为独立编码的"
+              << ladder_result.cpu_s * 100 / independent_result.cpu_s << "%"
+              << std::endl;
+  }
+
+  const std::vector<int64_t> key_frames = ReadKeyFrames(ladder_paths[0]);
+  bool aligned = !key_frames.empty();
+  for (size_t i = 1; i < ladder_paths.size(); ++i) {
+    if (ReadKeyFrames(ladder_paths[i]) != key_frames) {
+      std::cerr << ladder_paths[i] << "的关键帧与" << ladder_paths[0]
+                << "不一致" << std::endl;
+      aligned = false;
+    }
+  }
+  std::cerr << "关键帧" << key_frames.size() << "个，"
+            << (aligned ? "各路对齐" : "没有对齐") << std::endl;
+  return aligned ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+﻿// 测试base::ThreadPool的扩展性
+//
+// 1. 用ParallelFor按条带把1920x1080的BGRA画面转换为YUV420P，
+//    统计不同线程数下每帧的耗时和加速比；
+// 2. 在工作线程中投递大量耗时不均的小任务，用WaitGroup等待完成，
+//    统计吞吐量和窃取次数；
+// 3. 在任务中嵌套调用ParallelFor，检查不会死锁；
+// 4. 先投递大量BEST_EFFORT任务，再投递USER_BLOCKING任务，统计后者的等待时间。
+// 参数为测试的最大线程数。不依赖系统接口，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/thread_pool/main.cc
+//       base/threading/thread_pool.cc base/synchronization/wait_group.cc
+//       <base的源文件> -lpthread
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "base/synchronization/wait_group.h"
+#include "base/threading/thread_pool.h"
+
+namespace {
+
+const int kWidth = 1920;
+const int kHeight = 1080;
+const int kFrames = 60;
+// 每个条带的行数
+const int kBandRows = 16;
+const int kBands = (kHeight + kBandRows - 1) / kBandRows;
+
+const int kSmallTasks = 20000;
+
+using Clock = std::chrono::steady_clock;
+
+double ElapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// BT.601有限范围，与swscale的默认转换一致
+void ConvertRows(const uint8_t* bgra,
+                 int begin,
+                 int end,
+                 uint8_t* y_plane,
+                 uint8_t* u_plane,
+                 uint8_t* v_plane) {
+  for (int row = begin; row < end; ++row) {
+    const uint8_t* src = bgra + row * kWidth * 4;
+    uint8_t* y = y_plane + row * kWidth;
+    for (int x = 0; x < kWidth; ++x, src += 4) {
+      y[x] = static_cast<uint8_t>(
+          ((66 * src[2] + 129 * src[1] + 25 * src[0] + 128) >> 8) + 16);
+    }
+    if (row & 1) {
+      continue;
+    }
+    const uint8_t* src0 = bgra + row * kWidth * 4;
+    const uint8_t* src1 = src0 + kWidth * 4;
+    uint8_t* u = u_plane + row / 2 * (kWidth / 2);
+    uint8_t* v = v_plane + row / 2 * (kWidth / 2);
+    for (int x = 0; x < kWidth / 2; ++x, src0 += 8, src1 += 8) {
+      const int b = (src0[0] + src0[4] + src1[0] + src1[4] + 2) >> 2;
+      const int g = (src0[1] + src0[5] + src1[1] + src1[5] + 2) >> 2;
+      const int r = (src0[2] + src0[6] + src1[2] + src1[6] + 2) >> 2;
+      u[x] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) +
+                                  128);
+      v[x] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) +
+                                  128);
+    }
+  }
+}
+
+void BenchmarkConversion(int max_threads) {
+  std::vector<uint8_t> bgra(kWidth * kHeight * 4);
+  std::mt19937 random(1);
+  for (uint8_t& value : bgra) {
+    value = static_cast<uint8_t>(random());
+  }
+  std::vector<uint8_t> y(kWidth * kHeight);
+  std::vector<uint8_t> u(kWidth * kHeight / 4);
+  std::vector<uint8_t> v(kWidth * kHeight / 4);
+
+  // 单线程的结果作为参考
+  ConvertRows(bgra.data(), 0, kHeight, y.data(), u.data(), v.data());
+  const std::vector<uint8_t> expected_y = y;
+  const std::vector<uint8_t> expected_u = u;
+
+  std::cout << "颜色空间转换 " << kWidth << "x" << kHeight << "，每个条带"
+            << kBandRows << "行" << std::endl;
+
+  auto start = Clock::now();
+  for (int i = 0; i < kFrames; ++i) {
+    ConvertRows(bgra.data(), 0, kHeight, y.data(), u.data(), v.data());
+  }
+  const double serial_ms = ElapsedMs(start) / kFrames;
+  std::cout << "  不使用线程池: " << std::fixed << std::setprecision(2)
+            << serial_ms << "ms/帧" << std::endl;
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    base::ThreadPool pool(threads);
+    std::fill(y.begin(), y.end(), 0);
+    start = Clock::now();
+    for (int i = 0; i < kFrames; ++i) {
+      pool.ParallelFor(0, kBands, 1, [&](int begin, int end) {
+        ConvertRows(bgra.data(), begin * kBandRows,
+                    std::min(end * kBandRows, kHeight), y.data(), u.data(),
+                    v.data());
+      });
+    }
+    const double ms = ElapsedMs(start) / kFrames;
+    const bool same = y == expected_y && u == expected_u;
+    std::cout << "  " << threads << "线程: " << ms << "ms/帧，加速比"
+              << serial_ms / ms << (same ? "" : "，结果不一致!") << std::endl;
+  }
+}
+
+void BenchmarkSmallTasks(int max_threads) {
+  std::cout << "耗时不均的小任务 " << kSmallTasks << "个" << std::endl;
+
+  // 大部分任务很短，少数任务是平均值的几十倍
+  std::vector<int> work(kSmallTasks);
+  std::mt19937 random(2);
+  for (int& w : work) {
+    w = random() % 50 == 0 ? 20000 : 200 + random() % 400;
+  }
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    base::ThreadPool pool(threads);
+    std::atomic<uint64_t> sink(0);
+    base::WaitGroup wait_group;
+
+    const auto start = Clock::now();
+    // 一部分任务从工作线程中投递，进入该线程自己的队列，其它线程需要窃取
+    const int kBatch = 100;
+    wait_group.Add(kSmallTasks / kBatch);
+    for (int b = 0; b < kSmallTasks / kBatch; ++b) {
+      pool.PostTask([&, b]() {
+        wait_group.Add(kBatch);
+        for (int i = 0; i < kBatch; ++i) {
+          const int amount = work[b * kBatch + i];
+          pool.PostTask([&, amount]() {
+            uint64_t x = amount;
+            for (int k = 0; k < amount; ++k) {
+              x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            }
+            sink += x;
+            wait_group.Done();
+          });
+        }
+        wait_group.Done();
+      });
+    }
+    wait_group.Wait();
+    const double ms = ElapsedMs(start);
+
+    std::cout << "  " << threads << "线程: " << ms << "ms，"
+              << static_cast<int64_t>(kSmallTasks / ms) << "个/ms，窃取"
+              << pool.stolen_tasks() << "次" << std::endl;
+  }
+}
+
+bool TestNestedParallelFor() {
+  base::ThreadPool pool(4);
+  std::atomic<int> total(0);
+  base::WaitGroup wait_group(16);
+  for (int i = 0; i < 16; ++i) {
+    pool.PostTask([&]() {
+      pool.ParallelFor(0, 1000, 10, [&](int begin, int end) {
+        pool.ParallelFor(begin, end, 1, [&](int b, int e) { total += e - b; });
+      });
+      wait_group.Done();
+    });
+  }
+  wait_group.Wait();
+  const bool ok = total == 16 * 1000;
+  std::cout << "嵌套ParallelFor: " << (ok ? "通过" : "失败") << std::endl;
+  return ok;
+}
+
+void BenchmarkPriority() {
+  base::ThreadPool pool(2);
+  const int kBackground = 2000;
+  base::WaitGroup wait_group(kBackground + 1);
+  for (int i = 0; i < kBackground; ++i) {
+    pool.PostTask(
+        [&]() {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+          wait_group.Done();
+        },
+        base::TaskPriority::BEST_EFFORT);
+  }
+
+  const auto posted = Clock::now();
+  double latency_ms = 0;
+  pool.PostTask(
+      [&]() {
+        latency_ms = ElapsedMs(posted);
+        wait_group.Done();
+      },
+      base::TaskPriority::USER_BLOCKING);
+  wait_group.Wait();
+
+  std::cout << "排在" << kBackground << "个BEST_EFFORT任务之后的"
+            << "USER_BLOCKING任务等待" << latency_ms << "ms" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  // 测试的最大线程数，默认为CPU核数
+  int max_threads = argc > 1 ? atoi(argv[1]) : 0;
+  if (max_threads <= 0) {
+    max_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  BenchmarkConversion(max_threads);
+  BenchmarkSmallTasks(max_threads);
+  const bool ok = TestNestedParallelFor();
+  BenchmarkPriority();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+﻿// 测试线程角色对截屏节拍的影响
+//
+// 用忙循环的线程模拟编码负载(线程数为CPU核数的两倍，与x264相近)，
+// 同时按60帧/秒截屏(合成的画面复制)、每10毫秒处理一次声音，
+// 分别统计不设置线程角色和设置线程角色时截屏的唤醒抖动、跳过的帧数和声音的延迟。
+// 不依赖系统截屏接口，可以在非Windows平台上运行：
+//   g++ -std=c++14 -O2 -I. demo/thread_roles/main.cc
+//       base/threading/thread_role.cc base/threading/thread_role_posix.cc
+//       screen_record/src/util/frame_pacer.cc <base的源文件> -lpthread
+// 以普通用户运行时无法提高截屏和声音线程的优先级，只降低编码线程的优先级。
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "base/threading/thread_role.h"
+#include "screen_record/src/util/frame_pacer.h"
+
+namespace {
+
+const int kWidth = 1920;
+const int kHeight = 1080;
+const int kFps = 60;
+
+// 声音缓冲区的时长，与waveIn的缓冲区大小相当
+const std::chrono::milliseconds kAudioPeriod(10);
+// 声音处理晚于这个时间认为可能丢失数据
+const std::chrono::milliseconds kAudioLateLimit(5);
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  FramePacer::Stats capture;
+  int64_t audio_periods = 0;
+  int64_t audio_late = 0;
+  int64_t audio_max_delay_us = 0;
+  bool roles_applied = true;
+};
+
+// 模拟编码线程，一直占用CPU直到stop为true
+void EncodeLoop(bool use_roles,
+                const std::atomic<bool>* stop,
+                std::atomic<uint64_t>* work,
+                std::atomic<bool>* roles_applied) {
+  if (use_roles && !base::SetCurrentThreadRole(base::ThreadRole::ENCODE)) {
+    *roles_applied = false;
+  }
+  uint64_t x = 1;
+  while (!*stop) {
+    for (int i = 0; i < 100000; ++i) {
+      x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    *work += x & 1;
+  }
+}
+
+void CaptureLoop(bool use_roles,
+                 double seconds,
+                 FramePacer::Stats* stats,
+                 std::atomic<bool>* roles_applied) {
+  if (use_roles && !base::SetCurrentThreadRole(base::ThreadRole::CAPTURE)) {
+    *roles_applied = false;
+  }
+
+  std::vector<uint8_t> source(kWidth * kHeight * 4);
+  std::vector<uint8_t> frame(kWidth * kHeight * 4);
+  FramePacer pacer(kFps);
+  // 与录屏时一样，截屏线程的优先级提高后自旋等待不让出CPU
+  pacer.set_yield_while_spinning(!use_roles);
+
+  pacer.Start();
+  const int64_t total_frames = static_cast<int64_t>(kFps * seconds);
+  for (int64_t i = 0; i < total_frames; ++i) {
+    pacer.WaitForNextFrame();
+    memset(source.data(), static_cast<int>(i), kWidth * 4);
+    memcpy(frame.data(), source.data(), frame.size());
+  }
+  *stats = pacer.stats();
+}
+
+void AudioLoop(bool use_roles,
+               const std::atomic<bool>* stop,
+               Result* result,
+               std::atomic<bool>* roles_applied) {
+  if (use_roles && !base::SetCurrentThreadRole(base::ThreadRole::AUDIO)) {
+    *roles_applied = false;
+  }
+
+  auto deadline = Clock::now();
+  while (!*stop) {
+    deadline += kAudioPeriod;
+    std::this_thread::sleep_until(deadline);
+    const int64_t delay_us = std::chrono::duration_cast<
+        std::chrono::microseconds>(Clock::now() - deadline).count();
+    ++result->audio_periods;
+    result->audio_max_delay_us = std::max(result->audio_max_delay_us,
+                                          delay_us);
+    if (delay_us > std::chrono::duration_cast<std::chrono::microseconds>(
+                       kAudioLateLimit).count()) {
+      ++result->audio_late;
+      // 晚了太多时从当前时间重新开始，不补处理错过的周期
+      deadline = Clock::now();
+    }
+  }
+}
+
+Result Run(bool use_roles, int encode_threads, double seconds) {
+  Result result;
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> work(0);
+  std::atomic<bool> roles_applied(true);
+
+  std::vector<std::thread> encoders;
+  for (int i = 0; i < encode_threads; ++i) {
+    encoders.emplace_back(EncodeLoop, use_roles, &stop, &work, &roles_applied);
+  }
+  std::thread audio(AudioLoop, use_roles, &stop, &result, &roles_applied);
+  std::thread capture(CaptureLoop, use_roles, seconds, &result.capture,
+                      &roles_applied);
+
+  capture.join();
+  stop = true;
+  audio.join();
+  for (std::thread& encoder : encoders) {
+    encoder.join();
+  }
+
+  result.roles_applied = roles_applied;
+  return result;
+}
+
+void Print(const char* name, const Result& result) {
+  const FramePacer::Stats& stats = result.capture;
+  std::cout << name << std::endl;
+  std::cout << "  截屏: " << stats.frames << "帧，跳过" << stats.skipped_frames
+            << "帧，实际帧率" << stats.delivered_fps << "，平均抖动"
+            << stats.mean_jitter_us << "us，最大抖动" << stats.max_jitter_us
+            << "us" << std::endl;
+  std::cout << "  声音: " << result.audio_periods << "个周期，超过"
+            << kAudioLateLimit.count() << "ms的" << result.audio_late
+            << "次，最大延迟" << result.audio_max_delay_us << "us"
+            << std::endl;
+  if (!result.roles_applied) {
+    std::cout << "  部分线程角色没有设置成功，可能没有提高优先级的权限"
+              << std::endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const double seconds = argc > 1 ? atof(argv[1]) : 5.0;
+  if (seconds <= 0) {
+    std::cout << "用法: thread_roles [秒数]" << std::endl;
+    return 1;
+  }
+
+  const int cpus =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int encode_threads = cpus * 2;
+  std::cout << cpus << "个CPU，" << encode_threads << "个编码线程" << std::endl;
+  for (int i = 0; i < static_cast<int>(base::ThreadRole::COUNT); ++i) {
+    const base::ThreadRole role = static_cast<base::ThreadRole>(i);
+    const base::ThreadRoleConfig config = base::GetThreadRoleConfig(role);
+    std::cout << "  " << base::ThreadRoleToString(role) << ": "
+              << base::ThreadPriorityToString(config.priority) << "，CPU "
+              << (config.cpu_mask ? base::CpuMaskToString(config.cpu_mask)
+                                  : std::string("不限"))
+              << std::endl;
+  }
+
+  Print("不设置线程角色", Run(false, encode_threads, seconds));
+  Print("设置线程角色", Run(true, encode_threads, seconds));
+  return 0;
+}
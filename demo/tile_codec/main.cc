@@ -0,0 +1,368 @@
+﻿// 测试桌面画面专用的无损帧格式(encoder/tile_codec.h)
+//
+// 用SyntheticDesktop生成相同的画面序列(静止、打字、滚动、切换场景)，
+// 分别用单线程和线程池编码，统计每个核每秒编码的原始数据量、压缩比和
+// 各种图块的比例，同时解码每一帧并与原始画面比较，检查是否无损。
+// 每种方式测两遍：每秒一个关键帧，以及全部是关键帧(不引用上一帧)。
+// SyntheticDesktop中几乎没有差值图块，再用三种会编码成差值图块的内容单线程
+// 测一遍，画面每帧都在移动，每个图块都要重新编码：
+//   渐变: 平滑的背景渐变，每帧向右移动1个像素
+//   照片: 低频的颜色变化加上每个像素±4的噪声，每帧向右下移动
+//   文字: 浅色背景上次像素抗锯齿的文字，每帧向上滚动2行
+// 分别统计各种内容的编码速度，即各种图块的编码速度。
+// 参数：宽 高 帧数，默认为2560 1440和一个画面循环的帧数。
+// 不依赖FFmpeg和系统接口，可以在非Windows平台上运行。
+// GCC在-O2时不向量化计算残差的循环，按Release的-O3编译：
+//   g++ -std=c++14 -O3 -I. demo/tile_codec/main.cc encoder/tile_codec.cc
+//       capturer/synthetic_desktop.cc base/threading/thread_pool.cc
+//       <base的源文件> -lpthread
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "base/threading/thread_pool.h"
+#include "capturer/synthetic_desktop.h"
+#include "encoder/tile_codec.h"
+
+namespace {
+
+// 按60帧/秒录制，每秒一个关键帧
+const int kKeyFrameInterval = 60;
+
+// 移动的内容测试的帧数
+const int kMovingFrames = 120;
+
+const double kBytesPerMegabyte = 1024.0 * 1024.0;
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  double encode_s;
+  double decode_s;
+  int64_t raw_bytes;
+  int64_t encoded_bytes;
+  int64_t key_frame_bytes;
+  int key_frames;
+  TileStats tiles;
+  bool lossless;
+};  // struct Result
+
+double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 比原始画面大的图，每一帧是其中平移后的一块，模拟拖动和滚动
+class Canvas {
+ public:
+  Canvas(int width, int height, int frames, int dx, int dy)
+      : width_(width + frames * dx),
+        height_(height + frames * dy),
+        dx_(dx),
+        dy_(dy),
+        pixels_(static_cast<size_t>(width_) * height_) {}
+
+  uint32_t* row(int y) { return &pixels_[static_cast<size_t>(y) * width_]; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int stride() const { return width_ * 4; }
+
+  const uint8_t* Frame(int index) const {
+    return reinterpret_cast<const uint8_t*>(
+        &pixels_[static_cast<size_t>(index * dy_) * width_ + index * dx_]);
+  }
+
+ private:
+  const int width_;
+  const int height_;
+  const int dx_;
+  const int dy_;
+  std::vector<uint32_t> pixels_;
+
+  Canvas(const Canvas&) = delete;
+  Canvas& operator=(const Canvas&) = delete;
+};  // class Canvas
+
+uint32_t Random(uint32_t* state) {
+  // xorshift32
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+uint8_t Clamp(double value) {
+  return static_cast<uint8_t>(std::min(255.0, std::max(0.0, value + 0.5)));
+}
+
+uint32_t MakeColor(double b, double g, double r) {
+  return 0xFF000000u | Clamp(r) << 16 | Clamp(g) << 8 | Clamp(b);
+}
+
+void DrawGradient(Canvas* canvas) {
+  const double width = canvas->width();
+  const double height = canvas->height();
+  for (int y = 0; y < canvas->height(); ++y) {
+    uint32_t* row = canvas->row(y);
+    for (int x = 0; x < canvas->width(); ++x) {
+      row[x] = MakeColor(60 + 160 * x / width, 40 + 120 * y / height,
+                         200 - 100 * (x + y) / (width + height));
+    }
+  }
+}
+
+void DrawPhoto(Canvas* canvas) {
+  uint32_t random_state = 0x9E3779B9;
+  for (int y = 0; y < canvas->height(); ++y) {
+    uint32_t* row = canvas->row(y);
+    for (int x = 0; x < canvas->width(); ++x) {
+      const double light = 50 * sin(x / 97.0) * cos(y / 73.0) +
+                           30 * sin((x + 2 * y) / 211.0);
+      const uint32_t noise = Random(&random_state);
+      row[x] = MakeColor(90 + light + static_cast<int>(noise & 7) - 4,
+                         120 + light + static_cast<int>(noise >> 8 & 7) - 4,
+                         150 + light + static_cast<int>(noise >> 16 & 7) - 4);
+    }
+  }
+}
+
+// 每个字由几条随机的笔画组成，按3倍水平分辨率计算覆盖率，
+// R、G、B分别取相邻的三分之一像素，得到彩色的边缘
+void DrawText(Canvas* canvas) {
+  const int kCellWidth = 9;
+  const int kCellHeight = 16;
+  const int kLineHeight = 20;
+  const int kSamples = 4;
+  const double background[3] = {250, 248, 245};
+  const double foreground[3] = {40, 30, 30};
+
+  for (int y = 0; y < canvas->height(); ++y) {
+    uint32_t* row = canvas->row(y);
+    std::fill(row, row + canvas->width(),
+              MakeColor(background[0], background[1], background[2]));
+  }
+
+  uint32_t random_state = 0x2545F491;
+  std::vector<float> coverage(kCellWidth * 3 * kCellHeight);
+  for (int top = 4; top + kLineHeight <= canvas->height();
+       top += kLineHeight) {
+    // 每行的长度不同，行尾留白
+    const int line_end =
+        canvas->width() * (60 + Random(&random_state) % 40) / 100;
+    for (int left = 8; left + kCellWidth <= line_end; left += kCellWidth) {
+      std::fill(coverage.begin(), coverage.end(), 0.0f);
+      const uint32_t shape = Random(&random_state);
+      if (shape % 7 == 0) {
+        // 空格
+        continue;
+      }
+      // 2~3条笔画，端点在字的格子内
+      const int strokes = 2 + shape % 2;
+      for (int s = 0; s < strokes; ++s) {
+        const uint32_t r = Random(&random_state);
+        const double x0 = 1 + (r & 7) * (kCellWidth - 2) / 7.0;
+        const double y0 = 3 + (r >> 3 & 7) * (kCellHeight - 4) / 7.0;
+        const double x1 = 1 + (r >> 6 & 7) * (kCellWidth - 2) / 7.0;
+        const double y1 = 3 + (r >> 9 & 7) * (kCellHeight - 4) / 7.0;
+        // 只计算笔画附近的采样点
+        const int sx_begin = std::max(
+            0, static_cast<int>((std::min(x0, x1) - 1) * 3 * kSamples));
+        const int sx_end =
+            std::min(kCellWidth * 3 * kSamples,
+                     static_cast<int>((std::max(x0, x1) + 1) * 3 * kSamples));
+        const int sy_begin =
+            std::max(0, static_cast<int>((std::min(y0, y1) - 1) * kSamples));
+        const int sy_end =
+            std::min(kCellHeight * kSamples,
+                     static_cast<int>((std::max(y0, y1) + 1) * kSamples));
+        for (int sy = sy_begin; sy < sy_end; ++sy) {
+          for (int sx = sx_begin; sx < sx_end; ++sx) {
+            const double px = (sx + 0.5) / (3 * kSamples);
+            const double py = (sy + 0.5) / kSamples;
+            // 到线段的距离小于0.6个像素时在笔画内
+            const double vx = x1 - x0;
+            const double vy = y1 - y0;
+            const double length2 = vx * vx + vy * vy;
+            double t = length2 > 0
+                           ? ((px - x0) * vx + (py - y0) * vy) / length2
+                           : 0;
+            t = std::min(1.0, std::max(0.0, t));
+            const double ex = px - x0 - t * vx;
+            const double ey = py - y0 - t * vy;
+            if (ex * ex + ey * ey < 0.36) {
+              coverage[sy / kSamples * kCellWidth * 3 + sx / kSamples] +=
+                  1.0f / (kSamples * kSamples);
+            }
+          }
+        }
+      }
+      for (int cy = 0; cy < kCellHeight; ++cy) {
+        uint32_t* row = canvas->row(top + cy) + left;
+        for (int cx = 0; cx < kCellWidth; ++cx) {
+          double color[3];
+          for (int c = 0; c < 3; ++c) {
+            // BGRA中B在前，对应最右边的三分之一像素
+            const double a = std::min(
+                1.0f, coverage[cy * kCellWidth * 3 + cx * 3 + 2 - c]);
+            color[c] = background[c] + (foreground[c] - background[c]) * a;
+          }
+          row[cx] = MakeColor(color[0], color[1], color[2]);
+        }
+      }
+    }
+  }
+}
+
+// 编码frames帧，key_frame_interval为1时全部是关键帧。
+// next_frame返回下一帧的画面，每行stride个字节
+Result Run(int width,
+           int height,
+           int frames,
+           int key_frame_interval,
+           base::ThreadPool* thread_pool,
+           int stride,
+           const std::function<const uint8_t*()>& next_frame) {
+  TileEncoder encoder(width, height, thread_pool);
+  TileDecoder decoder(thread_pool);
+  std::vector<uint8_t> encoded;
+
+  Result result = {};
+  result.lossless = true;
+  const size_t frame_bytes = static_cast<size_t>(width) * height * 4;
+  const size_t row_bytes = static_cast<size_t>(width) * 4;
+  for (int i = 0; i < frames; ++i) {
+    const uint8_t* data = next_frame();
+    const bool key_frame = i % key_frame_interval == 0;
+
+    auto start = Clock::now();
+    encoder.Encode(data, stride, key_frame, &encoded);
+    result.encode_s += Seconds(start);
+
+    start = Clock::now();
+    const bool decoded = decoder.Decode(encoded.data(), encoded.size());
+    result.decode_s += Seconds(start);
+    if (!decoded) {
+      result.lossless = false;
+    }
+    for (int y = 0; y < height && result.lossless; ++y) {
+      if (memcmp(decoder.pixels() + static_cast<size_t>(y) * width,
+                 data + static_cast<size_t>(y) * stride, row_bytes) != 0) {
+        result.lossless = false;
+      }
+    }
+
+    result.raw_bytes += frame_bytes;
+    result.encoded_bytes += encoded.size();
+    if (key_frame) {
+      result.key_frame_bytes += encoded.size();
+      ++result.key_frames;
+    }
+    const TileStats& stats = encoder.last_stats();
+    result.tiles.unchanged += stats.unchanged;
+    result.tiles.solid += stats.solid;
+    result.tiles.palette += stats.palette;
+    result.tiles.delta += stats.delta;
+  }
+  return result;
+}
+
+Result RunDesktop(int width,
+                  int height,
+                  int frames,
+                  int key_frame_interval,
+                  base::ThreadPool* thread_pool) {
+  SyntheticDesktop desktop(width, height);
+  return Run(width, height, frames, key_frame_interval, thread_pool,
+             width * 4, [&desktop]() {
+               desktop.NextFrame();
+               return reinterpret_cast<const uint8_t*>(desktop.pixels());
+             });
+}
+
+Result RunCanvas(int width, int height, const Canvas& canvas) {
+  int index = 0;
+  return Run(width, height, kMovingFrames, kKeyFrameInterval, nullptr,
+             canvas.stride(),
+             [&canvas, &index]() { return canvas.Frame(index++); });
+}
+
+void Print(const char* name, const Result& result, int threads) {
+  const double raw_mb = result.raw_bytes / kBytesPerMegabyte;
+  const int64_t tiles = result.tiles.unchanged + result.tiles.solid +
+                        result.tiles.palette + result.tiles.delta;
+  std::cerr << name << ": 编码" << raw_mb / result.encode_s << "MB/s";
+  if (threads > 1) {
+    std::cerr << "(" << threads << "个线程)";
+  }
+  std::cerr << "，解码" << raw_mb / result.decode_s << "MB/s，压缩比"
+            << static_cast<double>(result.raw_bytes) / result.encoded_bytes
+            << "，关键帧平均" << result.key_frame_bytes / result.key_frames /
+                                     1024
+            << "KB，图块: 不变" << result.tiles.unchanged * 100 / tiles
+            << "%、单色" << result.tiles.solid * 100 / tiles << "%、调色板"
+            << result.tiles.palette * 100 / tiles << "%、差值"
+            << result.tiles.delta * 100 / tiles << "%"
+            << (result.lossless ? "" : "，解码结果与原始画面不一致")
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int width = argc > 1 ? atoi(argv[1]) : 2560;
+  const int height = argc > 2 ? atoi(argv[2]) : 1440;
+  const int frames =
+      argc > 3 ? atoi(argv[3]) : SyntheticDesktop::CycleFrames();
+  if (width <= 0 || height <= 0 || frames <= 0) {
+    std::cerr << "用法: tile_codec [宽] [高] [帧数]" << std::endl;
+    return 1;
+  }
+
+  base::ThreadPool* thread_pool = base::ThreadPool::GetDefault();
+  // ParallelFor的调用线程也处理图块
+  const int threads = thread_pool->num_threads() + 1;
+  std::cerr << width << "x" << height << "，" << frames << "帧" << std::endl;
+
+  bool lossless = true;
+  Result result =
+      RunDesktop(width, height, frames, kKeyFrameInterval, nullptr);
+  Print("单线程", result, 1);
+  lossless = lossless && result.lossless;
+  result = RunDesktop(width, height, frames, 1, nullptr);
+  Print("单线程，全关键帧", result, 1);
+  lossless = lossless && result.lossless;
+  result = RunDesktop(width, height, frames, kKeyFrameInterval, thread_pool);
+  Print("线程池", result, threads);
+  lossless = lossless && result.lossless;
+  result = RunDesktop(width, height, frames, 1, thread_pool);
+  Print("线程池，全关键帧", result, threads);
+  lossless = lossless && result.lossless;
+
+  std::cerr << "移动的内容，" << kMovingFrames << "帧，单线程" << std::endl;
+  struct Content {
+    const char* name;
+    int dx;
+    int dy;
+    void (*draw)(Canvas* canvas);
+  };
+  const Content contents[] = {
+      {"渐变", 1, 0, DrawGradient},
+      {"照片", 1, 1, DrawPhoto},
+      {"文字", 0, 2, DrawText},
+  };
+  for (const Content& content : contents) {
+    Canvas canvas(width, height, kMovingFrames, content.dx, content.dy);
+    content.draw(&canvas);
+    result = RunCanvas(width, height, canvas);
+    Print(content.name, result, 1);
+    lossless = lossless && result.lossless;
+  }
+  return lossless ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+﻿#include "encoder/audio_clock_sync.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "base/check.h"
+
+namespace {
+
+// 偏差超过这个值时立即修正，正常的回调抖动远小于这个值
+const double kResyncThresholdUs = 100000.0;
+
+// 采集中断后偏差超过这个值就立即修正，更小的偏差与采集时间的抖动相当
+const double kMinResyncUs = 5000.0;
+
+// 采集时间有几毫秒的抖动，偏差先经过平滑再用于控制
+const double kOffsetSmoothSeconds = 2.0;
+
+// 偏差修正的时间常数(秒)。比例系数为1 / T，积分系数为1 / (4 * T * T)，
+// 对应临界阻尼，大约2T之后稳定，不会来回振荡
+const double kCorrectionSeconds = 10.0;
+
+// 补偿比例的上限，0.5%的变速听不出来，足够覆盖常见的设备时钟偏差
+const double kMaxCompensation = 0.005;
+
+const double kMicrosecondsPerSecond = 1000000.0;
+
+}  // namespace
+
+AudioClockSync::AudioClockSync(int sample_rate)
+    : sample_rate_(sample_rate),
+      has_timestamp_(false),
+      last_timestamp_us_(0),
+      offset_us_(0.0),
+      max_offset_us_(0.0),
+      integral_(0.0),
+      compensation_(0.0),
+      resync_count_(0) {
+  DCHECK(sample_rate_ > 0);
+}
+
+AudioClockSync::~AudioClockSync() {}
+
+int64_t AudioClockSync::Update(int64_t timestamp_us,
+                               int64_t position,
+                               bool discontinuity) {
+  const double position_us = position * kMicrosecondsPerSecond / sample_rate_;
+  const double offset = timestamp_us - position_us;
+
+  if (fabs(offset) > kResyncThresholdUs ||
+      (discontinuity && fabs(offset) > kMinResyncUs)) {
+    // 积分项保留，它反映的是设备时钟的偏差，与这次跳变无关
+    ++resync_count_;
+    offset_us_ = 0.0;
+    has_timestamp_ = true;
+    last_timestamp_us_ = timestamp_us;
+    return llround(offset * sample_rate_ / kMicrosecondsPerSecond);
+  }
+
+  if (!has_timestamp_) {
+    has_timestamp_ = true;
+    last_timestamp_us_ = timestamp_us;
+    offset_us_ = offset;
+    return 0;
+  }
+
+  const double dt =
+      std::max<int64_t>(timestamp_us - last_timestamp_us_, 0) /
+      kMicrosecondsPerSecond;
+  last_timestamp_us_ = timestamp_us;
+
+  const double weight = dt / (dt + kOffsetSmoothSeconds);
+  offset_us_ += (offset - offset_us_) * weight;
+  max_offset_us_ = std::max(max_offset_us_, fabs(offset_us_));
+
+  const double offset_seconds = offset_us_ / kMicrosecondsPerSecond;
+  const double ki = 1.0 / (4.0 * kCorrectionSeconds * kCorrectionSeconds);
+  const double integral = integral_ + offset_seconds * dt;
+  const double compensation =
+      offset_seconds / kCorrectionSeconds + integral * ki;
+
+  // 达到上限时不再累积积分，避免偏差消除后长时间过冲
+  if (compensation > kMaxCompensation) {
+    compensation_ = kMaxCompensation;
+  } else if (compensation < -kMaxCompensation) {
+    compensation_ = -kMaxCompensation;
+  } else {
+    compensation_ = compensation;
+    integral_ = integral;
+  }
+
+  return 0;
+}
+
+double AudioClockSync::drift_ppm() const {
+  const double ki = 1.0 / (4.0 * kCorrectionSeconds * kCorrectionSeconds);
+  // 设备偏快时样本偏多，补偿为负数
+  return -integral_ * ki * 1000000.0;
+}
@@ -0,0 +1,59 @@
+﻿// 音频时钟与媒体时钟的同步
+
+#ifndef ENCODER_AUDIO_CLOCK_SYNC_H_
+#define ENCODER_AUDIO_CLOCK_SYNC_H_
+
+#include <stdint.h>
+
+// 音频的时间戳由样本数决定，而录音设备的时钟与系统时钟存在偏差(通常几十到几百ppm)，
+// 只按样本数计算时间戳，几个小时之后音频会比画面早或晚几百毫秒。
+// 每收到一段音频，比较它在媒体时钟上的采集时间和按样本数算出的位置：
+//   偏差很大(设备丢数据)或者采集中断过(暂停恢复)：立即跳过或丢弃一段样本；
+//   偏差较小：用PI控制计算重采样的补偿比例，平滑地增减样本，听不出变化。
+// 积分项稳定后就是设备时钟的偏差。
+class AudioClockSync {
+ public:
+  explicit AudioClockSync(int sample_rate);
+  ~AudioClockSync();
+
+  // 每收到一段音频调用一次
+  // timestamp_us: 第一个样本的采集时间(媒体时钟，微秒)
+  // position: 第一个样本在输出时间轴上的位置(输出采样率下的样本数)
+  // discontinuity: 这段音频之前采集中断过，如暂停后恢复，不论偏差大小都立即修正
+  // 返回需要立即修正的样本数：
+  //   正数表示音频落后，时间轴需要向后跳过这么多样本；
+  //   负数表示音频超前，需要丢弃这么多样本；
+  //   0表示只通过compensation()慢慢修正
+  int64_t Update(int64_t timestamp_us, int64_t position, bool discontinuity);
+
+  // 输出样本数需要调整的比例，正数表示需要增加样本
+  double compensation() const { return compensation_; }
+
+  // 平滑后的偏差(微秒)，正数表示音频落后于画面
+  double offset_us() const { return offset_us_; }
+  // 平滑后的偏差绝对值的最大值，不包括立即修正的偏差
+  double max_offset_us() const { return max_offset_us_; }
+  // 估计的设备时钟偏差，正数表示设备时钟偏快(实际采样率高于标称值)
+  double drift_ppm() const;
+  int64_t resync_count() const { return resync_count_; }
+
+ private:
+  const int sample_rate_;
+
+  bool has_timestamp_;
+  int64_t last_timestamp_us_;
+
+  double offset_us_;
+  double max_offset_us_;
+  // 偏差对时间的积分(微秒 * 秒)
+  double integral_;
+  double compensation_;
+
+  int64_t resync_count_;
+
+  AudioClockSync() = delete;
+  AudioClockSync(const AudioClockSync&) = delete;
+  AudioClockSync& operator=(const AudioClockSync&) = delete;
+};  // class AudioClockSync
+
+#endif  // ENCODER_AUDIO_CLOCK_SYNC_H_
@@ -1,26 +1,40 @@
 ﻿#include "encoder/audio_encoder.h"
 
+#include <math.h>
+
 #include "base/check.h"
 
+namespace {
+
+// 补偿的调整在这么长的时间内完成(秒)，每次设置补偿比例都会重新开始计算，
+// 时间越长，补偿比例的精度越高
+const int kCompensationSeconds = 10;
+
+}  // namespace
+
 AudioEncoder::AudioEncoder(const AudioConfig& audio_config)
     : initialized_(false),
-      need_resample_(false),
       codec_(nullptr),
       codec_context_(nullptr),
       frame_(nullptr),
       resampler_(nullptr),
+      fifo_(nullptr),
       config_(audio_config),
-      src_buf_size_(0),
-      src_data_(nullptr) {
+      convert_data_(nullptr),
+      convert_capacity_(0) {
 }
 
 AudioEncoder::~AudioEncoder() {
-  if (src_data_) {
-    av_freep(&src_data_[0]);
+  if (convert_data_) {
+    av_freep(&convert_data_[0]);
   }
-  av_freep(&src_data_);
-  src_data_ = nullptr;
+  av_freep(&convert_data_);
+  convert_data_ = nullptr;
 
+  if (fifo_) {
+    av_audio_fifo_free(fifo_);
+    fifo_ = nullptr;
+  }
   if (frame_) {
     av_frame_free(&frame_);
     frame_ = nullptr;
@@ -66,7 +80,7 @@ bool AudioEncoder::Initialize() {
       codec_context_->sample_fmt, codec_context_->sample_rate,
       static_cast<int64_t>(codec_context_->channel_layout), config_.sample_fmt,
       config_.sample_rate, config_.channel_layout);
-  if (need_resample_ && !resampler_) {
+  if (!resampler_) {
     return false;
   }
 
@@ -102,6 +116,13 @@ bool AudioEncoder::Open(AVStream* audio_stream) {
     return false;
   }
 
+  fifo_ = av_audio_fifo_alloc(codec_context_->sample_fmt,
+                              codec_context_->channels, frame_->nb_samples);
+  if (!fifo_) {
+    DCHECK(false);
+    return false;
+  }
+
   return true;
 }
 
@@ -114,41 +135,122 @@ int AudioEncoder::PushEncodeFrame(uint8_t* data,
                                   AVFrame** encoded_frame) {
   DCHECK(encoded_frame);
 
-  const int nb_samples = len / 4;
-  DCHECK(nb_samples == frame_->nb_samples);
-
   *encoded_frame = nullptr;
-  if (data && nb_samples > 0) {
-    DCHECK(src_buf_size_ >= len);
 
-    int ret = av_frame_make_writable(frame_);
+  int ret = 0;
+  if (data && len > 0) {
+    ret = PushSamples(data, len / BytesPerSample());
     if (ret < 0) {
-      DCHECK(false);
       return ret;
     }
+  }
+
+  *encoded_frame = PopFrame(false);
+  return ret;
+}
+
+AVCodecContext * AudioEncoder::GetCodecContext() const {
+  return codec_context_;
+}
+
+int AudioEncoder::PushSamples(const uint8_t* data, int nb_samples) {
+  DCHECK(fifo_);
+  if (!data || nb_samples <= 0) {
+    return 0;
+  }
 
-    memset(src_data_[0], 0, src_buf_size_);
-    memcpy(src_data_[0], data, len);
+  if (!ReserveConvertBuffer(swr_get_out_samples(resampler_, nb_samples))) {
+    return AVERROR(ENOMEM);
+  }
+
+  const uint8_t* src_data[AV_NUM_DATA_POINTERS] = {nullptr};
+  int ret = av_samples_fill_arrays(const_cast<uint8_t**>(src_data), nullptr,
+                                   data, config_.channels, nb_samples,
+                                   config_.sample_fmt, 1);
+  if (ret < 0) {
+    DCHECK(false);
+    return ret;
+  }
+
+  const int converted = swr_convert(resampler_, convert_data_,
+                                    convert_capacity_, src_data, nb_samples);
+  if (converted < 0) {
+    DCHECK(false);
+    return converted;
+  }
+
+  ret = av_audio_fifo_write(fifo_, reinterpret_cast<void**>(convert_data_),
+                            converted);
+  if (ret < converted) {
+    return ret < 0 ? ret : AVERROR(ENOMEM);
+  }
 
-    if (need_resample_) {
-      ret = swr_convert(resampler_, frame_->data, nb_samples,
-                        (const uint8_t**)src_data_, nb_samples);
-      if (ret < 0) {
-        DCHECK(false);
-        return ret;
+  return converted;
+}
+
+AVFrame* AudioEncoder::PopFrame(bool flush) {
+  DCHECK(fifo_ && frame_);
+
+  if (flush) {
+    // 取出重采样器中延迟的样本
+    while (ReserveConvertBuffer(swr_get_out_samples(resampler_, 0))) {
+      const int converted = swr_convert(resampler_, convert_data_,
+                                        convert_capacity_, nullptr, 0);
+      if (converted <= 0 ||
+          av_audio_fifo_write(fifo_, reinterpret_cast<void**>(convert_data_),
+                              converted) < converted) {
+        break;
       }
-    } else {
-      frame_->data[0] = src_data_[0];
     }
+  }
+
+  const int frame_size = FrameSize();
+  const int available = av_audio_fifo_size(fifo_);
+  int nb_samples = 0;
+  if (available >= frame_size) {
+    nb_samples = frame_size;
+  } else if (flush) {
+    nb_samples = available;
+  }
+  if (nb_samples <= 0) {
+    return nullptr;
+  }
+
+  // 编码器可能还在引用上一帧的数据
+  frame_->nb_samples = frame_size;
+  if (av_frame_make_writable(frame_) < 0) {
+    DCHECK(false);
+    return nullptr;
+  }
 
-    *encoded_frame = frame_;
+  frame_->nb_samples = nb_samples;
+  if (av_audio_fifo_read(fifo_, reinterpret_cast<void**>(frame_->data),
+                         nb_samples) < nb_samples) {
+    DCHECK(false);
+    return nullptr;
   }
 
-  return nb_samples;
+  return frame_;
 }
 
-AVCodecContext * AudioEncoder::GetCodecContext() const {
-  return codec_context_;
+int AudioEncoder::BufferedSamples() const {
+  return fifo_ ? av_audio_fifo_size(fifo_) : 0;
+}
+
+int AudioEncoder::DiscardSamples(int nb_samples) {
+  if (!fifo_ || nb_samples <= 0) {
+    return 0;
+  }
+  nb_samples = FFMIN(nb_samples, av_audio_fifo_size(fifo_));
+  return av_audio_fifo_drain(fifo_, nb_samples) < 0 ? 0 : nb_samples;
+}
+
+bool AudioEncoder::SetCompensation(double ratio) {
+  DCHECK(resampler_);
+
+  const int distance = codec_context_->sample_rate * kCompensationSeconds;
+  const int sample_delta = static_cast<int>(lround(ratio * distance));
+  return swr_set_compensation(resampler_, sample_delta, distance) >= 0;
 }
 
 int AudioEncoder::FrameSize() const {
@@ -156,22 +258,16 @@ int AudioEncoder::FrameSize() const {
   return frame_->nb_samples;
 }
 
+int AudioEncoder::BytesPerSample() const {
+  return av_get_bytes_per_sample(config_.sample_fmt) * config_.channels;
+}
+
 SwrContext* AudioEncoder::CreateResampler(AVSampleFormat dst_sample_fmt,
                                           int dst_sample_rate,
                                           int64_t dst_channel_layout,
                                           AVSampleFormat src_sample_fmt,
                                           int src_sample_rate,
                                           int64_t src_channel_layout) {
-  if ((dst_sample_fmt != src_sample_fmt) ||
-      (dst_sample_rate != src_sample_rate) ||
-      (dst_channel_layout != src_channel_layout)) {
-    need_resample_ = true;
-  }
-
-  if (!need_resample_) {
-    return nullptr;
-  }
-
   SwrContext* resampler = swr_alloc_set_opts(
       resampler_,
       dst_channel_layout, dst_sample_fmt, dst_sample_rate,
@@ -182,6 +278,9 @@ SwrContext* AudioEncoder::CreateResampler(AVSampleFormat dst_sample_fmt,
     return nullptr;
   }
 
+  // 格式相同时也进行重采样，用来补偿录音设备的时钟偏差
+  av_opt_set_int(resampler, "flags", SWR_FLAG_RESAMPLE, 0);
+
   int ret = swr_init(resampler);
   if (ret < 0) {
     swr_free(&resampler);
@@ -198,13 +297,11 @@ AVFrame* AudioEncoder::CreateFrame(
     return nullptr;
   }
 
-  int nb_samples = 0;
-  if (codec_->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE) {
-    nb_samples = 100000;
-  } else if (codec_context_->frame_size > 0) {
+  // 样本先放在缓冲区中，帧大小可变的编码器也按固定的大小编码
+  int nb_samples = 1024;
+  if (!(codec_->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE) &&
+      codec_context_->frame_size > 0) {
     nb_samples = codec_context_->frame_size;
-  } else {
-    nb_samples = 1024;
   }
 
   AVFrame* frame = av_frame_alloc();
@@ -215,22 +312,40 @@ AVFrame* AudioEncoder::CreateFrame(
   frame->nb_samples = nb_samples;
   frame->format = sample_fmt;
   frame->channels = channels;
+  frame->channel_layout = codec_context_->channel_layout;
   frame->sample_rate = sample_rate;
 
-  int ret = 0;
-  if (nb_samples > 0) {
-    ret = av_frame_get_buffer(frame, 0);
-    if (ret < 0) {
-      return nullptr;
-    }
-  }
-
-  ret = av_samples_alloc_array_and_samples(
-      &src_data_, &src_buf_size_, config_.channels, nb_samples,
-      config_.sample_fmt, 0);
+  int ret = av_frame_get_buffer(frame, 0);
   if (ret < 0) {
+    av_frame_free(&frame);
     return nullptr;
   }
 
   return frame;
 }
+
+bool AudioEncoder::ReserveConvertBuffer(int nb_samples) {
+  if (nb_samples <= 0) {
+    return false;
+  }
+  if (nb_samples <= convert_capacity_) {
+    return true;
+  }
+
+  if (convert_data_) {
+    av_freep(&convert_data_[0]);
+  }
+  av_freep(&convert_data_);
+  convert_capacity_ = 0;
+
+  int ret = av_samples_alloc_array_and_samples(
+      &convert_data_, nullptr, codec_context_->channels, nb_samples,
+      codec_context_->sample_fmt, 0);
+  if (ret < 0) {
+    convert_data_ = nullptr;
+    return false;
+  }
+
+  convert_capacity_ = nb_samples;
+  return true;
+}
@@ -4,6 +4,9 @@
 #include "encoder/av_config.h"
 #include "encoder/av_encoder.h"
 
+// 采集到的音频数据经过重采样后先放入缓冲区，凑够一帧再编码，
+// 每次写入的样本数不需要与编码器的帧大小一致。
+// 重采样时可以按比例增减样本，用于补偿录音设备的时钟偏差。
 class AudioEncoder : public AVEncoder {
  public:
   AudioEncoder(const AudioConfig& audio_config);
@@ -13,6 +16,8 @@ class AudioEncoder : public AVEncoder {
 
   // Override from AVEncoder
   bool Open(AVStream* audio_stream) override;
+  // 写入len字节的数据，缓冲区中的数据足够一帧时通过encoded_frame返回一帧，
+  // 返回写入缓冲区的样本数
   int PushEncodeFrame(uint8_t* data,
                       int len,
                       int width,
@@ -22,8 +27,22 @@ class AudioEncoder : public AVEncoder {
                       AVFrame** encoded_frame) override;
   AVCodecContext* GetCodecContext() const override;
 
+  // 写入nb_samples个采集到的样本，返回重采样后写入缓冲区的样本数，失败返回负数
+  int PushSamples(const uint8_t* data, int nb_samples);
+  // 缓冲区中的数据足够一帧时取出一帧，否则返回nullptr。
+  // flush为true时取出重采样器和缓冲区中剩余的所有样本，最后一帧可能不满一帧
+  AVFrame* PopFrame(bool flush);
+  // 缓冲区中等待编码的样本数
+  int BufferedSamples() const;
+  // 丢弃缓冲区开头的样本，返回实际丢弃的样本数
+  int DiscardSamples(int nb_samples);
+
+  // 设置输出样本数的调整比例，正数表示增加样本
+  bool SetCompensation(double ratio);
+
   int FrameSize() const;
-  int src_buf_size() const { return src_buf_size_; }
+  // 每个输入样本(所有声道)的字节数
+  int BytesPerSample() const;
 
  private:
   SwrContext* CreateResampler(AVSampleFormat dst_sample_fmt,
@@ -37,20 +56,22 @@ class AudioEncoder : public AVEncoder {
                        int channels,
                        int sample_rate);
 
-  bool initialized_;
+  // 确保重采样的输出缓冲区可以容纳nb_samples个样本
+  bool ReserveConvertBuffer(int nb_samples);
 
-  // 存在不需要重采样的情况
-  bool need_resample_;
+  bool initialized_;
 
   AVCodec* codec_;
   AVCodecContext* codec_context_;
   AVFrame* frame_;
   SwrContext* resampler_;
+  AVAudioFifo* fifo_;
 
   AudioConfig config_;
 
-  int src_buf_size_;
-  uint8_t** src_data_;
+  // 重采样的输出缓冲区
+  uint8_t** convert_data_;
+  int convert_capacity_;
 
   AudioEncoder() = delete;
   AudioEncoder(const AudioEncoder&) = delete;
@@ -1,19 +1,111 @@
 ﻿#ifndef ENCODER_AV_CONFIG_H_
 #define ENCODER_AV_CONFIG_H_
 
+#include <string>
+#include <vector>
+
 #include "encoder/ffmpeg.h"
 
 struct VideoConfig {
   // 帧率
   int fps;
 
+  // 输入画面的大小
   int width;
   int height;
+  // 编码后画面的大小，为0时与输入画面相同
+  int output_width;
+  int output_height;
 
   AVPixelFormat input_pixel_format;
   AVCodecID codec_id;
+  // 编码器的名称，如"libsvtav1"，为空时使用codec_id默认的编码器。
+  // 支持libx264、libx265、libsvtav1和libvpx-vp9的参数换算
+  std::string encoder_name;
+
+  // 最大关键帧间隔(帧数)，画面静止时GOP最长延长到这个值，
+  // 值越大文件越小，但拖动进度条时定位越慢
+  int max_gop_size;
+  // 因画面变化插入的关键帧之间的最小间隔(帧数)
+  int min_gop_size;
+  // 画面变化的比例超过这个值时认为发生了场景切换，插入关键帧
+  float scene_change_threshold;
+  // 是否根据变化区域设置感兴趣区域(ROI)，变化的区域分配更多码率
+  bool enable_roi;
+
+  // 编码速度和质量的平衡，ultrafast ~ veryslow
+  std::string preset;
+  // 针对画面内容的优化，如stillimage
+  std::string tune;
+  // 恒定质量因子，0~51，越小画质越好，bit_rate为0时有效
+  int crf;
+  // 平均码率(bps)，大于0时使用码率控制代替crf
+  int64_t bit_rate;
+  int max_b_frames;
+  // 编码线程数，0表示由编码器决定
+  int threads;
+  // 码率控制的前瞻帧数，小于0时使用preset中的值
+  int lookahead;
+  // 无损编码，用于导入剪辑软件的中间文件，忽略crf和bit_rate。
+  // 只有libx264、libx264rgb、ffv1和utvideo支持，后两种总是无损的
+  bool lossless;
+  // 直播用的低延迟编码：不使用B帧和前瞻，帧内分片多线程编码，
+  // bit_rate大于0时使用恒定码率，VBV缓冲区只有几帧
+  bool low_latency;
+
+  // 编码跟不上时是否自动降低画质，见QualityController
+  bool adaptive_quality;
+  // 自动调整时crf的上限
+  int max_crf;
+  // 自动调整时每编码一帧最多丢弃的帧数
+  int max_frame_skip;
+
+  VideoConfig()
+      : fps(0),
+        width(0),
+        height(0),
+        output_width(0),
+        output_height(0),
+        input_pixel_format(AV_PIX_FMT_NONE),
+        codec_id(AV_CODEC_ID_NONE),
+        max_gop_size(250),
+        min_gop_size(12),
+        scene_change_threshold(0.5f),
+        enable_roi(true),
+        preset("ultrafast"),
+        tune("stillimage"),
+        crf(18),
+        bit_rate(0),
+        max_b_frames(1),
+        threads(0),
+        lookahead(-1),
+        lossless(false),
+        low_latency(false),
+        adaptive_quality(false),
+        max_crf(18),
+        max_frame_skip(0) {}
 };  // struct VideoConfig
 
+// 视频画面中的矩形区域，单位为像素
+struct VideoRect {
+  int left;
+  int top;
+  int right;
+  int bottom;
+};  // struct VideoRect
+
+// 截屏端统计的每一帧的信息
+struct VideoFrameInfo {
+  // 与上一帧相比发生变化的区域占整个画面的比例，0~1
+  float change_ratio;
+  // 这一帧之前时间轴不连续，如暂停后恢复
+  bool discontinuity;
+  // 与上一帧相比发生变化的区域，坐标相对于输入画面
+  std::vector<VideoRect> dirty_rects;
+
+  VideoFrameInfo() : change_ratio(1.0f), discontinuity(false) {}
+};  // struct VideoFrameInfo
+
 struct AudioConfig {
   // 编码ID
   AVCodecID codec_id;
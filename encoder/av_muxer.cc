@@ -1,7 +1,19 @@
 ﻿#include "encoder/av_muxer.h"
 
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
 #include "base/check.h"
+#include "encoder/audio_clock_sync.h"
 #include "encoder/audio_encoder.h"
+#include "encoder/gop_controller.h"
+#include "encoder/muxer_sink.h"
+#include "encoder/rendition_encoder.h"
+#include "encoder/replay_buffer.h"
+#include "encoder/scale_pyramid.h"
 #include "encoder/video_encoder.h"
 
 #ifdef av_err2str
@@ -16,6 +28,15 @@ char* av_err2str(int errnum) {
   return av_make_error_string(str, AV_ERROR_MAX_STRING_SIZE, errnum);
 }
 
+const int64_t kMicrosecondsPerSecond = 1000000;
+
+// output_path的队列上限，写入本地文件，一般不会积压。
+// 写入跟不上时让编码等待，录屏文件中不能缺少数据
+const int64_t kOutputQueueBytes = 256LL * 1024 * 1024;
+
+// 多码率输出按像素数的这个次方分配码率，小画面每个像素需要更多的码率
+const double kRenditionBitRateExponent = 0.75;
+
 }  // namespace
 
 AVMuxer::AVMuxer(const AudioConfig& audio_config,
@@ -23,8 +44,15 @@ AVMuxer::AVMuxer(const AudioConfig& audio_config,
                  const std::string& output_path,
                  bool can_capture_voice)
     : initialized_(false),
+      prepared_(false),
+      aborted_(false),
+      fragmented_(false),
+      replay_buffer_(nullptr),
+      packet_bus_(new PacketBus()),
+      output_sink_index_(-1),
       can_capture_voice_(can_capture_voice),
-      audio_samples_(0),
+      audio_started_(false),
+      audio_pts_(0),
       video_pts_(0),
       format_context_(nullptr),
       output_format_(nullptr),
@@ -32,35 +60,22 @@ AVMuxer::AVMuxer(const AudioConfig& audio_config,
       audio_stream_(nullptr),
       video_config_(video_config),
       video_stream_(nullptr),
-      output_path_(output_path),
-      buffer_audio_frame_(nullptr),
-      size_per_audio_frame_(0),
-      last_index_(0) {
+      output_path_(output_path) {
 }
 
 AVMuxer::~AVMuxer() {
   Flush();
 
-  int ret = av_write_trailer(format_context_);
-  DCHECK(ret == 0);
+  // 等待所有输出写完队列中的数据，写入文件尾
+  packet_bus_->Stop();
 
   audio_encoder_.reset(nullptr);
   video_encoder_.reset(nullptr);
 
-  if (output_format_ && !(output_format_->flags & AVFMT_NOFILE) &&
-      format_context_) {
-    avio_closep(&format_context_->pb);
-  }
-
   avformat_free_context(format_context_);
 
   format_context_ = nullptr;
   output_format_ = nullptr;
-
-  if (buffer_audio_frame_) {
-    delete[] buffer_audio_frame_;
-    buffer_audio_frame_ = nullptr;
-  }
 }
 
 bool AVMuxer::Initialize() {
@@ -74,6 +89,11 @@ bool AVMuxer::Initialize() {
     DCHECK(false);
     return false;
   }
+  // 调用者应该先用MuxerSink::SupportsCodec检查
+  if (avformat_query_codec(output_format_, video_config_.codec_id,
+                           FF_COMPLIANCE_NORMAL) != 1) {
+    return false;
+  }
 
   int ret = avformat_alloc_output_context2(
       &format_context_, output_format_, NULL, NULL);
@@ -86,6 +106,7 @@ bool AVMuxer::Initialize() {
   if (!video_encoder_->Initialize()) {
     return false;
   }
+  gop_controller_.reset(new GopController(video_config_));
 
   if (can_capture_voice_) {
     // 有可能没有录音设备
@@ -98,91 +119,211 @@ bool AVMuxer::Initialize() {
   return true;
 }
 
-bool AVMuxer::Open() {
+bool AVMuxer::Prepare() {
+  DCHECK(!prepared_);
+
   if (!OpenVideo()) {
     return false;
   }
 
   can_capture_voice_ = OpenAudio();
 
-  // 打开输出文件
-  int ret = 0;
-  if (!(output_format_->flags & AVFMT_NOFILE)) {
-    ret = avio_open(
-        &format_context_->pb, output_path_.c_str(), AVIO_FLAG_WRITE);
-    if (ret < 0) {
+  prepared_ = true;
+  return true;
+}
+
+bool AVMuxer::BindOutput(const std::string& output_path) {
+  DCHECK(initialized_);
+
+  if (av_guess_format(NULL, output_path.c_str(), NULL) != output_format_) {
+    return false;
+  }
+  output_path_ = output_path;
+  return true;
+}
+
+bool AVMuxer::Open() {
+  if (!prepared_ && !Prepare()) {
+    return false;
+  }
+
+  for (std::unique_ptr<RenditionEncoder>& rendition : renditions_) {
+    if (!rendition->Open(can_capture_voice_ ? audio_stream_ : nullptr,
+                         fragmented_)) {
       return false;
     }
   }
 
-  ret = avformat_write_header(format_context_, NULL);
-  if (ret < 0) {
-    DCHECK(false);
+  // 回放模式下保存时才创建文件，这里只记录流的参数
+  if (replay_buffer_) {
+    if (!replay_buffer_->AddStream(video_stream_)) {
+      return false;
+    }
+    if (can_capture_voice_ && !replay_buffer_->AddStream(audio_stream_)) {
+      return false;
+    }
+  }
+
+  if (!packet_bus_->AddStream(video_stream_)) {
+    return false;
+  }
+  if (can_capture_voice_ && !packet_bus_->AddStream(audio_stream_)) {
     return false;
   }
 
+  // 打开输出文件失败时不开始录制，其它输出在后台打开
+  if (!replay_buffer_) {
+    std::unique_ptr<MuxerSink> sink =
+        std::make_unique<MuxerSink>(output_path_, std::string());
+    sink->set_fragmented(fragmented_);
+    PacketSinkOptions options;
+    options.max_queued_bytes = kOutputQueueBytes;
+    options.wait_for_open = true;
+    options.block_when_full = true;
+    output_sink_index_ = packet_bus_->AddSink(std::move(sink), options);
+  }
+
   video_pts_ = 0;
+  return packet_bus_->Start();
+}
+
+bool AVMuxer::AddRendition(int height, const std::string& output_path) {
+  DCHECK(initialized_);
+
+  const AVCodecContext* codec_ctx = video_encoder_->GetCodecContext();
+  // 缩放金字塔只处理YUV420P，无损编码的RGB画面不支持多码率
+  if (codec_ctx->pix_fmt != AV_PIX_FMT_YUV420P) {
+    return false;
+  }
+  const int max_height =
+      renditions_.empty() ? codec_ctx->height : renditions_.back()->height();
+  // YUV420P的宽高需要是偶数
+  height &= ~1;
+  if (height < 2 || height >= max_height) {
+    return false;
+  }
+  const int width = std::max(
+      static_cast<int>(static_cast<int64_t>(codec_ctx->width) * height /
+                       codec_ctx->height) & ~1,
+      2);
+
+  if (!scale_pyramid_) {
+    scale_pyramid_.reset(
+        new ScalePyramid(codec_ctx->width, codec_ctx->height));
+  }
+  if (!scale_pyramid_->AddLevel(width, height)) {
+    return false;
+  }
+
+  // 输入已经是缩小后的YUV420P画面，编码参数的其它部分与主输出相同
+  VideoConfig config = video_config_;
+  config.width = width;
+  config.height = height;
+  config.output_width = 0;
+  config.output_height = 0;
+  config.input_pixel_format = AV_PIX_FMT_YUV420P;
+  if (config.bit_rate > 0) {
+    const double pixel_ratio = static_cast<double>(width) * height /
+                               (codec_ctx->width * codec_ctx->height);
+    config.bit_rate = static_cast<int64_t>(
+        config.bit_rate * pow(pixel_ratio, kRenditionBitRateExponent));
+  }
+
+  std::unique_ptr<RenditionEncoder> rendition =
+      std::make_unique<RenditionEncoder>(config, output_path);
+  if (!rendition->Initialize()) {
+    return false;
+  }
+  renditions_.push_back(std::move(rendition));
   return true;
 }
 
+void AVMuxer::AddSink(std::unique_ptr<PacketSink> sink,
+                      const PacketSinkOptions& options) {
+  packet_bus_->AddSink(std::move(sink), options);
+}
+
 void AVMuxer::Flush() {
+  // 编码器还没有打开，如初始化失败或者预热的AVMuxer没有使用
+  if (!prepared_ || aborted_) {
+    return;
+  }
+
   if (can_capture_voice_) {
-    EncodeAudioFrame(nullptr, 0);
+    EncodeAudioFrame(nullptr, 0, 0, false);
+  }
+  EncodeVideoFrame(nullptr, 0, 0, 0, 0, VideoFrameInfo());
+
+  // 音频已经全部送入，编码多码率输出剩余的帧，写入文件尾
+  for (std::unique_ptr<RenditionEncoder>& rendition : renditions_) {
+    rendition->Stop();
   }
-  EncodeVideoFrame(nullptr, 0, 0, 0, 0);
 }
 
-bool AVMuxer::EncodeAudioFrame(uint8_t* data, int len) {
+void AVMuxer::Abort() {
+  aborted_ = true;
+  for (std::unique_ptr<RenditionEncoder>& rendition : renditions_) {
+    rendition->Abort();
+  }
+  packet_bus_->Abort();
+}
+
+bool AVMuxer::EncodeAudioFrame(uint8_t* data,
+                               int len,
+                               int64_t time_stamp,
+                               bool discontinuity) {
   AVCodecContext* codec_ctx = audio_encoder_->GetCodecContext();
 
   if (!data || len <= 0) {
+    if (!WriteAudioFrames(true)) {
+      return false;
+    }
     return WriteFrame(format_context_, codec_ctx, audio_stream_, nullptr);
   }
 
-  int index = 0;
-  int copy_len = 0;
-  int remaining_len = len;
-
-  bool res = false;
-  int ret = 0;
-  AVFrame* encoded_frame = nullptr;
-  while (remaining_len > 0) {
-    DCHECK(last_index_ < size_per_audio_frame_);
+  const int sample_rate = codec_ctx->sample_rate;
+  const int bytes_per_sample = audio_encoder_->BytesPerSample();
+  if (!audio_started_) {
+    // 音频从第一段数据的采集时间开始，与画面对齐
+    audio_pts_ = time_stamp * sample_rate / kMicrosecondsPerSecond;
+    audio_started_ = true;
+  }
 
-    copy_len = size_per_audio_frame_ - last_index_;
-    if (remaining_len < copy_len) {
-      memcpy(buffer_audio_frame_ + last_index_, data + index, remaining_len);
-      last_index_ += remaining_len;
+  // 比较采集时间和这段数据在输出时间轴上的位置
+  const int64_t position = audio_pts_ + audio_encoder_->BufferedSamples();
+  const int64_t correction =
+      audio_clock_sync_->Update(time_stamp, position, discontinuity);
+  if (correction > 0) {
+    // 音频落后，时间轴向后跳过一段
+    audio_pts_ += correction;
+  } else if (correction < 0) {
+    // 音频超前，先丢弃缓冲区中的样本，不够时再丢弃这段数据开头的样本
+    int64_t drop = -correction;
+    drop -= audio_encoder_->DiscardSamples(static_cast<int>(
+        std::min<int64_t>(drop, audio_encoder_->BufferedSamples())));
+    const int64_t skip_bytes =
+        drop * audio_config_.sample_rate / sample_rate * bytes_per_sample;
+    if (skip_bytes >= len) {
       return true;
     }
+    data += skip_bytes;
+    len -= static_cast<int>(skip_bytes);
+  }
+  audio_encoder_->SetCompensation(audio_clock_sync_->compensation());
 
-    memcpy(buffer_audio_frame_ + last_index_, data + index, copy_len);
-    ret = audio_encoder_->PushEncodeFrame(
-        buffer_audio_frame_, size_per_audio_frame_, 0, 0, 0, 0, &encoded_frame);
-    if (ret < 0) {
-      return false;
-    }
-
-    encoded_frame->pts = av_rescale_q(
-        audio_samples_, {1, codec_ctx->sample_rate}, codec_ctx->time_base);
-    audio_samples_ += ret;
-
-    DCHECK(encoded_frame);
-    res = WriteFrame(format_context_, codec_ctx, audio_stream_, encoded_frame);
-    if (!res) {
-      return false;
-    }
-
-    index += copy_len;
-    remaining_len -= copy_len;
-    last_index_ = 0;
+  if (audio_encoder_->PushSamples(data, len / bytes_per_sample) < 0) {
+    return false;
   }
 
-  return true;
+  return WriteAudioFrames(false);
 }
 
-bool AVMuxer::EncodeVideoFrame(
-    uint8_t* data, int width, int height, int stride, uint64_t time_stamp) {
+bool AVMuxer::EncodeVideoFrame(uint8_t* data,
+                               int width,
+                               int height,
+                               int stride,
+                               uint64_t time_stamp,
+                               const VideoFrameInfo& frame_info) {
   AVFrame* encoded_frame = nullptr;
   int ret = video_encoder_->PushEncodeFrame(
       data, height * stride, width, height, stride,
@@ -192,6 +333,24 @@ bool AVMuxer::EncodeVideoFrame(
   }
   if (encoded_frame) {
     encoded_frame->pts = time_stamp;
+    const bool key_frame = gop_controller_->ShouldForceKeyFrame(frame_info);
+    encoded_frame->pict_type =
+        key_frame ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+    // 关键帧要完整编码整个画面，不设置ROI，否则静止区域的画质会一直保持较差
+    video_encoder_->SetRegionsOfInterest(
+        encoded_frame, width, height,
+        key_frame ? std::vector<VideoRect>() : frame_info.dirty_rects);
+
+    // 在主输出编码之前缩小，各路与主输出使用相同的关键帧位置。
+    // 多码率输出失败时不影响主输出
+    if (scale_pyramid_ && scale_pyramid_->Scale(encoded_frame)) {
+      for (size_t i = 0; i < renditions_.size(); ++i) {
+        renditions_[i]->EncodeFrame(scale_pyramid_->level(static_cast<int>(i)),
+                                    time_stamp, key_frame, width, height,
+                                    frame_info.dirty_rects);
+      }
+    }
   }
 
   AVCodecContext* ctx = video_encoder_->GetCodecContext();
@@ -202,6 +361,36 @@ bool AVMuxer::EncodeVideoFrame(
   return res;
 }
 
+bool AVMuxer::SetVideoCrf(int crf) {
+  DCHECK(video_encoder_);
+  for (std::unique_ptr<RenditionEncoder>& rendition : renditions_) {
+    rendition->SetCrf(crf);
+  }
+  return video_encoder_->SetCrf(crf);
+}
+
+bool AVMuxer::CanSetVideoCrf() const {
+  return video_encoder_ && video_encoder_->CanSetCrf();
+}
+
+bool AVMuxer::WriteAudioFrames(bool flush) {
+  AVCodecContext* codec_ctx = audio_encoder_->GetCodecContext();
+
+  AVFrame* encoded_frame = nullptr;
+  while ((encoded_frame = audio_encoder_->PopFrame(flush)) != nullptr) {
+    encoded_frame->pts = av_rescale_q(
+        audio_pts_, {1, codec_ctx->sample_rate}, codec_ctx->time_base);
+    audio_pts_ += encoded_frame->nb_samples;
+
+    if (!WriteFrame(format_context_, codec_ctx, audio_stream_,
+                    encoded_frame)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
 int AVMuxer::AudioFrameSize() const {
   DCHECK(audio_encoder_ && audio_encoder_.get());
   return audio_encoder_->FrameSize();
@@ -237,8 +426,7 @@ bool AVMuxer::OpenAudio() {
     return false;
   }
 
-  size_per_audio_frame_ = audio_encoder_->src_buf_size();
-  buffer_audio_frame_ = new uint8_t[size_per_audio_frame_];
+  audio_clock_sync_.reset(new AudioClockSync(audio_codec_ctx->sample_rate));
 
   return true;
 }
@@ -294,25 +482,20 @@ bool AVMuxer::WriteFrame(AVFormatContext* format_ctx,
     av_packet_rescale_ts(&pkt, codec_ctx->time_base, stream->time_base);
     pkt.stream_index = stream->index;
 
-    ret = av_interleaved_write_frame(format_ctx, &pkt);
-    av_packet_unref(&pkt);
-
-    if (ret < 0) {
-      return false;
+    if (replay_buffer_) {
+      replay_buffer_->Push(&pkt);
     }
+    packet_bus_->Push(&pkt);
+    // 音频只编码一次，写入每一路多码率输出
+    if (stream == audio_stream_) {
+      for (std::unique_ptr<RenditionEncoder>& rendition : renditions_) {
+        rendition->WriteAudioPacket(&pkt);
+      }
+    }
+    av_packet_unref(&pkt);
   }
 
-  return true;
-}
-
-int AVMuxer::WriteVideoFrame(
-    const AVRational& time_base, AVStream* stream, AVPacket* pkt) {
-  /* rescale output packet timestamp values from codec to stream timebase */
-  av_packet_rescale_ts(pkt, time_base, stream->time_base);
-  pkt->stream_index = stream->index;
-
-  /* Write the compressed frame to the media file. */
-  const int ret = av_interleaved_write_frame(format_context_, pkt);
-  DCHECK(ret == 0);
-  return ret;
+  // 其它输出失败时不影响录制
+  return output_sink_index_ < 0 ||
+         !packet_bus_->sink_failed(output_sink_index_);
 }
@@ -1,14 +1,28 @@
 ﻿// 音视频合成器
+//
+// 编码后的数据包通过PacketBus分发给所有的输出，output_path是第一个输出，
+// 还可以用AddSink增加其它格式的文件或者管道，只编码一次。
+// AddRendition增加分辨率更低的多码率输出，画面只转换一次颜色空间，
+// 逐级缩小后在各自的线程中编码，关键帧对齐。
+// 打开编码器(Prepare)与打开输出(Open)分开，可以在开始录制之前预热编码器，
+// 见encoder/muxer_prewarmer.h。
 
 #ifndef ENCODER_AV_MUXER_H_
 #define ENCODER_AV_MUXER_H_
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "encoder/av_config.h"
+#include "encoder/packet_bus.h"
 
+class AudioClockSync;
 class AudioEncoder;
+class GopController;
+class RenditionEncoder;
+class ReplayBuffer;
+class ScalePyramid;
 class VideoEncoder;
 
 class AVMuxer {
@@ -21,62 +35,127 @@ class AVMuxer {
 
   bool Initialize();
 
+  // 在Initialize之后调用，打开编码器并创建流，不打开输出。
+  // 不调用时由Open调用
+  bool Prepare();
+  // 在Open之前调用，修改输出文件的路径。预热时还不知道文件名，
+  // 开始录制时再绑定，封装格式与构造时不同时返回false
+  bool BindOutput(const std::string& output_path);
+
+  // 在Open之前调用，mp4等格式分段写入，进程异常退出时已经写入的部分仍然可以播放
+  void set_fragmented(bool fragmented) { fragmented_ = fragmented; }
+  // 在Open之前调用，回放模式下编码数据只送入replay_buffer，不创建输出文件。
+  // replay_buffer的生命周期要长于AVMuxer
+  void set_replay_buffer(ReplayBuffer* replay_buffer) {
+    replay_buffer_ = replay_buffer;
+  }
+  // 在Open之前调用，增加一个输出。输出写得慢时只丢弃它自己的数据，不影响编码
+  void AddSink(std::unique_ptr<PacketSink> sink,
+               const PacketSinkOptions& options);
+
+  // 在Initialize之后、Open之前调用，增加一路多码率输出。
+  // height: 画面高度，宽度按输出画面的比例计算，按从大到小的顺序增加，
+  //         要小于输出画面和前一路的高度，否则返回false
+  // output_path: UTF-8编码的文件路径
+  bool AddRendition(int height, const std::string& output_path);
+
   bool Open();
   void Flush();
-
-  bool EncodeAudioFrame(uint8_t* data, int len);
+  // 取消录制时调用，丢弃编码器和输出队列中的数据，不写入文件尾，
+  // 之后不能再编码，析构时也不再刷新
+  void Abort();
+
+  // 时间戳都是媒体时钟(capturer/media_clock.h)上的时间，单位微秒
+  // time_stamp: 第一个样本的采集时间
+  // discontinuity: 这段数据之前采集中断过，如暂停后恢复
+  bool EncodeAudioFrame(uint8_t* data,
+                        int len,
+                        int64_t time_stamp,
+                        bool discontinuity);
   bool EncodeVideoFrame(uint8_t* data,
                         int width,
                         int height,
                         int stride,
-                        uint64_t time_stamp);
+                        uint64_t time_stamp,
+                        const VideoFrameInfo& frame_info);
 
   int AudioFrameSize() const;
 
+  // 录制过程中调整视频的crf
+  bool SetVideoCrf(int crf);
+  // 编码器是否支持SetVideoCrf，在Initialize之后调用
+  bool CanSetVideoCrf() const;
+
+  const GopController* gop_controller() const {
+    return gop_controller_.get();
+  }
+  // 没有录音时返回nullptr
+  const AudioClockSync* audio_clock_sync() const {
+    return audio_clock_sync_.get();
+  }
+  // 用于统计各输出写入和丢弃的数据包
+  const PacketBus* packet_bus() const { return packet_bus_.get(); }
+  // 多码率输出，按增加的顺序排列
+  size_t rendition_count() const { return renditions_.size(); }
+  const RenditionEncoder* rendition(size_t index) const {
+    return renditions_[index].get();
+  }
+
  private:
   bool OpenAudio();
   bool OpenVideo();
 
+  // 编码缓冲区中所有完整的音频帧，flush为true时编码剩余的所有样本
+  bool WriteAudioFrames(bool flush);
+
   bool WriteFrame(AVFormatContext* format_ctx,
                   AVCodecContext* codec_ctx,
                   AVStream* stream,
                   AVFrame* encoded_frame);
 
-  int WriteVideoFrame(const AVRational& time_base,
-                      AVStream* stream,
-                      AVPacket* pkt);
-
   bool initialized_;
+  bool prepared_;
+  bool aborted_;
+
+  bool fragmented_;
+
+  ReplayBuffer* replay_buffer_;
+
+  std::unique_ptr<PacketBus> packet_bus_;
+  // output_path对应的输出的序号，回放模式下为-1
+  int output_sink_index_;
 
   // 用来判断是否应该录音
   bool can_capture_voice_;
 
-  // 录入的声音的样例数
-  int audio_samples_;
+  // 是否已经收到第一段音频
+  bool audio_started_;
+  // 下一个音频帧的时间戳，单位为一个样本
+  int64_t audio_pts_;
 
   int64_t video_pts_;
 
+  // 只用来创建流和确定编码参数，不写入文件
   AVFormatContext* format_context_;
   AVOutputFormat* output_format_;
 
   AudioConfig audio_config_;
   std::unique_ptr<AudioEncoder> audio_encoder_;
+  std::unique_ptr<AudioClockSync> audio_clock_sync_;
   AVStream* audio_stream_;
 
   VideoConfig video_config_;
   std::unique_ptr<VideoEncoder> video_encoder_;
+  std::unique_ptr<GopController> gop_controller_;
   AVStream* video_stream_;
 
+  // 多码率输出，scale_pyramid_的每一级对应一路
+  std::unique_ptr<ScalePyramid> scale_pyramid_;
+  std::vector<std::unique_ptr<RenditionEncoder>> renditions_;
+
   std::string output_path_;
   std::string output_dir_;
 
-  // 存放每一帧的音频数据
-  uint8_t* buffer_audio_frame_;
-  // 每一个音频帧数据大小
-  int size_per_audio_frame_;
-  // 每次录音的数据大小不一定被size_per_audio_frame_整除
-  int last_index_;
-
   AVMuxer() = delete;
   AVMuxer(const AVMuxer&) = delete;
   AVMuxer& operator=(const AVMuxer&) = delete;
@@ -0,0 +1,188 @@
+﻿#include "encoder/encoder_calibrator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "base/check.h"
+#include "encoder/video_encoder.h"
+
+namespace {
+
+// 每个候选参数编码的画面时长(秒)
+const int kCalibrationSeconds = 2;
+const int kMinCalibrationFrames = 30;
+
+// 线程数0表示使用所有核
+int EffectiveThreads(int threads) {
+  if (threads > 0) {
+    return threads;
+  }
+  return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+// 取出编码器输出的所有数据包，校准时不需要保存
+bool DrainPackets(AVCodecContext* codec_context, AVPacket* packet) {
+  while (true) {
+    int ret = avcodec_receive_packet(codec_context, packet);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+      return true;
+    }
+    if (ret < 0) {
+      return false;
+    }
+    av_packet_unref(packet);
+  }
+}
+
+}  // namespace
+
+const double EncoderCalibrator::kRequiredHeadroom = 1.5;
+
+EncoderCalibrator::EncoderCalibrator(const VideoConfig& video_config,
+                                     CalibrationFrameSource* frame_source)
+    : video_config_(video_config), frame_source_(frame_source) {
+  DCHECK(frame_source_);
+  DCHECK(video_config_.fps > 0);
+}
+
+EncoderCalibrator::~EncoderCalibrator() {}
+
+void EncoderCalibrator::AddCandidate(const std::string& preset, int threads) {
+  candidates_.push_back({preset, threads});
+}
+
+bool EncoderCalibrator::Run(
+    const std::function<bool()>& should_cancel,
+    const std::function<void(int finished, int total)>& progress) {
+  measurements_.clear();
+
+  const int total = static_cast<int>(candidates_.size());
+  std::string failed_preset;
+  std::string current_preset;
+  bool preset_passed = false;
+  for (int i = 0; i < total; ++i) {
+    const Candidate& candidate = candidates_[i];
+
+    // 上一个preset所有线程数都达不到要求，更慢的preset不用再测
+    if (candidate.preset != current_preset) {
+      if (!current_preset.empty() && !preset_passed) {
+        break;
+      }
+      current_preset = candidate.preset;
+      preset_passed = false;
+    }
+
+    Measurement measurement;
+    if (!Measure(candidate, should_cancel, &measurement)) {
+      return false;
+    }
+    measurements_.push_back(measurement);
+    if (measurement.headroom >= kRequiredHeadroom) {
+      preset_passed = true;
+    }
+
+    if (progress) {
+      progress(i + 1, total);
+    }
+  }
+
+  return true;
+}
+
+const EncoderCalibrator::Measurement* EncoderCalibrator::Best() const {
+  // 候选参数按preset从快到慢添加，越靠后画质越好
+  const Measurement* best = nullptr;
+  for (const Measurement& measurement : measurements_) {
+    if (measurement.headroom < kRequiredHeadroom) {
+      continue;
+    }
+    if (!best || best->candidate.preset != measurement.candidate.preset ||
+        EffectiveThreads(measurement.candidate.threads) <
+            EffectiveThreads(best->candidate.threads)) {
+      best = &measurement;
+    }
+  }
+  return best;
+}
+
+bool EncoderCalibrator::Measure(const Candidate& candidate,
+                                const std::function<bool()>& should_cancel,
+                                Measurement* measurement) {
+  DCHECK(measurement);
+
+  VideoConfig config = video_config_;
+  config.preset = candidate.preset;
+  config.threads = candidate.threads;
+
+  VideoEncoder encoder(config);
+  if (!encoder.Initialize() || !encoder.Open(nullptr)) {
+    return false;
+  }
+
+  AVCodecContext* codec_context = encoder.GetCodecContext();
+  AVPacket* packet = av_packet_alloc();
+  if (!packet) {
+    return false;
+  }
+
+  const int frames =
+      std::max(config.fps * kCalibrationSeconds, kMinCalibrationFrames);
+  frame_source_->Rewind();
+
+  // 只统计编码的耗时，不包括生成画面的耗时
+  std::chrono::steady_clock::duration elapsed(0);
+  bool result = true;
+  for (int i = 0; i < frames && result; ++i) {
+    if (should_cancel && should_cancel()) {
+      result = false;
+      break;
+    }
+
+    int stride = 0;
+    const uint8_t* data = frame_source_->NextFrame(&stride);
+    if (!data) {
+      result = false;
+      break;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    AVFrame* frame = nullptr;
+    if (encoder.PushEncodeFrame(const_cast<uint8_t*>(data),
+                                stride * config.height, config.width,
+                                config.height, stride, 0, &frame) < 0 ||
+        !frame) {
+      result = false;
+      break;
+    }
+    frame->pts = av_rescale_q(i, {1, config.fps}, codec_context->time_base);
+    frame->pict_type = AV_PICTURE_TYPE_NONE;
+
+    result = avcodec_send_frame(codec_context, frame) >= 0 &&
+             DrainPackets(codec_context, packet);
+
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  // 编码器内部缓存的帧也计入耗时
+  if (result) {
+    const auto start = std::chrono::steady_clock::now();
+    result = avcodec_send_frame(codec_context, nullptr) >= 0 &&
+             DrainPackets(codec_context, packet);
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  av_packet_free(&packet);
+  if (!result) {
+    return false;
+  }
+
+  const double seconds = std::max(
+      std::chrono::duration<double>(elapsed).count(), 1e-6);
+  measurement->candidate = candidate;
+  measurement->frames = frames;
+  measurement->encode_seconds = seconds;
+  measurement->headroom = frames / static_cast<double>(config.fps) / seconds;
+  return true;
+}
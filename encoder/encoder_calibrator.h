@@ -0,0 +1,87 @@
+﻿// 编码性能校准
+//
+// 用模拟的桌面画面以不同的preset、线程数试编码，测量每种参数相对于实时编码的余量，
+// 选出在这台机器上能稳定实时编码的画质最好的参数。
+
+#ifndef ENCODER_ENCODER_CALIBRATOR_H_
+#define ENCODER_ENCODER_CALIBRATOR_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "encoder/av_config.h"
+
+// 校准使用的画面，每个候选参数都从头开始编码相同的画面序列
+class CalibrationFrameSource {
+ public:
+  virtual ~CalibrationFrameSource() {}
+
+  // 回到画面序列的开头
+  virtual void Rewind() = 0;
+  // 生成下一帧，返回的数据在下一次调用前有效，格式与VideoConfig一致
+  virtual const uint8_t* NextFrame(int* stride) = 0;
+};  // class CalibrationFrameSource
+
+class EncoderCalibrator {
+ public:
+  struct Candidate {
+    std::string preset;
+    // 0表示由编码器决定
+    int threads;
+  };
+
+  struct Measurement {
+    Candidate candidate;
+    int frames;
+    // 编码所有帧的耗时(秒)
+    double encode_seconds;
+    // 画面时长 / 编码耗时，大于1才能实时编码
+    double headroom;
+  };
+
+  // 实时余量不低于这个值才认为能稳定编码，留出截屏、录音等占用的CPU
+  static const double kRequiredHeadroom;
+
+  // video_config: 除preset、threads外的编码参数
+  EncoderCalibrator(const VideoConfig& video_config,
+                    CalibrationFrameSource* frame_source);
+  ~EncoderCalibrator();
+
+  // 候选参数需按preset从快到慢的顺序添加
+  void AddCandidate(const std::string& preset, int threads);
+
+  // 依次测量候选参数，某个preset所有线程数都达不到要求时不再测量更慢的preset
+  // should_cancel: 返回true时中止校准，可以为空
+  // progress: 每测量完一个候选参数调用一次，可以为空
+  // 中止或编码器无法工作时返回false
+  bool Run(const std::function<bool()>& should_cancel,
+           const std::function<void(int finished, int total)>& progress);
+
+  const std::vector<Measurement>& measurements() const {
+    return measurements_;
+  }
+
+  // 满足kRequiredHeadroom的画质最好的参数：preset最慢，其次线程最少
+  // 所有参数都达不到要求时返回nullptr
+  const Measurement* Best() const;
+
+ private:
+  bool Measure(const Candidate& candidate,
+               const std::function<bool()>& should_cancel,
+               Measurement* measurement);
+
+  VideoConfig video_config_;
+  CalibrationFrameSource* frame_source_;
+
+  std::vector<Candidate> candidates_;
+  std::vector<Measurement> measurements_;
+
+  EncoderCalibrator() = delete;
+  EncoderCalibrator(const EncoderCalibrator&) = delete;
+  EncoderCalibrator& operator=(const EncoderCalibrator&) = delete;
+};  // class EncoderCalibrator
+
+#endif  // ENCODER_ENCODER_CALIBRATOR_H_
@@ -0,0 +1,387 @@
+﻿#include "encoder/frame_ring.h"
+
+#include <string.h>
+
+#include "base/check.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+
+#include "base/strings/utf_string_conversions.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2,
+              "FrameRing requires lock-free 32-bit atomics");
+
+namespace {
+
+const uint32_t kRingMagic = 0x47524652;  // "RFRG"
+const uint32_t kRingVersion = 2;
+
+// 槽位和数据按缓存行对齐，避免两个进程写同一个缓存行
+const size_t kAlignment = 64;
+
+size_t AlignUp(size_t value) {
+  return (value + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+enum SlotState : uint32_t {
+  kSlotFree = 0,
+  kSlotReady = 1,
+  kSlotReading = 2,
+};
+
+#if defined(OS_WIN)
+std::wstring MappingName(const std::string& name) {
+  return L"Local\\" + base::UTF8ToWide(name);
+}
+#else
+std::string ShmName(const std::string& name) {
+  return "/" + name;
+}
+#endif
+
+}  // namespace
+
+SharedMemory::SharedMemory()
+#if defined(OS_WIN)
+    : handle_(nullptr),
+#else
+    : fd_(-1),
+      owner_(false),
+#endif
+      data_(nullptr),
+      size_(0) {
+}
+
+SharedMemory::~SharedMemory() {
+  Close();
+}
+
+bool SharedMemory::Create(const std::string& name, size_t size) {
+  DCHECK(!data_);
+  DCHECK(size > 0);
+
+#if defined(OS_WIN)
+  const uint64_t size64 = size;
+  HANDLE handle = CreateFileMappingW(
+      INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+      static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64),
+      MappingName(name).c_str());
+  if (!handle) {
+    return false;
+  }
+  if (GetLastError() == ERROR_ALREADY_EXISTS) {
+    CloseHandle(handle);
+    return false;
+  }
+  void* data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (!data) {
+    CloseHandle(handle);
+    return false;
+  }
+  handle_ = handle;
+#else
+  const std::string shm_name = ShmName(name);
+  int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    close(fd);
+    shm_unlink(shm_name.c_str());
+    return false;
+  }
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    shm_unlink(shm_name.c_str());
+    return false;
+  }
+  fd_ = fd;
+  owner_ = true;
+#endif
+
+  name_ = name;
+  data_ = static_cast<uint8_t*>(data);
+  size_ = size;
+  return true;
+}
+
+bool SharedMemory::Open(const std::string& name) {
+  DCHECK(!data_);
+
+#if defined(OS_WIN)
+  HANDLE handle =
+      OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, MappingName(name).c_str());
+  if (!handle) {
+    return false;
+  }
+  void* data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+  if (!data) {
+    CloseHandle(handle);
+    return false;
+  }
+  MEMORY_BASIC_INFORMATION info;
+  if (VirtualQuery(data, &info, sizeof(info)) == 0) {
+    UnmapViewOfFile(data);
+    CloseHandle(handle);
+    return false;
+  }
+  handle_ = handle;
+  size_ = info.RegionSize;
+#else
+  int fd = shm_open(ShmName(name).c_str(), O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  fd_ = fd;
+  owner_ = false;
+  size_ = size;
+#endif
+
+  name_ = name;
+  data_ = static_cast<uint8_t*>(data);
+  return true;
+}
+
+void SharedMemory::Close() {
+  if (!data_) {
+    return;
+  }
+
+#if defined(OS_WIN)
+  UnmapViewOfFile(data_);
+  CloseHandle(static_cast<HANDLE>(handle_));
+  handle_ = nullptr;
+#else
+  munmap(data_, size_);
+  close(fd_);
+  fd_ = -1;
+  if (owner_) {
+    shm_unlink(ShmName(name_).c_str());
+    owner_ = false;
+  }
+#endif
+
+  name_.clear();
+  data_ = nullptr;
+  size_ = 0;
+}
+
+// 共享内存的开头，之后依次是各个槽位
+struct FrameRing::Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_size;
+
+  // 写入端下一个使用的槽位序号，只由写入端修改
+  alignas(kAlignment) std::atomic<uint32_t> write_index;
+  // 读取端下一个使用的槽位序号，只由读取端修改（读取端退出后由写入端恢复）
+  alignas(kAlignment) std::atomic<uint32_t> read_index;
+};  // struct FrameRing::Header
+
+// 槽位的状态和信息，数据紧跟在后面
+struct FrameRing::Slot {
+  alignas(kAlignment) std::atomic<uint32_t> state;
+  int32_t len;
+  // 写入时的write_index，恢复读取端时用来区分旧数据和重新写入的数据
+  uint32_t sequence;
+  FrameMeta meta;
+};  // struct FrameRing::Slot
+
+// static
+size_t FrameRing::SlotStride(size_t slot_size) {
+  return AlignUp(sizeof(Slot)) + AlignUp(slot_size);
+}
+
+// static
+std::unique_ptr<FrameRing> FrameRing::Create(const std::string& name,
+                                             int slot_count,
+                                             int slot_size) {
+  DCHECK(slot_count > 0);
+  DCHECK(slot_size > 0);
+
+  const size_t size =
+      AlignUp(sizeof(Header)) + SlotStride(slot_size) * slot_count;
+  std::unique_ptr<SharedMemory> memory(new SharedMemory());
+  if (!memory->Create(name, size)) {
+    return nullptr;
+  }
+
+  // 新映射的共享内存内容为0，这里显式构造，保证原子变量的初始状态
+  Header* header = new (memory->data()) Header();
+  header->magic = kRingMagic;
+  header->version = kRingVersion;
+  header->slot_count = static_cast<uint32_t>(slot_count);
+  header->slot_size = static_cast<uint32_t>(slot_size);
+  header->write_index.store(0, std::memory_order_relaxed);
+  header->read_index.store(0, std::memory_order_relaxed);
+
+  std::unique_ptr<FrameRing> ring(new FrameRing(std::move(memory)));
+  for (int i = 0; i < slot_count; ++i) {
+    Slot* slot = new (ring->SlotAt(i)) Slot();
+    slot->len = 0;
+    slot->sequence = 0;
+    memset(&slot->meta, 0, sizeof(slot->meta));
+    slot->state.store(kSlotFree, std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  return ring;
+}
+
+// static
+std::unique_ptr<FrameRing> FrameRing::Open(const std::string& name) {
+  std::unique_ptr<SharedMemory> memory(new SharedMemory());
+  if (!memory->Open(name) || memory->size() < sizeof(Header)) {
+    return nullptr;
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const Header* header = reinterpret_cast<const Header*>(memory->data());
+  if (header->magic != kRingMagic || header->version != kRingVersion ||
+      header->slot_count == 0 || header->slot_size == 0) {
+    return nullptr;
+  }
+  const size_t size = AlignUp(sizeof(Header)) +
+                      SlotStride(header->slot_size) * header->slot_count;
+  if (memory->size() < size) {
+    return nullptr;
+  }
+
+  return std::unique_ptr<FrameRing>(new FrameRing(std::move(memory)));
+}
+
+FrameRing::FrameRing(std::unique_ptr<SharedMemory> memory)
+    : memory_(std::move(memory)),
+      header_(reinterpret_cast<Header*>(memory_->data())) {}
+
+FrameRing::~FrameRing() {}
+
+bool FrameRing::BeginWrite(FrameMeta** meta, uint8_t** data) {
+  DCHECK(meta);
+  DCHECK(data);
+
+  const uint32_t index =
+      header_->write_index.load(std::memory_order_relaxed) %
+      header_->slot_count;
+  Slot* slot = SlotAt(index);
+  if (slot->state.load(std::memory_order_acquire) != kSlotFree) {
+    return false;
+  }
+
+  *meta = &slot->meta;
+  *data = SlotData(index);
+  return true;
+}
+
+void FrameRing::EndWrite(int len) {
+  DCHECK(len >= 0 && len <= slot_size());
+
+  const uint32_t write_index =
+      header_->write_index.load(std::memory_order_relaxed);
+  Slot* slot = SlotAt(write_index % header_->slot_count);
+  DCHECK(slot->state.load(std::memory_order_relaxed) == kSlotFree);
+
+  slot->len = len;
+  slot->sequence = write_index;
+  slot->state.store(kSlotReady, std::memory_order_release);
+  header_->write_index.store(write_index + 1, std::memory_order_release);
+}
+
+bool FrameRing::BeginRead(const FrameMeta** meta,
+                          const uint8_t** data,
+                          int* len) {
+  DCHECK(meta);
+  DCHECK(data);
+  DCHECK(len);
+
+  const uint32_t index =
+      header_->read_index.load(std::memory_order_relaxed) %
+      header_->slot_count;
+  Slot* slot = SlotAt(index);
+  if (slot->state.load(std::memory_order_acquire) != kSlotReady) {
+    return false;
+  }
+  slot->state.store(kSlotReading, std::memory_order_relaxed);
+
+  *meta = &slot->meta;
+  *data = SlotData(index);
+  *len = slot->len;
+  return true;
+}
+
+void FrameRing::EndRead() {
+  const uint32_t read_index =
+      header_->read_index.load(std::memory_order_relaxed);
+  Slot* slot = SlotAt(read_index % header_->slot_count);
+  DCHECK(slot->state.load(std::memory_order_relaxed) == kSlotReading);
+
+  slot->state.store(kSlotFree, std::memory_order_release);
+  header_->read_index.store(read_index + 1, std::memory_order_release);
+}
+
+int FrameRing::RecoverReader() {
+  int dropped = 0;
+  uint32_t read_index = header_->read_index.load(std::memory_order_acquire);
+  const uint32_t write_index =
+      header_->write_index.load(std::memory_order_relaxed);
+
+  while (read_index != write_index) {
+    Slot* slot = SlotAt(read_index % header_->slot_count);
+    const uint32_t state = slot->state.load(std::memory_order_acquire);
+    if (state == kSlotReading) {
+      // 读取端处理到一半，这个槽位的数据丢弃
+      slot->state.store(kSlotFree, std::memory_order_release);
+      ++dropped;
+    } else if (state == kSlotReady && slot->sequence == read_index) {
+      // 最早的就绪槽位留给新的读取端
+      break;
+    }
+    // 槽位已经释放，但读取端退出前没来得及更新read_index。
+    // 缓冲区满时写入端可能已经在这个槽位写入了最新的一帧，它排在最后
+    ++read_index;
+  }
+
+  header_->read_index.store(read_index, std::memory_order_release);
+  return dropped;
+}
+
+int FrameRing::PendingSlots() const {
+  return static_cast<int>(header_->write_index.load(std::memory_order_acquire) -
+                          header_->read_index.load(std::memory_order_acquire));
+}
+
+int FrameRing::slot_count() const {
+  return static_cast<int>(header_->slot_count);
+}
+
+int FrameRing::slot_size() const {
+  return static_cast<int>(header_->slot_size);
+}
+
+FrameRing::Slot* FrameRing::SlotAt(int index) const {
+  return reinterpret_cast<Slot*>(memory_->data() + AlignUp(sizeof(Header)) +
+                                 SlotStride(header_->slot_size) * index);
+}
+
+uint8_t* FrameRing::SlotData(int index) const {
+  return reinterpret_cast<uint8_t*>(SlotAt(index)) + AlignUp(sizeof(Slot));
+}
@@ -0,0 +1,137 @@
+﻿// 进程间传递音视频数据的共享内存环形缓冲区
+
+#ifndef ENCODER_FRAME_RING_H_
+#define ENCODER_FRAME_RING_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "build/build_config.h"
+
+// 命名的共享内存，录屏进程创建，编码进程按名字打开
+class SharedMemory {
+ public:
+  SharedMemory();
+  ~SharedMemory();
+
+  // 创建name对应的共享内存，同名的共享内存已存在时失败
+  bool Create(const std::string& name, size_t size);
+  // 打开已存在的共享内存，映射全部内容
+  bool Open(const std::string& name);
+  void Close();
+
+  uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+#if defined(OS_WIN)
+  // HANDLE，避免在头文件中包含windows.h
+  void* handle_;
+#else
+  int fd_;
+  // 创建者负责删除共享内存的名字
+  bool owner_;
+#endif
+  std::string name_;
+  uint8_t* data_;
+  size_t size_;
+
+  SharedMemory(const SharedMemory&) = delete;
+  SharedMemory& operator=(const SharedMemory&) = delete;
+};  // class SharedMemory
+
+// 画面中的矩形区域，单位为像素
+struct FrameRect {
+  int32_t left;
+  int32_t top;
+  int32_t right;
+  int32_t bottom;
+};  // struct FrameRect
+
+// 随数据一起传递的信息
+struct FrameMeta {
+  enum Type : uint32_t {
+    kVideo = 1,
+    kAudio = 2,
+    // 数据已全部发送，读取端处理完之前的数据后退出
+    kEnd = 3,
+  };
+
+  enum Flags : uint32_t {
+    // 这一帧之前时间轴不连续，需要插入关键帧
+    kDiscontinuity = 1 << 0,
+  };
+
+  static const int kMaxRects = 32;
+
+  uint32_t type;
+  uint32_t flags;
+  // 采集时间，媒体时钟上的微秒数
+  uint64_t timestamp;
+
+  // 以下只对视频有效
+  int32_t width;
+  int32_t height;
+  int32_t stride;
+  float change_ratio;
+  int32_t rect_count;
+  FrameRect rects[kMaxRects];
+};  // struct FrameMeta
+
+// 单生产者单消费者的环形缓冲区，槽位的内存在两个进程间共享，数据写入槽位后不再复制。
+// 每个槽位有一个原子的状态，写入端把空闲的槽位填好后标记为就绪，
+// 读取端处理完就绪的槽位后标记为空闲，两端都按顺序使用槽位，不需要加锁。
+class FrameRing {
+ public:
+  // 创建缓冲区，slot_size为每个槽位的数据大小(字节)
+  static std::unique_ptr<FrameRing> Create(const std::string& name,
+                                           int slot_count,
+                                           int slot_size);
+  // 打开另一个进程创建的缓冲区
+  static std::unique_ptr<FrameRing> Open(const std::string& name);
+
+  ~FrameRing();
+
+  // 写入端：取得下一个空闲槽位，没有空闲槽位时返回false
+  bool BeginWrite(FrameMeta** meta, uint8_t** data);
+  // 写入端：len为写入的数据大小
+  void EndWrite(int len);
+
+  // 读取端：取得下一个就绪的槽位，没有数据时返回false
+  bool BeginRead(const FrameMeta** meta, const uint8_t** data, int* len);
+  void EndRead();
+
+  // 读取进程异常退出后由写入端调用，丢弃它正在处理的槽位，
+  // 新的读取进程从下一个就绪的槽位继续。返回丢弃的槽位数
+  int RecoverReader();
+
+  // 已写入但还没有处理完的槽位数
+  int PendingSlots() const;
+
+  int slot_count() const;
+  int slot_size() const;
+
+ private:
+  struct Header;
+  struct Slot;
+
+  // 一个槽位占用的字节数，包括槽位信息和数据
+  static size_t SlotStride(size_t slot_size);
+
+  explicit FrameRing(std::unique_ptr<SharedMemory> memory);
+
+  Slot* SlotAt(int index) const;
+  uint8_t* SlotData(int index) const;
+
+  std::unique_ptr<SharedMemory> memory_;
+  Header* header_;
+
+  FrameRing() = delete;
+  FrameRing(const FrameRing&) = delete;
+  FrameRing& operator=(const FrameRing&) = delete;
+};  // class FrameRing
+
+#endif  // ENCODER_FRAME_RING_H_
@@ -0,0 +1,60 @@
+﻿#include "encoder/gop_controller.h"
+
+#include <algorithm>
+
+#include "base/check.h"
+
+namespace {
+
+// 平均变化比例的平滑系数
+const float kAverageWeight = 0.2f;
+
+}  // namespace
+
+GopController::GopController(const VideoConfig& video_config)
+    : max_gop_size_(std::max(video_config.max_gop_size, 1)),
+      min_gop_size_(std::max(std::min(video_config.min_gop_size,
+                                       video_config.max_gop_size), 1)),
+      scene_change_threshold_(video_config.scene_change_threshold),
+      frames_since_key_frame_(0),
+      average_change_(0.0f),
+      frame_count_(0),
+      key_frame_count_(0),
+      scene_change_count_(0) {
+}
+
+GopController::~GopController() {
+}
+
+bool GopController::ShouldForceKeyFrame(const VideoFrameInfo& frame_info) {
+  const float change = std::min(std::max(frame_info.change_ratio, 0.0f), 1.0f);
+
+  bool key_frame = false;
+  if (frame_count_ == 0) {
+    key_frame = true;
+  } else if (frame_info.discontinuity) {
+    key_frame = true;
+  } else if (frames_since_key_frame_ + 1 >= max_gop_size_) {
+    key_frame = true;
+  } else if (frames_since_key_frame_ + 1 >= min_gop_size_ &&
+             change >= scene_change_threshold_ &&
+             average_change_ < scene_change_threshold_ / 2) {
+    // 持续的大面积变化（如滚动、播放视频）不算场景切换，
+    // 否则每min_gop_size帧就会插入一个关键帧
+    key_frame = true;
+    ++scene_change_count_;
+  }
+
+  average_change_ =
+      average_change_ * (1.0f - kAverageWeight) + change * kAverageWeight;
+
+  ++frame_count_;
+  if (key_frame) {
+    ++key_frame_count_;
+    frames_since_key_frame_ = 0;
+  } else {
+    ++frames_since_key_frame_;
+  }
+
+  return key_frame;
+}
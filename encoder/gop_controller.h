@@ -0,0 +1,45 @@
+﻿// 根据画面变化决定关键帧的位置
+
+#ifndef ENCODER_GOP_CONTROLLER_H_
+#define ENCODER_GOP_CONTROLLER_H_
+
+#include <stdint.h>
+
+#include "encoder/av_config.h"
+
+// 编码器自身的场景切换检测被关闭，关键帧完全由这里决定：
+//   1. 画面静止时不插入关键帧，直到达到max_gop_size
+//   2. 画面从基本静止突然大面积变化时插入关键帧
+//   3. 暂停恢复等时间轴不连续的位置插入关键帧
+class GopController {
+ public:
+  explicit GopController(const VideoConfig& video_config);
+  ~GopController();
+
+  // 返回这一帧是否需要编码成关键帧，每一帧调用一次
+  bool ShouldForceKeyFrame(const VideoFrameInfo& frame_info);
+
+  int64_t frame_count() const { return frame_count_; }
+  int64_t key_frame_count() const { return key_frame_count_; }
+  int64_t scene_change_count() const { return scene_change_count_; }
+
+ private:
+  const int max_gop_size_;
+  const int min_gop_size_;
+  const float scene_change_threshold_;
+
+  // 距离上一个关键帧的帧数
+  int frames_since_key_frame_;
+  // 最近一段时间画面变化比例的平均值
+  float average_change_;
+
+  int64_t frame_count_;
+  int64_t key_frame_count_;
+  int64_t scene_change_count_;
+
+  GopController() = delete;
+  GopController(const GopController&) = delete;
+  GopController& operator=(const GopController&) = delete;
+};  // class GopController
+
+#endif  // ENCODER_GOP_CONTROLLER_H_
@@ -0,0 +1,204 @@
+﻿#include "encoder/live_sink.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "base/check.h"
+
+namespace {
+
+// 7个188字节的TS包，加上IP、UDP和SRT的头不超过以太网的MTU
+const int kLivePacketSize = 1316;
+// rtmp等基于TCP的协议不按包发送，使用较大的缓冲区
+const int kStreamBufferSize = 32 * 1024;
+// 令牌桶最多累积的时长(秒)，允许短时间的突发
+const double kPacingBurstSeconds = 0.02;
+
+bool HasPrefix(const std::string& str, const char* prefix) {
+  return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+}  // namespace
+
+const double LiveSink::kPacingFactor = 1.5;
+
+LiveSink::LiveSink(const LiveSinkConfig& config)
+    : config_(config),
+      format_context_(nullptr),
+      network_io_(nullptr),
+      paced_io_(nullptr),
+      packet_(nullptr),
+      header_written_(false),
+      pacing_rate_(config.bit_rate / 8.0 * kPacingFactor),
+      pacing_burst_(std::max(pacing_rate_ * kPacingBurstSeconds,
+                             kLivePacketSize * 2.0)),
+      pacing_tokens_(pacing_burst_) {
+  DCHECK(!config_.url.empty());
+}
+
+LiveSink::~LiveSink() {
+  Free();
+}
+
+std::string LiveSink::name() const {
+  return config_.url.substr(0, config_.url.find('?'));
+}
+
+bool LiveSink::Open(const std::vector<PacketStream>& streams) {
+  DCHECK(!format_context_);
+
+  const std::string& url = config_.url;
+  const std::string format = !config_.format.empty() ? config_.format
+                             : HasPrefix(url, "rtmp")  ? "flv"
+                                                       : "mpegts";
+  int ret = avformat_alloc_output_context2(&format_context_, nullptr,
+                                           format.c_str(), url.c_str());
+  if (ret < 0 || !format_context_) {
+    return false;
+  }
+
+  for (const PacketStream& stream : streams) {
+    AVStream* out_stream = avformat_new_stream(format_context_, nullptr);
+    if (!out_stream ||
+        avcodec_parameters_copy(out_stream->codecpar, stream.parameters) <
+            0) {
+      return false;
+    }
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = stream.time_base;
+    time_bases_.push_back(stream.time_base);
+  }
+
+  // udp和srt每次写入发送一个网络包
+  const bool srt = HasPrefix(url, "srt://");
+  const bool packetized = srt || HasPrefix(url, "udp://");
+  AVDictionary* options = nullptr;
+  av_dict_set_int(&options, "rw_timeout", config_.timeout_us, 0);
+  if (packetized) {
+    av_dict_set_int(&options, "pkt_size", kLivePacketSize, 0);
+  }
+  if (srt) {
+    av_dict_set_int(&options, "latency", config_.srt_latency_us, 0);
+  }
+  ret = avio_open2(&network_io_, url.c_str(), AVIO_FLAG_WRITE, nullptr,
+                   &options);
+  av_dict_free(&options);
+  if (ret < 0) {
+    return false;
+  }
+
+  const int buffer_size = packetized ? kLivePacketSize : kStreamBufferSize;
+  uint8_t* buffer = static_cast<uint8_t*>(av_malloc(buffer_size));
+  if (!buffer) {
+    return false;
+  }
+  paced_io_ = avio_alloc_context(buffer, buffer_size, 1, this, nullptr,
+                                 &LiveSink::WritePacket, nullptr);
+  if (!paced_io_) {
+    av_freep(&buffer);
+    return false;
+  }
+  if (packetized) {
+    paced_io_->max_packet_size = buffer_size;
+  }
+  format_context_->pb = paced_io_;
+  // 不为交织缓存数据，每个数据包写完立即发送
+  format_context_->max_delay = 0;
+  format_context_->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+
+  AVDictionary* mux_options = nullptr;
+  if (format == "flv") {
+    // 直播没有时长和文件大小，结束时不回写文件头
+    av_dict_set(&mux_options, "flvflags", "no_duration_filesize", 0);
+  }
+  ret = avformat_write_header(format_context_, &mux_options);
+  av_dict_free(&mux_options);
+  if (ret < 0) {
+    return false;
+  }
+  header_written_ = true;
+
+  pacing_time_ = std::chrono::steady_clock::now();
+  packet_ = av_packet_alloc();
+  return packet_ != nullptr;
+}
+
+bool LiveSink::Write(const AVPacket* packet) {
+  DCHECK(packet && packet_ && header_written_);
+
+  const int index = packet->stream_index;
+  if (index < 0 || index >= static_cast<int>(time_bases_.size())) {
+    DCHECK(false);
+    return false;
+  }
+
+  if (av_packet_ref(packet_, packet) < 0) {
+    return false;
+  }
+  av_packet_rescale_ts(packet_, time_bases_[index],
+                       format_context_->streams[index]->time_base);
+  // 数据包按编码顺序到达，时间戳在每个流内单调，不需要交织
+  const int ret = av_write_frame(format_context_, packet_);
+  av_packet_unref(packet_);
+  return ret >= 0;
+}
+
+bool LiveSink::Close() {
+  bool result = true;
+  if (header_written_) {
+    result = av_write_trailer(format_context_) == 0;
+    header_written_ = false;
+  }
+  Free();
+  return result;
+}
+
+// static
+int LiveSink::WritePacket(void* opaque, uint8_t* buf, int buf_size) {
+  LiveSink* sink = static_cast<LiveSink*>(opaque);
+  DCHECK(sink && sink->network_io_);
+
+  sink->Pace(buf_size);
+  avio_write(sink->network_io_, buf, buf_size);
+  avio_flush(sink->network_io_);
+  return sink->network_io_->error < 0 ? sink->network_io_->error : buf_size;
+}
+
+void LiveSink::Pace(int size) {
+  if (pacing_rate_ <= 0) {
+    return;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed =
+      std::chrono::duration<double>(now - pacing_time_).count();
+  pacing_time_ = now;
+  pacing_tokens_ =
+      std::min(pacing_burst_, pacing_tokens_ + elapsed * pacing_rate_);
+  pacing_tokens_ -= size;
+  if (pacing_tokens_ < 0) {
+    // 欠下的令牌在下次调用时按等待的时间补回
+    std::this_thread::sleep_for(
+        std::chrono::duration<double>(-pacing_tokens_ / pacing_rate_));
+  }
+}
+
+void LiveSink::Free() {
+  av_packet_free(&packet_);
+  if (paced_io_) {
+    av_freep(&paced_io_->buffer);
+    avio_context_free(&paced_io_);
+  }
+  if (network_io_) {
+    avio_closep(&network_io_);
+  }
+  if (format_context_) {
+    // pb是paced_io_，已经释放
+    format_context_->pb = nullptr;
+    avformat_free_context(format_context_);
+    format_context_ = nullptr;
+  }
+  time_bases_.clear();
+}
@@ -0,0 +1,81 @@
+﻿// 直播输出
+//
+// 把数据包发送到FFmpeg支持的网络地址，如srt://、udp://、rtmp://。
+// 封装器不为交织缓存数据，每个数据包立即发送。发送按码率平滑，关键帧等
+// 较大的数据包分散成多个网络包发送，不会瞬间占满接收端和路由器的缓冲区。
+// 队列的时长由PacketBus限制(PacketSinkOptions::max_queued_us)，网络跟不上时
+// 丢帧而不是增加延迟。
+
+#ifndef ENCODER_LIVE_SINK_H_
+#define ENCODER_LIVE_SINK_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "encoder/ffmpeg.h"
+#include "encoder/packet_bus.h"
+
+struct LiveSinkConfig {
+  // 如"srt://127.0.0.1:9000"、"udp://127.0.0.1:9000"、"rtmp://host/app/key"
+  std::string url;
+  // 封装格式的名称，为空时rtmp使用flv，其它协议使用mpegts
+  std::string format;
+  // 音视频的总码率(bps)，按这个码率的kPacingFactor倍平滑发送，0表示不平滑
+  int64_t bit_rate;
+  // 网络读写的超时(微秒)，连接断开时Write不会一直阻塞
+  int64_t timeout_us;
+  // srt接收端的缓冲时长(微秒)，丢包后在这段时间内重传
+  int64_t srt_latency_us;
+
+  LiveSinkConfig()
+      : bit_rate(0), timeout_us(3000000), srt_latency_us(120000) {}
+};  // struct LiveSinkConfig
+
+class LiveSink : public PacketSink {
+ public:
+  // 平滑发送的码率相对于平均码率的倍数，留出关键帧和封装开销的余量
+  static const double kPacingFactor;
+
+  explicit LiveSink(const LiveSinkConfig& config);
+  ~LiveSink() override;
+
+  // 不包含地址中的参数，srt的passphrase等不会写入日志
+  std::string name() const override;
+  bool Open(const std::vector<PacketStream>& streams) override;
+  bool Write(const AVPacket* packet) override;
+  bool Close() override;
+
+ private:
+  // 封装器写入的数据先经过这里平滑后再写入网络
+  static int WritePacket(void* opaque, uint8_t* buf, int buf_size);
+
+  // 按码率等待，直到可以发送size字节
+  void Pace(int size);
+  void Free();
+
+  const LiveSinkConfig config_;
+
+  AVFormatContext* format_context_;
+  // 网络连接
+  AVIOContext* network_io_;
+  // 封装器使用的AVIOContext，缓冲区大小与网络包一致
+  AVIOContext* paced_io_;
+  std::vector<AVRational> time_bases_;
+  AVPacket* packet_;
+  bool header_written_;
+
+  // 令牌桶，单位为字节
+  double pacing_rate_;
+  double pacing_burst_;
+  double pacing_tokens_;
+  std::chrono::steady_clock::time_point pacing_time_;
+
+  LiveSink() = delete;
+  LiveSink(const LiveSink&) = delete;
+  LiveSink& operator=(const LiveSink&) = delete;
+};  // class LiveSink
+
+#endif  // ENCODER_LIVE_SINK_H_
@@ -0,0 +1,115 @@
+﻿#include "encoder/muxer_prewarmer.h"
+
+#include "base/threading/thread_role.h"
+#include "encoder/av_muxer.h"
+
+namespace {
+
+// VideoConfig的所有字段都会影响编码器或者关键帧的位置
+bool IsSameVideoConfig(const VideoConfig& a, const VideoConfig& b) {
+  return a.fps == b.fps && a.width == b.width && a.height == b.height &&
+         a.output_width == b.output_width &&
+         a.output_height == b.output_height &&
+         a.input_pixel_format == b.input_pixel_format &&
+         a.codec_id == b.codec_id && a.encoder_name == b.encoder_name &&
+         a.max_gop_size == b.max_gop_size &&
+         a.min_gop_size == b.min_gop_size &&
+         a.scene_change_threshold == b.scene_change_threshold &&
+         a.enable_roi == b.enable_roi && a.preset == b.preset &&
+         a.tune == b.tune && a.crf == b.crf && a.bit_rate == b.bit_rate &&
+         a.max_b_frames == b.max_b_frames && a.threads == b.threads &&
+         a.lookahead == b.lookahead && a.lossless == b.lossless &&
+         a.low_latency == b.low_latency &&
+         a.adaptive_quality == b.adaptive_quality &&
+         a.max_crf == b.max_crf && a.max_frame_skip == b.max_frame_skip;
+}
+
+bool IsSameAudioConfig(const AudioConfig& a, const AudioConfig& b) {
+  return a.codec_id == b.codec_id && a.sample_rate == b.sample_rate &&
+         a.channels == b.channels && a.channel_layout == b.channel_layout &&
+         a.sample_fmt == b.sample_fmt;
+}
+
+}  // namespace
+
+MuxerPrewarmer::MuxerPrewarmer() : can_capture_voice_(false) {
+}
+
+MuxerPrewarmer::~MuxerPrewarmer() {
+  Clear();
+}
+
+void MuxerPrewarmer::Prewarm(const AudioConfig& audio_config,
+                             const VideoConfig& video_config,
+                             const std::string& output_path,
+                             bool can_capture_voice) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  // 后台线程还没有结束时也是在预热相同的参数
+  if ((thread_.joinable() || av_muxer_) &&
+      Matches(audio_config, video_config, output_path, can_capture_voice)) {
+    return;
+  }
+
+  Join();
+  av_muxer_.reset();
+
+  audio_config_ = audio_config;
+  video_config_ = video_config;
+  output_path_ = output_path;
+  can_capture_voice_ = can_capture_voice;
+  thread_ = std::thread(&MuxerPrewarmer::Run, this);
+}
+
+std::unique_ptr<AVMuxer> MuxerPrewarmer::Take(
+    const AudioConfig& audio_config,
+    const VideoConfig& video_config,
+    const std::string& output_path,
+    bool can_capture_voice) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  Join();
+  if (!av_muxer_ ||
+      !Matches(audio_config, video_config, output_path, can_capture_voice)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<AVMuxer> av_muxer = std::move(av_muxer_);
+  if (!av_muxer->BindOutput(output_path)) {
+    return nullptr;
+  }
+  return av_muxer;
+}
+
+void MuxerPrewarmer::Clear() {
+  std::lock_guard<std::mutex> locker(mutex_);
+  Join();
+  av_muxer_.reset();
+}
+
+void MuxerPrewarmer::Run() {
+  // x264在这个线程中创建自己的线程，与编码线程使用相同的设置
+  base::SetCurrentThreadRole(base::ThreadRole::ENCODE);
+
+  std::unique_ptr<AVMuxer> av_muxer = std::make_unique<AVMuxer>(
+      audio_config_, video_config_, output_path_, can_capture_voice_);
+  if (av_muxer->Initialize() && av_muxer->Prepare()) {
+    av_muxer_ = std::move(av_muxer);
+  }
+}
+
+bool MuxerPrewarmer::Matches(const AudioConfig& audio_config,
+                             const VideoConfig& video_config,
+                             const std::string& output_path,
+                             bool can_capture_voice) const {
+  // 封装格式不同时流的参数(如全局头)不同，不能使用
+  return can_capture_voice == can_capture_voice_ &&
+         IsSameAudioConfig(audio_config, audio_config_) &&
+         IsSameVideoConfig(video_config, video_config_) &&
+         av_guess_format(NULL, output_path.c_str(), NULL) ==
+             av_guess_format(NULL, output_path_.c_str(), NULL);
+}
+
+void MuxerPrewarmer::Join() {
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
@@ -0,0 +1,75 @@
+﻿// 预热的音视频合成器
+//
+// 打开编码器(查找编码器、avcodec_open2、x264初始化线程和前瞻缓冲区、
+// 创建颜色空间转换)要几百毫秒，开始录制时才做的话，这期间截取的画面在
+// 队列中积压，开头几秒会卡顿。Prewarm在后台线程中提前创建AVMuxer并打开
+// 编码器，开始录制时Take取走，只需要再打开输出文件。
+
+#ifndef ENCODER_MUXER_PREWARMER_H_
+#define ENCODER_MUXER_PREWARMER_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "encoder/av_config.h"
+
+class AVMuxer;
+
+class MuxerPrewarmer {
+ public:
+  MuxerPrewarmer();
+  ~MuxerPrewarmer();
+
+  // 在后台线程中创建AVMuxer并打开编码器，丢弃之前预热的AVMuxer。
+  // 参数和封装格式与正在预热或者已经预热的相同时什么也不做。
+  // output_path只用来确定封装格式，Take时换成实际的文件路径
+  void Prewarm(const AudioConfig& audio_config,
+               const VideoConfig& video_config,
+               const std::string& output_path,
+               bool can_capture_voice);
+
+  // 参数和封装格式与预热时相同时返回预热的AVMuxer，后台还没有完成时等待。
+  // 返回的AVMuxer已经调用过Initialize和Prepare，输出路径为output_path，
+  // 还可以增加输出和多码率输出，然后调用Open。
+  // 没有预热、参数不同或者预热失败时返回nullptr
+  std::unique_ptr<AVMuxer> Take(const AudioConfig& audio_config,
+                                const VideoConfig& video_config,
+                                const std::string& output_path,
+                                bool can_capture_voice);
+
+  // 丢弃预热的AVMuxer，释放编码器占用的线程和内存
+  void Clear();
+
+ private:
+  // 后台线程
+  void Run();
+
+  // 参数和封装格式是否与预热时相同，调用前要锁住mutex_
+  bool Matches(const AudioConfig& audio_config,
+               const VideoConfig& video_config,
+               const std::string& output_path,
+               bool can_capture_voice) const;
+
+  // 等待后台线程结束，调用前要锁住mutex_
+  void Join();
+
+  // Prewarm、Take和Clear可能在不同的线程中调用
+  std::mutex mutex_;
+  std::thread thread_;
+
+  // 预热时的参数，只有参数相同时才能使用预热的AVMuxer
+  AudioConfig audio_config_;
+  VideoConfig video_config_;
+  std::string output_path_;
+  bool can_capture_voice_;
+
+  // 后台线程的结果，Join之后才能访问
+  std::unique_ptr<AVMuxer> av_muxer_;
+
+  MuxerPrewarmer(const MuxerPrewarmer&) = delete;
+  MuxerPrewarmer& operator=(const MuxerPrewarmer&) = delete;
+};  // class MuxerPrewarmer
+
+#endif  // ENCODER_MUXER_PREWARMER_H_
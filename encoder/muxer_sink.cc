@@ -0,0 +1,121 @@
+﻿#include "encoder/muxer_sink.h"
+
+#include "base/check.h"
+
+MuxerSink::MuxerSink(const std::string& url, const std::string& format)
+    : url_(url),
+      format_(format),
+      fragmented_(false),
+      format_context_(nullptr),
+      packet_(nullptr),
+      header_written_(false) {
+  DCHECK(!url_.empty());
+}
+
+MuxerSink::~MuxerSink() {
+  Free();
+}
+
+// static
+bool MuxerSink::SupportsCodec(const std::string& url,
+                              const std::string& format,
+                              AVCodecID codec_id) {
+  AVOutputFormat* output_format = av_guess_format(
+      format.empty() ? nullptr : format.c_str(), url.c_str(), nullptr);
+  return output_format &&
+         avformat_query_codec(output_format, codec_id, FF_COMPLIANCE_NORMAL) ==
+             1;
+}
+
+bool MuxerSink::Open(const std::vector<PacketStream>& streams) {
+  DCHECK(!format_context_);
+
+  int ret = avformat_alloc_output_context2(
+      &format_context_, nullptr, format_.empty() ? nullptr : format_.c_str(),
+      url_.c_str());
+  if (ret < 0 || !format_context_) {
+    return false;
+  }
+
+  for (const PacketStream& stream : streams) {
+    AVStream* out_stream = avformat_new_stream(format_context_, nullptr);
+    if (!out_stream ||
+        avcodec_parameters_copy(out_stream->codecpar, stream.parameters) <
+            0) {
+      return false;
+    }
+    // 不同封装格式的codec_tag不同，由封装器重新选择
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = stream.time_base;
+    time_bases_.push_back(stream.time_base);
+  }
+
+  if (!(format_context_->oformat->flags & AVFMT_NOFILE)) {
+    ret = avio_open(&format_context_->pb, url_.c_str(), AVIO_FLAG_WRITE);
+    if (ret < 0) {
+      return false;
+    }
+  }
+
+  // 每个关键帧开始一个分段，不需要在结束时写入完整的索引
+  AVDictionary* options = nullptr;
+  if (fragmented_) {
+    av_dict_set(&options, "movflags", "frag_keyframe+empty_moov", 0);
+  }
+  ret = avformat_write_header(format_context_, &options);
+  av_dict_free(&options);
+  if (ret < 0) {
+    return false;
+  }
+  header_written_ = true;
+
+  packet_ = av_packet_alloc();
+  return packet_ != nullptr;
+}
+
+bool MuxerSink::Write(const AVPacket* packet) {
+  DCHECK(packet && packet_ && header_written_);
+
+  const int index = packet->stream_index;
+  if (index < 0 || index >= static_cast<int>(time_bases_.size())) {
+    DCHECK(false);
+    return false;
+  }
+
+  // 数据包由所有输出共享，只取得引用，时间戳换算到写入头之后流的time_base
+  if (av_packet_ref(packet_, packet) < 0) {
+    return false;
+  }
+  av_packet_rescale_ts(packet_, time_bases_[index],
+                       format_context_->streams[index]->time_base);
+  // av_interleaved_write_frame接管packet_中的引用
+  return av_interleaved_write_frame(format_context_, packet_) >= 0;
+}
+
+bool MuxerSink::Close() {
+  bool result = true;
+  if (header_written_) {
+    result = av_write_trailer(format_context_) == 0;
+    header_written_ = false;
+  }
+  Free();
+  return result;
+}
+
+void MuxerSink::Abort() {
+  header_written_ = false;
+  Free();
+}
+
+void MuxerSink::Free() {
+  av_packet_free(&packet_);
+  if (format_context_) {
+    if (!(format_context_->oformat->flags & AVFMT_NOFILE) &&
+        format_context_->pb) {
+      avio_closep(&format_context_->pb);
+    }
+    avformat_free_context(format_context_);
+    format_context_ = nullptr;
+  }
+  time_bases_.clear();
+}
@@ -0,0 +1,54 @@
+﻿// 封装到文件或者FFmpeg支持的地址的输出，如mp4、mkv文件或者写入管道的MPEG-TS
+
+#ifndef ENCODER_MUXER_SINK_H_
+#define ENCODER_MUXER_SINK_H_
+
+#include <string>
+#include <vector>
+
+#include "encoder/ffmpeg.h"
+#include "encoder/packet_bus.h"
+
+class MuxerSink : public PacketSink {
+ public:
+  // url: UTF-8编码的文件路径或者FFmpeg的地址，如"pipe:1"
+  // format: 封装格式的名称，如"mp4"、"matroska"、"mpegts"，
+  //         为空时由url的后缀决定
+  MuxerSink(const std::string& url, const std::string& format);
+  ~MuxerSink() override;
+
+  // url、format与构造函数相同，返回封装格式是否支持这种编码，
+  // 如mp4和mkv都支持H.265、AV1和VP9，MPEG-TS不支持VP9
+  static bool SupportsCodec(const std::string& url,
+                            const std::string& format,
+                            AVCodecID codec_id);
+
+  // 在Open之前调用，mp4等格式分段写入，进程异常退出时已经写入的部分仍然可以播放
+  void set_fragmented(bool fragmented) { fragmented_ = fragmented; }
+
+  std::string name() const override { return url_; }
+  bool Open(const std::vector<PacketStream>& streams) override;
+  bool Write(const AVPacket* packet) override;
+  bool Close() override;
+  // 不写入文件尾，只关闭文件
+  void Abort() override;
+
+ private:
+  void Free();
+
+  const std::string url_;
+  const std::string format_;
+  bool fragmented_;
+
+  AVFormatContext* format_context_;
+  // 输入数据包的时间戳单位，按流的序号排列
+  std::vector<AVRational> time_bases_;
+  AVPacket* packet_;
+  bool header_written_;
+
+  MuxerSink() = delete;
+  MuxerSink(const MuxerSink&) = delete;
+  MuxerSink& operator=(const MuxerSink&) = delete;
+};  // class MuxerSink
+
+#endif  // ENCODER_MUXER_SINK_H_
@@ -0,0 +1,334 @@
+﻿#include "encoder/packet_bus.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "base/check.h"
+#include "base/threading/thread_role.h"
+
+namespace {
+
+const AVRational kMicrosecondTimeBase = {1, 1000000};
+
+void FreePacket(const AVPacket* packet) {
+  AVPacket* p = const_cast<AVPacket*>(packet);
+  av_packet_free(&p);
+}
+
+}  // namespace
+
+struct PacketBus::Sink {
+  struct Item {
+    std::shared_ptr<const AVPacket> packet;
+    // 解码时间，用于计算队列的时长
+    int64_t time_us;
+  };  // struct Item
+
+  std::unique_ptr<PacketSink> sink;
+  const PacketSinkOptions options;
+  std::thread thread;
+
+  std::mutex lock;
+  std::condition_variable cond;
+  // 写入线程取出数据包或者输出失败后通知，block_when_full时Push在这里等待
+  std::condition_variable space_cond;
+  // 所有输出共享同一个数据包，最后一个输出写完后释放
+  std::deque<Item> queue;
+  int64_t queued_bytes;
+  // 队列满后丢弃数据包，直到下一个视频关键帧
+  bool waiting_for_key_frame;
+  // Open已经返回
+  bool open_finished;
+  bool stopping;
+  // 用Abort代替Close关闭输出
+  bool aborting;
+  PacketSinkStats stats;
+
+  Sink(std::unique_ptr<PacketSink> sink, const PacketSinkOptions& options)
+      : sink(std::move(sink)),
+        options(options),
+        queued_bytes(0),
+        waiting_for_key_frame(false),
+        open_finished(false),
+        stopping(false),
+        aborting(false) {}
+};  // struct PacketBus::Sink
+
+PacketBus::PacketBus() : video_stream_index_(-1), started_(false) {}
+
+PacketBus::~PacketBus() {
+  Stop();
+  for (PacketStream& stream : streams_) {
+    avcodec_parameters_free(&stream.parameters);
+  }
+}
+
+bool PacketBus::AddStream(const AVStream* stream) {
+  DCHECK(stream && stream->codecpar);
+  DCHECK(!started_);
+  DCHECK(stream->index == static_cast<int>(streams_.size()));
+
+  AVCodecParameters* parameters = avcodec_parameters_alloc();
+  if (!parameters) {
+    return false;
+  }
+  if (avcodec_parameters_copy(parameters, stream->codecpar) < 0) {
+    avcodec_parameters_free(&parameters);
+    return false;
+  }
+
+  if (parameters->codec_type == AVMEDIA_TYPE_VIDEO &&
+      video_stream_index_ < 0) {
+    video_stream_index_ = stream->index;
+  }
+  streams_.push_back({parameters, stream->time_base});
+  return true;
+}
+
+int PacketBus::AddSink(std::unique_ptr<PacketSink> sink,
+                       const PacketSinkOptions& options) {
+  DCHECK(sink);
+  DCHECK(!started_);
+  DCHECK(options.max_queued_bytes > 0);
+
+  sinks_.push_back(std::make_unique<Sink>(std::move(sink), options));
+  return static_cast<int>(sinks_.size()) - 1;
+}
+
+bool PacketBus::Start() {
+  DCHECK(!started_);
+  if (streams_.empty()) {
+    return false;
+  }
+
+  for (std::unique_ptr<Sink>& sink : sinks_) {
+    sink->thread = std::thread(&PacketBus::RunSink, sink.get(), &streams_);
+  }
+  started_ = true;
+
+  bool result = true;
+  for (std::unique_ptr<Sink>& sink : sinks_) {
+    if (!sink->options.wait_for_open) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sink->lock);
+    sink->cond.wait(lock, [&sink]() { return sink->open_finished; });
+    result = result && !sink->stats.failed;
+  }
+  return result;
+}
+
+void PacketBus::Push(const AVPacket* packet) {
+  DCHECK(packet);
+  if (!started_ || sinks_.empty()) {
+    return;
+  }
+
+  const AVPacket* ref = av_packet_clone(packet);
+  if (!ref) {
+    for (std::unique_ptr<Sink>& sink : sinks_) {
+      std::lock_guard<std::mutex> lock(sink->lock);
+      ++sink->stats.dropped_packets;
+      // 不能缺少数据的输出不再写入，由sink_failed报告
+      if (sink->options.block_when_full) {
+        sink->stats.failed = true;
+      }
+    }
+    return;
+  }
+  std::shared_ptr<const AVPacket> shared(ref, FreePacket);
+
+  const bool key_frame = packet->stream_index == video_stream_index_ &&
+                         (packet->flags & AV_PKT_FLAG_KEY);
+  int64_t time_us = 0;
+  if (packet->stream_index >= 0 &&
+      packet->stream_index < static_cast<int>(streams_.size())) {
+    const int64_t time =
+        packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    time_us = av_rescale_q(time, streams_[packet->stream_index].time_base,
+                           kMicrosecondTimeBase);
+  }
+
+  // 先放入不等待的输出，最后才等待block_when_full的输出，
+  // 录屏文件写得慢时直播等输出仍然立即收到数据包
+  for (int pass = 0; pass < 2; ++pass) {
+    const bool blocking_pass = pass == 1;
+    for (std::unique_ptr<Sink>& sink : sinks_) {
+      if (sink->options.block_when_full == blocking_pass) {
+        Enqueue(sink.get(), shared, time_us, key_frame);
+      }
+    }
+  }
+}
+
+// static
+void PacketBus::Enqueue(Sink* sink,
+                        const std::shared_ptr<const AVPacket>& packet,
+                        int64_t time_us,
+                        bool key_frame) {
+  const int size = packet->size;
+  std::unique_lock<std::mutex> lock(sink->lock);
+  if (sink->options.block_when_full) {
+    // 比上限大的数据包等队列为空后放入
+    sink->space_cond.wait(lock, [sink, size]() {
+      return sink->stats.failed || sink->queue.empty() ||
+             sink->queued_bytes + size <= sink->options.max_queued_bytes;
+    });
+  }
+  if (sink->stats.failed) {
+    ++sink->stats.dropped_packets;
+    return;
+  }
+  if (sink->options.max_queued_us > 0 && !sink->queue.empty() &&
+      time_us - sink->queue.front().time_us > sink->options.max_queued_us) {
+    // 积压的数据已经过时，全部丢弃，从下一个关键帧开始
+    sink->stats.dropped_packets += static_cast<int64_t>(sink->queue.size());
+    sink->queue.clear();
+    sink->queued_bytes = 0;
+    sink->waiting_for_key_frame = true;
+  }
+  if (sink->waiting_for_key_frame && !key_frame) {
+    ++sink->stats.dropped_packets;
+    return;
+  }
+  if (!sink->options.block_when_full &&
+      sink->queued_bytes + size > sink->options.max_queued_bytes) {
+    ++sink->stats.dropped_packets;
+    sink->waiting_for_key_frame = true;
+    return;
+  }
+
+  sink->waiting_for_key_frame = false;
+  sink->queue.push_back({packet, time_us});
+  sink->queued_bytes += size;
+  sink->stats.max_queued_bytes =
+      std::max(sink->stats.max_queued_bytes, sink->queued_bytes);
+  sink->cond.notify_one();
+}
+
+void PacketBus::Stop() {
+  if (!started_) {
+    return;
+  }
+
+  for (std::unique_ptr<Sink>& sink : sinks_) {
+    std::lock_guard<std::mutex> lock(sink->lock);
+    sink->stopping = true;
+    sink->cond.notify_all();
+  }
+  for (std::unique_ptr<Sink>& sink : sinks_) {
+    if (sink->thread.joinable()) {
+      sink->thread.join();
+    }
+  }
+  started_ = false;
+}
+
+void PacketBus::Abort() {
+  if (!started_) {
+    return;
+  }
+
+  for (std::unique_ptr<Sink>& sink : sinks_) {
+    std::lock_guard<std::mutex> lock(sink->lock);
+    sink->stats.dropped_packets += static_cast<int64_t>(sink->queue.size());
+    sink->queue.clear();
+    sink->queued_bytes = 0;
+    sink->stopping = true;
+    sink->aborting = true;
+    sink->cond.notify_all();
+  }
+  for (std::unique_ptr<Sink>& sink : sinks_) {
+    if (sink->thread.joinable()) {
+      sink->thread.join();
+    }
+  }
+  started_ = false;
+}
+
+std::string PacketBus::sink_name(int index) const {
+  DCHECK(index >= 0 && index < static_cast<int>(sinks_.size()));
+  return sinks_[index]->sink->name();
+}
+
+PacketSinkStats PacketBus::sink_stats(int index) const {
+  DCHECK(index >= 0 && index < static_cast<int>(sinks_.size()));
+  Sink* sink = sinks_[index].get();
+  std::lock_guard<std::mutex> lock(sink->lock);
+  return sink->stats;
+}
+
+bool PacketBus::sink_failed(int index) const {
+  return sink_stats(index).failed;
+}
+
+// static
+void PacketBus::RunSink(Sink* sink, const std::vector<PacketStream>* streams) {
+  DCHECK(sink && streams);
+
+  // 写文件或者网络，不与截屏和编码抢占CPU
+  base::SetCurrentThreadRole(base::ThreadRole::IO);
+
+  const bool opened = sink->sink->Open(*streams);
+  bool ok = opened;
+  {
+    std::lock_guard<std::mutex> lock(sink->lock);
+    sink->open_finished = true;
+    sink->stats.failed = !opened;
+    sink->cond.notify_all();
+    sink->space_cond.notify_all();
+  }
+
+  while (true) {
+    std::shared_ptr<const AVPacket> packet;
+    {
+      std::unique_lock<std::mutex> lock(sink->lock);
+      if (!ok) {
+        // 输出失败后丢弃剩下的数据，Push也不再放入新的数据
+        sink->stats.failed = true;
+        sink->stats.dropped_packets +=
+            static_cast<int64_t>(sink->queue.size());
+        sink->queue.clear();
+        sink->queued_bytes = 0;
+        sink->space_cond.notify_all();
+      }
+      sink->cond.wait(lock, [sink]() {
+        return !sink->queue.empty() || sink->stopping;
+      });
+      if (sink->queue.empty()) {
+        break;
+      }
+      packet = std::move(sink->queue.front().packet);
+      sink->queue.pop_front();
+      sink->queued_bytes -= packet->size;
+      sink->space_cond.notify_all();
+    }
+
+    ok = sink->sink->Write(packet.get());
+
+    std::lock_guard<std::mutex> lock(sink->lock);
+    if (ok) {
+      ++sink->stats.written_packets;
+    } else {
+      ++sink->stats.dropped_packets;
+    }
+  }
+
+  if (!opened) {
+    return;
+  }
+  bool aborting = false;
+  {
+    std::lock_guard<std::mutex> lock(sink->lock);
+    aborting = sink->aborting;
+  }
+  if (aborting) {
+    sink->sink->Abort();
+  } else if (!sink->sink->Close()) {
+    std::lock_guard<std::mutex> lock(sink->lock);
+    sink->stats.failed = true;
+  }
+}
@@ -0,0 +1,130 @@
+﻿// 编码数据分发
+//
+// 一路编码的数据包同时送给多个输出(PacketSink)，如本地mp4文件、mkv文件和
+// 写入管道的MPEG-TS。每个输出有自己的写入线程和有上限的队列，数据包只增加
+// 引用计数，不复制数据。某个输出写得慢时只丢弃它自己队列中的数据，不阻塞编码，
+// 也不影响其它输出。队列满时从下一个视频关键帧开始恢复写入。
+// 录屏文件等不能缺少数据的输出可以设置为队列满时等待，这时它会有意地让编码
+// 慢下来，但数据包总是先放入其它输出的队列，不影响其它输出。
+// 直播等输出可以限制队列的时长，积压超过上限时丢弃整个队列，不增加延迟。
+
+#ifndef ENCODER_PACKET_BUS_H_
+#define ENCODER_PACKET_BUS_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "encoder/ffmpeg.h"
+
+// 流的编码参数，time_base是数据包时间戳的单位
+struct PacketStream {
+  AVCodecParameters* parameters;
+  AVRational time_base;
+};  // struct PacketStream
+
+// 数据包的输出，所有方法都在输出自己的写入线程中调用
+class PacketSink {
+ public:
+  virtual ~PacketSink() {}
+
+  // 用于日志
+  virtual std::string name() const = 0;
+
+  // streams按流的序号排列，在Close之前一直有效
+  virtual bool Open(const std::vector<PacketStream>& streams) = 0;
+  // 时间戳以所属的流的time_base为单位，packet的内容不能修改，
+  // 需要修改时用av_packet_ref取得自己的引用
+  virtual bool Write(const AVPacket* packet) = 0;
+  virtual bool Close() = 0;
+  // 取消录制时代替Close，不需要完整的输出，如不写入文件尾
+  virtual void Abort() { Close(); }
+};  // class PacketSink
+
+struct PacketSinkOptions {
+  // 队列中数据包的总大小上限(字节)
+  int64_t max_queued_bytes;
+  // 队列中最早和最新的数据包的时间差上限(微秒)，0表示不限制
+  int64_t max_queued_us;
+  // Start等待这个输出打开，打开失败时Start返回false。
+  // 为false时在后台打开，失败后只影响这个输出
+  bool wait_for_open;
+  // 队列满时Push等待输出写入，不丢弃数据，直到输出失败。这样的输出写得慢时
+  // 会让编码线程等待，拖慢编码是有意的；Push先放入其它输出，最后才等待。
+  // 为false时丢弃数据包，从下一个视频关键帧开始恢复
+  bool block_when_full;
+
+  PacketSinkOptions()
+      : max_queued_bytes(64LL * 1024 * 1024),
+        max_queued_us(0),
+        wait_for_open(false),
+        block_when_full(false) {}
+};  // struct PacketSinkOptions
+
+struct PacketSinkStats {
+  int64_t written_packets;
+  // 队列满、等待关键帧或者输出失败后丢弃的数据包数
+  int64_t dropped_packets;
+  // 队列达到过的最大字节数
+  int64_t max_queued_bytes;
+  // 打开、写入或关闭失败过
+  bool failed;
+
+  PacketSinkStats()
+      : written_packets(0),
+        dropped_packets(0),
+        max_queued_bytes(0),
+        failed(false) {}
+};  // struct PacketSinkStats
+
+class PacketBus {
+ public:
+  PacketBus();
+  // 没有调用Stop时在这里调用
+  ~PacketBus();
+
+  // 在Start之前按流的序号依次添加所有的流，复制流的编码参数和time_base
+  bool AddStream(const AVStream* stream);
+  // 在Start之前调用，返回输出的序号
+  int AddSink(std::unique_ptr<PacketSink> sink,
+              const PacketSinkOptions& options);
+
+  // 启动所有输出的写入线程，输出在自己的线程中打开
+  bool Start();
+  // 把数据包送入所有输出的队列，只在block_when_full的输出队列满时等待写入，
+  // 等待之前已经放入其它输出的队列。没有Start时丢弃
+  void Push(const AVPacket* packet);
+  // 等待所有输出写完队列中的数据后关闭输出，结束写入线程
+  void Stop();
+  // 丢弃所有输出队列中的数据，用PacketSink::Abort关闭输出，结束写入线程
+  void Abort();
+
+  size_t sink_count() const { return sinks_.size(); }
+  std::string sink_name(int index) const;
+  PacketSinkStats sink_stats(int index) const;
+  bool sink_failed(int index) const;
+
+ private:
+  // 一个输出和它的队列、写入线程，定义在packet_bus.cc中
+  struct Sink;
+
+  // 把数据包放入一个输出的队列，block_when_full时等待队列有空间
+  static void Enqueue(Sink* sink,
+                      const std::shared_ptr<const AVPacket>& packet,
+                      int64_t time_us,
+                      bool key_frame);
+  // 写入线程，打开输出后按顺序写入队列中的数据包
+  static void RunSink(Sink* sink, const std::vector<PacketStream>* streams);
+
+  std::vector<PacketStream> streams_;
+  int video_stream_index_;
+  std::vector<std::unique_ptr<Sink>> sinks_;
+  bool started_;
+
+  PacketBus(const PacketBus&) = delete;
+  PacketBus& operator=(const PacketBus&) = delete;
+};  // class PacketBus
+
+#endif  // ENCODER_PACKET_BUS_H_
@@ -0,0 +1,144 @@
+﻿#include "encoder/quality_controller.h"
+
+#include <algorithm>
+
+#include "base/check.h"
+
+namespace {
+
+// 编码耗时的平滑系数
+const double kAverageWeight = 0.1;
+
+// 负载超过这个值认为编码跟不上
+const double kHighLoad = 0.9;
+// 负载低于这个值认为有余量恢复画质
+const double kLowLoad = 0.6;
+
+// 连续空闲这么多个周期才恢复一级
+const int kIdleWindowsToRecover = 3;
+
+// 每次调整crf的步长
+const int kCrfDegradeStep = 2;
+const int kCrfRecoverStep = 1;
+
+}  // namespace
+
+QualityController::QualityController(const VideoConfig& video_config,
+                                     bool crf_adjustable)
+    : base_crf_(video_config.crf),
+      max_crf_(std::max(video_config.max_crf, video_config.crf)),
+      max_frame_skip_(std::max(video_config.max_frame_skip, 0)),
+      crf_adjustable_(crf_adjustable && video_config.bit_rate <= 0),
+      frame_budget_ms_(1000.0 / std::max(video_config.fps, 1)),
+      window_frames_(std::max(video_config.fps / 2, 1)),
+      backlog_high_(std::max(video_config.fps / 2, 2)),
+      backlog_critical_(std::max(video_config.fps * 2, 8)),
+      decision_({video_config.crf, 0}),
+      has_encode_time_(false),
+      average_encode_ms_(0.0),
+      load_(0.0),
+      frames_in_window_(0),
+      max_backlog_in_window_(0),
+      idle_windows_(0),
+      skipped_since_encode_(0),
+      degrade_count_(0),
+      recover_count_(0),
+      dropped_frames_(0) {
+}
+
+QualityController::~QualityController() {
+}
+
+bool QualityController::Update(double encode_ms, int backlog_frames) {
+  if (has_encode_time_) {
+    average_encode_ms_ = average_encode_ms_ * (1.0 - kAverageWeight) +
+                         encode_ms * kAverageWeight;
+  } else {
+    average_encode_ms_ = encode_ms;
+    has_encode_time_ = true;
+  }
+  // 丢帧时每编码一帧可用的时间相应变长
+  load_ = LoadWithFrameSkip(decision_.frame_skip);
+  max_backlog_in_window_ = std::max(max_backlog_in_window_, backlog_frames);
+
+  // 积压严重时不等周期结束
+  const bool critical = backlog_frames >= backlog_critical_;
+  if (++frames_in_window_ < window_frames_ && !critical) {
+    return false;
+  }
+
+  const int max_backlog = max_backlog_in_window_;
+  frames_in_window_ = 0;
+  max_backlog_in_window_ = 0;
+
+  if (critical || load_ > kHighLoad || max_backlog >= backlog_high_) {
+    idle_windows_ = 0;
+    return Degrade(critical);
+  }
+
+  // 恢复帧率会增加负载，按恢复后的负载判断
+  const int next_frame_skip = std::max(decision_.frame_skip - 1, 0);
+  if (LoadWithFrameSkip(next_frame_skip) < kLowLoad && max_backlog <= 1) {
+    if (++idle_windows_ >= kIdleWindowsToRecover) {
+      idle_windows_ = 0;
+      return Recover();
+    }
+  } else {
+    idle_windows_ = 0;
+  }
+
+  return false;
+}
+
+bool QualityController::ShouldDropFrame() {
+  if (skipped_since_encode_ < decision_.frame_skip) {
+    ++skipped_since_encode_;
+    ++dropped_frames_;
+    return true;
+  }
+
+  skipped_since_encode_ = 0;
+  return false;
+}
+
+double QualityController::LoadWithFrameSkip(int frame_skip) const {
+  return average_encode_ms_ / (frame_budget_ms_ * (frame_skip + 1));
+}
+
+bool QualityController::Degrade(bool critical) {
+  const Decision old_decision = decision_;
+
+  if (critical) {
+    // 积压严重，先尽快把队列消化掉
+    if (crf_adjustable_) {
+      decision_.crf = max_crf_;
+    }
+    decision_.frame_skip = std::min(decision_.frame_skip + 1, max_frame_skip_);
+  } else if (crf_adjustable_ && decision_.crf < max_crf_) {
+    decision_.crf = std::min(decision_.crf + kCrfDegradeStep, max_crf_);
+  } else if (decision_.frame_skip < max_frame_skip_) {
+    ++decision_.frame_skip;
+  }
+
+  if (decision_.crf == old_decision.crf &&
+      decision_.frame_skip == old_decision.frame_skip) {
+    return false;
+  }
+
+  ++degrade_count_;
+  return true;
+}
+
+bool QualityController::Recover() {
+  // 先恢复帧率，再恢复画质
+  if (decision_.frame_skip > 0) {
+    --decision_.frame_skip;
+  } else if (decision_.crf > base_crf_) {
+    decision_.crf = std::max(decision_.crf - kCrfRecoverStep, base_crf_);
+  } else {
+    return false;
+  }
+
+  ++recover_count_;
+  return true;
+}
@@ -0,0 +1,87 @@
+﻿// 根据编码积压自动调整画质
+
+#ifndef ENCODER_QUALITY_CONTROLLER_H_
+#define ENCODER_QUALITY_CONTROLLER_H_
+
+#include <stdint.h>
+
+#include "encoder/av_config.h"
+
+// 编码跟不上截屏时，待编码的画面在队列里越积越多，直到内存耗尽或截屏被阻塞。
+// 每隔一段时间根据每帧的编码耗时和队列中积压的帧数调整编码：
+//   负载过高：先提高crf，达到max_crf后再丢帧(每max_frame_skip + 1帧最多丢max_frame_skip帧)，
+//             编码器不能在录制过程中调整crf时直接丢帧
+//   负载恢复：按相反的顺序逐步恢复，需要连续几个周期都空闲，避免来回调整
+class QualityController {
+ public:
+  struct Decision {
+    int crf;
+    // 每编码一帧之后丢弃的帧数
+    int frame_skip;
+  };
+
+  // crf_adjustable: 编码器是否支持在录制过程中调整crf，
+  // 见AVMuxer::CanSetVideoCrf
+  QualityController(const VideoConfig& video_config, bool crf_adjustable);
+  ~QualityController();
+
+  // 每编码一帧调用一次
+  // encode_ms: 这一帧的编码耗时(毫秒)
+  // backlog_frames: 队列中等待编码的帧数
+  // 返回true表示需要调整，调整后的参数通过decision()获取
+  bool Update(double encode_ms, int backlog_frames);
+
+  // 这一帧是否应该丢弃，每收到一帧画面调用一次
+  bool ShouldDropFrame();
+
+  const Decision& decision() const { return decision_; }
+
+  // 平均每帧编码耗时 / 每编码一帧可用的时间
+  double load() const { return load_; }
+
+  int64_t degrade_count() const { return degrade_count_; }
+  int64_t recover_count() const { return recover_count_; }
+  int64_t dropped_frames() const { return dropped_frames_; }
+
+ private:
+  double LoadWithFrameSkip(int frame_skip) const;
+  bool Degrade(bool critical);
+  bool Recover();
+
+  const int base_crf_;
+  const int max_crf_;
+  const int max_frame_skip_;
+  // 是否可以调整crf，编码器不支持或者使用码率控制时不能调整
+  const bool crf_adjustable_;
+
+  // 帧间隔(毫秒)
+  const double frame_budget_ms_;
+  // 两次决策之间的帧数
+  const int window_frames_;
+  // 积压超过这个帧数认为负载过高
+  const int backlog_high_;
+  // 积压超过这个帧数时一次调整到底
+  const int backlog_critical_;
+
+  Decision decision_;
+
+  bool has_encode_time_;
+  double average_encode_ms_;
+  double load_;
+  int frames_in_window_;
+  int max_backlog_in_window_;
+  // 连续空闲的周期数
+  int idle_windows_;
+  // 距离上一次编码的帧的丢帧数
+  int skipped_since_encode_;
+
+  int64_t degrade_count_;
+  int64_t recover_count_;
+  int64_t dropped_frames_;
+
+  QualityController() = delete;
+  QualityController(const QualityController&) = delete;
+  QualityController& operator=(const QualityController&) = delete;
+};  // class QualityController
+
+#endif  // ENCODER_QUALITY_CONTROLLER_H_
@@ -0,0 +1,401 @@
+﻿#include "encoder/remote_encoder.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "base/check.h"
+#include "base/threading/thread_role.h"
+#include "encoder/worker_process.h"
+
+namespace {
+
+const int64_t kMicrosecondsPerSecond = 1000000;
+
+// 缓冲区满或没有数据时等待的时间
+const std::chrono::milliseconds kPollInterval(1);
+
+// 交错格式每个样本每个声道的字节数，不支持的格式返回0
+int PackedBytesPerSample(AVSampleFormat sample_fmt) {
+  switch (sample_fmt) {
+    case AV_SAMPLE_FMT_U8:
+      return 1;
+    case AV_SAMPLE_FMT_S16:
+      return 2;
+    case AV_SAMPLE_FMT_S32:
+    case AV_SAMPLE_FMT_FLT:
+      return 4;
+    case AV_SAMPLE_FMT_DBL:
+    case AV_SAMPLE_FMT_S64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+// 同一个录屏进程中每次录制使用不同的缓冲区名字
+std::string MakeRingName(const char* type) {
+  static std::atomic<int> counter(0);
+  return "ScreenRecord_" + std::to_string(WorkerProcess::CurrentProcessId()) +
+         "_" + std::to_string(counter++) + "_" + type;
+}
+
+}  // namespace
+
+RemoteEncoder::RemoteEncoder(const RemoteEncoderConfig& config)
+    : config_(config), stopped_(false), restart_count_(0), lost_frames_(0) {}
+
+RemoteEncoder::~RemoteEncoder() {
+  if (worker_) {
+    worker_->Terminate();
+  }
+}
+
+bool RemoteEncoder::Start() {
+  DCHECK(!worker_);
+
+  const VideoConfig& video_config = config_.video_config;
+  if (config_.video_slot_size <= 0) {
+    config_.video_slot_size = video_config.width * video_config.height * 4;
+  }
+
+  arguments_.video_ring = MakeRingName("video");
+  arguments_.audio_ring = MakeRingName("audio");
+  arguments_.parent_pid = WorkerProcess::CurrentProcessId();
+  arguments_.can_capture_voice = config_.can_capture_voice;
+  arguments_.encode_role = base::GetThreadRoleConfig(base::ThreadRole::ENCODE);
+  arguments_.audio_config = config_.audio_config;
+  arguments_.video_config = config_.video_config;
+
+  video_ring_ = FrameRing::Create(arguments_.video_ring,
+                                  config_.video_slot_count,
+                                  config_.video_slot_size);
+  audio_ring_ = FrameRing::Create(arguments_.audio_ring,
+                                  config_.audio_slot_count,
+                                  config_.audio_slot_size);
+  if (!video_ring_ || !audio_ring_) {
+    return false;
+  }
+
+  segments_.push_back(config_.output_path);
+  return LaunchWorker();
+}
+
+bool RemoteEncoder::PushVideoFrame(const uint8_t* data,
+                                   int width,
+                                   int height,
+                                   int stride,
+                                   uint64_t time_stamp,
+                                   const VideoFrameInfo& frame_info) {
+  DCHECK(data);
+
+  const int len = stride * height;
+  if (len <= 0 || len > video_slot_size()) {
+    return false;
+  }
+
+  FrameMeta* meta = nullptr;
+  uint8_t* slot_data = nullptr;
+  if (!BeginVideoFrame(&meta, &slot_data)) {
+    return false;
+  }
+
+  meta->type = FrameMeta::kVideo;
+  meta->flags = frame_info.discontinuity
+                    ? static_cast<uint32_t>(FrameMeta::kDiscontinuity)
+                    : 0u;
+  meta->timestamp = time_stamp;
+  meta->width = width;
+  meta->height = height;
+  meta->stride = stride;
+  meta->change_ratio = frame_info.change_ratio;
+  // 区域太多时不传，编码进程按整个画面都有变化处理
+  const size_t rect_count = frame_info.dirty_rects.size();
+  meta->rect_count = rect_count <= FrameMeta::kMaxRects
+                         ? static_cast<int32_t>(rect_count)
+                         : 0;
+  for (int i = 0; i < meta->rect_count; ++i) {
+    const VideoRect& rect = frame_info.dirty_rects[i];
+    meta->rects[i] = {rect.left, rect.top, rect.right, rect.bottom};
+  }
+  memcpy(slot_data, data, len);
+
+  EndVideoFrame(len);
+  return true;
+}
+
+bool RemoteEncoder::PushAudioFrame(const uint8_t* data,
+                                   int len,
+                                   int64_t time_stamp,
+                                   bool discontinuity) {
+  DCHECK(data);
+
+  const AudioConfig& audio_config = config_.audio_config;
+  const int block_align =
+      PackedBytesPerSample(audio_config.sample_fmt) * audio_config.channels;
+  const int slot_size = audio_ring_->slot_size();
+  if (block_align <= 0 && len > slot_size) {
+    return false;
+  }
+  // 拆分时按整个样本拆分
+  const int chunk_size =
+      block_align > 0 ? slot_size / block_align * block_align : slot_size;
+  const int64_t bytes_per_second =
+      static_cast<int64_t>(audio_config.sample_rate) * block_align;
+
+  int offset = 0;
+  while (offset < len) {
+    FrameMeta* meta = nullptr;
+    uint8_t* slot_data = nullptr;
+    if (!AcquireSlot(audio_ring_.get(), &meta, &slot_data)) {
+      return false;
+    }
+
+    const int size = std::min(chunk_size, len - offset);
+    memset(meta, 0, sizeof(*meta));
+    meta->type = FrameMeta::kAudio;
+    meta->flags = discontinuity && offset == 0
+                      ? static_cast<uint32_t>(FrameMeta::kDiscontinuity)
+                      : 0u;
+    meta->timestamp = time_stamp;
+    if (bytes_per_second > 0) {
+      meta->timestamp += offset * kMicrosecondsPerSecond / bytes_per_second;
+    }
+    memcpy(slot_data, data + offset, size);
+    audio_ring_->EndWrite(size);
+
+    offset += size;
+  }
+  return true;
+}
+
+bool RemoteEncoder::BeginVideoFrame(FrameMeta** meta, uint8_t** data) {
+  if (!AcquireSlot(video_ring_.get(), meta, data)) {
+    return false;
+  }
+  memset(*meta, 0, sizeof(**meta));
+  return true;
+}
+
+void RemoteEncoder::EndVideoFrame(int len) {
+  video_ring_->EndWrite(len);
+}
+
+bool RemoteEncoder::Stop(int timeout_ms) {
+  FrameMeta* meta = nullptr;
+  uint8_t* data = nullptr;
+  if (!AcquireSlot(video_ring_.get(), &meta, &data)) {
+    return false;
+  }
+  memset(meta, 0, sizeof(*meta));
+  meta->type = FrameMeta::kEnd;
+  video_ring_->EndWrite(0);
+  stopped_ = true;
+
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(timeout_ms);
+  while (true) {
+    const int64_t remaining_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now())
+            .count();
+    if (remaining_ms <= 0) {
+      worker_->Terminate();
+      worker_.reset();
+      return false;
+    }
+
+    if (worker_->Wait(static_cast<int>(std::min<int64_t>(remaining_ms, 100)))) {
+      if (worker_->exit_code() == 0) {
+        worker_.reset();
+        return true;
+      }
+      // 结束前崩溃，新的编码进程处理剩下的数据
+      if (!RestartWorker()) {
+        return false;
+      }
+    }
+  }
+}
+
+int RemoteEncoder::video_slot_size() const {
+  return video_ring_ ? video_ring_->slot_size() : config_.video_slot_size;
+}
+
+// static
+std::string RemoteEncoder::SegmentPath(const std::string& output_path,
+                                       int index) {
+  if (index == 0) {
+    return output_path;
+  }
+
+  const size_t slash = output_path.find_last_of("/\\");
+  const size_t dot = output_path.rfind('.');
+  const size_t pos =
+      dot == std::string::npos || (slash != std::string::npos && dot < slash)
+          ? output_path.size()
+          : dot;
+  return output_path.substr(0, pos) + "_" + std::to_string(index) +
+         output_path.substr(pos);
+}
+
+bool RemoteEncoder::LaunchWorker() {
+  arguments_.output_path = segments_.back();
+  arguments_.segment = static_cast<int>(segments_.size()) - 1;
+
+  std::vector<std::string> args = config_.worker_args;
+  const std::vector<std::string> encoder_args = arguments_.ToCommandLine();
+  args.insert(args.end(), encoder_args.begin(), encoder_args.end());
+
+  worker_.reset(new WorkerProcess());
+  if (!worker_->Start(config_.worker_path, args)) {
+    worker_.reset();
+    return false;
+  }
+  return true;
+}
+
+bool RemoteEncoder::RestartWorker() {
+  DCHECK(worker_);
+  DCHECK(!worker_->IsRunning());
+
+  if (restart_count_ >= config_.max_restarts) {
+    worker_.reset();
+    return false;
+  }
+
+  // 编码进程正在处理的数据丢弃，已经写入的数据留给新的编码进程
+  lost_frames_ += video_ring_->RecoverReader();
+  lost_frames_ += audio_ring_->RecoverReader();
+
+  ++restart_count_;
+  segments_.push_back(SegmentPath(config_.output_path, restart_count_));
+  return LaunchWorker();
+}
+
+bool RemoteEncoder::AcquireSlot(FrameRing* ring,
+                                FrameMeta** meta,
+                                uint8_t** data) {
+  DCHECK(ring);
+
+  if (!worker_ || stopped_) {
+    return false;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(config_.hang_timeout_ms);
+  while (true) {
+    if (!worker_->IsRunning()) {
+      if (!RestartWorker()) {
+        return false;
+      }
+      deadline = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds(config_.hang_timeout_ms);
+    }
+
+    if (ring->BeginWrite(meta, data)) {
+      return true;
+    }
+
+    if (std::chrono::steady_clock::now() >= deadline) {
+      // 编码进程卡住了，结束它之后按崩溃处理
+      worker_->Terminate();
+      continue;
+    }
+    std::this_thread::sleep_for(kPollInterval);
+  }
+}
+
+RemoteEncoderWorker::RemoteEncoderWorker(
+    const RemoteEncoderArguments& arguments)
+    : arguments_(arguments), video_frames_(0), audio_frames_(0) {}
+
+RemoteEncoderWorker::~RemoteEncoderWorker() {}
+
+bool RemoteEncoderWorker::Open() {
+  video_ring_ = FrameRing::Open(arguments_.video_ring);
+  audio_ring_ = FrameRing::Open(arguments_.audio_ring);
+  if (!video_ring_ || !audio_ring_) {
+    return false;
+  }
+
+  parent_watcher_.reset(new ParentWatcher());
+  return parent_watcher_->Watch(arguments_.parent_pid);
+}
+
+bool RemoteEncoderWorker::Run(Delegate* delegate) {
+  DCHECK(delegate);
+  DCHECK(video_ring_ && audio_ring_);
+
+  bool ok = true;
+  while (true) {
+    bool idle = true;
+
+    // 声音的缓冲区较小，优先处理
+    while (ReadAudio(delegate, &ok)) {
+      idle = false;
+      if (!ok) {
+        return false;
+      }
+    }
+
+    bool end = false;
+    if (ReadVideo(delegate, &ok, &end)) {
+      idle = false;
+      if (!ok) {
+        return false;
+      }
+      if (end) {
+        // 结束标记之前写入的声音都要处理完
+        while (ReadAudio(delegate, &ok)) {
+          if (!ok) {
+            return false;
+          }
+        }
+        return true;
+      }
+    }
+
+    if (idle) {
+      if (!parent_watcher_->IsParentAlive()) {
+        return false;
+      }
+      std::this_thread::sleep_for(kPollInterval);
+    }
+  }
+}
+
+bool RemoteEncoderWorker::ReadAudio(Delegate* delegate, bool* ok) {
+  const FrameMeta* meta = nullptr;
+  const uint8_t* data = nullptr;
+  int len = 0;
+  if (!audio_ring_->BeginRead(&meta, &data, &len)) {
+    return false;
+  }
+
+  *ok = delegate->OnAudioFrame(*meta, data, len);
+  audio_ring_->EndRead();
+  ++audio_frames_;
+  return true;
+}
+
+bool RemoteEncoderWorker::ReadVideo(Delegate* delegate, bool* ok, bool* end) {
+  const FrameMeta* meta = nullptr;
+  const uint8_t* data = nullptr;
+  int len = 0;
+  if (!video_ring_->BeginRead(&meta, &data, &len)) {
+    return false;
+  }
+
+  if (meta->type == FrameMeta::kEnd) {
+    *end = true;
+  } else {
+    *ok = delegate->OnVideoFrame(*meta, data, len);
+    ++video_frames_;
+  }
+  video_ring_->EndRead();
+  return true;
+}
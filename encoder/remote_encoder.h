@@ -0,0 +1,175 @@
+﻿// 在独立的进程中编码
+//
+// 录屏进程把采集到的画面和声音写入两个共享内存环形缓冲区(encoder/frame_ring.h)，
+// 编码进程直接从共享内存中读取数据编码，进程间不复制像素数据。
+// 编码进程崩溃或卡住时，录屏进程启动新的编码进程写入下一个分段文件
+// (xxx_1.mp4、xxx_2.mp4...)，新的编码进程从第一帧开始，自然从关键帧开始新的GOP。
+
+#ifndef ENCODER_REMOTE_ENCODER_H_
+#define ENCODER_REMOTE_ENCODER_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "encoder/av_config.h"
+#include "encoder/frame_ring.h"
+#include "encoder/remote_encoder_arguments.h"
+
+class ParentWatcher;
+class WorkerProcess;
+
+struct RemoteEncoderConfig {
+  // UTF-8编码的编码程序路径
+  std::string worker_path;
+  // 编码程序额外的命令行参数
+  std::vector<std::string> worker_args;
+  // 第一个分段的输出路径
+  std::string output_path;
+  bool can_capture_voice;
+
+  AudioConfig audio_config;
+  VideoConfig video_config;
+
+  // 视频缓冲区的槽位数，每个槽位存放一帧画面
+  int video_slot_count;
+  // 每个槽位的大小，为0时按video_config的画面大小计算
+  int video_slot_size;
+  int audio_slot_count;
+  int audio_slot_size;
+
+  // 编码进程异常退出后最多重新启动的次数
+  int max_restarts;
+  // 缓冲区一直是满的，超过这个时间(毫秒)认为编码进程卡住了
+  int hang_timeout_ms;
+
+  RemoteEncoderConfig()
+      : can_capture_voice(false),
+        video_slot_count(8),
+        video_slot_size(0),
+        audio_slot_count(32),
+        audio_slot_size(64 * 1024),
+        max_restarts(3),
+        hang_timeout_ms(10000) {}
+};  // struct RemoteEncoderConfig
+
+// 录屏进程中使用，发送数据给编码进程
+class RemoteEncoder {
+ public:
+  explicit RemoteEncoder(const RemoteEncoderConfig& config);
+  // 没有调用Stop时强制结束编码进程
+  ~RemoteEncoder();
+
+  // 创建缓冲区并启动编码进程
+  bool Start();
+
+  // 发送一帧画面，缓冲区满时等待编码进程处理。
+  // 编码进程无法重新启动时返回false
+  bool PushVideoFrame(const uint8_t* data,
+                      int width,
+                      int height,
+                      int stride,
+                      uint64_t time_stamp,
+                      const VideoFrameInfo& frame_info);
+  // 发送一段声音，超过槽位大小时拆分
+  bool PushAudioFrame(const uint8_t* data,
+                      int len,
+                      int64_t time_stamp,
+                      bool discontinuity);
+
+  // 直接在共享内存中生成画面，省去PushVideoFrame中的一次复制。
+  // BeginVideoFrame返回的data可以写入video_slot_size()字节，
+  // 填好meta后调用EndVideoFrame
+  bool BeginVideoFrame(FrameMeta** meta, uint8_t** data);
+  void EndVideoFrame(int len);
+
+  // 通知编码进程结束并等待它写完文件，超时后强制结束
+  bool Stop(int timeout_ms);
+
+  int video_slot_size() const;
+
+  // 编码进程重新启动的次数
+  int restart_count() const { return restart_count_; }
+  // 输出的分段文件
+  const std::vector<std::string>& segments() const { return segments_; }
+  // 编码进程崩溃时丢失的画面和声音数
+  int64_t lost_frames() const { return lost_frames_; }
+
+  // 第index个分段的输出路径，第0个为原始路径
+  static std::string SegmentPath(const std::string& output_path, int index);
+
+ private:
+  bool LaunchWorker();
+  // 编码进程退出后重新启动，超过重启次数时返回false
+  bool RestartWorker();
+  // 等待ring中的空闲槽位，期间检查编码进程的状态
+  bool AcquireSlot(FrameRing* ring, FrameMeta** meta, uint8_t** data);
+
+  RemoteEncoderConfig config_;
+  RemoteEncoderArguments arguments_;
+
+  std::unique_ptr<FrameRing> video_ring_;
+  std::unique_ptr<FrameRing> audio_ring_;
+  std::unique_ptr<WorkerProcess> worker_;
+
+  bool stopped_;
+  int restart_count_;
+  std::vector<std::string> segments_;
+  int64_t lost_frames_;
+
+  RemoteEncoder() = delete;
+  RemoteEncoder(const RemoteEncoder&) = delete;
+  RemoteEncoder& operator=(const RemoteEncoder&) = delete;
+};  // class RemoteEncoder
+
+// 编码进程中使用，从缓冲区读取数据交给Delegate处理
+class RemoteEncoderWorker {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // data指向共享内存，返回后不能再访问。返回false时结束编码
+    virtual bool OnVideoFrame(const FrameMeta& meta,
+                              const uint8_t* data,
+                              int len) = 0;
+    virtual bool OnAudioFrame(const FrameMeta& meta,
+                              const uint8_t* data,
+                              int len) = 0;
+  };  // class Delegate
+
+  explicit RemoteEncoderWorker(const RemoteEncoderArguments& arguments);
+  ~RemoteEncoderWorker();
+
+  // 打开录屏进程创建的缓冲区
+  bool Open();
+
+  // 处理数据直到收到结束标记，录屏进程退出或Delegate返回false时返回false
+  bool Run(Delegate* delegate);
+
+  int64_t video_frames() const { return video_frames_; }
+  int64_t audio_frames() const { return audio_frames_; }
+
+ private:
+  // 处理一个槽位，没有数据时返回false
+  bool ReadAudio(Delegate* delegate, bool* ok);
+  bool ReadVideo(Delegate* delegate, bool* ok, bool* end);
+
+  RemoteEncoderArguments arguments_;
+
+  std::unique_ptr<FrameRing> video_ring_;
+  std::unique_ptr<FrameRing> audio_ring_;
+  std::unique_ptr<ParentWatcher> parent_watcher_;
+
+  int64_t video_frames_;
+  int64_t audio_frames_;
+
+  RemoteEncoderWorker() = delete;
+  RemoteEncoderWorker(const RemoteEncoderWorker&) = delete;
+  RemoteEncoderWorker& operator=(const RemoteEncoderWorker&) = delete;
+};  // class RemoteEncoderWorker
+
+#endif  // ENCODER_REMOTE_ENCODER_H_
@@ -0,0 +1,198 @@
+﻿#include "encoder/remote_encoder_arguments.h"
+
+#include <stdlib.h>
+
+#include <map>
+
+namespace {
+
+const char kVideoRing[] = "video_ring";
+const char kAudioRing[] = "audio_ring";
+const char kOutput[] = "output";
+const char kSegment[] = "segment";
+const char kParentPid[] = "parent_pid";
+const char kCaptureVoice[] = "capture_voice";
+const char kEncodePriority[] = "encode_priority";
+const char kEncodeCpus[] = "encode_cpus";
+
+const char kAudioCodec[] = "audio_codec";
+const char kSampleRate[] = "sample_rate";
+const char kChannels[] = "channels";
+const char kChannelLayout[] = "channel_layout";
+const char kSampleFormat[] = "sample_fmt";
+
+const char kFps[] = "fps";
+const char kWidth[] = "width";
+const char kHeight[] = "height";
+const char kOutputWidth[] = "output_width";
+const char kOutputHeight[] = "output_height";
+const char kPixelFormat[] = "pix_fmt";
+const char kVideoCodec[] = "video_codec";
+const char kVideoEncoderName[] = "video_encoder";
+const char kMaxGopSize[] = "max_gop_size";
+const char kMinGopSize[] = "min_gop_size";
+const char kSceneChangeThreshold[] = "scene_change_threshold";
+const char kEnableRoi[] = "enable_roi";
+const char kPreset[] = "preset";
+const char kTune[] = "tune";
+const char kCrf[] = "crf";
+const char kBitRate[] = "bit_rate";
+const char kMaxBFrames[] = "max_b_frames";
+const char kThreads[] = "threads";
+const char kLookahead[] = "lookahead";
+const char kLossless[] = "lossless";
+
+void Append(const char* key,
+            const std::string& value,
+            std::vector<std::string>* args) {
+  args->push_back(std::string("--") + key + "=" + value);
+}
+
+void Append(const char* key, int64_t value, std::vector<std::string>* args) {
+  Append(key, std::to_string(value), args);
+}
+
+class ArgumentMap {
+ public:
+  explicit ArgumentMap(const std::vector<std::string>& args) {
+    for (const std::string& arg : args) {
+      if (arg.compare(0, 2, "--") != 0) {
+        continue;
+      }
+      const size_t pos = arg.find('=');
+      if (pos == std::string::npos) {
+        continue;
+      }
+      values_[arg.substr(2, pos - 2)] = arg.substr(pos + 1);
+    }
+  }
+
+  bool Has(const char* key) const { return values_.count(key) != 0; }
+
+  std::string String(const char* key) const {
+    auto it = values_.find(key);
+    return it == values_.end() ? std::string() : it->second;
+  }
+
+  template <typename T>
+  void Int(const char* key, T* value) const {
+    auto it = values_.find(key);
+    if (it != values_.end()) {
+      *value = static_cast<T>(strtoll(it->second.c_str(), nullptr, 10));
+    }
+  }
+
+  void Float(const char* key, float* value) const {
+    auto it = values_.find(key);
+    if (it != values_.end()) {
+      *value = static_cast<float>(strtod(it->second.c_str(), nullptr));
+    }
+  }
+
+  void Bool(const char* key, bool* value) const {
+    auto it = values_.find(key);
+    if (it != values_.end()) {
+      *value = it->second == "1";
+    }
+  }
+
+ private:
+  std::map<std::string, std::string> values_;
+};  // class ArgumentMap
+
+}  // namespace
+
+std::vector<std::string> RemoteEncoderArguments::ToCommandLine() const {
+  std::vector<std::string> args;
+  Append(kVideoRing, video_ring, &args);
+  Append(kAudioRing, audio_ring, &args);
+  Append(kOutput, output_path, &args);
+  Append(kSegment, segment, &args);
+  Append(kParentPid, parent_pid, &args);
+  Append(kCaptureVoice, can_capture_voice ? 1 : 0, &args);
+  Append(kEncodePriority,
+         base::ThreadPriorityToString(encode_role.priority), &args);
+  Append(kEncodeCpus, base::CpuMaskToString(encode_role.cpu_mask), &args);
+
+  Append(kAudioCodec, audio_config.codec_id, &args);
+  Append(kSampleRate, audio_config.sample_rate, &args);
+  Append(kChannels, audio_config.channels, &args);
+  Append(kChannelLayout, static_cast<int64_t>(audio_config.channel_layout),
+         &args);
+  Append(kSampleFormat, audio_config.sample_fmt, &args);
+
+  Append(kFps, video_config.fps, &args);
+  Append(kWidth, video_config.width, &args);
+  Append(kHeight, video_config.height, &args);
+  Append(kOutputWidth, video_config.output_width, &args);
+  Append(kOutputHeight, video_config.output_height, &args);
+  Append(kPixelFormat, video_config.input_pixel_format, &args);
+  Append(kVideoCodec, video_config.codec_id, &args);
+  Append(kVideoEncoderName, video_config.encoder_name, &args);
+  Append(kMaxGopSize, video_config.max_gop_size, &args);
+  Append(kMinGopSize, video_config.min_gop_size, &args);
+  Append(kSceneChangeThreshold,
+         std::to_string(video_config.scene_change_threshold), &args);
+  Append(kEnableRoi, video_config.enable_roi ? 1 : 0, &args);
+  Append(kPreset, video_config.preset, &args);
+  Append(kTune, video_config.tune, &args);
+  Append(kCrf, video_config.crf, &args);
+  Append(kBitRate, video_config.bit_rate, &args);
+  Append(kMaxBFrames, video_config.max_b_frames, &args);
+  Append(kThreads, video_config.threads, &args);
+  Append(kLookahead, video_config.lookahead, &args);
+  Append(kLossless, video_config.lossless ? 1 : 0, &args);
+  return args;
+}
+
+bool RemoteEncoderArguments::Parse(const std::vector<std::string>& args) {
+  ArgumentMap map(args);
+  if (!map.Has(kVideoRing) || !map.Has(kAudioRing) || !map.Has(kOutput)) {
+    return false;
+  }
+
+  video_ring = map.String(kVideoRing);
+  audio_ring = map.String(kAudioRing);
+  output_path = map.String(kOutput);
+  map.Int(kSegment, &segment);
+  map.Int(kParentPid, &parent_pid);
+  map.Bool(kCaptureVoice, &can_capture_voice);
+  // 不认识的值保持默认设置
+  base::ThreadPriorityFromString(map.String(kEncodePriority),
+                                 &encode_role.priority);
+  base::CpuMaskFromString(map.String(kEncodeCpus), &encode_role.cpu_mask);
+
+  map.Int(kAudioCodec, &audio_config.codec_id);
+  map.Int(kSampleRate, &audio_config.sample_rate);
+  map.Int(kChannels, &audio_config.channels);
+  map.Int(kChannelLayout, &audio_config.channel_layout);
+  map.Int(kSampleFormat, &audio_config.sample_fmt);
+
+  map.Int(kFps, &video_config.fps);
+  map.Int(kWidth, &video_config.width);
+  map.Int(kHeight, &video_config.height);
+  map.Int(kOutputWidth, &video_config.output_width);
+  map.Int(kOutputHeight, &video_config.output_height);
+  map.Int(kPixelFormat, &video_config.input_pixel_format);
+  map.Int(kVideoCodec, &video_config.codec_id);
+  if (map.Has(kVideoEncoderName)) {
+    video_config.encoder_name = map.String(kVideoEncoderName);
+  }
+  map.Int(kMaxGopSize, &video_config.max_gop_size);
+  map.Int(kMinGopSize, &video_config.min_gop_size);
+  map.Float(kSceneChangeThreshold, &video_config.scene_change_threshold);
+  map.Bool(kEnableRoi, &video_config.enable_roi);
+  if (map.Has(kPreset)) {
+    video_config.preset = map.String(kPreset);
+  }
+  if (map.Has(kTune)) {
+    video_config.tune = map.String(kTune);
+  }
+  map.Int(kCrf, &video_config.crf);
+  map.Int(kBitRate, &video_config.bit_rate);
+  map.Int(kMaxBFrames, &video_config.max_b_frames);
+  map.Int(kThreads, &video_config.threads);
+  map.Int(kLookahead, &video_config.lookahead);
+  map.Bool(kLossless, &video_config.lossless);
+  return true;
+}
@@ -0,0 +1,40 @@
+﻿// 编码子进程的命令行参数
+
+#ifndef ENCODER_REMOTE_ENCODER_ARGUMENTS_H_
+#define ENCODER_REMOTE_ENCODER_ARGUMENTS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/threading/thread_role.h"
+#include "encoder/av_config.h"
+
+struct RemoteEncoderArguments {
+  // 共享内存环形缓冲区的名字，见encoder/frame_ring.h
+  std::string video_ring;
+  std::string audio_ring;
+  // UTF-8编码的输出文件路径
+  std::string output_path;
+  // 分段序号，编码进程重新启动后从1开始递增
+  int segment;
+  // 录屏进程的ID，录屏进程退出后编码进程跟着退出
+  int64_t parent_pid;
+  bool can_capture_voice;
+  // 编码线程的优先级和可以使用的CPU，与录屏进程中的设置一致
+  base::ThreadRoleConfig encode_role;
+
+  AudioConfig audio_config;
+  VideoConfig video_config;
+
+  RemoteEncoderArguments()
+      : segment(0), parent_pid(0), can_capture_voice(false) {}
+
+  // 转换为--key=value形式的参数列表
+  std::vector<std::string> ToCommandLine() const;
+  // 解析ToCommandLine生成的参数，不认识的参数忽略
+  bool Parse(const std::vector<std::string>& args);
+};  // struct RemoteEncoderArguments
+
+#endif  // ENCODER_REMOTE_ENCODER_ARGUMENTS_H_
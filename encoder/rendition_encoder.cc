@@ -0,0 +1,267 @@
+﻿#include "encoder/rendition_encoder.h"
+
+#include "base/check.h"
+#include "base/threading/thread_role.h"
+#include "encoder/muxer_sink.h"
+#include "encoder/packet_bus.h"
+#include "encoder/video_encoder.h"
+
+namespace {
+
+// 等待编码的帧数上限，编码跟不上时让AVMuxer等待，而不是无限制地占用内存
+const size_t kMaxQueuedFrames = 4;
+
+// 与AVMuxer的输出文件相同
+const int64_t kOutputQueueBytes = 256LL * 1024 * 1024;
+
+}  // namespace
+
+RenditionEncoder::RenditionEncoder(const VideoConfig& video_config,
+                                   const std::string& output_path)
+    : video_config_(video_config),
+      output_path_(output_path),
+      format_context_(nullptr),
+      video_stream_(nullptr),
+      audio_stream_(nullptr),
+      packet_bus_(new PacketBus()),
+      flushing_(false),
+      aborting_(false),
+      pending_crf_(-1),
+      encoded_frames_(0),
+      failed_(false) {
+  DCHECK(video_config_.input_pixel_format == AV_PIX_FMT_YUV420P);
+}
+
+RenditionEncoder::~RenditionEncoder() {
+  Stop();
+
+  for (AVFrame* frame : frames_) {
+    av_frame_free(&frame);
+  }
+  video_encoder_.reset();
+  avformat_free_context(format_context_);
+}
+
+bool RenditionEncoder::Initialize() {
+  DCHECK(!video_encoder_);
+
+  int ret = avformat_alloc_output_context2(&format_context_, nullptr, nullptr,
+                                           output_path_.c_str());
+  if (ret < 0 || !format_context_) {
+    return false;
+  }
+
+  video_encoder_.reset(new VideoEncoder(video_config_));
+  return video_encoder_->Initialize();
+}
+
+bool RenditionEncoder::Open(const AVStream* audio_stream, bool fragmented) {
+  DCHECK(video_encoder_ && !thread_.joinable());
+
+  AVCodecContext* codec_ctx = video_encoder_->GetCodecContext();
+  video_stream_ = avformat_new_stream(format_context_, codec_ctx->codec);
+  if (!video_stream_) {
+    return false;
+  }
+  video_stream_->time_base = {1, 90000};
+  video_stream_->id = format_context_->nb_streams - 1;
+  if (format_context_->oformat->flags & AVFMT_GLOBALHEADER) {
+    codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+  if (!video_encoder_->Open(video_stream_) ||
+      !packet_bus_->AddStream(video_stream_)) {
+    return false;
+  }
+
+  // 音频流的参数与AVMuxer相同，数据包直接转发
+  if (audio_stream) {
+    audio_stream_ = avformat_new_stream(format_context_, nullptr);
+    if (!audio_stream_ ||
+        avcodec_parameters_copy(audio_stream_->codecpar,
+                                audio_stream->codecpar) < 0) {
+      return false;
+    }
+    audio_stream_->time_base = audio_stream->time_base;
+    audio_stream_->id = format_context_->nb_streams - 1;
+    if (!packet_bus_->AddStream(audio_stream_)) {
+      return false;
+    }
+  }
+
+  std::unique_ptr<MuxerSink> sink =
+      std::make_unique<MuxerSink>(output_path_, std::string());
+  sink->set_fragmented(fragmented);
+  PacketSinkOptions options;
+  options.max_queued_bytes = kOutputQueueBytes;
+  options.wait_for_open = true;
+  options.block_when_full = true;
+  packet_bus_->AddSink(std::move(sink), options);
+  if (!packet_bus_->Start()) {
+    return false;
+  }
+
+  thread_ = std::thread(&RenditionEncoder::Run, this);
+  return true;
+}
+
+bool RenditionEncoder::EncodeFrame(const AVFrame* frame,
+                                   int64_t time_stamp,
+                                   bool key_frame,
+                                   int src_width,
+                                   int src_height,
+                                   const std::vector<VideoRect>& dirty_rects) {
+  DCHECK(frame && thread_.joinable());
+  DCHECK(frame->width == video_config_.width &&
+         frame->height == video_config_.height);
+
+  if (failed_) {
+    return false;
+  }
+
+  AVFrame* ref = av_frame_clone(frame);
+  if (!ref) {
+    return false;
+  }
+  ref->pts = time_stamp;
+  ref->pict_type = key_frame ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+  // 关键帧不设置ROI，与AVMuxer一致
+  video_encoder_->SetRegionsOfInterest(
+      ref, src_width, src_height,
+      key_frame ? std::vector<VideoRect>() : dirty_rects);
+
+  std::unique_lock<std::mutex> lock(lock_);
+  DCHECK(!flushing_);
+  cond_.wait(lock, [this]() {
+    return frames_.size() < kMaxQueuedFrames || failed_;
+  });
+  if (failed_) {
+    av_frame_free(&ref);
+    return false;
+  }
+  frames_.push_back(ref);
+  cond_.notify_all();
+  return true;
+}
+
+void RenditionEncoder::WriteAudioPacket(const AVPacket* packet) {
+  DCHECK(packet);
+  if (!audio_stream_) {
+    return;
+  }
+
+  // PacketBus复制数据包的引用，这里只修改流的序号
+  AVPacket audio_packet = *packet;
+  audio_packet.stream_index = audio_stream_->index;
+  packet_bus_->Push(&audio_packet);
+}
+
+void RenditionEncoder::SetCrf(int crf) {
+  pending_crf_ = crf;
+}
+
+void RenditionEncoder::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!flushing_) {
+      flushing_ = true;
+      frames_.push_back(nullptr);
+      cond_.notify_all();
+    }
+  }
+  thread_.join();
+
+  // 等待输出写完队列中的数据，写入文件尾
+  packet_bus_->Stop();
+}
+
+void RenditionEncoder::Abort() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (AVFrame* frame : frames_) {
+      av_frame_free(&frame);
+    }
+    frames_.clear();
+    flushing_ = true;
+    aborting_ = true;
+    frames_.push_back(nullptr);
+    cond_.notify_all();
+  }
+  thread_.join();
+
+  packet_bus_->Abort();
+}
+
+void RenditionEncoder::Run() {
+  // 与录屏的编码线程相同，x264的线程继承这里的设置
+  base::SetCurrentThreadRole(base::ThreadRole::ENCODE);
+
+  while (true) {
+    AVFrame* frame = nullptr;
+    bool aborting = false;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      cond_.wait(lock, [this]() { return !frames_.empty(); });
+      frame = frames_.front();
+      frames_.pop_front();
+      aborting = aborting_;
+      cond_.notify_all();
+    }
+    if (!frame && aborting) {
+      break;
+    }
+
+    const int crf = pending_crf_.exchange(-1);
+    if (crf >= 0) {
+      video_encoder_->SetCrf(crf);
+    }
+
+    // 失败后继续取出队列中的帧，直到输入结束
+    if (!failed_) {
+      if (EncodeAndWrite(frame)) {
+        encoded_frames_ += frame ? 1 : 0;
+      } else {
+        std::lock_guard<std::mutex> lock(lock_);
+        failed_ = true;
+        cond_.notify_all();
+      }
+    }
+    if (!frame) {
+      break;
+    }
+    av_frame_free(&frame);
+  }
+}
+
+bool RenditionEncoder::EncodeAndWrite(AVFrame* frame) {
+  AVCodecContext* codec_ctx = video_encoder_->GetCodecContext();
+  int ret = avcodec_send_frame(codec_ctx, frame);
+  if (ret < 0) {
+    return false;
+  }
+
+  while (true) {
+    AVPacket packet = {0};
+    ret = avcodec_receive_packet(codec_ctx, &packet);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+      break;
+    } else if (ret < 0) {
+      return false;
+    }
+
+    av_packet_rescale_ts(&packet, codec_ctx->time_base,
+                         video_stream_->time_base);
+    packet.stream_index = video_stream_->index;
+    packet_bus_->Push(&packet);
+    av_packet_unref(&packet);
+  }
+
+  return !packet_bus_->sink_failed(0);
+}
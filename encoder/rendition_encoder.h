@@ -0,0 +1,103 @@
+﻿// 多码率输出中的一路
+//
+// 在自己的线程中编码ScalePyramid缩小后的画面，写入自己的文件。
+// 音频由AVMuxer编码一次，数据包送入每一路的输出。关键帧由AVMuxer的
+// GopController统一决定，各路的关键帧在同一个时间点，播放端可以在分段的
+// 边界切换码率。
+
+#ifndef ENCODER_RENDITION_ENCODER_H_
+#define ENCODER_RENDITION_ENCODER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "encoder/av_config.h"
+#include "encoder/ffmpeg.h"
+
+class PacketBus;
+class VideoEncoder;
+
+class RenditionEncoder {
+ public:
+  // video_config: 这一路的编码参数，输入是与输出同样大小的YUV420P画面
+  // output_path: UTF-8编码的输出文件路径
+  RenditionEncoder(const VideoConfig& video_config,
+                   const std::string& output_path);
+  ~RenditionEncoder();
+
+  bool Initialize();
+
+  // 打开编码器和输出文件，启动编码线程。
+  // audio_stream: AVMuxer的音频流，为空时没有音频
+  bool Open(const AVStream* audio_stream, bool fragmented);
+
+  // 编码一帧，frame的内容不会被修改，这里只增加引用。
+  // 队列已满时等待编码线程，各路的进度相差不超过几帧。
+  // src_width、src_height、dirty_rects: 输入画面的大小和变化区域，用于ROI
+  bool EncodeFrame(const AVFrame* frame,
+                   int64_t time_stamp,
+                   bool key_frame,
+                   int src_width,
+                   int src_height,
+                   const std::vector<VideoRect>& dirty_rects);
+
+  // AVMuxer编码好的音频数据包，时间戳的单位是AVMuxer的音频流的time_base
+  void WriteAudioPacket(const AVPacket* packet);
+
+  // 录制过程中调整crf，在编码线程中下一帧之前生效
+  void SetCrf(int crf);
+
+  // 编码剩余的帧，然后等待编码线程结束，写入文件尾
+  void Stop();
+  // 丢弃没有编码的帧，不刷新编码器，不写入文件尾，等待编码线程结束
+  void Abort();
+
+  const std::string& output_path() const { return output_path_; }
+  int width() const { return video_config_.width; }
+  int height() const { return video_config_.height; }
+  int64_t encoded_frames() const { return encoded_frames_; }
+  // 编码或者写入失败，之后的帧都被丢弃
+  bool failed() const { return failed_; }
+
+ private:
+  void Run();
+  bool EncodeAndWrite(AVFrame* frame);
+
+  VideoConfig video_config_;
+  const std::string output_path_;
+
+  std::unique_ptr<VideoEncoder> video_encoder_;
+  // 只用来创建流，不写入文件
+  AVFormatContext* format_context_;
+  AVStream* video_stream_;
+  AVStream* audio_stream_;
+  std::unique_ptr<PacketBus> packet_bus_;
+
+  std::thread thread_;
+  std::mutex lock_;
+  std::condition_variable cond_;
+  // 等待编码的帧，nullptr表示输入结束
+  std::deque<AVFrame*> frames_;
+  bool flushing_;
+  // Abort时设置，编码线程收到输入结束后不刷新编码器
+  bool aborting_;
+
+  // 小于0表示没有待生效的crf
+  std::atomic<int> pending_crf_;
+  std::atomic<int64_t> encoded_frames_;
+  std::atomic<bool> failed_;
+
+  RenditionEncoder() = delete;
+  RenditionEncoder(const RenditionEncoder&) = delete;
+  RenditionEncoder& operator=(const RenditionEncoder&) = delete;
+};  // class RenditionEncoder
+
+#endif  // ENCODER_RENDITION_ENCODER_H_
@@ -0,0 +1,305 @@
+﻿#include "encoder/replay_buffer.h"
+
+#include <algorithm>
+
+#include "base/check.h"
+#include "base/threading/thread_pool.h"
+
+namespace {
+
+const AVRational kMicrosecondTimeBase = {1, 1000000};
+
+// 用于排序和计算时长，没有pts时用dts
+int64_t PacketTime(const AVPacket* packet) {
+  return packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+}
+
+}  // namespace
+
+struct ReplayBuffer::Snapshot {
+  std::vector<Stream> streams;
+  std::vector<AVPacket*> packets;
+  // 第一个视频关键帧的解码时间，写文件时所有的流都减去这个时间
+  int64_t start_time_us;
+
+  Snapshot() : start_time_us(0) {}
+  ~Snapshot() {
+    for (Stream& stream : streams) {
+      avcodec_parameters_free(&stream.parameters);
+    }
+    for (AVPacket*& packet : packets) {
+      av_packet_free(&packet);
+    }
+  }
+};  // struct ReplayBuffer::Snapshot
+
+ReplayBuffer::ReplayBuffer(const ReplayBufferConfig& config)
+    : config_(config),
+      video_stream_index_(-1),
+      bytes_(0),
+      newest_time_us_(0),
+      waiting_for_key_frame_(false),
+      dropped_packets_(0) {
+  DCHECK(config_.max_bytes > 0 && config_.max_duration_us > 0);
+}
+
+ReplayBuffer::~ReplayBuffer() {
+  Clear();
+  for (Stream& stream : streams_) {
+    avcodec_parameters_free(&stream.parameters);
+  }
+}
+
+bool ReplayBuffer::AddStream(const AVStream* stream) {
+  DCHECK(stream && stream->codecpar);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  DCHECK(entries_.empty());
+  DCHECK(stream->index == static_cast<int>(streams_.size()));
+
+  AVCodecParameters* parameters = avcodec_parameters_alloc();
+  if (!parameters) {
+    return false;
+  }
+  if (avcodec_parameters_copy(parameters, stream->codecpar) < 0) {
+    avcodec_parameters_free(&parameters);
+    return false;
+  }
+
+  if (parameters->codec_type == AVMEDIA_TYPE_VIDEO &&
+      video_stream_index_ < 0) {
+    video_stream_index_ = stream->index;
+  }
+  streams_.push_back({parameters, stream->time_base});
+  return true;
+}
+
+void ReplayBuffer::Push(const AVPacket* packet) {
+  DCHECK(packet);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  if (packet->stream_index < 0 ||
+      packet->stream_index >= static_cast<int>(streams_.size())) {
+    DCHECK(false);
+    return;
+  }
+
+  const bool key_frame = packet->stream_index == video_stream_index_ &&
+                         (packet->flags & AV_PKT_FLAG_KEY);
+  if (entries_.empty() || waiting_for_key_frame_) {
+    if (!key_frame) {
+      ++dropped_packets_;
+      return;
+    }
+    waiting_for_key_frame_ = false;
+  }
+
+  AVPacket* ref = av_packet_clone(packet);
+  if (!ref) {
+    ++dropped_packets_;
+    return;
+  }
+
+  const AVRational time_base = streams_[packet->stream_index].time_base;
+  const int64_t time_us =
+      av_rescale_q(PacketTime(ref), time_base, kMicrosecondTimeBase);
+  entries_.push_back({ref, time_us, key_frame});
+  bytes_ += ref->size;
+  newest_time_us_ = std::max(newest_time_us_, time_us);
+
+  Trim();
+}
+
+bool ReplayBuffer::Save(const std::string& path) const {
+  std::shared_ptr<Snapshot> snapshot = TakeSnapshot();
+  return snapshot && WriteSnapshot(*snapshot, path);
+}
+
+void ReplayBuffer::SaveAsync(const std::string& path,
+                             const std::function<void(bool)>& callback) const {
+  std::shared_ptr<Snapshot> snapshot = TakeSnapshot();
+  if (!snapshot) {
+    if (callback) {
+      callback(false);
+    }
+    return;
+  }
+
+  base::ThreadPool::GetDefault()->PostTask([snapshot, path, callback]() {
+    const bool result = WriteSnapshot(*snapshot, path);
+    if (callback) {
+      callback(result);
+    }
+  });
+}
+
+int64_t ReplayBuffer::buffered_bytes() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return bytes_;
+}
+
+int64_t ReplayBuffer::buffered_duration_us() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return entries_.empty() ? 0 : newest_time_us_ - entries_.front().time_us;
+}
+
+int64_t ReplayBuffer::dropped_packets() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return dropped_packets_;
+}
+
+std::shared_ptr<ReplayBuffer::Snapshot> ReplayBuffer::TakeSnapshot() const {
+  std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+
+  std::lock_guard<std::mutex> lock(lock_);
+  if (entries_.empty()) {
+    return nullptr;
+  }
+
+  for (const Stream& stream : streams_) {
+    AVCodecParameters* parameters = avcodec_parameters_alloc();
+    if (!parameters) {
+      return nullptr;
+    }
+    snapshot->streams.push_back({parameters, stream.time_base});
+    if (avcodec_parameters_copy(parameters, stream.parameters) < 0) {
+      return nullptr;
+    }
+  }
+
+  // 只增加引用计数，持有锁的时间与数据量无关
+  snapshot->packets.reserve(entries_.size());
+  for (const Entry& entry : entries_) {
+    AVPacket* ref = av_packet_clone(entry.packet);
+    if (!ref) {
+      return nullptr;
+    }
+    snapshot->packets.push_back(ref);
+  }
+
+  // 有B帧时关键帧的解码时间早于显示时间，从解码时间开始保证dts不为负
+  const AVPacket* first = snapshot->packets.front();
+  const int64_t first_dts =
+      first->dts != AV_NOPTS_VALUE ? first->dts : first->pts;
+  snapshot->start_time_us = av_rescale_q(
+      first_dts, streams_[first->stream_index].time_base,
+      kMicrosecondTimeBase);
+  return snapshot;
+}
+
+// static
+bool ReplayBuffer::WriteSnapshot(const Snapshot& snapshot,
+                                 const std::string& path) {
+  AVFormatContext* format_context = nullptr;
+  int ret = avformat_alloc_output_context2(&format_context, nullptr, nullptr,
+                                           path.c_str());
+  if (ret < 0 || !format_context) {
+    return false;
+  }
+
+  bool result = true;
+  for (const Stream& stream : snapshot.streams) {
+    AVStream* out_stream = avformat_new_stream(format_context, nullptr);
+    if (!out_stream ||
+        avcodec_parameters_copy(out_stream->codecpar, stream.parameters) <
+            0) {
+      result = false;
+      break;
+    }
+    // 不同封装格式的codec_tag不同，由封装器重新选择
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = stream.time_base;
+  }
+
+  const bool need_file = !(format_context->oformat->flags & AVFMT_NOFILE);
+  if (result && need_file) {
+    result = avio_open(&format_context->pb, path.c_str(), AVIO_FLAG_WRITE) >=
+             0;
+  }
+  if (result) {
+    result = avformat_write_header(format_context, nullptr) >= 0;
+  }
+
+  AVPacket* packet = result ? av_packet_alloc() : nullptr;
+  for (size_t i = 0; result && packet && i < snapshot.packets.size(); ++i) {
+    const AVPacket* src = snapshot.packets[i];
+    const Stream& stream = snapshot.streams[src->stream_index];
+    const int64_t offset = av_rescale_q(snapshot.start_time_us,
+                                        kMicrosecondTimeBase, stream.time_base);
+    // 与第一个视频关键帧同时解码的音频之前的部分不写入
+    if (PacketTime(src) < offset) {
+      continue;
+    }
+
+    if (av_packet_ref(packet, src) < 0) {
+      result = false;
+      break;
+    }
+    if (packet->pts != AV_NOPTS_VALUE) {
+      packet->pts -= offset;
+    }
+    if (packet->dts != AV_NOPTS_VALUE) {
+      packet->dts -= offset;
+    }
+    av_packet_rescale_ts(packet, stream.time_base,
+                         format_context->streams[src->stream_index]->time_base);
+    // av_interleaved_write_frame接管packet中的引用
+    result = av_interleaved_write_frame(format_context, packet) >= 0;
+  }
+  av_packet_free(&packet);
+
+  if (result) {
+    result = av_write_trailer(format_context) == 0;
+  }
+  if (need_file && format_context->pb) {
+    avio_closep(&format_context->pb);
+  }
+  avformat_free_context(format_context);
+  return result;
+}
+
+void ReplayBuffer::Trim() {
+  while (!entries_.empty() &&
+         (bytes_ > config_.max_bytes ||
+          newest_time_us_ - entries_.front().time_us >
+              config_.max_duration_us)) {
+    if (DropFirstGop()) {
+      continue;
+    }
+    // 正在编码的GOP单独超过时长上限时保留，超过字节数上限时全部丢弃
+    if (bytes_ > config_.max_bytes) {
+      dropped_packets_ += static_cast<int64_t>(entries_.size());
+      Clear();
+      waiting_for_key_frame_ = true;
+    }
+    break;
+  }
+}
+
+bool ReplayBuffer::DropFirstGop() {
+  size_t next_key_frame = 1;
+  while (next_key_frame < entries_.size() &&
+         !entries_[next_key_frame].key_frame) {
+    ++next_key_frame;
+  }
+  if (next_key_frame >= entries_.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < next_key_frame; ++i) {
+    Entry& entry = entries_.front();
+    bytes_ -= entry.packet->size;
+    av_packet_free(&entry.packet);
+    entries_.pop_front();
+  }
+  dropped_packets_ += static_cast<int64_t>(next_key_frame);
+  return true;
+}
+
+void ReplayBuffer::Clear() {
+  for (Entry& entry : entries_) {
+    av_packet_free(&entry.packet);
+  }
+  entries_.clear();
+  bytes_ = 0;
+}
@@ -0,0 +1,99 @@
+﻿// 回放缓冲区
+//
+// 回放模式下不把编码数据写入文件，只在内存中保留最近一段时间的数据包，
+// 需要时再把缓冲区中的内容封装成文件，不重新编码。
+// 数据包只增加引用计数，不复制数据。缓冲区按GOP整体淘汰，第一个视频包总是
+// 关键帧，总字节数不超过max_bytes，总时长不超过max_duration_us。
+
+#ifndef ENCODER_REPLAY_BUFFER_H_
+#define ENCODER_REPLAY_BUFFER_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "encoder/ffmpeg.h"
+
+struct ReplayBufferConfig {
+  // 数据包的总大小上限(字节)
+  int64_t max_bytes;
+  // 保留的时长(微秒)
+  int64_t max_duration_us;
+
+  ReplayBufferConfig()
+      : max_bytes(512LL * 1024 * 1024), max_duration_us(120LL * 1000000) {}
+};  // struct ReplayBufferConfig
+
+class ReplayBuffer {
+ public:
+  explicit ReplayBuffer(const ReplayBufferConfig& config);
+  ~ReplayBuffer();
+
+  // 在Push之前按流的序号依次添加所有的流，复制流的编码参数和time_base
+  bool AddStream(const AVStream* stream);
+
+  // 添加一个编码后的数据包，时间戳以所属的流的time_base为单位。
+  // 缓冲区为空时第一个视频关键帧之前的数据包被丢弃
+  void Push(const AVPacket* packet);
+
+  // 把缓冲区中当前的内容写入path，文件格式由后缀决定，时间戳从0开始
+  bool Save(const std::string& path) const;
+  // 立即取得缓冲区的快照，在线程池中写入文件，不阻塞编码。
+  // callback在线程池的线程中调用
+  void SaveAsync(const std::string& path,
+                 const std::function<void(bool)>& callback) const;
+
+  int64_t buffered_bytes() const;
+  int64_t buffered_duration_us() const;
+  // 因超过上限或等待关键帧被丢弃的数据包数
+  int64_t dropped_packets() const;
+
+ private:
+  struct Stream {
+    AVCodecParameters* parameters;
+    AVRational time_base;
+  };  // struct Stream
+
+  struct Entry {
+    AVPacket* packet;
+    // 显示时间，用于计算缓冲的时长
+    int64_t time_us;
+    bool key_frame;
+  };  // struct Entry
+
+  // 缓冲区的快照，写文件时不需要加锁，定义在replay_buffer.cc中
+  struct Snapshot;
+
+  std::shared_ptr<Snapshot> TakeSnapshot() const;
+  static bool WriteSnapshot(const Snapshot& snapshot, const std::string& path);
+
+  // 超过上限时从最早的GOP开始淘汰
+  void Trim();
+  // 丢弃第一个GOP，缓冲区中只有一个GOP时返回false
+  bool DropFirstGop();
+  void Clear();
+
+  const ReplayBufferConfig config_;
+
+  mutable std::mutex lock_;
+  std::vector<Stream> streams_;
+  int video_stream_index_;
+  std::deque<Entry> entries_;
+  int64_t bytes_;
+  // 已收到的数据包中最晚的显示时间
+  int64_t newest_time_us_;
+  // 一个GOP就超过了字节数上限，丢弃后等待下一个关键帧
+  bool waiting_for_key_frame_;
+  int64_t dropped_packets_;
+
+  ReplayBuffer() = delete;
+  ReplayBuffer(const ReplayBuffer&) = delete;
+  ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+};  // class ReplayBuffer
+
+#endif  // ENCODER_REPLAY_BUFFER_H_
@@ -0,0 +1,70 @@
+﻿#include "encoder/scale_pyramid.h"
+
+#include "base/check.h"
+
+ScalePyramid::ScalePyramid(int width, int height)
+    : width_(width), height_(height) {
+  DCHECK(width_ > 0 && height_ > 0);
+}
+
+ScalePyramid::~ScalePyramid() {
+  for (Level& level : levels_) {
+    sws_freeContext(level.context);
+    av_frame_free(&level.frame);
+  }
+}
+
+bool ScalePyramid::AddLevel(int width, int height) {
+  const int src_width = levels_.empty() ? width_ : levels_.back().frame->width;
+  const int src_height =
+      levels_.empty() ? height_ : levels_.back().frame->height;
+  if (width <= 0 || height <= 0 || (width & 1) || (height & 1) ||
+      width > src_width || height >= src_height) {
+    DCHECK(false);
+    return false;
+  }
+
+  // 每一级最多缩小到一半左右，双线性插值足够，不需要更贵的bicubic
+  Level level = {nullptr, av_frame_alloc()};
+  if (!level.frame) {
+    return false;
+  }
+  level.frame->format = AV_PIX_FMT_YUV420P;
+  level.frame->width = width;
+  level.frame->height = height;
+  if (av_frame_get_buffer(level.frame, 0) < 0) {
+    av_frame_free(&level.frame);
+    return false;
+  }
+
+  level.context = sws_getContext(src_width, src_height, AV_PIX_FMT_YUV420P,
+                                 width, height, AV_PIX_FMT_YUV420P,
+                                 SWS_BILINEAR, nullptr, nullptr, nullptr);
+  if (!level.context) {
+    av_frame_free(&level.frame);
+    return false;
+  }
+
+  levels_.push_back(level);
+  return true;
+}
+
+bool ScalePyramid::Scale(const AVFrame* source) {
+  DCHECK(source);
+  DCHECK(source->format == AV_PIX_FMT_YUV420P);
+  DCHECK(source->width == width_ && source->height == height_);
+
+  const AVFrame* src = source;
+  for (Level& level : levels_) {
+    // 编码线程还持有上一帧的引用时分配新的缓冲区
+    if (av_frame_make_writable(level.frame) < 0) {
+      return false;
+    }
+    if (sws_scale(level.context, src->data, src->linesize, 0, src->height,
+                  level.frame->data, level.frame->linesize) < 0) {
+      return false;
+    }
+    src = level.frame;
+  }
+  return true;
+}
@@ -0,0 +1,47 @@
+﻿// 多码率输出的缩放金字塔
+//
+// 源画面只转换一次颜色空间，每一级从上一级缩小得到，而不是每一路都从
+// RGB的原始画面转换和缩小，级别越低读取的像素越少。缩放由libswscale完成，
+// 它有SSE2/AVX2等指令集的实现。
+
+#ifndef ENCODER_SCALE_PYRAMID_H_
+#define ENCODER_SCALE_PYRAMID_H_
+
+#include <vector>
+
+#include "encoder/ffmpeg.h"
+
+class ScalePyramid {
+ public:
+  // width、height: 源画面(YUV420P)的大小
+  ScalePyramid(int width, int height);
+  ~ScalePyramid();
+
+  // 增加一级，宽高都要是偶数，并且小于上一级，按从大到小的顺序调用
+  bool AddLevel(int width, int height);
+
+  // 把source逐级缩小，source的大小要与构造时一致。
+  // 缩小后的画面在下次Scale之前有效，需要保留时用av_frame_ref增加引用，
+  // 下次Scale时会分配新的缓冲区，不影响被引用的画面
+  bool Scale(const AVFrame* source);
+
+  int level_count() const { return static_cast<int>(levels_.size()); }
+  const AVFrame* level(int index) const { return levels_[index].frame; }
+
+ private:
+  struct Level {
+    // 从上一级缩小到这一级
+    SwsContext* context;
+    AVFrame* frame;
+  };
+
+  const int width_;
+  const int height_;
+  std::vector<Level> levels_;
+
+  ScalePyramid() = delete;
+  ScalePyramid(const ScalePyramid&) = delete;
+  ScalePyramid& operator=(const ScalePyramid&) = delete;
+};  // class ScalePyramid
+
+#endif  // ENCODER_SCALE_PYRAMID_H_
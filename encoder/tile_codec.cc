@@ -0,0 +1,696 @@
+﻿#include "encoder/tile_codec.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "base/check.h"
+#include "base/threading/thread_pool.h"
+#include "build/build_config.h"
+
+#if defined(COMPILER_MSVC) && defined(ARCH_CPU_X86_FAMILY)
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+const uint8_t kMagic[4] = {'T', 'I', 'L', 'E'};
+const uint8_t kVersion = 2;
+const uint8_t kKeyFrameFlag = 0x01;
+// 魔数、版本、标志、两个保留字节、宽、高
+const size_t kHeaderSize = 16;
+// 解码时拒绝的尺寸，防止损坏的数据申请过多内存
+const int kMaxDimension = 16384;
+const int kCacheLineSize = 64;
+
+// 图块数据的第一个字节。与上一帧相同的图块没有数据
+enum TileMode : uint8_t {
+  TILE_UNCHANGED = 0,
+  TILE_SOLID = 1,
+  TILE_PALETTE = 2,
+  TILE_DELTA = 3,
+};
+
+const int kMaxPaletteColors = 16;
+// 调色板模式每个字节的高4位是行程减1，低4位是颜色序号
+const int kMaxPaletteRun = 16;
+
+// 差值模式每组的像素数，每组每个通道的残差按组内最大的位数打包
+const int kGroupPixels = 8;
+// 组头第一个字节的低4位是B的位数，为kZeroGroups时高4位是连续的全0组数减1
+const uint8_t kZeroGroups = 0x0F;
+const int kMaxZeroGroups = 16;
+
+// 差值模式每组最多占2个字节的组头加每个通道8个字节，
+// 不满一组的像素也按一组计算，加上模式字节。
+// 打包的数据每次写入8个字节，多写的字节会被后面的数据覆盖，末尾留出8个字节
+size_t MaxTileBytes() {
+  const int groups = TileEncoder::kTileSize *
+                     (TileEncoder::kTileSize / kGroupPixels);
+  return 1 + static_cast<size_t>(groups) * (2 + 4 * kGroupPixels) + 8;
+}
+
+void WriteUint32(uint32_t value, uint8_t* out) {
+  out[0] = static_cast<uint8_t>(value);
+  out[1] = static_cast<uint8_t>(value >> 8);
+  out[2] = static_cast<uint8_t>(value >> 16);
+  out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t ReadUint32(const uint8_t* in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) |
+         (static_cast<uint32_t>(in[3]) << 24);
+}
+
+void WriteVarint(size_t value, std::vector<uint8_t>* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+bool ReadVarint(const uint8_t** in, const uint8_t* end, size_t* value) {
+  size_t result = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*in >= end) {
+      return false;
+    }
+    const uint8_t byte = *(*in)++;
+    result |= static_cast<size_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// 提示CPU把p所在的缓存行读入缓存
+inline void Prefetch(const void* p) {
+#if defined(COMPILER_GCC)
+  __builtin_prefetch(p);
+#elif defined(COMPILER_MSVC) && defined(ARCH_CPU_X86_FAMILY)
+  _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#endif
+}
+
+// value中最低的1所在的位，value不能为0
+int LowestBit(uint64_t value) {
+  static const uint8_t kPositions[64] = {
+      0,  1,  48, 2,  57, 49, 28, 3,  61, 58, 50, 42, 38, 29, 17, 4,
+      62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+      63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+      46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9,  13, 8,  7,  6};
+  return kPositions[((value & (0 - value)) * 0x03F79D71B4CB0A89ull) >> 58];
+}
+
+// 打包残差用的表
+struct PackTables {
+  // 0~255需要的位数
+  uint8_t width[256];
+  // 按位数左移width、2*width、4*width位的乘数。
+  // 移位数不是常量时x86的移位指令比乘法慢
+  uint64_t factors[9][3];
+
+  PackTables() {
+    width[0] = 0;
+    for (int i = 1; i < 256; ++i) {
+      width[i] = static_cast<uint8_t>(width[i / 2] + 1);
+    }
+    for (int w = 0; w <= 8; ++w) {
+      factors[w][0] = 1ull << w;
+      factors[w][1] = 1ull << (w * 2);
+      factors[w][2] = 1ull << (w * 4);
+    }
+  }
+};  // struct PackTables
+
+const PackTables kPackTables;
+
+// 把有符号的残差映射为0、-1、1、-2、2……对应的0、1、2、3、4……
+inline uint8_t ZigZag(uint8_t value) {
+  return static_cast<uint8_t>((value << 1) ^ (0 - (value >> 7)));
+}
+
+inline uint8_t UnZigZag(uint8_t value) {
+  return static_cast<uint8_t>((value >> 1) ^ (0 - (value & 1)));
+}
+
+// 一行像素各字节的残差。按左+上-左上预测，都按字节回绕；
+// 每行第一个像素按上边预测，第一行按左边预测。与上一行相同的行残差全为0
+void ComputeResiduals(const uint32_t* row,
+                      const uint32_t* above,
+                      int width,
+                      uint8_t* residuals) {
+  const uint8_t* current = reinterpret_cast<const uint8_t*>(row);
+  const uint8_t* up = reinterpret_cast<const uint8_t*>(above);
+  const int bytes = width * 4;
+  if (!up) {
+    for (int i = 0; i < 4; ++i) {
+      residuals[i] = ZigZag(current[i]);
+    }
+    for (int i = 4; i < bytes; ++i) {
+      residuals[i] = ZigZag(static_cast<uint8_t>(current[i] - current[i - 4]));
+    }
+    return;
+  }
+  for (int i = 0; i < 4; ++i) {
+    residuals[i] = ZigZag(static_cast<uint8_t>(current[i] - up[i]));
+  }
+  for (int i = 4; i < bytes; ++i) {
+    residuals[i] = ZigZag(static_cast<uint8_t>(current[i] - current[i - 4] -
+                                               up[i] + up[i - 4]));
+  }
+}
+
+// ComputeResiduals的逆运算，从左到右还原row
+void AddResiduals(const uint8_t* residuals,
+                  const uint32_t* above,
+                  int width,
+                  uint32_t* row) {
+  uint8_t* current = reinterpret_cast<uint8_t*>(row);
+  const uint8_t* up = reinterpret_cast<const uint8_t*>(above);
+  const int bytes = width * 4;
+  if (!up) {
+    for (int i = 0; i < 4; ++i) {
+      current[i] = UnZigZag(residuals[i]);
+    }
+    for (int i = 4; i < bytes; ++i) {
+      current[i] =
+          static_cast<uint8_t>(UnZigZag(residuals[i]) + current[i - 4]);
+    }
+    return;
+  }
+  for (int i = 0; i < 4; ++i) {
+    current[i] = static_cast<uint8_t>(UnZigZag(residuals[i]) + up[i]);
+  }
+  for (int i = 4; i < bytes; ++i) {
+    current[i] = static_cast<uint8_t>(UnZigZag(residuals[i]) +
+                                      current[i - 4] + up[i] - up[i - 4]);
+  }
+}
+
+// 一组8个像素(每个uint64_t两个像素)中第channel个通道的8个字节都小于2^width，
+// 依次拼成8*width位，相邻两个、四个逐步合并。
+// 像素的顺序为0、2、4、6、1、3、5、7，这样不用先把各通道转置到一起
+inline uint64_t PackChannel(const uint64_t* values, int channel, int width) {
+  const uint64_t* factors = kPackTables.factors[width];
+  const int shift = channel * 8;
+  const uint64_t mask = 0x000000FF000000FFull;
+  const uint64_t low = ((values[0] >> shift) & mask) |
+                       ((values[1] >> shift) & mask) * factors[0];
+  const uint64_t high = ((values[2] >> shift) & mask) |
+                        ((values[3] >> shift) & mask) * factors[0];
+  const uint64_t packed = low | high * factors[1];
+  return (packed & 0x00000000FFFFFFFFull) | (packed >> 32) * factors[2];
+}
+
+// 把packed的低8*width位依次分成8个width位的数，放到8个字节中
+inline uint64_t UnpackBits(uint64_t packed, int width) {
+  const uint64_t mask = (1ull << width) - 1;
+  const uint64_t mask2 = (1ull << (width * 2)) - 1;
+  const uint64_t mask4 = (1ull << (width * 4)) - 1;
+  packed = (packed & mask4) | ((packed >> (width * 4)) & mask4) << 32;
+  packed = (packed & mask2 * 0x0000000100000001ull) |
+           ((packed >> (width * 2)) & mask2 * 0x0000000100000001ull) << 16;
+  return (packed & mask * 0x0001000100010001ull) |
+         ((packed >> width) & mask * 0x0001000100010001ull) << 8;
+}
+
+// PackChannel的逆运算，把通道的8个字节放回values中，values的这个通道原来为0
+inline void UnpackChannel(uint64_t packed,
+                          int channel,
+                          int width,
+                          uint64_t* values) {
+  const uint64_t bytes = UnpackBits(packed, width);
+  const int shift = channel * 8;
+  for (int i = 0; i < 4; ++i) {
+    values[i] |= ((bytes >> (i * 8)) & 0x000000FF000000FFull) << shift;
+  }
+}
+
+}  // namespace
+
+const int TileEncoder::kTileSize;
+
+TileEncoder::TileEncoder(int width, int height, base::ThreadPool* thread_pool)
+    : width_(width),
+      height_(height),
+      tile_columns_((width + kTileSize - 1) / kTileSize),
+      tile_rows_((height + kTileSize - 1) / kTileSize),
+      thread_pool_(thread_pool),
+      has_previous_(false),
+      tile_capacity_(MaxTileBytes()) {
+  DCHECK(width_ > 0 && height_ > 0);
+  const int tile_count = tile_columns_ * tile_rows_;
+  previous_.resize(static_cast<size_t>(width_) * height_);
+  tile_buffer_.resize(tile_capacity_ * tile_count);
+  tile_sizes_.resize(tile_count);
+  tile_modes_.resize(tile_count);
+}
+
+TileEncoder::~TileEncoder() {
+}
+
+bool TileEncoder::Encode(const uint8_t* data,
+                         int stride,
+                         bool key_frame,
+                         std::vector<uint8_t>* output) {
+  DCHECK(output);
+  if (!data || stride < width_ * 4) {
+    DCHECK(false);
+    return false;
+  }
+
+  key_frame = key_frame || !has_previous_;
+  const int tile_count = tile_columns_ * tile_rows_;
+  auto encode_tiles = [this, data, stride, key_frame](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      // 图块的每一行在不同的内存页，硬件预取跟不上，
+      // 编码这个图块时提示CPU读入下一个图块的像素和上一帧的对应部分。
+      // 写成单独的函数时GCC认为它没有副作用，会删掉调用
+      if (i + 1 < end) {
+        const int left = (i + 1) % tile_columns_ * kTileSize;
+        const int top = (i + 1) / tile_columns_ * kTileSize;
+        const int row_bytes = std::min(kTileSize, width_ - left) * 4;
+        const int rows = std::min(kTileSize, height_ - top);
+        for (int y = 0; y < rows; ++y) {
+          const uint8_t* source =
+              data + static_cast<size_t>(top + y) * stride + left * 4;
+          const uint8_t* previous = reinterpret_cast<const uint8_t*>(
+              &previous_[static_cast<size_t>(top + y) * width_ + left]);
+          for (int offset = 0; offset < row_bytes; offset += kCacheLineSize) {
+            Prefetch(source + offset);
+            Prefetch(previous + offset);
+          }
+        }
+      }
+      tile_sizes_[i] = EncodeTile(i, data, stride, key_frame,
+                                  &tile_buffer_[tile_capacity_ * i]);
+    }
+  };
+  if (thread_pool_) {
+    thread_pool_->ParallelFor(0, tile_count, 0, encode_tiles);
+  } else {
+    encode_tiles(0, tile_count);
+  }
+  has_previous_ = true;
+
+  size_t payload_size = 0;
+  for (size_t size : tile_sizes_) {
+    payload_size += size;
+  }
+  output->clear();
+  output->reserve(kHeaderSize + tile_count * 3 + payload_size);
+  output->insert(output->end(), kMagic, kMagic + sizeof(kMagic));
+  output->push_back(kVersion);
+  output->push_back(key_frame ? kKeyFrameFlag : 0);
+  output->push_back(0);
+  output->push_back(0);
+  output->resize(kHeaderSize);
+  WriteUint32(width_, &(*output)[8]);
+  WriteUint32(height_, &(*output)[12]);
+  for (size_t size : tile_sizes_) {
+    WriteVarint(size, output);
+  }
+  for (int i = 0; i < tile_count; ++i) {
+    const uint8_t* tile = &tile_buffer_[tile_capacity_ * i];
+    output->insert(output->end(), tile, tile + tile_sizes_[i]);
+  }
+
+  last_stats_ = TileStats();
+  for (uint8_t mode : tile_modes_) {
+    switch (mode) {
+      case TILE_UNCHANGED:
+        ++last_stats_.unchanged;
+        break;
+      case TILE_SOLID:
+        ++last_stats_.solid;
+        break;
+      case TILE_PALETTE:
+        ++last_stats_.palette;
+        break;
+      default:
+        ++last_stats_.delta;
+        break;
+    }
+  }
+  return true;
+}
+
+size_t TileEncoder::EncodeTile(int index,
+                               const uint8_t* data,
+                               int stride,
+                               bool key_frame,
+                               uint8_t* out) {
+  const int left = index % tile_columns_ * kTileSize;
+  const int top = index / tile_columns_ * kTileSize;
+  const int tile_width = std::min(kTileSize, width_ - left);
+  const int tile_height = std::min(kTileSize, height_ - top);
+  const size_t row_bytes = tile_width * sizeof(uint32_t);
+
+  auto source_row = [data, stride, left, top](int y) {
+    return reinterpret_cast<const uint32_t*>(
+        data + static_cast<size_t>(top + y) * stride) + left;
+  };
+  auto previous_row = [this, left, top](int y) {
+    return &previous_[static_cast<size_t>(top + y) * width_ + left];
+  };
+
+  if (!key_frame) {
+    int y = 0;
+    while (y < tile_height &&
+           memcmp(source_row(y), previous_row(y), row_bytes) == 0) {
+      ++y;
+    }
+    if (y == tile_height) {
+      tile_modes_[index] = TILE_UNCHANGED;
+      return 0;
+    }
+  }
+  for (int y = 0; y < tile_height; ++y) {
+    memcpy(previous_row(y), source_row(y), row_bytes);
+  }
+
+  const uint32_t first_color = *source_row(0);
+  uint32_t difference = 0;
+  for (int y = 0; y < tile_height && !difference; ++y) {
+    const uint32_t* row = source_row(y);
+    for (int x = 0; x < tile_width; ++x) {
+      difference |= row[x] ^ first_color;
+    }
+  }
+  uint8_t* p = out;
+  if (!difference) {
+    tile_modes_[index] = TILE_SOLID;
+    *p++ = TILE_SOLID;
+    WriteUint32(first_color, p);
+    return 5;
+  }
+
+  // 按行程生成调色板的序号，行程可以跨行，超过kMaxPaletteColors种颜色时放弃
+  uint32_t palette[kMaxPaletteColors] = {first_color};
+  int color_count = 1;
+  uint8_t tokens[kTileSize * kTileSize];
+  int token_count = 0;
+  uint32_t run_color = first_color;
+  int run_index = 0;
+  int run_length = 0;
+  auto flush_run = [&tokens, &token_count](int value, int length) {
+    for (; length > kMaxPaletteRun; length -= kMaxPaletteRun) {
+      tokens[token_count++] =
+          static_cast<uint8_t>((kMaxPaletteRun - 1) << 4 | value);
+    }
+    tokens[token_count++] = static_cast<uint8_t>((length - 1) << 4 | value);
+  };
+  // 颜色的变化不规律时逐个像素比较的分支常常预测失败，
+  // 所以先不用分支找出一行中颜色变化的位置，再逐个处理
+  bool use_palette = true;
+  for (int y = 0; y < tile_height && use_palette; ++y) {
+    const uint32_t* row = source_row(y);
+    uint64_t changes = row[0] != run_color;
+    for (int x = 1; x < tile_width; ++x) {
+      changes |= static_cast<uint64_t>(row[x] != row[x - 1]) << x;
+    }
+    // 当前行程在这一行中开始的位置
+    int run_start = 0;
+    for (; changes; changes &= changes - 1) {
+      const int x = LowestBit(changes);
+      flush_run(run_index, run_length + x - run_start);
+      const uint32_t color = row[x];
+      uint32_t matches = 0;
+      for (int i = 0; i < kMaxPaletteColors; ++i) {
+        matches |= static_cast<uint32_t>(palette[i] == color) << i;
+      }
+      matches &= (1u << color_count) - 1;
+      if (matches) {
+        run_index = LowestBit(matches);
+      } else if (color_count < kMaxPaletteColors) {
+        run_index = color_count;
+        palette[color_count++] = color;
+      } else {
+        use_palette = false;
+        break;
+      }
+      run_color = color;
+      run_length = 0;
+      run_start = x;
+    }
+    run_length += tile_width - run_start;
+  }
+
+  if (use_palette) {
+    flush_run(run_index, run_length);
+    tile_modes_[index] = TILE_PALETTE;
+    *p++ = TILE_PALETTE;
+    *p++ = static_cast<uint8_t>(color_count);
+    for (int i = 0; i < color_count; ++i) {
+      WriteUint32(palette[i], p);
+      p += 4;
+    }
+    memcpy(p, tokens, token_count);
+    p += token_count;
+    return p - out;
+  }
+
+  tile_modes_[index] = TILE_DELTA;
+  *p++ = TILE_DELTA;
+  // 一行的残差，每个uint64_t是两个像素，不满一组的部分为0
+  uint64_t residuals[kTileSize / 2] = {0};
+  const int group_count = (tile_width + kGroupPixels - 1) / kGroupPixels;
+  // 还没有写入的连续全0组数，可以跨行
+  int zero_groups = 0;
+  for (int y = 0; y < tile_height; ++y) {
+    ComputeResiduals(source_row(y), y > 0 ? source_row(y - 1) : nullptr,
+                     tile_width, reinterpret_cast<uint8_t*>(residuals));
+    for (int g = 0; g < group_count; ++g) {
+      uint64_t* values = &residuals[g * (kGroupPixels / 2)];
+      uint64_t bits = values[0] | values[1] | values[2] | values[3];
+      if (!bits) {
+        if (++zero_groups == kMaxZeroGroups) {
+          *p++ = static_cast<uint8_t>((zero_groups - 1) << 4 | kZeroGroups);
+          zero_groups = 0;
+        }
+        continue;
+      }
+      if (zero_groups > 0) {
+        *p++ = static_cast<uint8_t>((zero_groups - 1) << 4 | kZeroGroups);
+        zero_groups = 0;
+      }
+      bits |= bits >> 32;
+      int widths[4];
+      for (int c = 0; c < 4; ++c) {
+        widths[c] = kPackTables.width[(bits >> (c * 8)) & 0xFF];
+      }
+      *p++ = static_cast<uint8_t>(widths[1] << 4 | widths[0]);
+      *p++ = static_cast<uint8_t>(widths[3] << 4 | widths[2]);
+      // A通常与预测相同
+      const int channels = widths[3] ? 4 : 3;
+      for (int c = 0; c < channels; ++c) {
+        const uint64_t packed = PackChannel(values, c, widths[c]);
+        memcpy(p, &packed, sizeof(packed));
+        p += widths[c];
+      }
+    }
+  }
+  if (zero_groups > 0) {
+    *p++ = static_cast<uint8_t>((zero_groups - 1) << 4 | kZeroGroups);
+  }
+  DCHECK(static_cast<size_t>(p - out) + 8 <= tile_capacity_);
+  return p - out;
+}
+
+TileDecoder::TileDecoder(base::ThreadPool* thread_pool)
+    : thread_pool_(thread_pool), width_(0), height_(0), tile_columns_(0) {
+}
+
+TileDecoder::~TileDecoder() {
+}
+
+bool TileDecoder::Decode(const uint8_t* data, size_t size) {
+  if (!data || size < kHeaderSize ||
+      memcmp(data, kMagic, sizeof(kMagic)) != 0 || data[4] != kVersion) {
+    return false;
+  }
+  const bool key_frame = (data[5] & kKeyFrameFlag) != 0;
+  const uint32_t width = ReadUint32(data + 8);
+  const uint32_t height = ReadUint32(data + 12);
+  if (width == 0 || height == 0 ||
+      width > static_cast<uint32_t>(kMaxDimension) ||
+      height > static_cast<uint32_t>(kMaxDimension)) {
+    return false;
+  }
+  if (width != static_cast<uint32_t>(width_) ||
+      height != static_cast<uint32_t>(height_)) {
+    // 非关键帧引用的上一帧尺寸必须相同
+    if (!key_frame) {
+      return false;
+    }
+    width_ = static_cast<int>(width);
+    height_ = static_cast<int>(height);
+    tile_columns_ = (width_ + TileEncoder::kTileSize - 1) /
+                    TileEncoder::kTileSize;
+    frame_.assign(static_cast<size_t>(width_) * height_, 0);
+  }
+
+  const int tile_rows =
+      (height_ + TileEncoder::kTileSize - 1) / TileEncoder::kTileSize;
+  const int tile_count = tile_columns_ * tile_rows;
+  const uint8_t* data_end = data + size;
+  const uint8_t* p = data + kHeaderSize;
+  std::vector<size_t> offsets(tile_count + 1);
+  size_t total = 0;
+  for (int i = 0; i < tile_count; ++i) {
+    size_t tile_size = 0;
+    if (!ReadVarint(&p, data_end, &tile_size) ||
+        (key_frame && tile_size == 0)) {
+      return false;
+    }
+    offsets[i] = total;
+    total += tile_size;
+    if (total > size) {
+      return false;
+    }
+  }
+  offsets[tile_count] = total;
+  if (total != static_cast<size_t>(data_end - p)) {
+    return false;
+  }
+
+  std::atomic<bool> ok(true);
+  auto decode_tiles = [this, p, &offsets, &ok](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      if (!DecodeTile(i, p + offsets[i], offsets[i + 1] - offsets[i])) {
+        ok = false;
+      }
+    }
+  };
+  if (thread_pool_) {
+    thread_pool_->ParallelFor(0, tile_count, 0, decode_tiles);
+  } else {
+    decode_tiles(0, tile_count);
+  }
+  return ok;
+}
+
+bool TileDecoder::DecodeTile(int index, const uint8_t* data, size_t size) {
+  if (size == 0) {
+    return true;
+  }
+
+  const int tile_size = TileEncoder::kTileSize;
+  const int left = index % tile_columns_ * tile_size;
+  const int top = index / tile_columns_ * tile_size;
+  const int tile_width = std::min(tile_size, width_ - left);
+  const int tile_height = std::min(tile_size, height_ - top);
+  auto frame_row = [this, left, top](int y) {
+    return &frame_[static_cast<size_t>(top + y) * width_ + left];
+  };
+
+  const uint8_t* p = data + 1;
+  const uint8_t* end = data + size;
+  switch (data[0]) {
+    case TILE_SOLID: {
+      if (size != 5) {
+        return false;
+      }
+      const uint32_t color = ReadUint32(p);
+      for (int y = 0; y < tile_height; ++y) {
+        uint32_t* row = frame_row(y);
+        std::fill(row, row + tile_width, color);
+      }
+      return true;
+    }
+
+    case TILE_PALETTE: {
+      if (p >= end) {
+        return false;
+      }
+      const int color_count = *p++;
+      if (color_count < 2 || color_count > kMaxPaletteColors ||
+          end - p < color_count * 4) {
+        return false;
+      }
+      uint32_t palette[kMaxPaletteColors];
+      for (int i = 0; i < color_count; ++i) {
+        palette[i] = ReadUint32(p);
+        p += 4;
+      }
+      int x = 0;
+      int y = 0;
+      while (p < end) {
+        const int value = *p & 0x0F;
+        int run = (*p >> 4) + 1;
+        ++p;
+        if (value >= color_count) {
+          return false;
+        }
+        while (run > 0) {
+          if (y >= tile_height) {
+            return false;
+          }
+          const int count = std::min(run, tile_width - x);
+          uint32_t* row = frame_row(y) + x;
+          std::fill(row, row + count, palette[value]);
+          run -= count;
+          x += count;
+          if (x == tile_width) {
+            x = 0;
+            ++y;
+          }
+        }
+      }
+      return y == tile_height && x == 0;
+    }
+
+    case TILE_DELTA: {
+      uint64_t residuals[tile_size / 2];
+      const int group_count = (tile_width + kGroupPixels - 1) / kGroupPixels;
+      int zero_groups = 0;
+      for (int y = 0; y < tile_height; ++y) {
+        for (int g = 0; g < group_count; ++g) {
+          uint64_t* values = &residuals[g * (kGroupPixels / 2)];
+          if (zero_groups == 0) {
+            if (p >= end) {
+              return false;
+            }
+            if ((*p & 0x0F) == kZeroGroups) {
+              zero_groups = (*p++ >> 4) + 1;
+            } else {
+              if (end - p < 2) {
+                return false;
+              }
+              const int widths[4] = {p[0] & 0x0F, p[0] >> 4, p[1] & 0x0F,
+                                     p[1] >> 4};
+              p += 2;
+              memset(values, 0, kGroupPixels * 4);
+              for (int c = 0; c < 4; ++c) {
+                if (widths[c] > 8 || end - p < widths[c]) {
+                  return false;
+                }
+                uint64_t packed = 0;
+                memcpy(&packed, p, widths[c]);
+                p += widths[c];
+                if (widths[c]) {
+                  UnpackChannel(packed, c, widths[c], values);
+                }
+              }
+              continue;
+            }
+          }
+          --zero_groups;
+          memset(values, 0, kGroupPixels * 4);
+        }
+        AddResiduals(reinterpret_cast<const uint8_t*>(residuals),
+                     y > 0 ? frame_row(y - 1) : nullptr, tile_width,
+                     frame_row(y));
+      }
+      return zero_groups == 0 && p == end;
+    }
+
+    default:
+      return false;
+  }
+}
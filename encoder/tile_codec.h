@@ -0,0 +1,114 @@
+﻿// 桌面画面专用的无损帧格式
+//
+// 画面分成64x64的图块，每个图块独立编码，可以并行编解码：
+// - 与上一帧相同的图块只记录长度0，不保存数据
+// - 只有一种颜色的图块保存这个颜色
+// - 不超过16种颜色的图块(文字、图标)保存调色板和按行程编码的序号
+// - 其它图块每个字节按左+上-左上预测，每8个像素一组，各通道的残差按组内
+//   最大的位数打包，连续的全0组只记录组数
+// 每一帧的数据：文件头、各图块的长度(LEB128变长整数)、各图块的数据。
+// 像素为BGRA格式，按小端序的uint32_t处理。
+
+#ifndef ENCODER_TILE_CODEC_H_
+#define ENCODER_TILE_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace base {
+class ThreadPool;
+}  // namespace base
+
+// 一帧中各种图块的数量
+struct TileStats {
+  int unchanged;
+  int solid;
+  int palette;
+  int delta;
+
+  TileStats() : unchanged(0), solid(0), palette(0), delta(0) {}
+};  // struct TileStats
+
+class TileEncoder {
+ public:
+  static const int kTileSize = 64;
+
+  // thread_pool: 并行编码图块的线程池，为nullptr时在调用线程中编码
+  TileEncoder(int width, int height, base::ThreadPool* thread_pool);
+  ~TileEncoder();
+
+  // 编码一帧BGRA画面，stride为每行的字节数，结果替换output的内容。
+  // key_frame为true或者是第一帧时不引用上一帧，可以单独解码
+  bool Encode(const uint8_t* data,
+              int stride,
+              bool key_frame,
+              std::vector<uint8_t>* output);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  // 上一次Encode的统计
+  const TileStats& last_stats() const { return last_stats_; }
+
+ private:
+  // 编码第index个图块，返回数据的长度，0表示与上一帧相同
+  size_t EncodeTile(int index,
+                    const uint8_t* data,
+                    int stride,
+                    bool key_frame,
+                    uint8_t* out);
+
+  const int width_;
+  const int height_;
+  const int tile_columns_;
+  const int tile_rows_;
+  base::ThreadPool* const thread_pool_;
+
+  // 上一帧的画面，每行width_个像素
+  std::vector<uint32_t> previous_;
+  bool has_previous_;
+
+  // 每个图块的输出位置固定，并行编码时互不影响
+  std::vector<uint8_t> tile_buffer_;
+  size_t tile_capacity_;
+  std::vector<size_t> tile_sizes_;
+  std::vector<uint8_t> tile_modes_;
+
+  TileStats last_stats_;
+
+  TileEncoder() = delete;
+  TileEncoder(const TileEncoder&) = delete;
+  TileEncoder& operator=(const TileEncoder&) = delete;
+};  // class TileEncoder
+
+class TileDecoder {
+ public:
+  // thread_pool: 并行解码图块的线程池，为nullptr时在调用线程中解码
+  explicit TileDecoder(base::ThreadPool* thread_pool);
+  ~TileDecoder();
+
+  // 解码一帧，数据损坏、尺寸变化的非关键帧或者没有关键帧时返回false
+  bool Decode(const uint8_t* data, size_t size);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  // 解码后的画面，BGRA格式，每行width()个像素
+  const uint32_t* pixels() const { return frame_.data(); }
+
+ private:
+  bool DecodeTile(int index, const uint8_t* data, size_t size);
+
+  base::ThreadPool* const thread_pool_;
+
+  int width_;
+  int height_;
+  int tile_columns_;
+  std::vector<uint32_t> frame_;
+
+  TileDecoder() = delete;
+  TileDecoder(const TileDecoder&) = delete;
+  TileDecoder& operator=(const TileDecoder&) = delete;
+};  // class TileDecoder
+
+#endif  // ENCODER_TILE_CODEC_H_
@@ -1,9 +1,97 @@
 ﻿#include "encoder/video_encoder.h"
 
+#include <limits.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
 #include "base/check.h"
+#include "base/threading/thread_pool.h"
 
 namespace {
 
+// ROI的量化偏移，范围-1~1，x264中乘以25作为QP的偏移
+// 变化区域提高画质
+const AVRational kDirtyRegionQOffset = {-1, 10};
+// 未变化区域与上一帧完全相同，尽量用最少的码率编码
+const AVRational kStaticRegionQOffset = {2, 5};
+
+// 并行转换颜色空间时每个条带的最小行数，太小时线程调度的开销超过收益
+const int kMinBandRows = 64;
+
+// 低延迟编码时VBV缓冲区的时长(毫秒)，决定关键帧等码率峰值最多积压多久
+const int kLowLatencyVbvMs = 250;
+
+// x264的preset，从快到慢，其它编码器的速度档位按这个顺序换算
+const char* const kX264Presets[] = {
+    "ultrafast", "superfast", "veryfast", "faster", "fast",
+    "medium",    "slow",      "slower",   "veryslow",
+};
+// 与kX264Presets对应的速度档位。FFmpeg 4.x的libsvtav1只接受0~8
+const int kSvtAv1Presets[] = {8, 8, 7, 7, 6, 5, 4, 3, 2};
+const int kVp9CpuUsed[] = {8, 7, 6, 5, 4, 3, 2, 1, 0};
+// cpu-used不小于这个值时使用realtime模式，否则使用good模式
+const int kVp9RealtimeCpuUsed = 5;
+
+// x265的crf比x264大4~6时画质相近
+const int kX265CrfOffset = 5;
+// AV1和VP9的crf范围是0~63，换算后x264的18约为VP9的25、AV1的28
+const int kMaxAv1Crf = 63;
+const int kVp9CrfOffset = 3;
+const int kAv1CrfOffset = 6;
+
+// VP9每个tile至少256像素宽，AV1使用相同的划分
+const int kMinTileWidth = 256;
+const int kMaxTileColumnsLog2 = 4;
+// libvpx的lag-in-frames上限
+const int kMaxVp9LagInFrames = 25;
+
+// 无损编码的分片数，8核时每个核两个分片，负载比较均衡。
+// FFV1要求分片数能排成行列数相近的网格，如16、24
+const int kLosslessSlices = 16;
+// 不慢于这个preset(veryfast)时无损编码器使用更快的算法
+const int kLosslessFastPreset = 2;
+
+// 返回preset在kX264Presets中的位置，不认识的preset按medium处理
+int PresetIndex(const std::string& preset) {
+  const int count = static_cast<int>(sizeof(kX264Presets) /
+                                     sizeof(kX264Presets[0]));
+  for (int i = 0; i < count; ++i) {
+    if (preset == kX264Presets[i]) {
+      return i;
+    }
+  }
+  return 5;
+}
+
+// 把x264的crf(0~51)换算到0~63
+int ScaleCrf(int crf, int offset) {
+  return std::min(std::max(crf * kMaxAv1Crf / 51 + offset, 0), kMaxAv1Crf);
+}
+
+// 按画面宽度划分tile的列数(log2)，tile越多并行度越高，压缩率略低
+int TileColumnsLog2(int width) {
+  int log2 = 0;
+  while (log2 < kMaxTileColumnsLog2 && (kMinTileWidth << (log2 + 1)) <= width) {
+    ++log2;
+  }
+  return log2;
+}
+
+// 画面内容是否是桌面、文字等屏幕内容，决定是否启用屏幕内容编码工具
+bool IsScreenContent(const std::string& tune) {
+  return tune.find("stillimage") != std::string::npos ||
+         tune.find("animation") != std::string::npos;
+}
+
+void AppendParam(const std::string& param, std::string* params) {
+  if (!params->empty()) {
+    params->append(":");
+  }
+  params->append(param);
+}
+
 AVFrame* CreateVideoFrame(AVPixelFormat pix_fmt, int width, int height) {
   AVFrame *video_frame = av_frame_alloc();
   if (!video_frame) {
@@ -43,6 +131,8 @@ VideoEncoder::VideoEncoder(const VideoConfig& video_config)
       codec_context_(nullptr),
       frame_(nullptr),
       sws_context_(nullptr),
+      band_chroma_shift_(1),
+      copy_input_(false),
       dict_(nullptr),
       input_pixel_format_(video_config.input_pixel_format),
       output_pixel_format_(AV_PIX_FMT_YUV420P),
@@ -67,16 +157,28 @@ VideoEncoder::~VideoEncoder() {
   if (sws_context_) {
     sws_freeContext(sws_context_);
   }
+
+  for (SwsContext* context : band_contexts_) {
+    sws_freeContext(context);
+  }
 }
 
 bool VideoEncoder::Initialize() {
   DCHECK(!initialized_);
 
   const AVCodecID codec_id = video_config_.codec_id;
-  codec_ = avcodec_find_encoder(codec_id);
-  if (!codec_) {
-    DCHECK(false) << "Unable to find video encoder";
-    return false;
+  if (!video_config_.encoder_name.empty()) {
+    // FFmpeg编译时可能没有包含这个编码器，由调用者处理
+    codec_ = avcodec_find_encoder_by_name(video_config_.encoder_name.c_str());
+    if (!codec_ || codec_->id != codec_id) {
+      return false;
+    }
+  } else {
+    codec_ = avcodec_find_encoder(codec_id);
+    if (!codec_) {
+      DCHECK(false) << "Unable to find video encoder";
+      return false;
+    }
   }
 
   codec_context_ = avcodec_alloc_context3(codec_);
@@ -86,34 +188,67 @@ bool VideoEncoder::Initialize() {
   }
 
   codec_context_->codec_id = codec_id;
-  codec_context_->pix_fmt = AV_PIX_FMT_YUV420P;
+  output_pixel_format_ = ChooseOutputPixelFormat();
+  if (output_pixel_format_ == AV_PIX_FMT_NONE) {
+    return false;
+  }
+  codec_context_->pix_fmt = output_pixel_format_;
   codec_context_->codec_type = AVMEDIA_TYPE_VIDEO;
   codec_context_->framerate = {video_config_.fps, 1};
-  codec_context_->time_base = {1, 1000};
-  codec_context_->gop_size = 30;
-  codec_context_->max_b_frames = 1;
-  codec_context_->width = video_config_.width;
-  codec_context_->height = video_config_.height;
+  // 时间戳是媒体时钟上的微秒数，与音频使用同一个时钟
+  codec_context_->time_base = {1, 1000000};
+  // 关键帧由GopController决定，这里只限制最大间隔
+  codec_context_->gop_size = video_config_.max_gop_size;
+  codec_context_->keyint_min = video_config_.min_gop_size;
+  // B帧要等后面的帧编码完才能输出
+  codec_context_->max_b_frames =
+      video_config_.low_latency ? 0 : video_config_.max_b_frames;
+  codec_context_->thread_count = video_config_.threads;
+  codec_context_->width = video_config_.output_width > 0
+                              ? video_config_.output_width
+                              : video_config_.width;
+  codec_context_->height = video_config_.output_height > 0
+                               ? video_config_.output_height
+                               : video_config_.height;
   codec_context_->sample_aspect_ratio.num = 1;
   codec_context_->sample_aspect_ratio.den = 1;
-  // 设置了这个标志不需要设置bit_rate
-  codec_context_->flags |= AV_CODEC_FLAG_QSCALE;
 
-  // x264需要设置这个
-  // 限制码率因子 0~51 0为无损模式，23为缺省值，51可能是最差的。该数字越小，图像质量越好。
-  av_opt_set(codec_context_->priv_data, "crf", "18", 0);
+  if (video_config_.bit_rate > 0 && video_config_.low_latency) {
+    // 恒定码率，网络带宽按码率预留，峰值只能由很小的VBV缓冲区吸收
+    codec_context_->bit_rate = video_config_.bit_rate;
+    codec_context_->rc_min_rate = video_config_.bit_rate;
+    codec_context_->rc_max_rate = video_config_.bit_rate;
+    codec_context_->rc_buffer_size = static_cast<int>(std::min<int64_t>(
+        video_config_.bit_rate * kLowLatencyVbvMs / 1000, INT_MAX));
+  } else if (video_config_.bit_rate > 0) {
+    codec_context_->bit_rate = video_config_.bit_rate;
+    // 限制码率峰值，避免画面剧烈变化时码率过高
+    codec_context_->rc_max_rate = video_config_.bit_rate * 2;
+    codec_context_->rc_buffer_size =
+        static_cast<int>(std::min<int64_t>(video_config_.bit_rate * 2, INT_MAX));
+  } else {
+    // 设置了这个标志不需要设置bit_rate，crf在各编码器的参数中设置
+    codec_context_->flags |= AV_CODEC_FLAG_QSCALE;
+  }
 
   av_opt_set(codec_context_->priv_data, "brand", "mp42", 0);
   av_opt_set(codec_context_->priv_data, "movflags", "disable_chpl", 0);
 
-  if (codec_context_->codec_id == AV_CODEC_ID_H264) {
-    // tune的参数主要配合视频类型和视觉优化的参数，或特别的情况
-    // https://www.jianshu.com/p/b46a33dd958d
-    av_opt_set(codec_context_->priv_data, "tune", "stillimage", 0);
-    // 调节编码速度和质量的平衡，有10个选项：
-    //   ultrafast、superfast、veryfast、faster、fast、medium、slow、slower、veryslow、placebo
-    // 从快到慢
-    av_opt_set(codec_context_->priv_data, "preset", "ultrafast", 0);
+  // 各编码器的参数名称和取值范围不同。preset、tune和crf都按x264的含义设置，
+  // 在这里换算成各编码器相近的参数
+  const std::string encoder_name = codec_->name;
+  if (encoder_name == "libx264" || encoder_name == "libx264rgb") {
+    SetX264Options();
+  } else if (encoder_name == "libx265") {
+    SetX265Options();
+  } else if (encoder_name == "libsvtav1") {
+    SetSvtAv1Options();
+  } else if (encoder_name == "libvpx-vp9") {
+    SetVp9Options();
+  } else if (encoder_name == "ffv1") {
+    SetFfv1Options();
+  } else if (encoder_name == "utvideo") {
+    SetUtVideoOptions();
   }
 
   frame_ = CreateVideoFrame(codec_context_->pix_fmt,
@@ -123,12 +258,21 @@ bool VideoEncoder::Initialize() {
     return false;
   }
 
+  // 输出大小与输入不同时在颜色空间转换的同时缩放
   sws_context_ = CreateSoftwareScaler(
-      input_pixel_format_, codec_context_->width, codec_context_->height,
+      input_pixel_format_, video_config_.width, video_config_.height,
       output_pixel_format_, codec_context_->width, codec_context_->height);
   if (!sws_context_) {
     return false;
   }
+  if (!CreateBandScalers()) {
+    return false;
+  }
+  copy_input_ = input_pixel_format_ == AV_PIX_FMT_RGB32 &&
+                (output_pixel_format_ == AV_PIX_FMT_RGB32 ||
+                 output_pixel_format_ == AV_PIX_FMT_0RGB32) &&
+                codec_context_->width == video_config_.width &&
+                codec_context_->height == video_config_.height;
 
   initialized_ = true;
   return initialized_;
@@ -136,7 +280,6 @@ bool VideoEncoder::Initialize() {
 
 bool VideoEncoder::Open(AVStream* video_stream) {
   DCHECK(initialized_);
-  DCHECK(video_stream);
 
   int ret = avcodec_open2(codec_context_, codec_, &dict_);
   if (ret < 0) {
@@ -144,6 +287,11 @@ bool VideoEncoder::Open(AVStream* video_stream) {
     return false;
   }
 
+  // 没有输出文件时(如性能校准)只打开编码器
+  if (!video_stream) {
+    return true;
+  }
+
   ret = avcodec_parameters_from_context(video_stream->codecpar, codec_context_);
   if (ret < 0) {
     DCHECK(false) << "Failed to copy avcodec parameters.";
@@ -183,8 +331,18 @@ int VideoEncoder::PushEncodeFrame(uint8_t* data,
     uint8_t* src[3] = {const_cast<uint8_t*>(src_data), nullptr, nullptr};
     int src_stride[1] = {stride};
 
-    ret = sws_scale(sws_context_, src, src_stride, 0, src_height, frame_->data,
-                    frame_->linesize);
+    if (copy_input_ && src_width == video_config_.width &&
+        src_height == video_config_.height) {
+      // 只是忽略了alpha通道，不需要转换
+      av_image_copy_plane(frame_->data[0], frame_->linesize[0], src_data,
+                          stride, src_width * 4, src_height);
+    } else if (!band_contexts_.empty() && src_width == video_config_.width &&
+               src_height == video_config_.height) {
+      ret = ConvertBands(src_data, stride);
+    } else {
+      ret = sws_scale(sws_context_, src, src_stride, 0, src_height,
+                      frame_->data, frame_->linesize);
+    }
     if (ret < 0) {
       DCHECK(false) << "Error while converting video picture.";
       return ret;
@@ -196,6 +354,78 @@ int VideoEncoder::PushEncodeFrame(uint8_t* data,
   return 0;
 }
 
+bool VideoEncoder::SetCrf(int crf) {
+  DCHECK(codec_context_);
+
+  if (!CanSetCrf()) {
+    return false;
+  }
+  return av_opt_set(codec_context_->priv_data, "crf",
+                    std::to_string(crf).c_str(), 0) >= 0;
+}
+
+bool VideoEncoder::CanSetCrf() const {
+  // libx264在每一帧编码前检查crf是否变化，变化时重新配置x264。
+  // 其它编码器只在打开时读取crf，使用码率控制时没有crf
+  return codec_ && std::string(codec_->name) == "libx264" &&
+         video_config_.bit_rate <= 0;
+}
+
+void VideoEncoder::SetRegionsOfInterest(
+    AVFrame* frame,
+    int src_width,
+    int src_height,
+    const std::vector<VideoRect>& dirty_rects) {
+  DCHECK(frame);
+
+  // frame_会被重复使用，先清除上一帧的ROI
+  av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+  if (!video_config_.enable_roi || dirty_rects.empty() || src_width <= 0 ||
+      src_height <= 0) {
+    return;
+  }
+
+  // 变化区域在前，整个画面作为最后一个区域；
+  // 区域重叠时以前面的区域为准
+  const size_t count = dirty_rects.size() + 1;
+  AVFrameSideData* side_data = av_frame_new_side_data(
+      frame, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+      static_cast<int>(count * sizeof(AVRegionOfInterest)));
+  if (!side_data) {
+    return;
+  }
+
+  const int dst_width = codec_context_->width;
+  const int dst_height = codec_context_->height;
+
+  AVRegionOfInterest* roi =
+      reinterpret_cast<AVRegionOfInterest*>(side_data->data);
+  for (const VideoRect& rect : dirty_rects) {
+    roi->self_size = sizeof(AVRegionOfInterest);
+    roi->left = static_cast<int>(
+        static_cast<int64_t>(rect.left) * dst_width / src_width);
+    roi->top = static_cast<int>(
+        static_cast<int64_t>(rect.top) * dst_height / src_height);
+    roi->right = std::min(
+        dst_width, static_cast<int>((static_cast<int64_t>(rect.right) *
+                                         dst_width + src_width - 1) /
+                                    src_width));
+    roi->bottom = std::min(
+        dst_height, static_cast<int>((static_cast<int64_t>(rect.bottom) *
+                                          dst_height + src_height - 1) /
+                                     src_height));
+    roi->qoffset = kDirtyRegionQOffset;
+    ++roi;
+  }
+
+  roi->self_size = sizeof(AVRegionOfInterest);
+  roi->left = 0;
+  roi->top = 0;
+  roi->right = dst_width;
+  roi->bottom = dst_height;
+  roi->qoffset = kStaticRegionQOffset;
+}
+
 AVCodecContext* VideoEncoder::GetCodecContext() const {
   return codec_context_;
 }
@@ -205,6 +435,213 @@ AVRational VideoEncoder::GetTimeBase() const {
   return codec_context_->time_base;
 }
 
+void VideoEncoder::SetX264Options() {
+  void* options = codec_context_->priv_data;
+  if (video_config_.lossless) {
+    // qp为0时无损，libx264rgb直接编码RGB，libx264编码YUV444P以外的格式仍有损失
+    av_opt_set_int(options, "qp", 0, 0);
+  } else if (video_config_.bit_rate <= 0) {
+    // 限制码率因子 0~51 0为无损模式，23为缺省值，51可能是最差的。该数字越小，图像质量越好。
+    av_opt_set(options, "crf", std::to_string(video_config_.crf).c_str(), 0);
+  }
+
+  // tune的参数主要配合视频类型和视觉优化的参数，或特别的情况
+  // https://www.jianshu.com/p/b46a33dd958d
+  std::string tune = video_config_.tune;
+  if (video_config_.low_latency &&
+      tune.find("zerolatency") == std::string::npos) {
+    // x264可以同时使用一个画面类型的tune和zerolatency
+    tune = tune.empty() ? "zerolatency" : tune + ",zerolatency";
+  }
+  av_opt_set(options, "tune", tune.c_str(), 0);
+  // 调节编码速度和质量的平衡，有10个选项：
+  //   ultrafast、superfast、veryfast、faster、fast、medium、slow、slower、veryslow、placebo
+  // 从快到慢
+  av_opt_set(options, "preset", video_config_.preset.c_str(), 0);
+  if (video_config_.low_latency) {
+    // zerolatency已经包含这些设置，这里明确写出，不受preset和lookahead影响。
+    // 分片多线程在一帧内并行，编码一帧立即输出一帧
+    av_opt_set_int(options, "rc-lookahead", 0, 0);
+    av_opt_set(options, "x264-params", "sliced-threads=1:sync-lookahead=0", 0);
+    if (video_config_.bit_rate > 0) {
+      av_opt_set(options, "nal-hrd", "cbr", 0);
+    }
+  } else if (video_config_.lookahead >= 0) {
+    av_opt_set_int(options, "rc-lookahead", video_config_.lookahead, 0);
+  }
+  // 关闭x264自身的场景切换检测，强制关键帧时编码为IDR帧
+  av_opt_set(options, "sc_threshold", "0", 0);
+  av_opt_set(options, "forced-idr", "1", 0);
+  // x264在关闭自适应量化时会忽略ROI，ultrafast默认关闭了自适应量化
+  if (video_config_.enable_roi) {
+    av_opt_set(options, "aq-mode", "1", 0);
+  }
+}
+
+void VideoEncoder::SetX265Options() {
+  void* options = codec_context_->priv_data;
+  if (video_config_.bit_rate <= 0) {
+    av_opt_set_int(options, "crf",
+                   std::min(video_config_.crf + kX265CrfOffset, 51), 0);
+  }
+
+  // preset的名称与x264相同。x265没有stillimage，只保留它也有的tune，
+  // 屏幕内容编码(SCC)需要专门编译的x265，这里不使用
+  av_opt_set(options, "preset", video_config_.preset.c_str(), 0);
+  if (video_config_.low_latency) {
+    av_opt_set(options, "tune", "zerolatency", 0);
+  } else if (video_config_.tune == "animation" ||
+             video_config_.tune == "zerolatency") {
+    av_opt_set(options, "tune", video_config_.tune.c_str(), 0);
+  }
+
+  // 关键帧由GopController决定，强制关键帧时编码为IDR帧
+  av_opt_set(options, "forced-idr", "1", 0);
+  std::string params = "scenecut=0";
+  const int lookahead =
+      video_config_.low_latency ? 0 : video_config_.lookahead;
+  if (lookahead >= 0) {
+    AppendParam("rc-lookahead=" + std::to_string(lookahead), &params);
+  }
+  // libx265不使用thread_count，线程数由线程池决定
+  if (video_config_.threads > 0) {
+    AppendParam("pools=" + std::to_string(video_config_.threads), &params);
+  }
+  if (video_config_.low_latency && video_config_.bit_rate > 0) {
+    AppendParam("hrd=1", &params);
+  }
+  av_opt_set(options, "x265-params", params.c_str(), 0);
+}
+
+void VideoEncoder::SetSvtAv1Options() {
+  void* options = codec_context_->priv_data;
+  if (video_config_.bit_rate <= 0) {
+    // FFmpeg 4.x没有crf，使用固定的qp
+    const int crf = ScaleCrf(video_config_.crf, kAv1CrfOffset);
+    if (av_opt_set_int(options, "crf", crf, 0) < 0) {
+      av_opt_set_int(options, "rc", 0, 0);
+      av_opt_set_int(options, "qp", crf, 0);
+    }
+  } else {
+    av_opt_set_int(options, "rc", 1, 0);
+  }
+  av_opt_set_int(options, "preset",
+                 kSvtAv1Presets[PresetIndex(video_config_.preset)], 0);
+
+  // 屏幕内容编码工具(调色板、帧内块复制)对文字和界面的压缩率提高很多。
+  // FFmpeg 4.x的libsvtav1不支持svtav1-params，也不支持强制关键帧，
+  // 关键帧只按gop_size固定间隔插入
+  std::string params;
+  const std::string& tune = video_config_.tune;
+  AppendParam(IsScreenContent(tune) ? "scm=1"
+                                    : tune == "film" ? "scm=0" : "scm=2",
+              &params);
+  AppendParam("tile-columns=" +
+                  std::to_string(TileColumnsLog2(codec_context_->width)),
+              &params);
+  if (video_config_.low_latency) {
+    AppendParam("pred-struct=1:lookahead=0", &params);
+  } else if (video_config_.lookahead >= 0) {
+    AppendParam("lookahead=" + std::to_string(video_config_.lookahead),
+                &params);
+  }
+  if (video_config_.threads > 0) {
+    AppendParam("lp=" + std::to_string(video_config_.threads), &params);
+  }
+  av_opt_set(options, "svtav1-params", params.c_str(), 0);
+}
+
+void VideoEncoder::SetVp9Options() {
+  void* options = codec_context_->priv_data;
+  if (video_config_.bit_rate <= 0) {
+    // 码率为0时是恒定质量模式
+    codec_context_->bit_rate = 0;
+    av_opt_set_int(options, "crf",
+                   ScaleCrf(video_config_.crf, kVp9CrfOffset), 0);
+  }
+
+  const int cpu_used = kVp9CpuUsed[PresetIndex(video_config_.preset)];
+  const bool realtime =
+      video_config_.low_latency || cpu_used >= kVp9RealtimeCpuUsed;
+  av_opt_set(options, "deadline", realtime ? "realtime" : "good", 0);
+  av_opt_set_int(options, "cpu-used", cpu_used, 0);
+
+  // 按行多线程，tile的列之间可以并行编码和解码
+  av_opt_set_int(options, "row-mt", 1, 0);
+  av_opt_set_int(options, "tile-columns",
+                 TileColumnsLog2(codec_context_->width), 0);
+  av_opt_set_int(options, "frame-parallel", 0, 0);
+  const std::string& tune = video_config_.tune;
+  if (IsScreenContent(tune)) {
+    av_opt_set(options, "tune-content", "screen", 0);
+  } else if (tune == "film") {
+    av_opt_set(options, "tune-content", "film", 0);
+  }
+
+  // VP9没有B帧，前瞻的帧用来生成替代参考帧(alt-ref)
+  const int lag = video_config_.low_latency ? 0
+                  : video_config_.lookahead >= 0
+                      ? std::min(video_config_.lookahead, kMaxVp9LagInFrames)
+                      : -1;
+  if (lag >= 0) {
+    av_opt_set_int(options, "lag-in-frames", lag, 0);
+  }
+  if (lag == 0) {
+    av_opt_set_int(options, "auto-alt-ref", 0, 0);
+  }
+  // 变化区域的ROI需要开启自适应量化
+  if (video_config_.enable_roi) {
+    av_opt_set_int(options, "aq-mode", 3, 0);
+  }
+}
+
+void VideoEncoder::SetFfv1Options() {
+  void* options = codec_context_->priv_data;
+
+  // 版本3才支持分片，每个分片独立编码，可以按分片多线程编解码
+  av_opt_set_int(options, "level", 3, 0);
+  codec_context_->slices = kLosslessSlices;
+  codec_context_->thread_type = FF_THREAD_SLICE;
+  // 快的preset使用Golomb-Rice编码，比区间编码快，文件稍大
+  const bool fast = PresetIndex(video_config_.preset) <= kLosslessFastPreset;
+  av_opt_set_int(options, "coder", fast ? 0 : 1, 0);
+  av_opt_set_int(options, "context", 0, 0);
+  // 关键帧重置上下文，非关键帧依赖前一帧的上下文，
+  // gop_size决定拖动时的定位粒度
+}
+
+void VideoEncoder::SetUtVideoOptions() {
+  // 每一帧都是关键帧。left预测最快，median压缩率更高
+  const bool fast = PresetIndex(video_config_.preset) <= kLosslessFastPreset;
+  av_opt_set(codec_context_->priv_data, "pred", fast ? "left" : "median", 0);
+  codec_context_->slices = kLosslessSlices;
+  codec_context_->thread_type = FF_THREAD_SLICE;
+}
+
+AVPixelFormat VideoEncoder::ChooseOutputPixelFormat() const {
+  if (!video_config_.lossless) {
+    return AV_PIX_FMT_YUV420P;
+  }
+
+  // 按顺序选择第一个编码器支持的格式
+  const AVPixelFormat candidates[] = {
+      input_pixel_format_,
+      input_pixel_format_ == AV_PIX_FMT_RGB32 ? AV_PIX_FMT_0RGB32
+                                              : AV_PIX_FMT_NONE,
+      AV_PIX_FMT_GBRP,
+      AV_PIX_FMT_YUV444P,
+  };
+  for (AVPixelFormat candidate : candidates) {
+    for (const AVPixelFormat* format = codec_->pix_fmts;
+         format && *format != AV_PIX_FMT_NONE; ++format) {
+      if (*format == candidate) {
+        return candidate;
+      }
+    }
+  }
+  return AV_PIX_FMT_NONE;
+}
+
 SwsContext* VideoEncoder::CreateSoftwareScaler(
     AVPixelFormat src_pixel_format, int src_width, int src_height,
     AVPixelFormat dst_pixel_format, int dst_width, int dst_height) {
@@ -218,3 +655,72 @@ SwsContext* VideoEncoder::CreateSoftwareScaler(
   }
   return software_scaler_context;
 }
+
+bool VideoEncoder::CreateBandScalers() {
+  DCHECK(band_contexts_.empty());
+
+  // 缩放时每一行输出与相邻的多行输入有关，只在大小不变时分条带转换。
+  // 条带边缘的色度只用到条带内的行，与整体转换相比只在边缘有细微差别
+  const int width = video_config_.width;
+  const int height = video_config_.height;
+  if (codec_context_->width != width || codec_context_->height != height) {
+    return true;
+  }
+  if (output_pixel_format_ == AV_PIX_FMT_YUV420P) {
+    band_chroma_shift_ = 1;
+  } else if (output_pixel_format_ == AV_PIX_FMT_GBRP ||
+             output_pixel_format_ == AV_PIX_FMT_YUV444P) {
+    band_chroma_shift_ = 0;
+  } else {
+    return true;
+  }
+
+  const int threads = base::ThreadPool::GetDefault()->num_threads();
+  const int band_count = std::min(threads, height / kMinBandRows);
+  if (band_count < 2) {
+    return true;
+  }
+
+  // YUV420P的色度行数减半，条带从偶数行开始
+  const int band_rows = (height / band_count) & ~1;
+  for (int i = 0; i < band_count; ++i) {
+    const int begin = i * band_rows;
+    const int end = i == band_count - 1 ? height : begin + band_rows;
+    SwsContext* context = CreateSoftwareScaler(
+        input_pixel_format_, width, end - begin, output_pixel_format_, width,
+        end - begin);
+    if (!context) {
+      return false;
+    }
+    band_contexts_.push_back(context);
+    band_rows_.push_back(begin);
+  }
+  band_rows_.push_back(height);
+  return true;
+}
+
+int VideoEncoder::ConvertBands(const uint8_t* data, int stride) {
+  DCHECK(!band_contexts_.empty());
+
+  std::atomic<int> result(0);
+  base::ThreadPool::GetDefault()->ParallelFor(
+      0, static_cast<int>(band_contexts_.size()), 1,
+      [this, data, stride, &result](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+          const int row = band_rows_[i];
+          const int rows = band_rows_[i + 1] - row;
+          const uint8_t* src[1] = {data + static_cast<size_t>(row) * stride};
+          const int src_stride[1] = {stride};
+          const int chroma_row = row >> band_chroma_shift_;
+          uint8_t* dst[3] = {
+              frame_->data[0] + row * frame_->linesize[0],
+              frame_->data[1] + chroma_row * frame_->linesize[1],
+              frame_->data[2] + chroma_row * frame_->linesize[2]};
+          if (sws_scale(band_contexts_[i], src, src_stride, 0, rows, dst,
+                        frame_->linesize) < 0) {
+            result = -1;
+          }
+        }
+      });
+  return result;
+}
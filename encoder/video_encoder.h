@@ -3,6 +3,8 @@
 #ifndef ENCODER_VIDEO_ENCODER_H_
 #define ENCODER_VIDEO_ENCODER_H_
 
+#include <vector>
+
 #include "encoder/av_config.h"
 #include "encoder/av_encoder.h"
 
@@ -14,6 +16,7 @@ class VideoEncoder : public AVEncoder {
   bool Initialize();
 
   // Override from AVEncoder
+  // video_stream为空时只打开编码器，不设置输出流的参数
   bool Open(AVStream* video_stream) override;
   int PushEncodeFrame(uint8_t* data,
                       int len,
@@ -26,11 +29,40 @@ class VideoEncoder : public AVEncoder {
 
   AVRational GetTimeBase() const;
 
+  // 编码过程中修改crf，从下一帧开始生效，只有libx264支持
+  bool SetCrf(int crf);
+  // 是否可以用SetCrf修改crf，在Initialize之后调用
+  bool CanSetCrf() const;
+
+  // 根据变化区域给frame设置ROI，变化区域降低量化参数，其余区域提高量化参数。
+  // src_width、src_height为输入画面的大小，dirty_rects为空时清除ROI
+  void SetRegionsOfInterest(AVFrame* frame,
+                            int src_width,
+                            int src_height,
+                            const std::vector<VideoRect>& dirty_rects);
+
  private:
+  // 各编码器的私有参数，在avcodec_open2之前调用
+  void SetX264Options();
+  void SetX265Options();
+  void SetSvtAv1Options();
+  void SetVp9Options();
+  void SetFfv1Options();
+  void SetUtVideoOptions();
+
+  // 有损编码使用YUV420P。无损编码优先使用与输入相同的RGB格式，
+  // 编码器不支持时依次使用平面RGB和YUV444P，都不支持时返回AV_PIX_FMT_NONE
+  AVPixelFormat ChooseOutputPixelFormat() const;
+
   SwsContext* CreateSoftwareScaler(
       AVPixelFormat src_pixel_format, int src_width, int src_height,
       AVPixelFormat dst_pixel_format, int dst_width, int dst_height);
 
+  // 不缩放时把画面按行分成几个条带，在线程池中并行转换颜色空间，
+  // 只支持YUV420P、GBRP和YUV444P
+  bool CreateBandScalers();
+  int ConvertBands(const uint8_t* data, int stride);
+
   bool initialized_;
 
   AVCodec* codec_;
@@ -39,6 +71,15 @@ class VideoEncoder : public AVEncoder {
 
   SwsContext* sws_context_;
 
+  // 每个条带的转换上下文和起始行，为空时整个画面一起转换
+  std::vector<SwsContext*> band_contexts_;
+  std::vector<int> band_rows_;
+  // 色度平面的行数相对于亮度的位移，YUV420P为1，GBRP和YUV444P为0
+  int band_chroma_shift_;
+
+  // 输出格式与输入的内存布局相同(如BGRA和BGR0)，不缩放时直接复制
+  bool copy_input_;
+
   AVDictionary* dict_;
 
   AVPixelFormat input_pixel_format_;
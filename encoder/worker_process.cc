@@ -0,0 +1,237 @@
+﻿#include "encoder/worker_process.h"
+
+#include <chrono>
+#include <thread>
+
+#include "base/check.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+
+#include "base/strings/utf_string_conversions.h"
+#else
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(OS_WIN)
+// 按CommandLineToArgvW的规则给参数加引号
+void AppendQuotedArgument(const std::wstring& arg, std::wstring* command_line) {
+  if (!arg.empty() && arg.find_first_of(L" \t\n\v\"") == std::wstring::npos) {
+    command_line->append(arg);
+    return;
+  }
+
+  command_line->push_back(L'"');
+  for (size_t i = 0;; ++i) {
+    size_t backslashes = 0;
+    while (i < arg.size() && arg[i] == L'\\') {
+      ++i;
+      ++backslashes;
+    }
+    if (i == arg.size()) {
+      // 结尾的反斜杠后面是引号，需要转义
+      command_line->append(backslashes * 2, L'\\');
+      break;
+    }
+    if (arg[i] == L'"') {
+      command_line->append(backslashes * 2 + 1, L'\\');
+    } else {
+      command_line->append(backslashes, L'\\');
+    }
+    command_line->push_back(arg[i]);
+  }
+  command_line->push_back(L'"');
+}
+#endif
+
+}  // namespace
+
+WorkerProcess::WorkerProcess()
+    :
+#if defined(OS_WIN)
+      process_(nullptr),
+#endif
+      pid_(0),
+      running_(false),
+      exit_code_(0) {
+}
+
+WorkerProcess::~WorkerProcess() {
+  if (running_) {
+    Terminate();
+  }
+}
+
+bool WorkerProcess::Start(const std::string& path,
+                          const std::vector<std::string>& args) {
+  DCHECK(!running_);
+
+#if defined(OS_WIN)
+  const std::wstring wide_path = base::UTF8ToWide(path);
+  std::wstring command_line;
+  AppendQuotedArgument(wide_path, &command_line);
+  for (const std::string& arg : args) {
+    command_line.push_back(L' ');
+    AppendQuotedArgument(base::UTF8ToWide(arg), &command_line);
+  }
+
+  STARTUPINFOW startup_info = {};
+  startup_info.cb = sizeof(startup_info);
+  PROCESS_INFORMATION process_info = {};
+  // CreateProcessW可能修改命令行，需要可写的缓冲区
+  if (!CreateProcessW(wide_path.c_str(), &command_line[0], NULL, NULL, FALSE,
+                      CREATE_NO_WINDOW, NULL, NULL, &startup_info,
+                      &process_info)) {
+    return false;
+  }
+  CloseHandle(process_info.hThread);
+  process_ = process_info.hProcess;
+  pid_ = process_info.dwProcessId;
+#else
+  std::vector<char*> argv;
+  argv.push_back(const_cast<char*>(path.c_str()));
+  for (const std::string& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    return false;
+  }
+  if (pid == 0) {
+    execv(path.c_str(), argv.data());
+    _exit(127);
+  }
+  pid_ = pid;
+#endif
+
+  running_ = true;
+  exit_code_ = 0;
+  return true;
+}
+
+bool WorkerProcess::IsRunning() {
+  if (!running_) {
+    return false;
+  }
+
+#if defined(OS_WIN)
+  if (WaitForSingleObject(static_cast<HANDLE>(process_), 0) == WAIT_OBJECT_0) {
+    DWORD exit_code = 0;
+    GetExitCodeProcess(static_cast<HANDLE>(process_), &exit_code);
+    Reap(static_cast<int>(exit_code));
+  }
+#else
+  int status = 0;
+  const pid_t ret = waitpid(static_cast<pid_t>(pid_), &status, WNOHANG);
+  if (ret == static_cast<pid_t>(pid_)) {
+    Reap(WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status));
+  } else if (ret < 0) {
+    Reap(-1);
+  }
+#endif
+
+  return running_;
+}
+
+bool WorkerProcess::Wait(int timeout_ms) {
+#if defined(OS_WIN)
+  if (running_) {
+    WaitForSingleObject(static_cast<HANDLE>(process_), timeout_ms);
+  }
+  return !IsRunning();
+#else
+  // waitpid不支持超时，轮询子进程的状态
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (IsRunning()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+#endif
+}
+
+void WorkerProcess::Terminate() {
+  if (!running_) {
+    return;
+  }
+
+#if defined(OS_WIN)
+  TerminateProcess(static_cast<HANDLE>(process_), 1);
+  WaitForSingleObject(static_cast<HANDLE>(process_), INFINITE);
+  DWORD exit_code = 0;
+  GetExitCodeProcess(static_cast<HANDLE>(process_), &exit_code);
+  Reap(static_cast<int>(exit_code));
+#else
+  kill(static_cast<pid_t>(pid_), SIGKILL);
+  int status = 0;
+  waitpid(static_cast<pid_t>(pid_), &status, 0);
+  Reap(WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status));
+#endif
+}
+
+// static
+int64_t WorkerProcess::CurrentProcessId() {
+#if defined(OS_WIN)
+  return static_cast<int64_t>(GetCurrentProcessId());
+#else
+  return static_cast<int64_t>(getpid());
+#endif
+}
+
+void WorkerProcess::Reap(int exit_code) {
+#if defined(OS_WIN)
+  CloseHandle(static_cast<HANDLE>(process_));
+  process_ = nullptr;
+#endif
+  running_ = false;
+  exit_code_ = exit_code;
+}
+
+ParentWatcher::ParentWatcher()
+    :
+#if defined(OS_WIN)
+      parent_(nullptr),
+#endif
+      parent_pid_(0) {
+}
+
+ParentWatcher::~ParentWatcher() {
+#if defined(OS_WIN)
+  if (parent_) {
+    CloseHandle(static_cast<HANDLE>(parent_));
+  }
+#endif
+}
+
+bool ParentWatcher::Watch(int64_t parent_pid) {
+  parent_pid_ = parent_pid;
+#if defined(OS_WIN)
+  parent_ = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(parent_pid));
+  return parent_ != nullptr;
+#else
+  return getppid() == static_cast<pid_t>(parent_pid);
+#endif
+}
+
+bool ParentWatcher::IsParentAlive() {
+  if (parent_pid_ == 0) {
+    return true;
+  }
+#if defined(OS_WIN)
+  return parent_ &&
+         WaitForSingleObject(static_cast<HANDLE>(parent_), 0) == WAIT_TIMEOUT;
+#else
+  // 父进程退出后子进程被其它进程收养
+  return getppid() == static_cast<pid_t>(parent_pid_);
+#endif
+}
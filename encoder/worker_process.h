@@ -0,0 +1,70 @@
+﻿// 启动和监视编码子进程
+
+#ifndef ENCODER_WORKER_PROCESS_H_
+#define ENCODER_WORKER_PROCESS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "build/build_config.h"
+
+class WorkerProcess {
+ public:
+  WorkerProcess();
+  // 子进程还在运行时强制结束
+  ~WorkerProcess();
+
+  // path: UTF-8编码的可执行文件路径
+  // args: 命令行参数，不包括程序名
+  bool Start(const std::string& path, const std::vector<std::string>& args);
+
+  // 非阻塞地检查子进程是否还在运行
+  bool IsRunning();
+  // 等待子进程退出，超时返回false
+  bool Wait(int timeout_ms);
+  void Terminate();
+
+  // 子进程退出后有效，被信号结束时为负的信号值
+  int exit_code() const { return exit_code_; }
+  int64_t pid() const { return pid_; }
+
+  static int64_t CurrentProcessId();
+
+ private:
+  // 子进程退出后回收资源
+  void Reap(int exit_code);
+
+#if defined(OS_WIN)
+  // HANDLE
+  void* process_;
+#endif
+  int64_t pid_;
+  bool running_;
+  int exit_code_;
+
+  WorkerProcess(const WorkerProcess&) = delete;
+  WorkerProcess& operator=(const WorkerProcess&) = delete;
+};  // class WorkerProcess
+
+// 子进程中用来检查父进程是否已经退出，父进程异常退出时子进程跟着退出
+class ParentWatcher {
+ public:
+  ParentWatcher();
+  ~ParentWatcher();
+
+  bool Watch(int64_t parent_pid);
+  bool IsParentAlive();
+
+ private:
+#if defined(OS_WIN)
+  void* parent_;
+#endif
+  int64_t parent_pid_;
+
+  ParentWatcher(const ParentWatcher&) = delete;
+  ParentWatcher& operator=(const ParentWatcher&) = delete;
+};  // class ParentWatcher
+
+#endif  // ENCODER_WORKER_PROCESS_H_
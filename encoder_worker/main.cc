@@ -0,0 +1,169 @@
+﻿// 编码进程
+//
+// 由录屏进程启动(encoder/remote_encoder.h)，从共享内存中读取画面和声音，
+// 编码后写入文件。参数见encoder/remote_encoder_arguments.h。
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/threading/thread_role.h"
+#include "build/build_config.h"
+#include "encoder/av_config.h"
+#include "encoder/av_muxer.h"
+#include "encoder/frame_ring.h"
+#include "encoder/remote_encoder.h"
+#include "encoder/remote_encoder_arguments.h"
+#include "logger/logger.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+
+#include <shellapi.h>
+
+#include "base/strings/utf_string_conversions.h"
+#endif
+
+namespace {
+
+const char kFilter[] = "EncoderWorker";
+
+// 编码进程的退出码，录屏进程据此判断是否需要重新启动
+const int kExitSuccess = 0;
+const int kExitInvalidArguments = 2;
+const int kExitOpenFailed = 3;
+const int kExitEncodeFailed = 4;
+
+// 取得UTF-8编码的命令行参数，不包括程序名
+std::vector<std::string> GetArguments(int argc, char** argv) {
+  std::vector<std::string> args;
+#if defined(OS_WIN)
+  int count = 0;
+  wchar_t** wide_argv = CommandLineToArgvW(GetCommandLineW(), &count);
+  if (wide_argv) {
+    for (int i = 1; i < count; ++i) {
+      args.push_back(base::WideToUTF8(wide_argv[i]));
+    }
+    LocalFree(wide_argv);
+  }
+#else
+  for (int i = 1; i < argc; ++i) {
+    args.push_back(argv[i]);
+  }
+#endif
+  return args;
+}
+
+// 把共享内存中的数据交给AVMuxer编码
+class MuxerDelegate : public RemoteEncoderWorker::Delegate {
+ public:
+  MuxerDelegate(AVMuxer* av_muxer, bool can_capture_voice, bool rebase)
+      : av_muxer_(av_muxer),
+        can_capture_voice_(can_capture_voice),
+        rebase_(rebase),
+        started_(false),
+        base_time_(0) {}
+  ~MuxerDelegate() override {}
+
+  bool OnVideoFrame(const FrameMeta& meta,
+                    const uint8_t* data,
+                    int len) override {
+    if (meta.stride <= 0 || meta.height <= 0 ||
+        len < meta.stride * meta.height) {
+      return false;
+    }
+
+    if (!started_) {
+      // 重新启动后的分段从第一帧开始计时
+      base_time_ = rebase_ ? meta.timestamp : 0;
+      started_ = true;
+    }
+
+    VideoFrameInfo frame_info;
+    frame_info.change_ratio = meta.change_ratio;
+    frame_info.discontinuity = (meta.flags & FrameMeta::kDiscontinuity) != 0;
+    for (int i = 0; i < meta.rect_count; ++i) {
+      const FrameRect& rect = meta.rects[i];
+      frame_info.dirty_rects.push_back(
+          {rect.left, rect.top, rect.right, rect.bottom});
+    }
+
+    // 编码器只读取画面，不会修改共享内存
+    return av_muxer_->EncodeVideoFrame(
+        const_cast<uint8_t*>(data), meta.width, meta.height, meta.stride,
+        meta.timestamp - base_time_, frame_info);
+  }
+
+  bool OnAudioFrame(const FrameMeta& meta,
+                    const uint8_t* data,
+                    int len) override {
+    // 声音从第一帧画面开始
+    if (!can_capture_voice_ || !started_ || meta.timestamp < base_time_ ||
+        len <= 0) {
+      return true;
+    }
+
+    av_muxer_->EncodeAudioFrame(
+        const_cast<uint8_t*>(data), len,
+        static_cast<int64_t>(meta.timestamp - base_time_),
+        (meta.flags & FrameMeta::kDiscontinuity) != 0);
+    return true;
+  }
+
+ private:
+  AVMuxer* av_muxer_;
+  bool can_capture_voice_;
+  bool rebase_;
+  bool started_;
+  uint64_t base_time_;
+
+  MuxerDelegate(const MuxerDelegate&) = delete;
+  MuxerDelegate& operator=(const MuxerDelegate&) = delete;
+};  // class MuxerDelegate
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  logger::LoggingSettings settings;
+  settings.logging_dest = logger::LOG_TO_ALL;
+  logger::InitLogging(settings);
+
+  RemoteEncoderArguments arguments;
+  if (!arguments.Parse(GetArguments(argc, argv))) {
+    LOG_ERROR(kFilter, "参数错误");
+    return kExitInvalidArguments;
+  }
+
+  // x264在编码线程中创建自己的线程，在Linux上会继承这里的设置
+  if (!base::SetCurrentThreadConfig(arguments.encode_role)) {
+    LOG_WARN(kFilter, "设置编码线程的优先级失败");
+  }
+
+  RemoteEncoderWorker worker(arguments);
+  if (!worker.Open()) {
+    LOG_ERROR(kFilter, "打开共享内存失败");
+    return kExitOpenFailed;
+  }
+
+  std::unique_ptr<AVMuxer> av_muxer = std::make_unique<AVMuxer>(
+      arguments.audio_config, arguments.video_config, arguments.output_path,
+      arguments.can_capture_voice);
+  // 编码进程可能崩溃，写入分段的文件保证已经写入的部分可以播放
+  av_muxer->set_fragmented(true);
+  if (!av_muxer->Initialize() || !av_muxer->Open()) {
+    LOG_ERROR(kFilter, "创建输出文件失败: %s", arguments.output_path.c_str());
+    return kExitOpenFailed;
+  }
+
+  LOG_INFO(kFilter, "开始编码，分段%d: %s", arguments.segment,
+           arguments.output_path.c_str());
+
+  MuxerDelegate delegate(av_muxer.get(), arguments.can_capture_voice,
+                         arguments.segment > 0);
+  const bool result = worker.Run(&delegate);
+  av_muxer.reset();
+
+  LOG_INFO(kFilter, "结束编码，画面%lld帧，声音%lld段", worker.video_frames(),
+           worker.audio_frames());
+  return result ? kExitSuccess : kExitEncodeFailed;
+}
@@ -1,13 +1,26 @@
 ﻿#include "logger/logger.h"
 
-#include <windows.h>
-
 #include <assert.h>
 #include <stdarg.h>
+#include <stdio.h>
 
 #include <string>
 
 #include "base/strings/stringprintf.h"
+#include "build/build_config.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <limits.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <codecvt>
+#include <locale>
+#endif
 
 namespace logger {
 
@@ -15,27 +28,94 @@ namespace {
 
 int g_logging_destination = LOG_DEFAULT;
 
+#if defined(OS_WIN)
+using FileHandle = HANDLE;
+const wchar_t kPathSeparator = L'\\';
+#else
+using FileHandle = FILE*;
+const wchar_t kPathSeparator = L'/';
+
+// 日志文件的路径按UTF-8编码传给系统
+std::wstring_convert<std::codecvt_utf8<wchar_t>>& PathConverter() {
+  static std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+  return converter;
+}
+#endif
+
 std::wstring* g_log_file_path = nullptr;
-HANDLE g_log_file_handle = NULL;
+FileHandle g_log_file_handle = nullptr;
+
+// 时间、进程ID:线程ID、级别、文件(行号)、过滤器和内容
+const char kLogFormat[] =
+    "[%04d-%02d-%02d %02d:%02d:%02d.%03d][%lu:%lu][%s][%s(%d)][%s] %s\n";
 
 void DeleteFilePath(const std::wstring& log_file) {
+#if defined(OS_WIN)
   DeleteFile(log_file.c_str());
+#else
+  unlink(PathConverter().to_bytes(log_file).c_str());
+#endif
 }
 
 std::wstring GetDefaultLogFile() {
+#if defined(OS_WIN)
   wchar_t module_name[MAX_PATH];
   GetModuleFileName(nullptr, module_name, MAX_PATH);
 
   std::wstring log_file = module_name;
-  size_t last_backslash = log_file.rfind('\\', log_file.size());
-  if (last_backslash != std::wstring::npos) {
-    log_file.erase(last_backslash + 1);
+#else
+  char module_name[PATH_MAX];
+  const ssize_t len =
+      readlink("/proc/self/exe", module_name, sizeof(module_name) - 1);
+  module_name[len > 0 ? len : 0] = 0;
+
+  std::wstring log_file = PathConverter().from_bytes(module_name);
+#endif
+  size_t last_separator = log_file.rfind(kPathSeparator, log_file.size());
+  if (last_separator != std::wstring::npos) {
+    log_file.erase(last_separator + 1);
   }
   log_file += L"debug.log";
 
   return log_file;
 }
 
+FileHandle OpenLogFile(const std::wstring& log_file) {
+#if defined(OS_WIN)
+  FileHandle handle = CreateFile(log_file.c_str(), FILE_APPEND_DATA,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                 OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  return handle == INVALID_HANDLE_VALUE ? nullptr : handle;
+#else
+  return fopen(PathConverter().to_bytes(log_file).c_str(), "a");
+#endif
+}
+
+// 当前目录下的debug.log
+bool GetCurrentDirectoryLogFile(std::wstring* log_file) {
+#if defined(OS_WIN)
+  wchar_t system_buffer[MAX_PATH];
+  system_buffer[0] = 0;
+  DWORD len = ::GetCurrentDirectory(sizeof(system_buffer), system_buffer);
+  if (len == 0 || len > sizeof(system_buffer)) {
+    return false;
+  }
+  *log_file = system_buffer;
+#else
+  char system_buffer[PATH_MAX];
+  if (!getcwd(system_buffer, sizeof(system_buffer))) {
+    return false;
+  }
+  *log_file = PathConverter().from_bytes(system_buffer);
+#endif
+
+  if (log_file->empty() || log_file->back() != kPathSeparator) {
+    *log_file += kPathSeparator;
+  }
+  *log_file += L"debug.log";
+  return true;
+}
+
 bool InitializeLogFileHandle() {
   if (g_log_file_handle) {
     return true;
@@ -49,30 +129,14 @@ bool InitializeLogFileHandle() {
     return true;
   }
 
-  g_log_file_handle = CreateFile(g_log_file_path->c_str(), FILE_APPEND_DATA,
-                                 FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
-                                 OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-  if (g_log_file_handle == INVALID_HANDLE_VALUE ||
-      g_log_file_handle == nullptr) {
-    wchar_t system_buffer[MAX_PATH];
-    system_buffer[0] = 0;
-    DWORD len = ::GetCurrentDirectory(sizeof(system_buffer), system_buffer);
-    if (len == 0 || len > sizeof(system_buffer)) {
+  g_log_file_handle = OpenLogFile(*g_log_file_path);
+  if (!g_log_file_handle) {
+    if (!GetCurrentDirectoryLogFile(g_log_file_path)) {
       return false;
     }
 
-    *g_log_file_path = system_buffer;
-    if (g_log_file_path->back() != L'\\') {
-      *g_log_file_path += L"\\";
-    }
-    *g_log_file_path += L"debug.log";
-
-    g_log_file_handle = CreateFile(g_log_file_path->c_str(), FILE_APPEND_DATA,
-                                   FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
-                                   OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (g_log_file_handle == INVALID_HANDLE_VALUE ||
-        g_log_file_handle == nullptr) {
-      g_log_file_handle = nullptr;
+    g_log_file_handle = OpenLogFile(*g_log_file_path);
+    if (!g_log_file_handle) {
       return false;
     }
   }
@@ -80,8 +144,12 @@ bool InitializeLogFileHandle() {
   return true;
 }
 
-void CloseFile(HANDLE handle) {
+void CloseFile(FileHandle handle) {
+#if defined(OS_WIN)
   CloseHandle(handle);
+#else
+  fclose(handle);
+#endif
 }
 
 void CloseLogFileUnlocked() {
@@ -90,7 +158,7 @@ void CloseLogFileUnlocked() {
   }
 
   CloseFile(g_log_file_handle);
-  g_log_file_handle = NULL;
+  g_log_file_handle = nullptr;
 
   if (!g_log_file_path) {
     g_logging_destination &= ~LOG_TO_FILE;
@@ -137,20 +205,35 @@ void Log(const char* filter,
   va_end(args);
 
   std::string file = filename;
-  size_t pos = file.rfind('\\', file.size());
+  size_t pos = file.find_last_of("\\/");
   if (pos != std::string::npos) {
     file = file.substr(pos + 1);
   }
 
+#if defined(OS_WIN)
   SYSTEMTIME local_time;
   GetLocalTime(&local_time);
-  fprintf(stderr, "[%04d-%02d-%02d %02d:%02d:%02d.%03d][%lu:%lu][%s][%s(%d)][%s] %s\n",
+  fprintf(stderr, kLogFormat,
           local_time.wYear, local_time.wMonth, local_time.wDay,
           local_time.wHour, local_time.wMinute, local_time.wSecond,
           local_time.wMilliseconds,
           GetCurrentProcessId(), GetCurrentThreadId(),
           level, file.c_str(), line_number, filter,
           str.c_str());
+#else
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  struct tm local_time;
+  localtime_r(&now.tv_sec, &local_time);
+  fprintf(stderr, kLogFormat,
+          local_time.tm_year + 1900, local_time.tm_mon + 1,
+          local_time.tm_mday, local_time.tm_hour, local_time.tm_min,
+          local_time.tm_sec, static_cast<int>(now.tv_usec / 1000),
+          static_cast<unsigned long>(getpid()),
+          static_cast<unsigned long>(syscall(SYS_gettid)),
+          level, file.c_str(), line_number, filter,
+          str.c_str());
+#endif
 }
 
 }  // namespace logger
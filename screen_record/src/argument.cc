@@ -2,5 +2,17 @@
 
 DEFINE_int32(fps, 25, "帧率");
 DEFINE_string(capturer, "gdi", "截屏方式");
+DEFINE_string(audio, "",
+              "录音的来源: WaveIn(录音设备)、Loopback(系统播放的声音)、"
+              "Synthetic(测试音)、Wav(循环回放--audio_file)，"
+              "多个来源用逗号分隔时混音，如WaveIn,Loopback:0.5，冒号后为增益。"
+              "为空时Windows上用录音设备，命令行程序在其他平台上不录音");
+DEFINE_string(audio_file, "",
+              "--audio=Wav时回放的文件，16位PCM、双声道、44100Hz");
+DEFINE_int32(audio_period_ms, 40, "每次送去编码的声音时长(毫秒)");
+DEFINE_int32(audio_buffers, 6, "同时交给录音设备的缓冲区个数");
+DEFINE_int32(audio_mix_latency_ms, 100, "多个录音来源混音增加的延迟(毫秒)");
+DEFINE_bool(audio_processing, false,
+            "录音经过高通滤波、噪声门、自动增益和限幅后再编码");
 
 SettingManager* g_setting_manager = nullptr;
@@ -2,10 +2,18 @@
 #define SCREEN_RECORD_SRC_ARGUMENT_H_
 
 #include "gflags/gflags.h"
-#include "screen_record/src/setting/setting_manager.h"
 
+// 命令行录屏程序(screen_record_cli)也使用这些参数，这里不引入Qt
 DECLARE_int32(fps);
 DECLARE_string(capturer);
+DECLARE_string(audio);
+DECLARE_string(audio_file);
+DECLARE_int32(audio_period_ms);
+DECLARE_int32(audio_buffers);
+DECLARE_int32(audio_mix_latency_ms);
+DECLARE_bool(audio_processing);
+
+class SettingManager;
 
 extern SettingManager* g_setting_manager;
 
@@ -13,7 +13,7 @@
 template<uint32_t MAX_SIZE>
 class DataQueue {
  public:
-  DataQueue() : total_size_(0){ }
+  DataQueue() : total_size_(0), video_count_(0) {}
 
   template<typename T>
   bool Push(AVData* data, T abort_func) {
@@ -31,6 +31,9 @@ class DataQueue {
 
       queue_.push(data);
       total_size_ += data->len;
+      if (data->type == AVData::VIDEO) {
+        ++video_count_;
+      }
     }
 
     if (was_empty) {
@@ -57,6 +60,9 @@ class DataQueue {
       *data = queue_.front();
       queue_.pop();
       total_size_ -= (*data)->len;
+      if ((*data)->type == AVData::VIDEO) {
+        --video_count_;
+      }
     }
 
     if (was_full) {
@@ -72,25 +78,46 @@ class DataQueue {
       AVData* data = queue_.front();
       if (data) {
         total_size_ -= data->len;
+        if (data->type == AVData::VIDEO) {
+          --video_count_;
+        }
         delete data;
       }
 
       queue_.pop();
     }
 
-    DCHECK(total_size_ == 0);
+    DCHECK(total_size_ == 0 && video_count_ == 0);
   }
 
+  // 唤醒所有等待的线程，让它们重新检查abort_func。
+  // 先获取锁，保证等待的线程在检查abort_func和开始等待之间不会错过通知
   void Notify() {
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+    }
     cond_.notify_all();
   }
 
+  // 队列中所有数据的大小
+  uint32_t TotalSize() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    return total_size_;
+  }
+
+  // 队列中画面的帧数，不包括声音和鼠标轨迹
+  uint32_t VideoCount() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    return video_count_;
+  }
+
  private:
   bool IsFull() const {
     return total_size_ >= MAX_SIZE;
   }
 
   uint32_t total_size_;
+  uint32_t video_count_;
   std::queue<AVData*> queue_;
 
   std::mutex mutex_;
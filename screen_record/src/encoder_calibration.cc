@@ -0,0 +1,131 @@
+﻿#include "screen_record/src/encoder_calibration.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "base/check.h"
+#include "capturer/picture_capturer_synthetic.h"
+#include "encoder/encoder_calibrator.h"
+#include "logger/logger.h"
+#include "screen_record/src/argument.h"
+#include "screen_record/src/setting/setting_manager.h"
+
+namespace {
+
+const char kFilter[] = "EncoderCalibration";
+
+// 比这更慢的preset不适合实时录屏，不参与校准
+const char kSlowestPreset[] = "slow";
+
+// 从滚动阶段开始编码，比静止和打字更接近最坏的情况
+class SyntheticFrameSource : public CalibrationFrameSource {
+ public:
+  SyntheticFrameSource(int width, int height)
+      : width_(width), height_(height) {}
+  ~SyntheticFrameSource() override {}
+
+  void Rewind() override {
+    frame_.reset();
+    capturer_ = std::make_unique<PictureCapturerSynthetic>(width_, height_);
+    capturer_->SkipTo(PictureCapturerSynthetic::Phase::SCROLLING);
+  }
+
+  const uint8_t* NextFrame(int* stride) override {
+    DCHECK(capturer_ && stride);
+
+    AVData* av_data = nullptr;
+    if (!capturer_->CaptureScreen(&av_data) || !av_data) {
+      return nullptr;
+    }
+    frame_.reset(av_data);
+
+    *stride = frame_->len / frame_->height;
+    return frame_->data;
+  }
+
+ private:
+  const int width_;
+  const int height_;
+
+  std::unique_ptr<PictureCapturerSynthetic> capturer_;
+  std::unique_ptr<AVData> frame_;
+
+  SyntheticFrameSource(const SyntheticFrameSource&) = delete;
+  SyntheticFrameSource& operator=(const SyntheticFrameSource&) = delete;
+};  // class SyntheticFrameSource
+
+}  // namespace
+
+bool CalibrateEncoder(int width,
+                      int height,
+                      int fps,
+                      const std::function<bool()>& should_cancel,
+                      const std::function<void(int, int)>& progress,
+                      EncoderCalibrationResult* result) {
+  DCHECK(result);
+  DCHECK(width > 0 && height > 0 && fps > 0);
+
+  SyntheticFrameSource frame_source(width, height);
+  EncoderCalibrator calibrator(
+      g_setting_manager->MakeVideoConfig(width, height, fps), &frame_source);
+
+  // 线程数：使用一半的核，给截屏和其他程序留出CPU；或者由编码器决定
+  std::vector<int> thread_counts;
+  const int cores = static_cast<int>(std::thread::hardware_concurrency());
+  if (cores > 2) {
+    thread_counts.push_back(cores / 2);
+  }
+  thread_counts.push_back(0);
+
+  for (int i = 0; SettingManager::kPresetList[i]; ++i) {
+    for (int threads : thread_counts) {
+      calibrator.AddCandidate(SettingManager::kPresetList[i], threads);
+    }
+    if (strcmp(SettingManager::kPresetList[i], kSlowestPreset) == 0) {
+      break;
+    }
+  }
+
+  if (!calibrator.Run(should_cancel, progress)) {
+    LOG_WARN(kFilter, "校准中止");
+    return false;
+  }
+
+  const auto& measurements = calibrator.measurements();
+  for (const auto& measurement : measurements) {
+    LOG_INFO(kFilter, "%dx%d@%d preset: %s, 线程: %d, 编码%d帧耗时%.3f秒, 余量: %.2f",
+             width, height, fps, measurement.candidate.preset.c_str(),
+             measurement.candidate.threads, measurement.frames,
+             measurement.encode_seconds, measurement.headroom);
+  }
+
+  const EncoderCalibrator::Measurement* best = calibrator.Best();
+  if (best) {
+    result->sustainable = true;
+  } else {
+    // 没有能实时编码的参数，选最快的
+    if (measurements.empty()) {
+      return false;
+    }
+    best = &*std::max_element(
+        measurements.begin(), measurements.end(),
+        [](const EncoderCalibrator::Measurement& a,
+           const EncoderCalibrator::Measurement& b) {
+          return a.headroom < b.headroom;
+        });
+    result->sustainable = false;
+  }
+
+  result->preset = best->candidate.preset;
+  result->threads = best->candidate.threads;
+  result->headroom = best->headroom;
+
+  LOG_INFO(kFilter, "校准结果 preset: %s, 线程: %d, 余量: %.2f, 能否实时编码: %d",
+           result->preset.c_str(), result->threads, result->headroom,
+           result->sustainable);
+  return true;
+}
@@ -0,0 +1,32 @@
+﻿// 用模拟的桌面画面校准编码参数
+
+#ifndef SCREEN_RECORD_SRC_ENCODER_CALIBRATION_H_
+#define SCREEN_RECORD_SRC_ENCODER_CALIBRATION_H_
+
+#include <functional>
+#include <string>
+
+struct EncoderCalibrationResult {
+  std::string preset;
+  int threads;
+  // 实时编码的余量
+  double headroom;
+  // 是否有能稳定实时编码的参数，没有时preset、threads为最快的参数
+  bool sustainable;
+
+  EncoderCalibrationResult()
+      : threads(0), headroom(0.0), sustainable(false) {}
+};  // struct EncoderCalibrationResult
+
+// 按当前的编码设置，在width x height、fps下测量各个preset和线程数，
+// 选出能稳定实时编码的画质最好的参数。耗时较长，不要在UI线程调用
+// should_cancel: 返回true时中止
+// progress: 每测量完一组参数调用一次
+bool CalibrateEncoder(int width,
+                      int height,
+                      int fps,
+                      const std::function<bool()>& should_cancel,
+                      const std::function<void(int, int)>& progress,
+                      EncoderCalibrationResult* result);
+
+#endif  // SCREEN_RECORD_SRC_ENCODER_CALIBRATION_H_
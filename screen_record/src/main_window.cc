@@ -13,6 +13,7 @@
 #include "screen_record/src/argument.h"
 #include "screen_record/src/screen_recorder.h"
 #include "screen_record/src/setting/setting_dialog.h"
+#include "screen_record/src/setting/setting_manager.h"
 
 const char kName[] = "ScreenRecord";
 
@@ -44,6 +45,7 @@ MainWindow::MainWindow(QWidget* parent)
 
   ui_.recordTimeLabel->hide();
   ui_.btnStop->setEnabled(false);
+  ui_.btnSaveReplay->hide();
 
   layout()->setSizeConstraint(QLayout::SetFixedSize);
   ui_.contentFrame->layout()->setSizeConstraint(QLayout::SetFixedSize);
@@ -53,8 +55,14 @@ MainWindow::MainWindow(QWidget* parent)
   screen_recorder_ = std::make_unique<ScreenRecorder>(
       [this]() { emit recordCompleted(); },
       [this]() { emit recordCanceled(); },
-      [this]() { emit recordFailed(); }
+      [this]() { emit recordFailed(); },
+      [this](const FinalizeProgress& progress) {
+        emit finalizeProgress(progress.Percent());
+      }
   );
+  // 提前打开编码器，点击开始后立即录屏
+  screen_recorder_->prewarm(local_path_.absolutePath(),
+                            g_setting_manager->fps());
 }
 
 MainWindow::~MainWindow() {
@@ -67,11 +75,10 @@ void MainWindow::onClose() {
     screen_recorder_->cancelRecord();
   }
 
-  // 先隐藏窗口，然后等待录屏结束
+  // 先隐藏窗口，然后等待截屏线程结束和所有录屏写完文件，
+  // 之后编码线程不会再调用回调函数
   hide();
-  while (screen_recorder_->status() != ScreenRecorder::Status::STOPPED) {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-  }
+  screen_recorder_->waitForFinalize();
 
   // 关闭
   close();
@@ -84,6 +91,10 @@ void MainWindow::onMinimize() {
 void MainWindow::onClickSettingButton() {
   SettingDialog setting_dialog(this);
   setting_dialog.exec();
+
+  // 设置可能修改了编码参数，参数不变时不会重新预热
+  screen_recorder_->prewarm(local_path_.absolutePath(),
+                            g_setting_manager->fps());
 }
 
 void MainWindow::onClickStartBtn() {
@@ -114,6 +125,12 @@ void MainWindow::onClickStopBtn() {
   stop();
 }
 
+void MainWindow::onClickSaveReplayBtn() {
+  if (!screen_recorder_->saveReplay()) {
+    LOG_WARN(kFilter, "没有可以保存的回放");
+  }
+}
+
 void MainWindow::onClickOpenBtn() {
   openLocalPath();
 }
@@ -129,7 +146,15 @@ void MainWindow::onUpdateTime() {
 }
 
 void MainWindow::onRecordCompleted() {
-  ui_.btnStart->setEnabled(true);
+  // 写完文件时可能已经开始了下一次录屏
+  if (screen_recorder_->status() != ScreenRecorder::Status::STOPPED) {
+    return;
+  }
+  ui_.recordTimeLabel->hide();
+
+  // 编码器在录屏结束时释放，为下一次录屏重新预热
+  screen_recorder_->prewarm(local_path_.absolutePath(),
+                            g_setting_manager->fps());
 }
 
 void MainWindow::onRecordFailed() {
@@ -140,6 +165,17 @@ void MainWindow::onRecordCanceled() {
   LOG_INFO(kFilter, "取消录屏");
 }
 
+void MainWindow::onFinalizeProgress(int percent) {
+  // 录屏时间标签在停止录屏后用来显示保存进度，开始下一次录屏后不再显示
+  if (timer_->isActive() ||
+      screen_recorder_->status() != ScreenRecorder::Status::STOPPED) {
+    return;
+  }
+  ui_.recordTimeLabel->setText(
+      QString(QStringLiteral("正在保存 %1%")).arg(percent));
+  ui_.recordTimeLabel->show();
+}
+
 void MainWindow::mousePressEvent(QMouseEvent* event) {
   if (ui_.titleFrame->rect().contains(event->pos())) {
     should_move_window_ = true;
@@ -172,6 +208,24 @@ void MainWindow::start() {
   LOG_INFO(kFilter, "截屏方式: %s", g_setting_manager->CaptureType().toStdString().c_str());
   LOG_INFO(kFilter, "文件格式: %s", g_setting_manager->FileFormat().toStdString().c_str());
   LOG_INFO(kFilter, "视频编码格式: %s", g_setting_manager->VideoEncoder().toStdString().c_str());
+  LOG_INFO(kFilter, "单独记录鼠标轨迹: %d", g_setting_manager->CursorTrack());
+  LOG_INFO(kFilter, "性能方案: %s, preset: %s, tune: %s, crf: %d, 码率: %dkbps, "
+           "B帧: %d, 线程: %d, 前瞻: %d, 关键帧间隔: %ds, 缩放: %d%%, 可变帧率: %d",
+           g_setting_manager->PerformanceProfileName().toStdString().c_str(),
+           g_setting_manager->Preset().toStdString().c_str(),
+           g_setting_manager->Tune().toStdString().c_str(),
+           g_setting_manager->Crf(), g_setting_manager->BitRate(),
+           g_setting_manager->MaxBFrames(), g_setting_manager->EncodeThreads(),
+           g_setting_manager->Lookahead(),
+           g_setting_manager->KeyFrameInterval(), g_setting_manager->Scale(),
+           g_setting_manager->VariableFrameRate());
+  LOG_INFO(kFilter, "自动调整画质: %d", g_setting_manager->AdaptiveQuality());
+  LOG_INFO(kFilter, "回放模式: %d, 保留%ds, 最多%dMB",
+           g_setting_manager->ReplayMode(), g_setting_manager->ReplaySeconds(),
+           g_setting_manager->ReplayMaxMegabytes());
+
+  // 回放模式下停止录屏不保存，需要时点击保存回放
+  ui_.btnSaveReplay->setVisible(g_setting_manager->ReplayMode());
 
   screen_recorder_->startRecord(
       local_path_.absolutePath(), g_setting_manager->fps());
@@ -211,9 +265,10 @@ void MainWindow::stop() {
   timer_->stop();
   ui_.recordTimeLabel->hide();
 
+  // 文件在后台写完，不用等待就可以开始下一次录屏
   ui_.btnStart->setText(QStringLiteral("开始"));
-  ui_.btnStart->setEnabled(false);
   ui_.btnStop->setEnabled(false);
+  ui_.btnSaveReplay->hide();
 
   ui_.settingButton->setEnabled(true);
 }
@@ -278,6 +333,8 @@ void MainWindow::connectSignals() {
           this, &MainWindow::onClickStartBtn);
   connect(ui_.btnStop, &QPushButton::clicked,
           this, &MainWindow::onClickStopBtn);
+  connect(ui_.btnSaveReplay, &QPushButton::clicked,
+          this, &MainWindow::onClickSaveReplayBtn);
   connect(ui_.btnOpen, &QPushButton::clicked,
           this, &MainWindow::onClickOpenBtn);
 
@@ -287,6 +344,8 @@ void MainWindow::connectSignals() {
   connect(this, &MainWindow::recordCanceled,
           this, &MainWindow::onRecordCanceled);
   connect(this, &MainWindow::recordFailed, this, &MainWindow::onRecordFailed);
+  connect(this, &MainWindow::finalizeProgress,
+          this, &MainWindow::onFinalizeProgress);
 
   // 定时器
   timer_.reset(new QTimer(this));
@@ -25,6 +25,8 @@ class MainWindow : public QMainWindow {
   void recordCompleted();
   void recordFailed();
   void recordCanceled();
+  // 停止录屏后在后台写文件的进度，0~100
+  void finalizeProgress(int percent);
 
  private slots:
   void onClose();
@@ -34,6 +36,7 @@ class MainWindow : public QMainWindow {
 
   void onClickStartBtn();
   void onClickStopBtn();
+  void onClickSaveReplayBtn();
   void onClickOpenBtn();
 
   void onUpdateTime();
@@ -41,6 +44,7 @@ class MainWindow : public QMainWindow {
   void onRecordCompleted();
   void onRecordFailed();
   void onRecordCanceled();
+  void onFinalizeProgress(int percent);
 
  private:
   void mousePressEvent(QMouseEvent* event) override;
@@ -0,0 +1,1243 @@
+﻿#include "screen_record/src/recorder.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "base/check.h"
+#include "base/threading/thread_role.h"
+#include "build/build_config.h"
+#include "capturer/audio_mixer.h"
+#include "capturer/audio_processor.h"
+#include "capturer/audio_source_synthetic.h"
+#include "capturer/audio_source_wav.h"
+#include "capturer/cursor_track.h"
+#include "capturer/frame_differ.h"
+#include "capturer/picture_capturer_synthetic.h"
+#include "encoder/audio_clock_sync.h"
+#include "encoder/av_muxer.h"
+#include "encoder/gop_controller.h"
+#include "encoder/live_sink.h"
+#include "encoder/muxer_sink.h"
+#include "encoder/quality_controller.h"
+#include "encoder/remote_encoder.h"
+#include "encoder/rendition_encoder.h"
+#include "encoder/replay_buffer.h"
+#include "logger/logger.h"
+#include "screen_record/src/data_queue.h"
+#include "screen_record/src/util/frame_pacer.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+
+#include "capturer/audio_source_loopback.h"
+#include "capturer/cursor_capturer.h"
+#include "capturer/picture_capturer_d3d9.h"
+#include "capturer/picture_capturer_dxgi.h"
+#include "capturer/picture_capturer_gdi.h"
+#include "capturer/voice_capturer.h"
+#elif defined(OS_LINUX)
+#include "capturer/picture_capturer_x11.h"
+#endif
+
+namespace {
+
+const char kFilter[] = "Recorder";
+
+// 等待编码的数据队列的上限(字节)
+const uint32_t kMaxSize = 1024 * 1024 * 1024;
+
+// 声道数
+const uint16_t kChannels = 2;
+// 采样率：每秒钟采集的样本的个数
+const uint32_t kSamplesPerSec = 44100;
+// 每个样本bit数
+const uint16_t kBitsPerSample = 16;
+
+// 可变帧率时，画面静止的情况下至少间隔这么久(微秒)编码一帧
+const uint64_t kMaxFrameIntervalUs = 1000000;
+
+// 每帧最多传给编码器的变化区域数，超过时合并为一个区域
+const int kMaxDirtyRects = 32;
+
+// 鼠标轨迹文件后缀
+const char kCursorTrackSuffix[] = ".cursor";
+
+// 停止录屏时等待编码进程写完文件的时间(毫秒)
+const int kEncoderWorkerStopTimeoutMs = 30000;
+// 截屏画面每行的字节数可能有对齐，共享内存的槽位按这个对齐计算
+const int kStrideAlignment = 256;
+
+// 直播时估计的音频码率和封装开销(bps)，用于平滑发送
+const int64_t kStreamAudioBitRate = 256000;
+// 直播发送队列的时长上限，网络跟不上时丢帧而不是增加延迟
+const int64_t kStreamMaxQueueUs = 500000;
+
+// 停止录屏后报告写文件进度的间隔
+const std::chrono::milliseconds kFinalizeProgressInterval(200);
+
+bool IsCaptureType(const std::string& capture_type, const char* name) {
+  if (capture_type.size() != strlen(name)) {
+    return false;
+  }
+  for (size_t i = 0; i < capture_type.size(); ++i) {
+    if (tolower(static_cast<unsigned char>(capture_type[i])) !=
+        tolower(static_cast<unsigned char>(name[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// audio_source中的一个录音来源
+struct AudioSourceSpec {
+  std::string name;
+  float gain;
+};
+
+// 按逗号拆分audio_source，每一项为"名称"或者"名称:增益"，为空时从录音设备录音
+std::vector<AudioSourceSpec> ParseAudioSources(
+    const std::string& audio_source) {
+  std::vector<AudioSourceSpec> specs;
+  size_t begin = 0;
+  while (begin < audio_source.size()) {
+    size_t end = audio_source.find(',', begin);
+    if (end == std::string::npos) {
+      end = audio_source.size();
+    }
+    const std::string item = audio_source.substr(begin, end - begin);
+    begin = end + 1;
+    if (item.empty()) {
+      continue;
+    }
+
+    AudioSourceSpec spec;
+    const size_t colon = item.find(':');
+    spec.name = item.substr(0, colon);
+    spec.gain = colon == std::string::npos
+                    ? 1.0f
+                    : static_cast<float>(atof(item.c_str() + colon + 1));
+    specs.push_back(spec);
+  }
+  if (specs.empty()) {
+    specs.push_back({"WaveIn", 1.0f});
+  }
+  return specs;
+}
+
+// 录音设备和环回录音只在Windows上可用
+bool IsWindowsAudioSource(const std::string& name) {
+  return IsCaptureType(name, "WaveIn") || IsCaptureType(name, "Loopback");
+}
+
+// 其他平台上至少有一个来源可用时才录音
+bool CanCaptureVoice(const RecorderConfig& config) {
+#if defined(OS_WIN)
+  return config.capture_voice;
+#else
+  if (!config.capture_voice) {
+    return false;
+  }
+  for (const AudioSourceSpec& spec : ParseAudioSources(config.audio_source)) {
+    if (!IsWindowsAudioSource(spec.name)) {
+      return true;
+    }
+  }
+  return false;
+#endif
+}
+
+// 按名称创建一个录音来源，不支持时返回nullptr
+std::unique_ptr<AudioSource> CreateAudioSourceByName(
+    const std::string& name,
+    const AudioSourceConfig& audio_config,
+    const std::string& audio_file,
+    const AudioSource::DataCallback& callback) {
+#if defined(OS_WIN)
+  if (IsCaptureType(name, "WaveIn")) {
+    return std::make_unique<VoiceCapturer>(audio_config, callback);
+  }
+  if (IsCaptureType(name, "Loopback")) {
+    return std::make_unique<AudioSourceLoopback>(audio_config, callback);
+  }
+#endif
+  if (IsCaptureType(name, "Synthetic")) {
+    return std::make_unique<AudioSourceSynthetic>(
+        audio_config, AudioSourceSynthetic::Waveform::TONE, callback);
+  }
+  if (IsCaptureType(name, "Wav")) {
+    // 文件结束后从头回放，录屏时长不受文件长度限制
+    return std::make_unique<AudioSourceWav>(audio_config, audio_file, true,
+                                            callback);
+  }
+  return nullptr;
+}
+
+// 多码率输出与录屏文件同名，加上画面高度，如"xxx_720p.mp4"
+std::string GenerateRenditionPath(const std::string& output_path, int height) {
+  const size_t dot = output_path.rfind('.');
+  const std::string suffix = "_" + std::to_string(height) + "p";
+  if (dot == std::string::npos) {
+    return output_path + suffix;
+  }
+  return output_path.substr(0, dot) + suffix + output_path.substr(dot);
+}
+
+AudioConfig MakeAudioConfig() {
+  AudioConfig audio_config;
+  audio_config.channels = kChannels;
+  audio_config.sample_rate = kSamplesPerSec;
+  audio_config.sample_fmt = AV_SAMPLE_FMT_S16;
+  audio_config.channel_layout = AV_CH_LAYOUT_STEREO;
+  return audio_config;
+}
+
+// 独立进程编码时由编码进程写入视频文件，编码进程崩溃不影响录屏。
+// 回放缓冲区、额外的输出、直播和多码率输出在录屏进程中，
+// 这时总是在录屏进程中编码
+bool UsesEncoderWorker(const RecorderConfig& config) {
+  return !config.encoder_worker_path.empty() && !config.replay_mode &&
+         config.extra_outputs.empty() && config.stream_url.empty() &&
+         config.rendition_heights.empty();
+}
+
+// 获取主显示器的尺寸
+bool GetPrimaryScreenSize(int* width, int* height) {
+  DCHECK(width && height);
+
+#if defined(OS_WIN)
+  HMONITOR monitor =
+      MonitorFromWindow(GetDesktopWindow(), MONITOR_DEFAULTTOPRIMARY);
+  DCHECK(monitor);
+
+  MONITORINFO mi;
+  ZeroMemory(&mi, sizeof(mi));
+  mi.cbSize = sizeof(mi);
+
+  BOOL res = GetMonitorInfo(monitor, &mi);
+  DCHECK(res);
+
+  *width = mi.rcMonitor.right - mi.rcMonitor.left;
+  *height = mi.rcMonitor.bottom - mi.rcMonitor.top;
+  return true;
+#elif defined(OS_LINUX)
+  return PictureCapturerX11::GetScreenSize(std::string(), width, height);
+#else
+  return false;
+#endif
+}
+
+// 截屏画面的尺寸，Synthetic可以指定尺寸，其它截屏方式与屏幕相同
+bool GetCaptureSize(const RecorderConfig& config, int* width, int* height) {
+  if (IsCaptureType(config.capture_type, "Synthetic") &&
+      !config.capture_source.empty()) {
+    // 宽高需要是偶数，YUV420P的色度平面宽高减半
+    return sscanf(config.capture_source.c_str(), "%dx%d", width, height) ==
+               2 &&
+           *width > 0 && *height > 0 && *width % 2 == 0 && *height % 2 == 0;
+  }
+#if defined(OS_LINUX)
+  if (IsCaptureType(config.capture_type, "X11")) {
+    return PictureCapturerX11::GetScreenSize(config.capture_source, width,
+                                             height);
+  }
+#endif
+  return GetPrimaryScreenSize(width, height);
+}
+
+// 启动编码进程，失败时返回nullptr
+std::unique_ptr<RemoteEncoder> StartRemoteEncoder(
+    const std::string& worker_path,
+    bool can_capture_voice,
+    const AudioConfig& audio_config,
+    const VideoConfig& video_config,
+    const std::string& output_path) {
+  RemoteEncoderConfig config;
+  config.worker_path = worker_path;
+  config.output_path = output_path;
+  config.can_capture_voice = can_capture_voice;
+  config.audio_config = audio_config;
+  config.video_config = video_config;
+  const int stride = (video_config.width * 4 + kStrideAlignment - 1) /
+                     kStrideAlignment * kStrideAlignment;
+  config.video_slot_size = stride * video_config.height;
+
+  std::unique_ptr<RemoteEncoder> remote_encoder =
+      std::make_unique<RemoteEncoder>(config);
+  if (!remote_encoder->Start()) {
+    return nullptr;
+  }
+  return remote_encoder;
+}
+
+}  // namespace
+
+struct Recorder::Session {
+  RecorderConfig config;
+  // 截屏画面的大小
+  int width;
+  int height;
+  // 调用Start的时间
+  std::chrono::steady_clock::time_point start_time;
+
+  DataQueue<kMaxSize> data_queue;
+  std::thread thread;
+
+  // 截屏和录音已经结束，队列中不会再有新的数据
+  std::atomic<bool> capture_ended;
+  // 取消录屏，编码线程丢弃队列中的数据，不写完文件
+  std::atomic<bool> canceled;
+  // 编码器初始化失败，截屏线程不再截屏
+  std::atomic<bool> encode_failed;
+  // 截屏失败，编码完队列中已有的数据后报告录屏失败，在capture_ended之前设置
+  std::atomic<bool> capture_failed;
+  // 编码线程已经结束，可以回收
+  std::atomic<bool> finished;
+  // 截屏结束的时间，在capture_ended之前设置
+  std::chrono::steady_clock::time_point capture_end_time;
+
+  // 截屏结束时队列中的数据量，还没有报告过进度时为-1
+  int64_t backlog_bytes;
+  std::chrono::steady_clock::time_point last_progress_time;
+
+  // 回放模式下录屏时不为空，SaveReplay在其它线程中访问
+  std::mutex replay_mutex;
+  std::unique_ptr<ReplayBuffer> replay_buffer;
+
+  Session()
+      : width(0),
+        height(0),
+        capture_ended(false),
+        canceled(false),
+        encode_failed(false),
+        capture_failed(false),
+        finished(false),
+        backlog_bytes(-1) {}
+  // 编码失败时队列中可能还有数据
+  ~Session() { data_queue.Clear(); }
+};  // struct Recorder::Session
+
+Recorder::Recorder(
+    const std::function<void()>& on_recording_completed,
+    const std::function<void()>& on_recording_canceled,
+    const std::function<void()>& on_recording_failed,
+    const std::function<void(const FinalizeProgress&)>& on_finalize_progress)
+    : width_(0),
+      height_(0),
+      status_(Status::STOPPED),
+      audio_discontinuity_(false),
+      session_(nullptr),
+      on_recording_completed_(on_recording_completed),
+      on_recording_canceled_(on_recording_canceled),
+      on_recording_failed_(on_recording_failed),
+      on_finalize_progress_(on_finalize_progress) {
+  abort_func_ = [this]() {
+    return status_ == Status::CANCELING ||
+           status_ == Status::STOPPING ||
+           status_ == Status::STOPPED;
+  };
+}
+
+Recorder::~Recorder() {
+  WaitForFinalize();
+}
+
+// static
+std::string Recorder::GenerateOutputPath(const std::string& output_dir,
+                                         const std::string& file_format) {
+  const auto now = std::chrono::system_clock::now();
+  const time_t seconds = std::chrono::system_clock::to_time_t(now);
+  const int milliseconds = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          now.time_since_epoch())
+          .count() %
+      1000);
+
+  struct tm local_time;
+#if defined(OS_WIN)
+  localtime_s(&local_time, &seconds);
+#else
+  localtime_r(&seconds, &local_time);
+#endif
+
+  char filename[64];
+  snprintf(filename, sizeof(filename), "%04d-%02d-%02d-%02d-%02d-%02d-%03d.%s",
+           local_time.tm_year + 1900, local_time.tm_mon + 1,
+           local_time.tm_mday, local_time.tm_hour, local_time.tm_min,
+           local_time.tm_sec, milliseconds, file_format.c_str());
+
+  std::string output_path;
+  output_path.append(output_dir).append("/").append(filename);
+  return output_path;
+}
+
+void Recorder::Prewarm(const RecorderConfig& config) {
+  DCHECK(config.fps > 0 && config.make_video_config);
+  DCHECK(!config.output_path.empty());
+
+  int width = 0;
+  int height = 0;
+  if (UsesEncoderWorker(config) || !GetCaptureSize(config, &width, &height)) {
+    muxer_prewarmer_.Clear();
+    return;
+  }
+
+  const bool capture_voice = CanCaptureVoice(config);
+  const VideoConfig video_config =
+      config.make_video_config(width, height, config.fps);
+  LOG_INFO(kFilter, "预热编码器: %s %dx%d, %s",
+           video_config.encoder_name.c_str(), video_config.width,
+           video_config.height, config.output_path.c_str());
+  muxer_prewarmer_.Prewarm(MakeAudioConfig(), video_config,
+                           config.output_path, capture_voice);
+}
+
+bool Recorder::Start(const RecorderConfig& config) {
+  DCHECK(status_ == Status::STOPPED);
+  DCHECK(config.fps > 0 && config.make_video_config);
+
+  start_time_ = std::chrono::steady_clock::now();
+  config_ = config;
+  if (!CanCaptureVoice(config_)) {
+    if (config_.capture_voice) {
+      LOG_WARN(kFilter, "这个平台不支持从录音设备录音，忽略");
+    }
+    config_.capture_voice = false;
+  }
+#if !defined(OS_WIN)
+  if (config_.cursor_track) {
+    LOG_WARN(kFilter, "这个平台不支持记录鼠标轨迹，忽略");
+    config_.cursor_track = false;
+  }
+#endif
+  // 回放模式下保存的是一段画面，没有对应的鼠标轨迹，鼠标绘制到画面中
+  if (config_.replay_mode) {
+    config_.cursor_track = false;
+  }
+
+  if (!GetCaptureSize(config_, &width_, &height_)) {
+    LOG_ERROR(kFilter, "无法取得%s截屏的画面尺寸: %s",
+              config_.capture_type.c_str(), config_.capture_source.c_str());
+    return false;
+  }
+
+  // 上一次录屏的截屏线程已经结束，这里只是回收。
+  // 编码线程可能还在写文件，不等待
+  if (capture_picture_thread_.joinable()) {
+    capture_picture_thread_.join();
+  }
+  ReapSessions();
+
+  audio_source_.reset(config_.capture_voice ? CreateAudioSource() : nullptr);
+  if (config_.capture_voice && !audio_source_) {
+    LOG_ERROR(kFilter, "不支持的录音来源: %s", config_.audio_source.c_str());
+    return false;
+  }
+  audio_processor_.reset(
+      audio_source_ && config_.audio_processing
+          ? new AudioProcessor(AudioProcessorConfig(), kChannels,
+                               kSamplesPerSec)
+          : nullptr);
+
+  std::unique_ptr<Session> session = std::make_unique<Session>();
+  session->config = config_;
+  session->width = width_;
+  session->height = height_;
+  session->start_time = start_time_;
+  Session* current = session.get();
+  {
+    std::lock_guard<std::mutex> locker(sessions_mutex_);
+    DCHECK(!session_);
+    sessions_.push_back(std::move(session));
+    session_ = current;
+  }
+
+  // 截屏和录音线程开始之前开始计时
+  media_clock_.Start();
+  audio_discontinuity_ = false;
+
+  // 将状态设置为正在录屏
+  SetStatus(Status::RECORDING);
+
+  // 先开始截屏，编码器初始化期间的画面在队列中等待
+  capture_picture_thread_ =
+      std::thread(&Recorder::CapturePicture, this, current);
+  current->thread = std::thread(&Recorder::Run, this, current);
+  return true;
+}
+
+void Recorder::Stop() {
+  SetStatus(Status::STOPPING);
+}
+
+void Recorder::Cancel() {
+  {
+    // 编码线程不必等截屏线程结束，立即停止编码
+    std::lock_guard<std::mutex> locker(sessions_mutex_);
+    if (session_) {
+      session_->canceled = true;
+    }
+  }
+  SetStatus(Status::CANCELING);
+}
+
+void Recorder::Pause() {
+  DCHECK(status_ == Status::RECORDING);
+  media_clock_.Pause();
+  SetStatus(Status::PAUSE);
+
+  if (audio_source_) {
+    audio_source_->Pause();
+  }
+}
+
+void Recorder::Resume() {
+  DCHECK(status_ == Status::PAUSE);
+  media_clock_.Resume();
+  audio_discontinuity_ = true;
+  SetStatus(Status::RECORDING);
+
+  if (audio_source_) {
+    audio_source_->Resume();
+  }
+}
+
+bool Recorder::SaveReplay() {
+  std::lock_guard<std::mutex> sessions_locker(sessions_mutex_);
+  if (!session_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> locker(session_->replay_mutex);
+  const std::unique_ptr<ReplayBuffer>& replay_buffer = session_->replay_buffer;
+  if (!replay_buffer) {
+    return false;
+  }
+
+  const std::string path =
+      GenerateOutputPath(config_.output_dir, config_.file_format);
+  LOG_INFO(kFilter, "保存回放: %s, 时长%.1fs, 缓冲%lldKB", path.c_str(),
+           replay_buffer->buffered_duration_us() / 1000000.0,
+           replay_buffer->buffered_bytes() / 1024);
+
+  const auto save_start = std::chrono::steady_clock::now();
+  replay_buffer->SaveAsync(path, [path, save_start](bool result) {
+    const double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                  std::chrono::steady_clock::now() -
+                                  save_start)
+                                  .count();
+    if (result) {
+      LOG_INFO(kFilter, "回放保存完成, 耗时%.0fms: %s", elapsed_ms,
+               path.c_str());
+    } else {
+      LOG_ERROR(kFilter, "回放保存失败: %s", path.c_str());
+    }
+  });
+  return true;
+}
+
+void Recorder::WaitForFinalize() {
+  DCHECK(status_ != Status::RECORDING && status_ != Status::PAUSE);
+
+  if (capture_picture_thread_.joinable()) {
+    capture_picture_thread_.join();
+  }
+
+  std::vector<std::unique_ptr<Session>> sessions;
+  {
+    std::lock_guard<std::mutex> locker(sessions_mutex_);
+    DCHECK(!session_);
+    sessions.swap(sessions_);
+  }
+  for (std::unique_ptr<Session>& session : sessions) {
+    session->thread.join();
+  }
+}
+
+void Recorder::ReapSessions() {
+  std::vector<std::unique_ptr<Session>> finished_sessions;
+  {
+    std::lock_guard<std::mutex> locker(sessions_mutex_);
+    for (auto it = sessions_.begin(); it != sessions_.end();) {
+      if ((*it)->finished) {
+        finished_sessions.push_back(std::move(*it));
+        it = sessions_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  // 编码线程设置finished之后就结束了，不会阻塞
+  for (std::unique_ptr<Session>& session : finished_sessions) {
+    session->thread.join();
+  }
+}
+
+void Recorder::SetStatus(Status status) {
+  {
+    std::lock_guard<std::mutex> locker(status_mutex_);
+    status_ = status;
+  }
+  status_cond_.notify_all();
+
+  // 停止或取消时唤醒阻塞在队列上的截屏线程和录音线程
+  std::lock_guard<std::mutex> locker(sessions_mutex_);
+  if (session_) {
+    session_->data_queue.Notify();
+  }
+}
+
+std::chrono::steady_clock::duration Recorder::WaitWhilePaused() {
+  const auto pause_start = std::chrono::steady_clock::now();
+  {
+    std::unique_lock<std::mutex> locker(status_mutex_);
+    if (status_ != Status::PAUSE) {
+      return std::chrono::steady_clock::duration::zero();
+    }
+    status_cond_.wait(locker, [this]() { return status_ != Status::PAUSE; });
+  }
+  return std::chrono::steady_clock::now() - pause_start;
+}
+
+void Recorder::Run(Session* session) {
+  LOG_INFO(kFilter, "开始录屏: %s", session->config.output_path.c_str());
+
+  // x264在这个线程中创建自己的线程，在Linux上会继承这里的设置
+  if (!base::SetCurrentThreadRole(base::ThreadRole::ENCODE)) {
+    LOG_WARN(kFilter, "设置编码线程的优先级失败");
+  }
+
+  if (!Encode(session)) {
+    // 截屏线程看到后结束录屏
+    session->encode_failed = true;
+    session->data_queue.Notify();
+    on_recording_failed_();
+  } else if (session->capture_failed) {
+    on_recording_failed_();
+  } else if (session->canceled) {
+    on_recording_canceled_();
+  } else {
+    on_recording_completed_();
+  }
+
+  LOG_INFO(kFilter, "结束录屏: %s", session->config.output_path.c_str());
+  session->finished = true;
+}
+
+bool Recorder::Encode(Session* session) {
+  const RecorderConfig& config = session->config;
+  DataQueue<kMaxSize>& data_queue = session->data_queue;
+  // 截屏结束后编码完队列中剩余的数据，取消时立即结束
+  auto capture_ended = [session]() {
+    return session->capture_ended || session->canceled;
+  };
+
+  const AudioConfig audio_config = MakeAudioConfig();
+  const VideoConfig video_config =
+      config.make_video_config(session->width, session->height, config.fps);
+
+  const std::string& filepath = config.output_path;
+  if (!MuxerSink::SupportsCodec(filepath, std::string(),
+                                video_config.codec_id)) {
+    LOG_ERROR(kFilter, "%s不支持%s编码", filepath.c_str(),
+              video_config.encoder_name.c_str());
+    return false;
+  }
+
+  const bool streaming = !config.stream_url.empty();
+  std::unique_ptr<RemoteEncoder> remote_encoder;
+  std::unique_ptr<AVMuxer> av_muxer;
+  if (UsesEncoderWorker(config)) {
+    remote_encoder = StartRemoteEncoder(config.encoder_worker_path,
+                                        config.capture_voice, audio_config,
+                                        video_config, filepath);
+    if (!remote_encoder) {
+      LOG_ERROR(kFilter, "启动编码进程失败");
+      return false;
+    }
+  } else {
+    // 预热的编码器已经打开，只需要绑定输出文件
+    av_muxer = muxer_prewarmer_.Take(audio_config, video_config, filepath,
+                                     config.capture_voice);
+    if (av_muxer) {
+      LOG_INFO(kFilter, "使用预热的编码器");
+    } else {
+      av_muxer = std::make_unique<AVMuxer>(audio_config, video_config,
+                                           filepath, config.capture_voice);
+      if (!av_muxer->Initialize()) {
+        return false;
+      }
+    }
+    if (config.replay_mode) {
+      ReplayBufferConfig replay_config;
+      replay_config.max_duration_us = config.replay_seconds * 1000000LL;
+      replay_config.max_bytes = config.replay_max_megabytes * 1024LL * 1024;
+
+      std::lock_guard<std::mutex> locker(session->replay_mutex);
+      session->replay_buffer = std::make_unique<ReplayBuffer>(replay_config);
+      av_muxer->set_replay_buffer(session->replay_buffer.get());
+    }
+    // 额外的输出在后台打开，失败时不影响录屏文件
+    for (const RecorderOutput& output : config.extra_outputs) {
+      if (!MuxerSink::SupportsCodec(output.url, output.format,
+                                    video_config.codec_id)) {
+        LOG_WARN(kFilter, "额外输出%s不支持%s编码，忽略", output.url.c_str(),
+                 video_config.encoder_name.c_str());
+        continue;
+      }
+      LOG_INFO(kFilter, "额外输出: %s %s", output.format.c_str(),
+               output.url.c_str());
+      av_muxer->AddSink(std::make_unique<MuxerSink>(output.url, output.format),
+                        PacketSinkOptions());
+    }
+    if (streaming) {
+      LiveSinkConfig live_config;
+      live_config.url = config.stream_url;
+      live_config.bit_rate = video_config.bit_rate + kStreamAudioBitRate;
+      std::unique_ptr<LiveSink> live_sink =
+          std::make_unique<LiveSink>(live_config);
+      LOG_INFO(kFilter, "直播: %s, 码率%lldkbps", live_sink->name().c_str(),
+               video_config.bit_rate / 1000);
+      PacketSinkOptions live_options;
+      live_options.max_queued_us = kStreamMaxQueueUs;
+      av_muxer->AddSink(std::move(live_sink), live_options);
+    }
+    // 高度不小于录屏画面的多码率输出被忽略
+    for (int rendition_height : config.rendition_heights) {
+      const std::string path =
+          GenerateRenditionPath(filepath, rendition_height);
+      if (av_muxer->AddRendition(rendition_height, path)) {
+        LOG_INFO(kFilter, "多码率输出: %s", path.c_str());
+      } else {
+        LOG_WARN(kFilter, "忽略多码率输出: %dp", rendition_height);
+      }
+    }
+    if (!av_muxer->Open()) {
+      return false;
+    }
+  }
+  LOG_INFO(kFilter, "编码器初始化完成，距离开始录屏%.1fms",
+           std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - session->start_time)
+               .count());
+  // 编码进程无法重新启动后不再发送数据
+  bool remote_encoder_failed = false;
+
+  // 鼠标轨迹与视频文件同名
+  std::unique_ptr<CursorTrackWriter> cursor_writer;
+  if (config.cursor_track) {
+    cursor_writer = std::make_unique<CursorTrackWriter>();
+    if (!cursor_writer->Open(filepath + kCursorTrackSuffix)) {
+      LOG_ERROR(kFilter, "创建鼠标轨迹文件失败");
+      cursor_writer.reset();
+    }
+  }
+
+  // 编码跟不上时自动调整画质，需要统计编码耗时，只在录屏进程中编码时有效
+  std::unique_ptr<QualityController> quality_controller;
+  if (video_config.adaptive_quality && av_muxer) {
+    // 只有部分编码器能在录制过程中调整crf，不能调整时直接丢帧
+    quality_controller = std::make_unique<QualityController>(
+        video_config, av_muxer->CanSetVideoCrf());
+  }
+  // 被丢弃的帧的信息合并到下一个编码的帧中
+  bool frame_dropped = false;
+  bool pending_discontinuity = false;
+  float pending_change_ratio = 0.0f;
+  // 用于统计第一帧送入编码器的耗时
+  bool has_video = false;
+
+  while (!session->canceled) {
+    if (session->capture_ended) {
+      ReportFinalizeProgress(session, false);
+    }
+
+    AVData* av_data = nullptr;
+    if (!data_queue.Pop(&av_data, capture_ended)) {
+      break;
+    }
+
+    if (av_data->type == AVData::AUDIO) {
+      if (remote_encoder) {
+        if (!remote_encoder_failed &&
+            !remote_encoder->PushAudioFrame(av_data->data, av_data->len,
+                                            av_data->timestamp,
+                                            av_data->discontinuity)) {
+          LOG_ERROR(kFilter, "编码进程多次异常退出，停止编码");
+          remote_encoder_failed = true;
+        }
+      } else {
+        av_muxer->EncodeAudioFrame(av_data->data, av_data->len,
+                                   av_data->timestamp, av_data->discontinuity);
+      }
+    } else if (av_data->type == AVData::VIDEO) {
+      if (quality_controller && quality_controller->ShouldDropFrame()) {
+        frame_dropped = true;
+        pending_discontinuity |= av_data->discontinuity;
+        pending_change_ratio =
+            std::max(pending_change_ratio, av_data->change_ratio);
+        delete av_data;
+        continue;
+      }
+
+      int stride = av_data->len / av_data->height;
+      const int64_t pts = static_cast<int64_t>(av_data->timestamp);
+      if (!has_video) {
+        has_video = true;
+        LOG_INFO(kFilter,
+                 "第一帧送入编码器，距离开始录屏%.1fms，在队列中等待%.1fms",
+                 std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - session->start_time)
+                     .count(),
+                 (media_clock_.Now() - pts) / 1000.0);
+      }
+      VideoFrameInfo frame_info;
+      frame_info.change_ratio = av_data->change_ratio;
+      frame_info.discontinuity = av_data->discontinuity;
+      if (frame_dropped) {
+        // 变化区域只相对于上一帧，前面有帧被丢弃时不设置ROI
+        frame_info.change_ratio =
+            std::max(frame_info.change_ratio, pending_change_ratio);
+        frame_info.discontinuity |= pending_discontinuity;
+        frame_dropped = false;
+        pending_discontinuity = false;
+        pending_change_ratio = 0.0f;
+      } else {
+        frame_info.dirty_rects.reserve(av_data->dirty_rects.size());
+        for (const DirtyRect& rect : av_data->dirty_rects) {
+          frame_info.dirty_rects.push_back(
+              {rect.left, rect.top, rect.right, rect.bottom});
+        }
+      }
+
+      if (remote_encoder) {
+        if (!remote_encoder_failed &&
+            !remote_encoder->PushVideoFrame(av_data->data, av_data->width,
+                                            av_data->height, stride, pts,
+                                            frame_info)) {
+          LOG_ERROR(kFilter, "编码进程多次异常退出，停止编码");
+          remote_encoder_failed = true;
+        }
+        delete av_data;
+        continue;
+      }
+
+      const auto encode_start = std::chrono::steady_clock::now();
+      av_muxer->EncodeVideoFrame(av_data->data, av_data->width,
+                                 av_data->height, stride, pts, frame_info);
+
+      if (quality_controller) {
+        const double encode_ms = std::chrono::duration<double, std::milli>(
+                                     std::chrono::steady_clock::now() -
+                                     encode_start)
+                                     .count();
+        const int backlog_frames = static_cast<int>(data_queue.VideoCount());
+        const QualityController::Decision old_decision =
+            quality_controller->decision();
+        if (quality_controller->Update(encode_ms, backlog_frames)) {
+          const QualityController::Decision& decision =
+              quality_controller->decision();
+          if (decision.crf != old_decision.crf &&
+              !av_muxer->SetVideoCrf(decision.crf)) {
+            LOG_WARN(kFilter, "调整crf失败: %d", decision.crf);
+          }
+          LOG_INFO(kFilter,
+                   "画质调整 pts: %lld, 负载: %.2f, 积压: %d帧, crf: %d -> %d, "
+                   "丢帧: %d -> %d",
+                   pts, quality_controller->load(), backlog_frames,
+                   old_decision.crf, decision.crf, old_decision.frame_skip,
+                   decision.frame_skip);
+        }
+      }
+    } else if (av_data->type == AVData::CURSOR) {
+      if (cursor_writer) {
+        cursor_writer->Write(av_data->data, av_data->len);
+      }
+    } else {
+      DCHECK(false);
+    }
+
+    delete av_data;
+  }
+
+  const bool canceled = session->canceled;
+  if (canceled) {
+    // 取消录屏时丢弃积压的数据，不刷新编码器，也不写入文件尾。
+    // 编码进程在RemoteEncoder析构时强制结束
+    data_queue.Clear();
+    if (av_muxer) {
+      av_muxer->Abort();
+    }
+  } else {
+    // 等待编码进程结束或者刷新编码器、写入文件尾
+    ReportFinalizeProgress(session, true);
+  }
+
+  if (remote_encoder) {
+    if (!canceled && !remote_encoder_failed &&
+        !remote_encoder->Stop(kEncoderWorkerStopTimeoutMs)) {
+      LOG_ERROR(kFilter, "等待编码进程结束失败");
+    }
+    LOG_INFO(kFilter, "独立进程编码: 重新启动%d次，输出%d个文件，丢失%lld帧",
+             remote_encoder->restart_count(),
+             static_cast<int>(remote_encoder->segments().size()),
+             remote_encoder->lost_frames());
+  } else {
+    const GopController* gop_controller = av_muxer->gop_controller();
+    LOG_INFO(kFilter, "编码%lld帧，关键帧%lld个，其中场景切换%lld个",
+             gop_controller->frame_count(), gop_controller->key_frame_count(),
+             gop_controller->scene_change_count());
+  }
+
+  const AudioClockSync* audio_clock_sync =
+      av_muxer ? av_muxer->audio_clock_sync() : nullptr;
+  if (audio_clock_sync) {
+    LOG_INFO(kFilter,
+             "音画同步: 当前偏差%.1fms，最大偏差%.1fms，录音设备时钟偏差%.1fppm，"
+             "立即修正%lld次",
+             audio_clock_sync->offset_us() / 1000.0,
+             audio_clock_sync->max_offset_us() / 1000.0,
+             audio_clock_sync->drift_ppm(),
+             audio_clock_sync->resync_count());
+  }
+
+  if (quality_controller) {
+    LOG_INFO(kFilter, "画质调整: 降低%lld次，恢复%lld次，丢弃%lld帧",
+             quality_controller->degrade_count(),
+             quality_controller->recover_count(),
+             quality_controller->dropped_frames());
+  }
+
+  const PacketBus* packet_bus = av_muxer ? av_muxer->packet_bus() : nullptr;
+  for (size_t i = 0; packet_bus && i < packet_bus->sink_count(); ++i) {
+    const int index = static_cast<int>(i);
+    const PacketSinkStats stats = packet_bus->sink_stats(index);
+    LOG_INFO(kFilter, "输出%s: 写入%lld个数据包，丢弃%lld个，队列最大%lldKB%s",
+             packet_bus->sink_name(index).c_str(), stats.written_packets,
+             stats.dropped_packets, stats.max_queued_bytes / 1024,
+             stats.failed ? "，写入失败" : "");
+  }
+
+  for (size_t i = 0; av_muxer && i < av_muxer->rendition_count(); ++i) {
+    const RenditionEncoder* rendition = av_muxer->rendition(i);
+    LOG_INFO(kFilter, "多码率输出%dx%d: 编码%lld帧%s", rendition->width(),
+             rendition->height(), rendition->encoded_frames(),
+             rendition->failed() ? "，编码或写入失败" : "");
+  }
+
+  av_muxer.reset();
+  remote_encoder.reset();
+  cursor_writer.reset();
+
+  LOG_INFO(kFilter, "写完文件，截屏结束后积压%lldKB，用时%.1fms",
+           std::max<int64_t>(session->backlog_bytes, 0) / 1024,
+           std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - session->capture_end_time)
+               .count());
+
+  // 正在后台保存的回放持有数据包的引用，不受影响
+  {
+    std::lock_guard<std::mutex> locker(session->replay_mutex);
+    if (session->replay_buffer) {
+      LOG_INFO(kFilter, "回放缓冲区: 丢弃%lld个数据包",
+               session->replay_buffer->dropped_packets());
+      session->replay_buffer.reset();
+    }
+  }
+  return true;
+}
+
+void Recorder::ReportFinalizeProgress(Session* session, bool flushing) {
+  const auto now = std::chrono::steady_clock::now();
+  if (!flushing &&
+      now - session->last_progress_time < kFinalizeProgressInterval) {
+    return;
+  }
+  session->last_progress_time = now;
+
+  FinalizeProgress progress;
+  progress.output_path = session->config.output_path;
+  progress.remaining_bytes = session->data_queue.TotalSize();
+  if (session->backlog_bytes < 0) {
+    session->backlog_bytes = progress.remaining_bytes;
+  }
+  progress.backlog_bytes = session->backlog_bytes;
+  progress.flushing = flushing;
+  on_finalize_progress_(progress);
+}
+
+void Recorder::HandleVoiceData(const uint8_t* data, int len) {
+  DCHECK(data && len > 0);
+
+  // 缓冲区填满时回调，最后一个样本在delay_us之前采集到，
+  // 据此推算第一个样本的采集时间
+  const int64_t bytes_per_second =
+      kSamplesPerSec * kChannels * (kBitsPerSample / 8);
+  const int64_t duration =
+      len * 1000000LL / bytes_per_second + audio_source_->delay_us();
+
+  AVData* av_data = new AVData();
+  av_data->type = AVData::AUDIO;
+  av_data->timestamp = std::max<int64_t>(media_clock_.Now() - duration, 0);
+  av_data->discontinuity = audio_discontinuity_.exchange(false);
+  av_data->len = len;
+  av_data->data = new uint8_t[len];
+  memcpy(av_data->data, data, len);
+  if (audio_processor_) {
+    audio_processor_->Process(reinterpret_cast<int16_t*>(av_data->data),
+                              len / (kChannels * (kBitsPerSample / 8)));
+  }
+
+  // 录音在截屏线程结束之前停止，session_在这期间不会改变
+  Session* session = nullptr;
+  {
+    std::lock_guard<std::mutex> locker(sessions_mutex_);
+    session = session_;
+  }
+  if (!session ||
+      !session->data_queue.Push(av_data, [this, session]() {
+        return abort_func_() || session->encode_failed;
+      })) {
+    delete av_data;
+  }
+}
+
+PictureCapturer* Recorder::CreatePictureCapturer() const {
+  const std::string& capture_type = config_.capture_type;
+  if (IsCaptureType(capture_type, "Synthetic")) {
+    return new PictureCapturerSynthetic(width_, height_);
+  }
+#if defined(OS_WIN)
+  if (IsCaptureType(capture_type, "GDI")) {
+    return new PictureCapturerGdi();
+  } else if (IsCaptureType(capture_type, "D3D9")) {
+    return new PictureCapturerD3D9();
+  } else if (IsCaptureType(capture_type, "DXGI")) {
+    return new PictureCapturerDXGI();
+  }
+#elif defined(OS_LINUX)
+  if (IsCaptureType(capture_type, "X11")) {
+    return new PictureCapturerX11(config_.capture_source);
+  }
+#endif
+  return nullptr;
+}
+
+AudioSource* Recorder::CreateAudioSource() {
+  AudioSourceConfig audio_config;
+  audio_config.channels = kChannels;
+  audio_config.samples_per_second = kSamplesPerSec;
+  audio_config.bits_per_sample = kBitsPerSample;
+  audio_config.period_ms = config_.audio_period_ms;
+  audio_config.buffer_count = config_.audio_buffer_count;
+  const AudioSource::DataCallback callback =
+      [this](const uint8_t* data, int len) { HandleVoiceData(data, len); };
+
+  const std::vector<AudioSourceSpec> specs =
+      ParseAudioSources(config_.audio_source);
+  if (specs.size() == 1 && specs[0].gain == 1.0f) {
+    return CreateAudioSourceByName(specs[0].name, audio_config,
+                                   config_.audio_file, callback)
+        .release();
+  }
+
+  // 多个来源或者需要调整音量时经过混音器。
+  // 混音的延迟至少要容纳一个输入周期，否则输入的数据经常来不及混音
+  const int latency_ms =
+      std::max(config_.audio_mix_latency_ms, 2 * config_.audio_period_ms);
+  std::unique_ptr<AudioMixer> mixer =
+      std::make_unique<AudioMixer>(audio_config, latency_ms, callback);
+  const std::string audio_file = config_.audio_file;
+  // 混音器接受float的输入，系统声音超出满刻度时由限幅器压低，不在混音前削波
+  AudioSourceConfig input_config = audio_config;
+  input_config.allow_float = true;
+  for (const AudioSourceSpec& spec : specs) {
+    mixer->AddInput(spec.name, spec.gain,
+                    [spec, input_config, audio_file](
+                        const AudioSource::DataCallback& input_callback) {
+                      return CreateAudioSourceByName(spec.name, input_config,
+                                                     audio_file,
+                                                     input_callback);
+                    });
+  }
+  if (mixer->input_count() == 0) {
+    return nullptr;
+  }
+  return mixer.release();
+}
+
+void Recorder::CapturePicture(Session* session) {
+  // 停止录屏或者编码失败时结束截屏
+  auto abort_func = [this, session]() {
+    return abort_func_() || session->encode_failed;
+  };
+  DataQueue<kMaxSize>& data_queue = session->data_queue;
+
+  const bool role_applied =
+      base::SetCurrentThreadRole(base::ThreadRole::CAPTURE);
+  if (!role_applied) {
+    LOG_WARN(kFilter, "设置截屏线程的优先级失败");
+  }
+
+  // 开始录音，失败时只录画面
+  if (audio_source_ && !audio_source_->Start()) {
+    LOG_WARN(kFilter, "开始录音失败: %s", config_.audio_source.c_str());
+  }
+
+  std::unique_ptr<PictureCapturer> capturer(CreatePictureCapturer());
+  if (!capturer) {
+    LOG_ERROR(kFilter, "不支持的截屏方式: %s", config_.capture_type.c_str());
+  }
+
+#if defined(OS_WIN)
+  // 单独记录鼠标轨迹时画面中不绘制鼠标，
+  // 这样只有鼠标移动时画面保持不变，DXGI可以跳过没有变化的帧
+  std::unique_ptr<CursorCapturer> cursor_capturer;
+  if (capturer && config_.cursor_track) {
+    capturer->set_draw_mouse(false);
+    cursor_capturer = std::make_unique<CursorCapturer>();
+  }
+#endif
+
+  // 按绝对时间点截屏，截屏耗时不会累积到后面的帧
+  FramePacer pacer(config_.fps);
+  // 截屏线程的优先级高于编码线程时，自旋等待不让出CPU
+  if (role_applied &&
+      base::GetThreadRoleConfig(base::ThreadRole::CAPTURE).priority >
+          base::GetThreadRoleConfig(base::ThreadRole::ENCODE).priority) {
+    pacer.set_yield_while_spinning(false);
+  }
+  pacer.Start();
+
+  bool capture_result = capturer != nullptr;
+
+  // 统计画面变化，用于决定关键帧的位置
+  FrameDiffer frame_differ;
+  bool discontinuity = false;
+  // 上一次送去编码的画面的时间戳
+  uint64_t last_video_pts = 0;
+  bool has_video = false;
+
+  uint32_t count = 0;
+  uint64_t pts = 0;
+  while (capture_result) {
+    pacer.WaitForNextFrame();
+
+    // 时间戳取自媒体时钟，暂停的时长不计入。
+    // 暂停之后时钟停止，这时截取的画面可能与上一帧时间戳相同，保证严格递增
+    pts = static_cast<uint64_t>(media_clock_.Now());
+    if (has_video && pts <= last_video_pts) {
+      pts = last_video_pts + 1;
+    }
+
+    if (abort_func()) {
+      break;
+    }
+
+    AVData* av_data = nullptr;
+    if (!capturer->CaptureScreen(&av_data)) {
+      capture_result = false;
+      break;
+    } else if (av_data) {
+      if (count == 0) {
+        LOG_INFO(kFilter, "截取第一帧，距离开始录屏%.1fms",
+                 std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start_time_)
+                     .count());
+      }
+      av_data->timestamp = pts;
+      av_data->change_ratio = frame_differ.Compare(
+          av_data->data, av_data->width, av_data->height,
+          av_data->len / av_data->height);
+      if (av_data->change_ratio < 1.0f) {
+        frame_differ.GetDirtyRects(kMaxDirtyRects, &av_data->dirty_rects);
+      }
+      av_data->discontinuity = discontinuity;
+
+      // 可变帧率：画面没有变化时不编码，时间戳保证播放时长不变
+      if (config_.variable_frame_rate && has_video && !discontinuity &&
+          av_data->change_ratio == 0.0f &&
+          pts - last_video_pts < kMaxFrameIntervalUs) {
+        delete av_data;
+        av_data = nullptr;
+      } else {
+        discontinuity = false;
+        last_video_pts = pts;
+        has_video = true;
+        if (!data_queue.Push(av_data, abort_func)) {
+          delete av_data;
+          break;
+        }
+      }
+    }
+
+#if defined(OS_WIN)
+    if (cursor_capturer) {
+      AVData* cursor_data = nullptr;
+      // 鼠标轨迹文件的时间戳以毫秒为单位
+      if (cursor_capturer->Capture(pts / 1000, &cursor_data) && cursor_data &&
+          !data_queue.Push(cursor_data, abort_func)) {
+        delete cursor_data;
+        break;
+      }
+    }
+#endif
+
+    ++count;
+
+    // 暂停，恢复后的第一帧标记为不连续，编码时插入关键帧
+    if (status_ == Status::PAUSE) {
+      const std::chrono::steady_clock::duration paused = WaitWhilePaused();
+      discontinuity = true;
+      pacer.Restart();
+      LOG_INFO(kFilter, "暂停%.3f秒",
+               std::chrono::duration<double>(paused).count());
+    }
+  }
+
+  // 结束录音
+  if (audio_source_) {
+    audio_source_->Stop();
+  }
+  if (audio_processor_) {
+    LOG_INFO(kFilter, "录音处理: 自动增益%.1fdB，限幅器压低音量的块%lld个",
+             audio_processor_->agc_gain_db(),
+             static_cast<long long>(audio_processor_->limited_blocks()));
+  }
+
+  char info[1024];
+  memset(info, 0, 1024);
+
+  if (capture_result) {
+    double diff = media_clock_.Now() / 1000000.0;
+    snprintf(info, sizeof(info),
+             "截屏操作结束，耗时%.3f秒，截取%u帧，帧率: %.3f", diff, count,
+             count / diff);
+  } else {
+    snprintf(info, sizeof(info), "%s", "抓屏失败");
+    // 编码线程结束时报告失败，不再报告录屏完成
+    session->capture_failed = true;
+  }
+
+  capturer.reset();
+
+  LOG_INFO(kFilter, "%s", info);
+  LOG_INFO(kFilter, "截屏节拍统计: %s", pacer.FormatStats().c_str());
+
+  // 把队列交给编码线程在后台编码完，然后就可以开始下一次录屏
+  if (status_ == Status::CANCELING) {
+    session->canceled = true;
+  }
+  session->capture_end_time = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> locker(sessions_mutex_);
+    session_ = nullptr;
+  }
+  session->capture_ended = true;
+  data_queue.Notify();
+
+  SetStatus(Status::STOPPED);
+}
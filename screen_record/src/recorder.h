@@ -0,0 +1,269 @@
+﻿// 录屏的核心流程：截屏、录音、编码并写入文件，不依赖Qt。
+//
+// 界面程序的ScreenRecorder(screen_record/src/screen_recorder.h)把设置转换成
+// RecorderConfig，命令行程序(screen_record_cli/main.cc)由命令行参数生成，
+// 两者的录屏流程完全相同。
+//
+// 停止录屏时截屏和录音立即结束，编码线程在后台编码队列中剩余的数据、
+// 写入文件尾，这期间就可以开始下一次录屏。
+
+#ifndef SCREEN_RECORD_SRC_RECORDER_H_
+#define SCREEN_RECORD_SRC_RECORDER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "build/build_config.h"
+#include "capturer/media_clock.h"
+#include "encoder/av_config.h"
+#include "encoder/muxer_prewarmer.h"
+
+class AudioProcessor;
+class AudioSource;
+class PictureCapturer;
+
+// 录屏文件之外同时写入的输出，只编码一次
+struct RecorderOutput {
+  // 封装格式的名称，如"mpegts"，为空时由url的后缀决定
+  std::string format;
+  // 文件路径或者FFmpeg的地址，如"pipe:1"
+  std::string url;
+};  // struct RecorderOutput
+
+struct RecorderConfig {
+  // 截屏方式，不区分大小写："GDI"、"D3D9"、"DXGI"只在Windows上可用，
+  // "X11"只在Linux上可用，"Synthetic"生成模拟的桌面画面
+  std::string capture_type;
+  // 截屏的来源，X11为显示的名称，如":0"，为空时使用DISPLAY环境变量；
+  // Synthetic为画面的尺寸，如"1920x1080"，为空时与主显示器相同
+  std::string capture_source;
+  int fps;
+
+  // UTF-8编码的录屏文件路径，见GenerateOutputPath
+  std::string output_path;
+  // 回放模式下保存的文件放在output_dir下，后缀为file_format
+  std::string output_dir;
+  std::string file_format;
+
+  // 按截屏画面的宽高和帧率生成编码参数，在编码线程和调用Prewarm的线程中调用
+  std::function<VideoConfig(int width, int height, int fps)>
+      make_video_config;
+
+  // 是否录音
+  bool capture_voice;
+  // 录音的来源，不区分大小写："WaveIn"(为空时也是)从录音设备录音、
+  // "Loopback"录制系统播放的声音，这两个只在Windows上可用；
+  // "Synthetic"生成测试音；"Wav"循环回放audio_file，
+  // 格式要与录音相同(16位PCM、双声道、44100Hz)。
+  // 多个来源用逗号分隔，混音后编码，如"WaveIn,Loopback:0.5"，冒号后为增益
+  std::string audio_source;
+  // UTF-8编码的WAV文件路径
+  std::string audio_file;
+  // 每次送去编码的声音时长(毫秒)，越短录音的延迟越低，回调越频繁
+  int audio_period_ms;
+  // 同时交给录音设备的缓冲区个数
+  int audio_buffer_count;
+  // 混音增加的延迟(毫秒)，至少为audio_period_ms的两倍
+  int audio_mix_latency_ms;
+  // 录音是否经过高通滤波、噪声门、自动增益和限幅(capturer/audio_processor.h)
+  bool audio_processing;
+  // 是否单独记录鼠标轨迹，只在Windows上支持
+  bool cursor_track;
+  // 画面没有变化时是否丢弃这一帧
+  bool variable_frame_rate;
+
+  // 编码进程的路径，不为空时由编码进程写入视频文件，编码进程崩溃不影响录屏。
+  // 回放、额外的输出、直播和多码率输出都在录屏进程中，这时忽略编码进程
+  std::string encoder_worker_path;
+
+  // 回放模式：只在内存中保留最近的画面，调用SaveReplay时才写入文件
+  bool replay_mode;
+  int replay_seconds;
+  int replay_max_megabytes;
+
+  std::vector<RecorderOutput> extra_outputs;
+  // 直播地址，为空时不直播
+  std::string stream_url;
+  // 多码率输出的画面高度，从大到小排列
+  std::vector<int> rendition_heights;
+
+  RecorderConfig()
+      : fps(0),
+        capture_voice(false),
+        audio_period_ms(40),
+        audio_buffer_count(6),
+        audio_mix_latency_ms(100),
+        audio_processing(false),
+        cursor_track(false),
+        variable_frame_rate(false),
+        replay_mode(false),
+        replay_seconds(0),
+        replay_max_megabytes(0) {}
+};  // struct RecorderConfig
+
+// 停止录屏后在后台写完文件的进度
+struct FinalizeProgress {
+  std::string output_path;
+  // 停止录屏时队列中还没有编码的数据量
+  int64_t backlog_bytes;
+  // 现在队列中还没有编码的数据量
+  int64_t remaining_bytes;
+  // 队列已经编码完，正在刷新编码器、写入文件尾
+  bool flushing;
+
+  FinalizeProgress() : backlog_bytes(0), remaining_bytes(0), flushing(false) {}
+
+  // 完成的百分比，刷新编码器和写入文件尾算作最后1%
+  int Percent() const {
+    if (flushing || backlog_bytes <= 0) {
+      return 99;
+    }
+    return static_cast<int>((backlog_bytes - remaining_bytes) * 99 /
+                            backlog_bytes);
+  }
+};  // struct FinalizeProgress
+
+class Recorder {
+ public:
+  enum class Status {
+    RECORDING = 0,
+    PAUSE,
+    CANCELING,
+    // 截屏和录音正在结束，很快变为STOPPED
+    STOPPING,
+    // 可以开始下一次录屏，之前的录屏可能还在后台写文件
+    STOPPED,
+  };
+
+  // on_recording_completed: 录屏成功并写完文件的回调函数
+  // on_recording_canceled: 取消录屏的回调函数
+  // on_recording_failed: 录屏失败的回调函数
+  // on_finalize_progress: 停止录屏后写文件的进度，每隔一段时间调用一次
+  // 有可能在别的线程里调用这些函数，开始下一次录屏之后也可能收到之前的录屏
+  // 的回调
+  Recorder(const std::function<void()>& on_recording_completed,
+           const std::function<void()>& on_recording_canceled,
+           const std::function<void()>& on_recording_failed,
+           const std::function<void(const FinalizeProgress&)>&
+               on_finalize_progress);
+  // 等待所有录屏写完文件
+  ~Recorder();
+
+  // 在output_dir下按当前时间生成文件名，如"2024-01-02-03-04-05-006.mp4"
+  static std::string GenerateOutputPath(const std::string& output_dir,
+                                        const std::string& file_format);
+
+  // 在后台打开编码器，之后用相同的编码参数和文件格式调用Start时直接使用，
+  // 开始录屏时只需要打开输出文件。output_path只用来确定文件格式。
+  // 程序启动、修改设置和录屏结束后调用，参数变化时丢弃之前预热的编码器。
+  // 独立进程编码时不预热
+  void Prewarm(const RecorderConfig& config);
+
+  // 开始录屏，截屏线程立即开始截屏，编码器在编码线程中初始化(没有预热时)，
+  // 这期间的画面在队列中等待。取不到屏幕尺寸时返回false。
+  // 状态为STOPPED时就可以调用，不需要等待之前的录屏写完文件
+  bool Start(const RecorderConfig& config);
+  // 停止录屏，立即返回，截屏线程结束后状态变为STOPPED，
+  // 编码线程在后台写完文件后调用on_recording_completed
+  void Stop();
+  // 取消录屏，立即返回。编码线程丢弃队列中积压的数据，不写完文件，
+  // 结束后调用on_recording_canceled
+  void Cancel();
+  // 暂停录屏
+  void Pause();
+  // 恢复录屏
+  void Resume();
+  // 回放模式下把缓冲区中最近的画面保存到output_dir，在后台写入文件。
+  // 不在回放模式下录屏时返回false
+  bool SaveReplay();
+
+  // 在Stop或Cancel之后调用，等待截屏线程结束和所有录屏写完文件。
+  // 与Start在同一个线程中调用
+  void WaitForFinalize();
+
+  Status status() const { return status_; }
+
+ private:
+  // 一次录屏的编码部分，截屏结束后在后台编码队列中剩余的数据
+  struct Session;
+
+  // 编码线程
+  void Run(Session* session);
+  // 初始化编码器，然后编码队列中的数据直到截屏结束并且队列为空，
+  // 初始化失败时返回false
+  bool Encode(Session* session);
+  // 截屏结束后报告写文件的进度，flushing为false时按时间间隔报告
+  void ReportFinalizeProgress(Session* session, bool flushing);
+
+  // 回收已经写完文件的录屏
+  void ReapSessions();
+
+  // 处理声音数据的回调函数
+  void HandleVoiceData(const uint8_t* data, int len);
+
+  // 截屏线程，结束时把session交给编码线程在后台结束
+  void CapturePicture(Session* session);
+  // 按capture_type创建截屏对象，不支持时返回nullptr
+  PictureCapturer* CreatePictureCapturer() const;
+  // 按audio_source创建录音对象，不支持时返回nullptr
+  AudioSource* CreateAudioSource();
+
+  // 修改状态并唤醒所有等待状态变化的线程
+  void SetStatus(Status status);
+  // 暂停时阻塞，直到恢复录屏或者结束录屏，返回暂停的时长
+  std::chrono::steady_clock::duration WaitWhilePaused();
+
+  RecorderConfig config_;
+  // 截屏画面的大小
+  int width_;
+  int height_;
+  // 调用Start的时间，用于统计截取第一帧的耗时
+  std::chrono::steady_clock::time_point start_time_;
+
+  // 当前状态
+  std::atomic<Status> status_;
+  std::mutex status_mutex_;
+  std::condition_variable status_cond_;
+
+  // 截屏和录音共用的时钟，暂停时停止计时
+  MediaClock media_clock_;
+  // 恢复录屏后收到的第一段音频需要标记为不连续
+  std::atomic<bool> audio_discontinuity_;
+
+  std::thread capture_picture_thread_;
+
+  // 录音，在截屏线程中开始和结束，不录音时为空
+  std::unique_ptr<AudioSource> audio_source_;
+  // 录音的处理，在录音线程中使用，不处理时为空
+  std::unique_ptr<AudioProcessor> audio_processor_;
+
+  // 所有还没有写完文件的录屏，session_是正在截屏的那个，截屏线程结束时置空
+  std::mutex sessions_mutex_;
+  std::vector<std::unique_ptr<Session>> sessions_;
+  Session* session_;
+
+  // Prewarm预热的编码器，编码线程开始时取走
+  MuxerPrewarmer muxer_prewarmer_;
+
+  std::function<bool()> abort_func_;
+
+  std::function<void()> on_recording_completed_;
+  std::function<void()> on_recording_canceled_;
+  std::function<void()> on_recording_failed_;
+  std::function<void(const FinalizeProgress&)> on_finalize_progress_;
+
+  Recorder() = delete;
+  Recorder(const Recorder&) = delete;
+  Recorder& operator=(const Recorder&) = delete;
+};  // class Recorder
+
+#endif  // SCREEN_RECORD_SRC_RECORDER_H_
@@ -1,37 +1,33 @@
 ﻿#ifndef SCREEN_RECORD_SRC_SCREEN_RECORDER_H_
 #define SCREEN_RECORD_SRC_SCREEN_RECORDER_H_
 
-#include <atomic>
 #include <functional>
-#include <thread>
 
-#include <QtCore/QThread>
+#include <QtCore/QString>
 
-#include "screen_record/src/data_queue.h"
+#include "screen_record/src/recorder.h"
 
-const uint32_t kMaxSize = 1024 * 1024 * 1024;
-
-class VoiceCapturer;
-
-class ScreenRecorder : public QThread {
+// 按设置(SettingManager)录屏，录屏流程在Recorder中
+class ScreenRecorder {
  public:
-  enum class Status {
-    RECORDING = 0,
-    PAUSE,
-    CANCELING,
-    STOPPING,
-    STOPPED,
-  };
+  using Status = Recorder::Status;
 
   // on_recording_completed: 录屏成功的回调函数
   // on_recording_canceled: 取消录屏的回调函数
   // on_recording_failed: 录屏失败的回调函数
+  // on_finalize_progress: 停止录屏后在后台写文件的进度
   // 有可能在别的线程里调用这些函数
   ScreenRecorder(const std::function<void()>& on_recording_completed,
                  const std::function<void()>& on_recording_canceled,
-                 const std::function<void()>& on_recording_failed);
+                 const std::function<void()>& on_recording_failed,
+                 const std::function<void(const FinalizeProgress&)>&
+                     on_finalize_progress);
   ~ScreenRecorder();
 
+  // 按当前的设置在后台打开编码器，开始录屏时不用再等待编码器初始化。
+  // 程序启动、修改设置和录屏结束后调用，参数与startRecord相同
+  void prewarm(const QString& dir, int fps);
+
   // 开始录屏
   // 这个函数是异步操作，会创建一个线程来执行录屏操作
   // 参数：
@@ -42,43 +38,26 @@ class ScreenRecorder : public QThread {
   void stopRecord();
   // 取消录屏
   void cancelRecord();
+  // 在stopRecord或cancelRecord之后调用，等待所有录屏写完文件
+  void waitForFinalize();
   // 暂停录屏
   void pauseRecord();
   // 重新开始录屏
   void restartRecord();
+  // 回放模式下把缓冲区中最近的画面保存到视频保存路径，在后台写入文件。
+  // 不在回放模式下录屏时返回false
+  bool saveReplay();
 
   Status status() const {
-    return status_;
+    return recorder_.status();
   }
 
  private:
-  // 录屏线程
-  void run() override;
-
-  // 处理声音数据的回调函数
-  void handleVoiceDataCallback(const uint8_t* data, int len);
-
-  // 截屏线程
-  void capturePictureThread(int fps);
-
-  // 当前状态
-  std::atomic<Status> status_;
-
-  // 帧率
-  int fps_;
-
-  // 保存路径
-  std::string output_dir_;
-
-  DataQueue<kMaxSize> data_queue_;
-  std::thread capture_picture_thread_;
-
-  std::unique_ptr<VoiceCapturer> voice_capturer_;
+  // 按当前的设置生成录屏参数，文件名按当前时间生成
+  RecorderConfig makeRecorderConfig(const QString& dir, int fps) const;
 
-  std::function<bool()> abort_func_;
+  Recorder recorder_;
 
-  std::function<void()> on_recording_completed_;
-  std::function<void()> on_recording_canceled_;
   std::function<void()> on_recording_failed_;
 
   ScreenRecorder() = delete;
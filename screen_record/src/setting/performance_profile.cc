@@ -0,0 +1,38 @@
+﻿#include "screen_record/src/setting/performance_profile.h"
+
+#include <algorithm>
+
+#include "base/check.h"
+
+const PerformanceProfile* FindPerformanceProfile(const std::string& name) {
+  for (const auto& profile : kPerformanceProfileList) {
+    if (name == profile.name) {
+      return &profile;
+    }
+  }
+  return nullptr;
+}
+
+void ApplyProfileToVideoConfig(const PerformanceProfile& profile,
+                               VideoConfig* video_config) {
+  DCHECK(video_config && video_config->fps > 0);
+
+  const int fps = video_config->fps;
+  video_config->max_gop_size = fps * profile.key_frame_interval;
+  video_config->min_gop_size = std::max(fps / 2, 1);
+  video_config->preset = profile.preset;
+  video_config->tune = profile.tune;
+  video_config->crf = profile.crf;
+  video_config->bit_rate = static_cast<int64_t>(profile.bit_rate) * 1000;
+  video_config->max_b_frames = profile.max_b_frames;
+  video_config->threads = profile.threads;
+  video_config->lookahead = profile.lookahead;
+
+  // 缩放后的宽高需要是偶数，YUV420P的色度平面宽高减半
+  if (profile.scale != 100) {
+    video_config->output_width =
+        std::max((video_config->width * profile.scale / 100) & ~1, 2);
+    video_config->output_height =
+        std::max((video_config->height * profile.scale / 100) & ~1, 2);
+  }
+}
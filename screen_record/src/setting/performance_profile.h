@@ -0,0 +1,56 @@
+﻿// 性能方案，一次设置整条编码流水线的参数。
+// 不依赖Qt，设置界面和命令行录屏程序(screen_record_cli)共用
+
+#ifndef SCREEN_RECORD_SRC_SETTING_PERFORMANCE_PROFILE_H_
+#define SCREEN_RECORD_SRC_SETTING_PERFORMANCE_PROFILE_H_
+
+#include <string>
+
+#include "encoder/av_config.h"
+
+struct PerformanceProfile {
+  const char* name;
+  const char* preset;
+  const char* tune;
+  int crf;
+  // 码率(kbps)，0表示使用crf
+  int bit_rate;
+  int max_b_frames;
+  // 编码线程数，0表示由编码器决定
+  int threads;
+  // 码率控制的前瞻帧数
+  int lookahead;
+  // 最大关键帧间隔(秒)
+  int key_frame_interval;
+  // 输出画面相对于屏幕的缩放比例(%)
+  int scale;
+  // 画面没有变化时不编码，生成可变帧率的视频
+  bool variable_frame_rate;
+};  // struct PerformanceProfile
+
+// Low-CPU: 低配机器，降低分辨率，尽量少占用CPU
+// Balanced: 默认方案
+// Quality: 画质优先，不丢弃静止帧
+// Archive: 长期保存，用更多的CPU换取更小的文件
+constexpr PerformanceProfile kPerformanceProfileList[] = {
+  {"Low-CPU", "ultrafast", "stillimage", 20, 0, 0, 2, 0, 10, 75, true},
+  {"Balanced", "veryfast", "stillimage", 18, 0, 1, 0, 10, 10, 100, true},
+  {"Quality", "medium", "stillimage", 16, 0, 3, 0, 40, 5, 100, false},
+  {"Archive", "slower", "stillimage", 20, 0, 3, 0, 60, 20, 100, true},
+};
+
+// 增加性能方案之前固定的编码参数：ultrafast、crf 18、1秒一个关键帧、
+// 恒定帧率。之前版本的配置文件中没有编码参数，继续使用这些参数，
+// 不在方案列表中，设置界面显示为Custom
+constexpr PerformanceProfile kLegacyPerformanceProfile = {
+    "Legacy", "ultrafast", "stillimage", 18, 0, 1, 0, 0, 1, 100, false};
+
+// 名称为name的性能方案，不存在时返回nullptr
+const PerformanceProfile* FindPerformanceProfile(const std::string& name);
+
+// 把性能方案中的编码参数写入video_config，
+// video_config的宽高和帧率需要先设置好
+void ApplyProfileToVideoConfig(const PerformanceProfile& profile,
+                               VideoConfig* video_config);
+
+#endif  // SCREEN_RECORD_SRC_SETTING_PERFORMANCE_PROFILE_H_
@@ -1,10 +1,14 @@
 ﻿#include "screen_record/src/setting/setting_dialog.h"
 
+#include <windows.h>
+
+#include <QtCore/QSignalBlocker>
 #include <QtGui/QMouseEvent>
 
 #include "base/check.h"
 #include "encoder/ffmpeg.h"
 #include "screen_record/src/argument.h"
+#include "screen_record/src/encoder_calibration.h"
 #include "screen_record/src/setting/setting_manager.h"
 
 namespace {
@@ -12,7 +16,7 @@ namespace {
 }  // namespace
 
 SettingDialog::SettingDialog(QWidget* parent)
-    : should_move_window_(false) {
+    : should_move_window_(false), cancel_calibration_(false) {
   ui_.setupUi(this);
 
   DCHECK(g_setting_manager);
@@ -20,6 +24,10 @@ SettingDialog::SettingDialog(QWidget* parent)
   QString file_format = g_setting_manager->FileFormat();
   QString capture_type = g_setting_manager->CaptureType();
   QString video_encoder = g_setting_manager->VideoEncoder();
+  bool cursor_track = g_setting_manager->CursorTrack();
+  bool adaptive_quality = g_setting_manager->AdaptiveQuality();
+  bool encoder_process = g_setting_manager->EncoderProcess();
+  bool replay_mode = g_setting_manager->ReplayMode();
 
   setWindowFlags(Qt::Dialog | Qt::FramelessWindowHint);
 
@@ -76,6 +84,44 @@ SettingDialog::SettingDialog(QWidget* parent)
   DCHECK(index != -1);
   ui_.videoCodecSelector->setCurrentIndex(index);
 
+  ui_.cursorTrackCheckBox->setChecked(cursor_track);
+  ui_.adaptiveQualityCheckBox->setChecked(adaptive_quality);
+  ui_.encoderProcessCheckBox->setChecked(encoder_process);
+  ui_.replayModeCheckBox->setChecked(replay_mode);
+
+  for (const auto& profile : kPerformanceProfileList) {
+    ui_.profileSelector->addItem(profile.name);
+  }
+  ui_.profileSelector->addItem(SettingManager::kCustomPerformanceProfile);
+
+  i = 0;
+  while (SettingManager::kPresetList[i]) {
+    ui_.presetSelector->addItem(SettingManager::kPresetList[i]);
+    ++i;
+  }
+
+  i = 0;
+  while (SettingManager::kTuneList[i]) {
+    ui_.tuneSelector->addItem(SettingManager::kTuneList[i]);
+    ++i;
+  }
+
+  for (int scale : SettingManager::kScaleList) {
+    ui_.scaleSelector->addItem(QString("%1%").arg(scale), scale);
+  }
+
+  ui_.crfSpinBox->setRange(SettingManager::kMinCrf, SettingManager::kMaxCrf);
+  ui_.bitRateSpinBox->setRange(0, SettingManager::kMaxBitRate);
+  ui_.bitRateSpinBox->setSingleStep(500);
+  ui_.bFramesSpinBox->setRange(0, SettingManager::kMaxBFrames);
+  ui_.threadsSpinBox->setRange(0, SettingManager::kMaxThreads);
+  ui_.lookaheadSpinBox->setRange(0, SettingManager::kMaxLookahead);
+  ui_.keyFrameIntervalSpinBox->setRange(SettingManager::kMinKeyFrameInterval,
+                                        SettingManager::kMaxKeyFrameInterval);
+
+  updateEncoderWidgets();
+  updateCalibrationLabel();
+
   connect(ui_.btnClose, &QPushButton::clicked,
           this, &SettingDialog::onClose);
   connect(ui_.fpsSelector, &QComboBox::currentTextChanged,
@@ -86,9 +132,51 @@ SettingDialog::SettingDialog(QWidget* parent)
           this, &SettingDialog::onCaptureTypeChanged);
   connect(ui_.videoCodecSelector, &QComboBox::currentTextChanged,
           this, &SettingDialog::onVideoEncoderChanged);
+  connect(ui_.cursorTrackCheckBox, &QCheckBox::stateChanged,
+          this, &SettingDialog::onCursorTrackChanged);
+
+  // QSpinBox::valueChanged有重载
+  auto spin_box_changed =
+      static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged);
+  connect(ui_.profileSelector, &QComboBox::currentTextChanged,
+          this, &SettingDialog::onPerformanceProfileChanged);
+  connect(ui_.presetSelector, &QComboBox::currentTextChanged,
+          this, &SettingDialog::onPresetChanged);
+  connect(ui_.tuneSelector, &QComboBox::currentTextChanged,
+          this, &SettingDialog::onTuneChanged);
+  connect(ui_.crfSpinBox, spin_box_changed,
+          this, &SettingDialog::onCrfChanged);
+  connect(ui_.bitRateSpinBox, spin_box_changed,
+          this, &SettingDialog::onBitRateChanged);
+  connect(ui_.bFramesSpinBox, spin_box_changed,
+          this, &SettingDialog::onMaxBFramesChanged);
+  connect(ui_.threadsSpinBox, spin_box_changed,
+          this, &SettingDialog::onEncodeThreadsChanged);
+  connect(ui_.lookaheadSpinBox, spin_box_changed,
+          this, &SettingDialog::onLookaheadChanged);
+  connect(ui_.keyFrameIntervalSpinBox, spin_box_changed,
+          this, &SettingDialog::onKeyFrameIntervalChanged);
+  connect(ui_.scaleSelector,
+          static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+          this, &SettingDialog::onScaleChanged);
+  connect(ui_.variableFrameRateCheckBox, &QCheckBox::stateChanged,
+          this, &SettingDialog::onVariableFrameRateChanged);
+  connect(ui_.adaptiveQualityCheckBox, &QCheckBox::stateChanged,
+          this, &SettingDialog::onAdaptiveQualityChanged);
+  connect(ui_.encoderProcessCheckBox, &QCheckBox::stateChanged,
+          this, &SettingDialog::onEncoderProcessChanged);
+  connect(ui_.replayModeCheckBox, &QCheckBox::stateChanged,
+          this, &SettingDialog::onReplayModeChanged);
+  connect(ui_.calibrateButton, &QPushButton::clicked,
+          this, &SettingDialog::onCalibrate);
 }
 
-SettingDialog::~SettingDialog() {}
+SettingDialog::~SettingDialog() {
+  cancel_calibration_ = true;
+  if (calibration_thread_.joinable()) {
+    calibration_thread_.join();
+  }
+}
 
 void SettingDialog::onFpsChanged(const QString& fps_str) {
   bool res = false;
@@ -110,6 +198,195 @@ void SettingDialog::onVideoEncoderChanged(const QString& new_encoder) {
   g_setting_manager->SetVideoEncoder(new_encoder);
 }
 
+void SettingDialog::onCursorTrackChanged(int state) {
+  g_setting_manager->SetCursorTrack(state == Qt::Checked);
+}
+
+void SettingDialog::onPerformanceProfileChanged(const QString& new_profile) {
+  // 选择Custom时保持当前参数不变
+  if (g_setting_manager->ApplyPerformanceProfile(new_profile)) {
+    updateEncoderWidgets();
+  }
+}
+
+void SettingDialog::onPresetChanged(const QString& new_preset) {
+  g_setting_manager->SetPreset(new_preset);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onTuneChanged(const QString& new_tune) {
+  g_setting_manager->SetTune(new_tune);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onCrfChanged(int new_crf) {
+  g_setting_manager->SetCrf(new_crf);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onBitRateChanged(int new_bit_rate) {
+  g_setting_manager->SetBitRate(new_bit_rate);
+  // 使用码率控制时crf不起作用
+  ui_.crfSpinBox->setEnabled(new_bit_rate == 0);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onMaxBFramesChanged(int new_max_b_frames) {
+  g_setting_manager->SetMaxBFrames(new_max_b_frames);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onEncodeThreadsChanged(int new_threads) {
+  g_setting_manager->SetEncodeThreads(new_threads);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onLookaheadChanged(int new_lookahead) {
+  g_setting_manager->SetLookahead(new_lookahead);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onKeyFrameIntervalChanged(int new_interval) {
+  g_setting_manager->SetKeyFrameInterval(new_interval);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onScaleChanged(int index) {
+  if (index < 0) {
+    return;
+  }
+  g_setting_manager->SetScale(ui_.scaleSelector->itemData(index).toInt());
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onVariableFrameRateChanged(int state) {
+  g_setting_manager->SetVariableFrameRate(state == Qt::Checked);
+  updatePerformanceProfile();
+}
+
+void SettingDialog::onAdaptiveQualityChanged(int state) {
+  g_setting_manager->SetAdaptiveQuality(state == Qt::Checked);
+}
+
+void SettingDialog::onEncoderProcessChanged(int state) {
+  g_setting_manager->SetEncoderProcess(state == Qt::Checked);
+}
+
+void SettingDialog::onReplayModeChanged(int state) {
+  g_setting_manager->SetReplayMode(state == Qt::Checked);
+}
+
+void SettingDialog::onCalibrate() {
+  if (calibration_thread_.joinable()) {
+    return;
+  }
+
+  // 按主显示器的大小和当前帧率校准
+  const int width = GetSystemMetrics(SM_CXSCREEN);
+  const int height = GetSystemMetrics(SM_CYSCREEN);
+  const int fps = g_setting_manager->fps();
+
+  ui_.calibrateButton->setEnabled(false);
+  ui_.calibrationLabel->setText(QStringLiteral("正在校准..."));
+
+  cancel_calibration_ = false;
+  calibration_thread_ = std::thread([this, width, height, fps]() {
+    EncoderCalibrationResult result;
+    const bool succeeded = CalibrateEncoder(
+        width, height, fps, [this]() { return cancel_calibration_.load(); },
+        [this](int finished, int total) {
+          QMetaObject::invokeMethod(
+              this,
+              [this, finished, total]() {
+                ui_.calibrationLabel->setText(
+                    QStringLiteral("正在校准... %1/%2").arg(finished).arg(total));
+              },
+              Qt::QueuedConnection);
+        },
+        &result);
+
+    QMetaObject::invokeMethod(
+        this,
+        [this, succeeded, result, width, height, fps]() {
+          calibration_thread_.join();
+          ui_.calibrateButton->setEnabled(true);
+
+          if (!succeeded) {
+            ui_.calibrationLabel->setText(QStringLiteral("校准失败"));
+            return;
+          }
+
+          g_setting_manager->SetCalibration(
+              QString::fromStdString(result.preset), result.threads,
+              result.headroom,
+              QString("%1x%2@%3").arg(width).arg(height).arg(fps));
+          // 使用校准得到的参数
+          g_setting_manager->SetPreset(QString::fromStdString(result.preset));
+          g_setting_manager->SetEncodeThreads(result.threads);
+          updateEncoderWidgets();
+          updateCalibrationLabel();
+
+          if (!result.sustainable) {
+            ui_.calibrationLabel->setText(
+                ui_.calibrationLabel->text() +
+                QStringLiteral("，无法实时编码，请降低帧率或缩放"));
+          }
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+void SettingDialog::updateCalibrationLabel() {
+  if (!g_setting_manager->HasCalibration()) {
+    ui_.calibrationLabel->setText(QStringLiteral("未校准"));
+    return;
+  }
+
+  const int threads = g_setting_manager->CalibrationThreads();
+  ui_.calibrationLabel->setText(
+      QStringLiteral("%1: %2, 线程%3, 余量%4倍")
+          .arg(g_setting_manager->CalibrationTarget())
+          .arg(g_setting_manager->CalibrationPreset())
+          .arg(threads > 0 ? QString::number(threads)
+                           : QStringLiteral("自动"))
+          .arg(g_setting_manager->CalibrationHeadroom(), 0, 'f', 1));
+}
+
+void SettingDialog::updateEncoderWidgets() {
+  const QSignalBlocker preset_blocker(ui_.presetSelector);
+  const QSignalBlocker tune_blocker(ui_.tuneSelector);
+  const QSignalBlocker crf_blocker(ui_.crfSpinBox);
+  const QSignalBlocker bit_rate_blocker(ui_.bitRateSpinBox);
+  const QSignalBlocker b_frames_blocker(ui_.bFramesSpinBox);
+  const QSignalBlocker threads_blocker(ui_.threadsSpinBox);
+  const QSignalBlocker lookahead_blocker(ui_.lookaheadSpinBox);
+  const QSignalBlocker interval_blocker(ui_.keyFrameIntervalSpinBox);
+  const QSignalBlocker scale_blocker(ui_.scaleSelector);
+  const QSignalBlocker vfr_blocker(ui_.variableFrameRateCheckBox);
+
+  ui_.presetSelector->setCurrentText(g_setting_manager->Preset());
+  ui_.tuneSelector->setCurrentText(g_setting_manager->Tune());
+  ui_.crfSpinBox->setValue(g_setting_manager->Crf());
+  ui_.crfSpinBox->setEnabled(g_setting_manager->BitRate() == 0);
+  ui_.bitRateSpinBox->setValue(g_setting_manager->BitRate());
+  ui_.bFramesSpinBox->setValue(g_setting_manager->MaxBFrames());
+  ui_.threadsSpinBox->setValue(g_setting_manager->EncodeThreads());
+  ui_.lookaheadSpinBox->setValue(g_setting_manager->Lookahead());
+  ui_.keyFrameIntervalSpinBox->setValue(g_setting_manager->KeyFrameInterval());
+  ui_.scaleSelector->setCurrentIndex(
+      ui_.scaleSelector->findData(g_setting_manager->Scale()));
+  ui_.variableFrameRateCheckBox->setChecked(
+      g_setting_manager->VariableFrameRate());
+
+  updatePerformanceProfile();
+}
+
+void SettingDialog::updatePerformanceProfile() {
+  const QSignalBlocker blocker(ui_.profileSelector);
+  ui_.profileSelector->setCurrentText(
+      g_setting_manager->PerformanceProfileName());
+}
+
 void SettingDialog::mousePressEvent(QMouseEvent* event) {
   if (ui_.titleBar->rect().contains(event->pos())) {
     should_move_window_ = true;
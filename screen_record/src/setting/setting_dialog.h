@@ -1,6 +1,9 @@
 ﻿#ifndef SCREEN_RECORD_SRC_SETTING_SETTING_DIALOG_H_
 #define SCREEN_RECORD_SRC_SETTING_SETTING_DIALOG_H_
 
+#include <atomic>
+#include <thread>
+
 #include <QtWidgets/QDialog>
 
 #include "screen_record/uic/ui_setting_dialog.h"
@@ -19,8 +22,34 @@ class SettingDialog : public QDialog {
   void onFileFormatChanged(const QString& new_format);
   void onCaptureTypeChanged(const QString& new_type);
   void onVideoEncoderChanged(const QString& new_encoder);
+  void onCursorTrackChanged(int state);
+
+  void onPerformanceProfileChanged(const QString& new_profile);
+  void onPresetChanged(const QString& new_preset);
+  void onTuneChanged(const QString& new_tune);
+  void onCrfChanged(int new_crf);
+  void onBitRateChanged(int new_bit_rate);
+  void onMaxBFramesChanged(int new_max_b_frames);
+  void onEncodeThreadsChanged(int new_threads);
+  void onLookaheadChanged(int new_lookahead);
+  void onKeyFrameIntervalChanged(int new_interval);
+  void onScaleChanged(int index);
+  void onVariableFrameRateChanged(int state);
+  void onAdaptiveQualityChanged(int state);
+  void onEncoderProcessChanged(int state);
+  void onReplayModeChanged(int state);
+
+  // 开始性能校准
+  void onCalibrate();
 
  private:
+  // 根据SettingManager中的编码参数更新控件，不触发信号
+  void updateEncoderWidgets();
+  // 编码参数修改后，选中与之一致的性能方案
+  void updatePerformanceProfile();
+  // 显示保存的校准结果
+  void updateCalibrationLabel();
+
   void mousePressEvent(QMouseEvent* event) override;
   void mouseReleaseEvent(QMouseEvent* event) override;
   void mouseMoveEvent(QMouseEvent* event) override;
@@ -32,6 +61,10 @@ class SettingDialog : public QDialog {
   // 移动前窗口左上角坐标
   QPoint window_pt_before_move_;
 
+  // 校准线程，关闭对话框时中止
+  std::thread calibration_thread_;
+  std::atomic<bool> cancel_calibration_;
+
   Ui::SettingDialogUI ui_;
 };  // class SettingDialog
 
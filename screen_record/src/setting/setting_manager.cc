@@ -1,5 +1,10 @@
 ﻿#include "screen_record/src/setting/setting_manager.h"
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <thread>
+
 #include <QtCore/QDir>
 #include <QtCore/QSettings>
 
@@ -15,6 +20,66 @@ const char kFpsKey[] = "App/fps";
 const char kFileFormatKey[] = "App/fileFormat";
 const char kCaptureTypeKey[] = "App/captureType";
 const char kVideoEncoderKey[] = "App/videoEncoder";
+const char kCursorTrackKey[] = "App/cursorTrack";
+const char kPresetKey[] = "App/preset";
+const char kTuneKey[] = "App/tune";
+const char kCrfKey[] = "App/crf";
+const char kBitRateKey[] = "App/bitRate";
+const char kMaxBFramesKey[] = "App/maxBFrames";
+const char kEncodeThreadsKey[] = "App/encodeThreads";
+const char kLookaheadKey[] = "App/lookahead";
+const char kKeyFrameIntervalKey[] = "App/keyFrameInterval";
+const char kScaleKey[] = "App/scale";
+const char kVariableFrameRateKey[] = "App/variableFrameRate";
+const char kAdaptiveQualityKey[] = "App/adaptiveQuality";
+const char kEncoderProcessKey[] = "App/encoderProcess";
+const char kLosslessIntraOnlyKey[] = "App/losslessIntraOnly";
+const char kReplayModeKey[] = "App/replayMode";
+const char kReplaySecondsKey[] = "App/replaySeconds";
+const char kReplayMaxMegabytesKey[] = "App/replayMaxMegabytes";
+const char kExtraOutputsKey[] = "App/extraOutputs";
+const char kStreamUrlKey[] = "App/streamUrl";
+const char kStreamBitRateKey[] = "App/streamBitRate";
+const char kRenditionsKey[] = "App/renditions";
+const char kCalibrationPresetKey[] = "App/calibrationPreset";
+const char kCalibrationThreadsKey[] = "App/calibrationThreads";
+const char kCalibrationHeadroomKey[] = "App/calibrationHeadroom";
+const char kCalibrationTargetKey[] = "App/calibrationTarget";
+// 后面加上角色名，如"ThreadRole/capturePriority"
+const char kThreadRolePriorityKey[] = "ThreadRole/%1Priority";
+const char kThreadRoleCpusKey[] = "ThreadRole/%1Cpus";
+
+// 自动调整画质时crf最多提高的值
+const int kAdaptiveCrfRange = 8;
+// 自动调整画质时每编码一帧最多丢弃的帧数
+const int kAdaptiveMaxFrameSkip = 2;
+
+const SettingManager::VideoEncoderInfo* FindVideoEncoderInfo(
+    const QString& description) {
+  for (const auto& info : SettingManager::kVideoEncoderList) {
+    if (description == QString(info.description)) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+bool IsInList(const char* const* list, const QString& value) {
+  for (int i = 0; list[i]; ++i) {
+    if (value == QString(list[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int ClampValue(int value, int min_value, int max_value) {
+  return std::min(std::max(value, min_value), max_value);
+}
+
+QString ThreadRoleKey(const char* key, base::ThreadRole role) {
+  return QString(key).arg(base::ThreadRoleToString(role));
+}
 
 }  // namespace
 
@@ -24,16 +89,99 @@ SettingManager* SettingManager::GetInstance() {
   return &instance;
 }
 
-AVCodecID SettingManager::VideoCodecID() const {
-  const int count = sizeof(kVideoEncoderList) / sizeof(VideoEncoderInfo);
-  for (int i = 0; i < count; ++i) {
-    if (video_encoder_ == QString(kVideoEncoderList[i].description)) {
-      return kVideoEncoderList[i].codec_id;
+QString SettingManager::PerformanceProfileName() const {
+  for (const auto& profile : kPerformanceProfileList) {
+    if (preset_ == QString(profile.preset) &&
+        tune_ == QString(profile.tune) &&
+        crf_ == profile.crf &&
+        bit_rate_ == profile.bit_rate &&
+        max_b_frames_ == profile.max_b_frames &&
+        encode_threads_ == profile.threads &&
+        lookahead_ == profile.lookahead &&
+        key_frame_interval_ == profile.key_frame_interval &&
+        scale_ == profile.scale &&
+        variable_frame_rate_ == profile.variable_frame_rate) {
+      return QString(profile.name);
     }
   }
+  return QString(kCustomPerformanceProfile);
+}
+
+base::ThreadRoleConfig SettingManager::ThreadRoleSetting(
+    base::ThreadRole role) const {
+  DCHECK(role != base::ThreadRole::COUNT);
+  return thread_roles_[static_cast<int>(role)];
+}
+
+VideoConfig SettingManager::MakeVideoConfig(int width,
+                                            int height,
+                                            int fps) const {
+  VideoConfig video_config;
+  video_config.width = width;
+  video_config.height = height;
+  video_config.fps = fps;
+  video_config.input_pixel_format = AV_PIX_FMT_RGB32;
+  video_config.codec_id = VideoCodecID();
+  video_config.encoder_name = VideoEncoderName();
+
+  // 当前的编码参数按性能方案的格式传入，与命令行程序的换算一致
+  const std::string preset = preset_.toStdString();
+  const std::string tune = tune_.toStdString();
+  const PerformanceProfile profile = {
+      kCustomPerformanceProfile, preset.c_str(), tune.c_str(), crf_,
+      bit_rate_, max_b_frames_, encode_threads_, lookahead_,
+      key_frame_interval_, scale_, variable_frame_rate_};
+  ApplyProfileToVideoConfig(profile, &video_config);
+
+  video_config.adaptive_quality = adaptive_quality_;
+  video_config.max_crf = std::min(crf_ + kAdaptiveCrfRange, kMaxCrf);
+  video_config.max_frame_skip = kAdaptiveMaxFrameSkip;
+
+  // 直播时恒定码率，关键帧间隔固定，观众加入后最多等待这么久就能看到画面
+  if (Streaming()) {
+    video_config.low_latency = true;
+    video_config.bit_rate = static_cast<int64_t>(stream_bit_rate_) * 1000;
+    video_config.max_b_frames = 0;
+    video_config.max_gop_size = fps * kStreamKeyFrameInterval;
+  }
+
+  // 无损编码的文件本来就大，不调整画质，也不使用B帧，
+  // 关键帧间隔很短，剪辑软件可以快速定位到任意一帧
+  if (LosslessEncoder()) {
+    video_config.lossless = true;
+    video_config.bit_rate = 0;
+    video_config.adaptive_quality = false;
+    video_config.enable_roi = false;
+    video_config.max_b_frames = 0;
+    video_config.max_gop_size =
+        lossless_intra_only_ ? 1 : std::max(fps / 2, 1);
+    video_config.min_gop_size = video_config.max_gop_size;
+  }
+
+  return video_config;
+}
+
+AVCodecID SettingManager::VideoCodecID() const {
+  const VideoEncoderInfo* info = FindVideoEncoderInfo(video_encoder_);
+  if (!info) {
+    DCHECK(false);
+    return kDefaultVideoCodecID;
+  }
+  return info->codec_id;
+}
 
-  DCHECK(false);
-  return kDefaultVideoCodecID;
+std::string SettingManager::VideoEncoderName() const {
+  const VideoEncoderInfo* info = FindVideoEncoderInfo(video_encoder_);
+  if (!info) {
+    DCHECK(false);
+    return kVideoEncoderList[0].encoder_name;
+  }
+  return info->encoder_name;
+}
+
+bool SettingManager::LosslessEncoder() const {
+  const VideoEncoderInfo* info = FindVideoEncoderInfo(video_encoder_);
+  return info && info->lossless;
 }
 
 void SettingManager::SetFps(int new_fps) {
@@ -72,8 +220,311 @@ void SettingManager::SetVideoEncoder(const QString& new_encoder) {
   settings_->setValue(kVideoEncoderKey, QVariant::fromValue(video_encoder_));
 }
 
-SettingManager::SettingManager() {
+void SettingManager::SetCursorTrack(bool cursor_track) {
+  if (cursor_track_ == cursor_track) {
+    return;
+  }
+
+  cursor_track_ = cursor_track;
+  settings_->setValue(kCursorTrackKey, QVariant::fromValue(cursor_track_));
+}
+
+void SettingManager::SetPreset(const QString& new_preset) {
+  if (preset_ == new_preset) {
+    return;
+  }
+
+  preset_ = new_preset;
+  settings_->setValue(kPresetKey, QVariant::fromValue(preset_));
+}
+
+void SettingManager::SetTune(const QString& new_tune) {
+  if (tune_ == new_tune) {
+    return;
+  }
+
+  tune_ = new_tune;
+  settings_->setValue(kTuneKey, QVariant::fromValue(tune_));
+}
+
+void SettingManager::SetCrf(int new_crf) {
+  if (crf_ == new_crf) {
+    return;
+  }
+
+  crf_ = new_crf;
+  settings_->setValue(kCrfKey, QVariant::fromValue(crf_));
+}
+
+void SettingManager::SetBitRate(int new_bit_rate) {
+  if (bit_rate_ == new_bit_rate) {
+    return;
+  }
+
+  bit_rate_ = new_bit_rate;
+  settings_->setValue(kBitRateKey, QVariant::fromValue(bit_rate_));
+}
+
+void SettingManager::SetMaxBFrames(int new_max_b_frames) {
+  if (max_b_frames_ == new_max_b_frames) {
+    return;
+  }
+
+  max_b_frames_ = new_max_b_frames;
+  settings_->setValue(kMaxBFramesKey, QVariant::fromValue(max_b_frames_));
+}
+
+void SettingManager::SetEncodeThreads(int new_threads) {
+  if (encode_threads_ == new_threads) {
+    return;
+  }
+
+  encode_threads_ = new_threads;
+  settings_->setValue(kEncodeThreadsKey, QVariant::fromValue(encode_threads_));
+}
+
+void SettingManager::SetLookahead(int new_lookahead) {
+  if (lookahead_ == new_lookahead) {
+    return;
+  }
+
+  lookahead_ = new_lookahead;
+  settings_->setValue(kLookaheadKey, QVariant::fromValue(lookahead_));
+}
+
+void SettingManager::SetKeyFrameInterval(int new_interval) {
+  if (key_frame_interval_ == new_interval) {
+    return;
+  }
+
+  key_frame_interval_ = new_interval;
+  settings_->setValue(kKeyFrameIntervalKey,
+                      QVariant::fromValue(key_frame_interval_));
+}
+
+void SettingManager::SetScale(int new_scale) {
+  if (scale_ == new_scale) {
+    return;
+  }
+
+  scale_ = new_scale;
+  settings_->setValue(kScaleKey, QVariant::fromValue(scale_));
+}
+
+void SettingManager::SetVariableFrameRate(bool variable_frame_rate) {
+  if (variable_frame_rate_ == variable_frame_rate) {
+    return;
+  }
+
+  variable_frame_rate_ = variable_frame_rate;
+  settings_->setValue(kVariableFrameRateKey,
+                      QVariant::fromValue(variable_frame_rate_));
+}
+
+void SettingManager::SetAdaptiveQuality(bool adaptive_quality) {
+  if (adaptive_quality_ == adaptive_quality) {
+    return;
+  }
+
+  adaptive_quality_ = adaptive_quality;
+  settings_->setValue(kAdaptiveQualityKey,
+                      QVariant::fromValue(adaptive_quality_));
+}
+
+void SettingManager::SetLosslessIntraOnly(bool intra_only) {
+  if (lossless_intra_only_ == intra_only) {
+    return;
+  }
+
+  lossless_intra_only_ = intra_only;
+  settings_->setValue(kLosslessIntraOnlyKey,
+                      QVariant::fromValue(lossless_intra_only_));
+}
+
+void SettingManager::SetEncoderProcess(bool encoder_process) {
+  if (encoder_process_ == encoder_process) {
+    return;
+  }
+
+  encoder_process_ = encoder_process;
+  settings_->setValue(kEncoderProcessKey,
+                      QVariant::fromValue(encoder_process_));
+}
+
+void SettingManager::SetThreadRoleSetting(
+    base::ThreadRole role,
+    const base::ThreadRoleConfig& config) {
+  DCHECK(role != base::ThreadRole::COUNT);
+  thread_roles_[static_cast<int>(role)] = config;
+  settings_->setValue(
+      ThreadRoleKey(kThreadRolePriorityKey, role),
+      QVariant::fromValue(
+          QString(base::ThreadPriorityToString(config.priority))));
+  settings_->setValue(
+      ThreadRoleKey(kThreadRoleCpusKey, role),
+      QVariant::fromValue(
+          QString::fromStdString(base::CpuMaskToString(config.cpu_mask))));
+}
+
+void SettingManager::SetReplayMode(bool replay_mode) {
+  if (replay_mode_ == replay_mode) {
+    return;
+  }
+
+  replay_mode_ = replay_mode;
+  settings_->setValue(kReplayModeKey, QVariant::fromValue(replay_mode_));
+}
+
+void SettingManager::SetReplaySeconds(int seconds) {
+  if (replay_seconds_ == seconds) {
+    return;
+  }
+
+  replay_seconds_ = seconds;
+  settings_->setValue(kReplaySecondsKey, QVariant::fromValue(replay_seconds_));
+}
+
+void SettingManager::SetReplayMaxMegabytes(int megabytes) {
+  if (replay_max_megabytes_ == megabytes) {
+    return;
+  }
+
+  replay_max_megabytes_ = megabytes;
+  settings_->setValue(kReplayMaxMegabytesKey,
+                      QVariant::fromValue(replay_max_megabytes_));
+}
+
+void SettingManager::SetExtraOutputs(const QString& extra_outputs) {
+  if (extra_outputs_ == extra_outputs) {
+    return;
+  }
+
+  extra_outputs_ = extra_outputs;
+  settings_->setValue(kExtraOutputsKey, QVariant::fromValue(extra_outputs_));
+}
+
+void SettingManager::SetStreamUrl(const QString& url) {
+  if (stream_url_ == url) {
+    return;
+  }
+
+  stream_url_ = url;
+  settings_->setValue(kStreamUrlKey, QVariant::fromValue(stream_url_));
+}
+
+void SettingManager::SetStreamBitRate(int bit_rate) {
+  if (stream_bit_rate_ == bit_rate) {
+    return;
+  }
+
+  stream_bit_rate_ = bit_rate;
+  settings_->setValue(kStreamBitRateKey, QVariant::fromValue(stream_bit_rate_));
+}
+
+void SettingManager::SetRenditions(const QString& renditions) {
+  if (renditions_ == renditions) {
+    return;
+  }
+
+  renditions_ = renditions;
+  settings_->setValue(kRenditionsKey, QVariant::fromValue(renditions_));
+}
+
+QList<int> SettingManager::RenditionHeights() const {
+  QList<int> heights;
+  for (const QString& item : renditions_.split(',', Qt::SkipEmptyParts)) {
+    bool ok = false;
+    const int height = item.trimmed().toInt(&ok);
+    if (ok && height >= kMinRenditionHeight && !heights.contains(height)) {
+      heights.append(height);
+    }
+  }
+  std::sort(heights.begin(), heights.end(), std::greater<int>());
+  return heights;
+}
+
+QList<SettingManager::ExtraOutput> SettingManager::MakeExtraOutputs(
+    const QString& output_path) const {
+  // 去掉录屏文件的后缀
+  const int dot = output_path.lastIndexOf('.');
+  const QString base_path = dot > 0 ? output_path.left(dot) : output_path;
+
+  QList<ExtraOutput> outputs;
+  for (const QString& item : extra_outputs_.split(',', Qt::SkipEmptyParts)) {
+    const QString entry = item.trimmed();
+    const int separator = entry.indexOf('=');
+    if (separator > 0) {
+      const QString url = entry.mid(separator + 1).trimmed();
+      if (!url.isEmpty()) {
+        outputs.append({entry.left(separator).trimmed(), url});
+      }
+      continue;
+    }
+
+    if (entry == file_format_) {
+      continue;
+    }
+    for (int i = 0; kExtraFileFormatList[i]; ++i) {
+      if (entry == QString(kExtraFileFormatList[i])) {
+        outputs.append({QString(), base_path + "." + entry});
+        break;
+      }
+    }
+  }
+  return outputs;
+}
+
+bool SettingManager::ApplyPerformanceProfile(const QString& name) {
+  const PerformanceProfile* profile =
+      FindPerformanceProfile(name.toStdString());
+  if (!profile) {
+    return false;
+  }
+
+  SetPreset(QString(profile->preset));
+  SetTune(QString(profile->tune));
+  SetCrf(profile->crf);
+  SetBitRate(profile->bit_rate);
+  SetMaxBFrames(profile->max_b_frames);
+  SetEncodeThreads(profile->threads);
+  SetLookahead(profile->lookahead);
+  SetKeyFrameInterval(profile->key_frame_interval);
+  SetScale(profile->scale);
+  SetVariableFrameRate(profile->variable_frame_rate);
+  return true;
+}
+
+void SettingManager::SetCalibration(const QString& preset,
+                                    int threads,
+                                    double headroom,
+                                    const QString& target) {
+  calibration_preset_ = preset;
+  calibration_threads_ = threads;
+  calibration_headroom_ = headroom;
+  calibration_target_ = target;
+
+  settings_->setValue(kCalibrationPresetKey,
+                      QVariant::fromValue(calibration_preset_));
+  settings_->setValue(kCalibrationThreadsKey,
+                      QVariant::fromValue(calibration_threads_));
+  settings_->setValue(kCalibrationHeadroomKey,
+                      QVariant::fromValue(calibration_headroom_));
+  settings_->setValue(kCalibrationTargetKey,
+                      QVariant::fromValue(calibration_target_));
+}
+
+SettingManager::SettingManager()
+    : cursor_track_(kDefaultCursorTrack),
+      adaptive_quality_(kDefaultAdaptiveQuality),
+      encoder_process_(kDefaultEncoderProcess),
+      replay_mode_(kDefaultReplayMode),
+      replay_seconds_(kDefaultReplaySeconds),
+      replay_max_megabytes_(kDefaultReplayMaxMegabytes),
+      stream_bit_rate_(kDefaultStreamBitRate),
+      calibration_threads_(0),
+      calibration_headroom_(0.0) {
   DecodeConfig();
+  DecodeThreadRoleConfig();
 }
 
 SettingManager::~SettingManager() {
@@ -84,12 +535,64 @@ void SettingManager::Reset() {
   file_format_ = QString(kDefaultFileFormat);
   capture_type_ = QString(kDefaultCaptureType);
   video_encoder_ = QString(kDefaultVideoEncoder);
+  cursor_track_ = kDefaultCursorTrack;
+  adaptive_quality_ = kDefaultAdaptiveQuality;
+  encoder_process_ = kDefaultEncoderProcess;
+  lossless_intra_only_ = kDefaultLosslessIntraOnly;
+  replay_mode_ = kDefaultReplayMode;
+  replay_seconds_ = kDefaultReplaySeconds;
+  replay_max_megabytes_ = kDefaultReplayMaxMegabytes;
+  extra_outputs_.clear();
+  stream_url_.clear();
+  stream_bit_rate_ = kDefaultStreamBitRate;
+  renditions_.clear();
+
+  const PerformanceProfile* profile =
+      FindPerformanceProfile(kDefaultPerformanceProfile);
+  DCHECK(profile);
+  preset_ = QString(profile->preset);
+  tune_ = QString(profile->tune);
+  crf_ = profile->crf;
+  bit_rate_ = profile->bit_rate;
+  max_b_frames_ = profile->max_b_frames;
+  encode_threads_ = profile->threads;
+  lookahead_ = profile->lookahead;
+  key_frame_interval_ = profile->key_frame_interval;
+  scale_ = profile->scale;
+  variable_frame_rate_ = profile->variable_frame_rate;
 
   DCHECK(settings_.get());
   settings_->setValue(kFpsKey, QVariant::fromValue(fps_));
   settings_->setValue(kFileFormatKey, QVariant::fromValue(file_format_));
   settings_->setValue(kCaptureTypeKey, QVariant::fromValue(capture_type_));
   settings_->setValue(kVideoEncoderKey, QVariant::fromValue(video_encoder_));
+  settings_->setValue(kCursorTrackKey, QVariant::fromValue(cursor_track_));
+  settings_->setValue(kPresetKey, QVariant::fromValue(preset_));
+  settings_->setValue(kTuneKey, QVariant::fromValue(tune_));
+  settings_->setValue(kCrfKey, QVariant::fromValue(crf_));
+  settings_->setValue(kBitRateKey, QVariant::fromValue(bit_rate_));
+  settings_->setValue(kMaxBFramesKey, QVariant::fromValue(max_b_frames_));
+  settings_->setValue(kEncodeThreadsKey, QVariant::fromValue(encode_threads_));
+  settings_->setValue(kLookaheadKey, QVariant::fromValue(lookahead_));
+  settings_->setValue(kKeyFrameIntervalKey,
+                      QVariant::fromValue(key_frame_interval_));
+  settings_->setValue(kScaleKey, QVariant::fromValue(scale_));
+  settings_->setValue(kVariableFrameRateKey,
+                      QVariant::fromValue(variable_frame_rate_));
+  settings_->setValue(kAdaptiveQualityKey,
+                      QVariant::fromValue(adaptive_quality_));
+  settings_->setValue(kEncoderProcessKey,
+                      QVariant::fromValue(encoder_process_));
+  settings_->setValue(kLosslessIntraOnlyKey,
+                      QVariant::fromValue(lossless_intra_only_));
+  settings_->setValue(kReplayModeKey, QVariant::fromValue(replay_mode_));
+  settings_->setValue(kReplaySecondsKey, QVariant::fromValue(replay_seconds_));
+  settings_->setValue(kReplayMaxMegabytesKey,
+                      QVariant::fromValue(replay_max_megabytes_));
+  settings_->setValue(kExtraOutputsKey, QVariant::fromValue(extra_outputs_));
+  settings_->setValue(kStreamUrlKey, QVariant::fromValue(stream_url_));
+  settings_->setValue(kStreamBitRateKey, QVariant::fromValue(stream_bit_rate_));
+  settings_->setValue(kRenditionsKey, QVariant::fromValue(renditions_));
 }
 
 void SettingManager::DecodeConfig() {
@@ -125,6 +628,27 @@ void SettingManager::DecodeConfig() {
   QString file_format = settings_->value(kFileFormatKey, QVariant::fromValue(QString())).toString();
   QString capture_type = settings_->value(kCaptureTypeKey, QVariant::fromValue(QString())).toString();
   QString video_encoder = settings_->value(kVideoEncoderKey, QVariant::fromValue(QString())).toString();
+  cursor_track_ = settings_->value(kCursorTrackKey, QVariant::fromValue(kDefaultCursorTrack)).toBool();
+  adaptive_quality_ = settings_->value(kAdaptiveQualityKey, QVariant::fromValue(kDefaultAdaptiveQuality)).toBool();
+  encoder_process_ = settings_->value(kEncoderProcessKey, QVariant::fromValue(kDefaultEncoderProcess)).toBool();
+  lossless_intra_only_ = settings_->value(kLosslessIntraOnlyKey, QVariant::fromValue(kDefaultLosslessIntraOnly)).toBool();
+  replay_mode_ = settings_->value(kReplayModeKey, QVariant::fromValue(kDefaultReplayMode)).toBool();
+  replay_seconds_ = ClampValue(
+      settings_->value(kReplaySecondsKey, QVariant::fromValue(kDefaultReplaySeconds)).toInt(),
+      kMinReplaySeconds, kMaxReplaySeconds);
+  replay_max_megabytes_ = ClampValue(
+      settings_->value(kReplayMaxMegabytesKey, QVariant::fromValue(kDefaultReplayMaxMegabytes)).toInt(),
+      kMinReplayMaxMegabytes, kMaxReplayMaxMegabytes);
+  settings_->setValue(kReplaySecondsKey, QVariant::fromValue(replay_seconds_));
+  settings_->setValue(kReplayMaxMegabytesKey,
+                      QVariant::fromValue(replay_max_megabytes_));
+  extra_outputs_ = settings_->value(kExtraOutputsKey, QVariant::fromValue(QString())).toString();
+  stream_url_ = settings_->value(kStreamUrlKey, QVariant::fromValue(QString())).toString().trimmed();
+  stream_bit_rate_ = ClampValue(
+      settings_->value(kStreamBitRateKey, QVariant::fromValue(kDefaultStreamBitRate)).toInt(),
+      kMinStreamBitRate, kMaxBitRate);
+  settings_->setValue(kStreamBitRateKey, QVariant::fromValue(stream_bit_rate_));
+  renditions_ = settings_->value(kRenditionsKey, QVariant::fromValue(QString())).toString();
 
   int index = -1;
 
@@ -174,19 +698,112 @@ void SettingManager::DecodeConfig() {
     capture_type_ = capture_type;
   }
 
-  index = -1;
-  i = 0;
-  for (; i < ARRAYSIZE(kVideoEncoderList); ++i) {
-    if (video_encoder == QString(kVideoEncoderList[i].description)) {
-      index = i;
-      break;
-    }
-    ++i;
-  }
-  if (index == -1) {
+  if (!FindVideoEncoderInfo(video_encoder)) {
     video_encoder_ = kDefaultVideoEncoder;
     settings_->setValue(kVideoEncoderKey, QVariant::fromValue(video_encoder_));
   } else {
     video_encoder_ = video_encoder;
   }
+
+  DecodeEncoderConfig();
+}
+
+void SettingManager::DecodeEncoderConfig() {
+  // 没有保存过的参数使用默认性能方案中的值。之前版本的配置文件中没有
+  // 编码参数，使用当时固定的参数，升级后录屏的CPU占用和文件不变
+  const PerformanceProfile* profile =
+      settings_->contains(kPresetKey)
+          ? FindPerformanceProfile(kDefaultPerformanceProfile)
+          : &kLegacyPerformanceProfile;
+  DCHECK(profile);
+
+  QString preset = settings_->value(kPresetKey, QVariant::fromValue(QString(profile->preset))).toString();
+  if (!IsInList(kPresetList, preset)) {
+    preset = QString(profile->preset);
+  }
+  preset_ = preset;
+
+  QString tune = settings_->value(kTuneKey, QVariant::fromValue(QString(profile->tune))).toString();
+  if (!IsInList(kTuneList, tune)) {
+    tune = QString(profile->tune);
+  }
+  tune_ = tune;
+
+  crf_ = ClampValue(
+      settings_->value(kCrfKey, QVariant::fromValue(profile->crf)).toInt(),
+      kMinCrf, kMaxCrf);
+  bit_rate_ = ClampValue(
+      settings_->value(kBitRateKey, QVariant::fromValue(profile->bit_rate)).toInt(),
+      0, kMaxBitRate);
+  max_b_frames_ = ClampValue(
+      settings_->value(kMaxBFramesKey, QVariant::fromValue(profile->max_b_frames)).toInt(),
+      0, kMaxBFrames);
+  encode_threads_ = ClampValue(
+      settings_->value(kEncodeThreadsKey, QVariant::fromValue(profile->threads)).toInt(),
+      0, kMaxThreads);
+  lookahead_ = ClampValue(
+      settings_->value(kLookaheadKey, QVariant::fromValue(profile->lookahead)).toInt(),
+      0, kMaxLookahead);
+  key_frame_interval_ = ClampValue(
+      settings_->value(kKeyFrameIntervalKey, QVariant::fromValue(profile->key_frame_interval)).toInt(),
+      kMinKeyFrameInterval, kMaxKeyFrameInterval);
+
+  int scale = settings_->value(kScaleKey, QVariant::fromValue(profile->scale)).toInt();
+  if (std::find(std::begin(kScaleList), std::end(kScaleList), scale) ==
+      std::end(kScaleList)) {
+    scale = profile->scale;
+  }
+  scale_ = scale;
+
+  variable_frame_rate_ = settings_->value(kVariableFrameRateKey, QVariant::fromValue(profile->variable_frame_rate)).toBool();
+
+  settings_->setValue(kPresetKey, QVariant::fromValue(preset_));
+  settings_->setValue(kTuneKey, QVariant::fromValue(tune_));
+  settings_->setValue(kCrfKey, QVariant::fromValue(crf_));
+  settings_->setValue(kBitRateKey, QVariant::fromValue(bit_rate_));
+  settings_->setValue(kMaxBFramesKey, QVariant::fromValue(max_b_frames_));
+  settings_->setValue(kEncodeThreadsKey, QVariant::fromValue(encode_threads_));
+  settings_->setValue(kLookaheadKey, QVariant::fromValue(lookahead_));
+  settings_->setValue(kKeyFrameIntervalKey,
+                      QVariant::fromValue(key_frame_interval_));
+  settings_->setValue(kScaleKey, QVariant::fromValue(scale_));
+  settings_->setValue(kVariableFrameRateKey,
+                      QVariant::fromValue(variable_frame_rate_));
+
+  // 校准结果不合法时当作没有校准过
+  QString calibration_preset = settings_->value(kCalibrationPresetKey, QVariant::fromValue(QString())).toString();
+  if (IsInList(kPresetList, calibration_preset)) {
+    calibration_preset_ = calibration_preset;
+    calibration_threads_ = ClampValue(
+        settings_->value(kCalibrationThreadsKey, QVariant::fromValue(0)).toInt(),
+        0, kMaxThreads);
+    calibration_headroom_ = settings_->value(kCalibrationHeadroomKey, QVariant::fromValue(0.0)).toDouble();
+    calibration_target_ = settings_->value(kCalibrationTargetKey, QVariant::fromValue(QString())).toString();
+  }
+}
+
+void SettingManager::DecodeThreadRoleConfig() {
+  // 默认值与CPU核数有关，不写入配置文件，换到别的机器上仍然合适
+  const int num_cpus = static_cast<int>(std::thread::hardware_concurrency());
+  for (int i = 0; i < static_cast<int>(base::ThreadRole::COUNT); ++i) {
+    const base::ThreadRole role = static_cast<base::ThreadRole>(i);
+    base::ThreadRoleConfig config =
+        base::DefaultThreadRoleConfig(role, num_cpus);
+
+    const QString priority_key = ThreadRoleKey(kThreadRolePriorityKey, role);
+    if (settings_->contains(priority_key)) {
+      base::ThreadPriorityFromString(
+          settings_->value(priority_key).toString().toStdString(),
+          &config.priority);
+    }
+    // 空字符串表示不限制CPU
+    const QString cpus_key = ThreadRoleKey(kThreadRoleCpusKey, role);
+    if (settings_->contains(cpus_key)) {
+      base::CpuMaskFromString(
+          settings_->value(cpus_key).toString().toStdString(),
+          &config.cpu_mask);
+    }
+
+    thread_roles_[i] = config;
+  }
 }
@@ -1,11 +1,17 @@
 ﻿#ifndef SCREEN_RECORD_SRC_SETTING_SETTING_MANAGER_H_
 #define SCREEN_RECORD_SRC_SETTING_SETTING_MANAGER_H_
 
+#include <string>
+
+#include <QtCore/QList>
 #include <QtCore/QScopedPointer>
 #include <QtCore/QString>
 
 #include "base/files/file_path.h"
+#include "base/threading/thread_role.h"
+#include "encoder/av_config.h"
 #include "encoder/ffmpeg.h"
+#include "screen_record/src/setting/performance_profile.h"
 
 class QSettings;
 
@@ -13,7 +19,19 @@ class SettingManager {
  public:
   struct VideoEncoderInfo {
     AVCodecID codec_id;
+    // FFmpeg中编码器的名称
+    const char* encoder_name;
     const char* description;
+    // 无损编码，生成的文件较大，只能使用mkv
+    bool lossless;
+  };
+
+  // 录屏文件之外同时写入的输出，只编码一次
+  struct ExtraOutput {
+    // 封装格式的名称，如"mpegts"，为空时由url的后缀决定
+    QString format;
+    // 文件路径或者FFmpeg的地址，如"pipe:1"
+    QString url;
   };
 
   static constexpr int kDefaultFps = 25;
@@ -21,27 +39,168 @@ class SettingManager {
   static constexpr char* kDefaultVideoEncoder = "H.264(x264)";
   static constexpr char* kDefaultFileFormat = "mp4";
   static constexpr char* kDefaultCaptureType = "GDI";
+  static constexpr bool kDefaultCursorTrack = false;
+  static constexpr bool kDefaultAdaptiveQuality = true;
+  static constexpr bool kDefaultEncoderProcess = false;
+  static constexpr bool kDefaultLosslessIntraOnly = true;
+  static constexpr bool kDefaultReplayMode = false;
+  static constexpr int kDefaultReplaySeconds = 120;
+  static constexpr int kDefaultReplayMaxMegabytes = 512;
+  static constexpr int kDefaultStreamBitRate = 4000;
+  static constexpr char* kDefaultPerformanceProfile = "Balanced";
+  // 参数与所有性能方案都不一致时显示的名称
+  static constexpr char* kCustomPerformanceProfile = "Custom";
+
+  static constexpr int kMinCrf = 0;
+  static constexpr int kMaxCrf = 51;
+  static constexpr int kMaxBitRate = 100000;
+  static constexpr int kMaxBFrames = 16;
+  static constexpr int kMaxThreads = 64;
+  static constexpr int kMaxLookahead = 250;
+  static constexpr int kMinKeyFrameInterval = 1;
+  static constexpr int kMaxKeyFrameInterval = 60;
+  static constexpr int kMinReplaySeconds = 10;
+  static constexpr int kMaxReplaySeconds = 1800;
+  static constexpr int kMinReplayMaxMegabytes = 16;
+  static constexpr int kMaxReplayMaxMegabytes = 4096;
+  static constexpr int kMinStreamBitRate = 500;
+  static constexpr int kStreamKeyFrameInterval = 2;
+  static constexpr int kMinRenditionHeight = 144;
 
   static constexpr int kFpsList[] = { 16, 25, 30, 60 };
-  static constexpr char* kCaptureTypeList[] = { "GDI", "DXGI", nullptr };
+  // Synthetic: 生成模拟的桌面画面，用于测试编码参数
+  static constexpr char* kCaptureTypeList[] = { "GDI", "DXGI", "Synthetic", nullptr };
   static constexpr char* kFileFormatList[] = { "mp4", "mkv", nullptr };
+  // 额外输出可以使用的文件后缀
+  static constexpr char* kExtraFileFormatList[] = { "mp4", "mkv", "ts", nullptr };
+  // preset、tune和crf都按x264的含义设置，由VideoEncoder换算成各编码器的参数。
+  // mp4和mkv都支持前四种编码，无损编码用于导入剪辑软件的中间文件
   static constexpr VideoEncoderInfo kVideoEncoderList[] = {
-    {AV_CODEC_ID_H264, "H.264(x264)"},
+    {AV_CODEC_ID_H264, "libx264", "H.264(x264)", false},
+    {AV_CODEC_ID_HEVC, "libx265", "H.265(x265)", false},
+    {AV_CODEC_ID_AV1, "libsvtav1", "AV1(SVT-AV1)", false},
+    {AV_CODEC_ID_VP9, "libvpx-vp9", "VP9(libvpx)", false},
+    {AV_CODEC_ID_H264, "libx264rgb", "H.264 RGB无损(x264)", true},
+    {AV_CODEC_ID_FFV1, "ffv1", "FFV1无损", true},
+    {AV_CODEC_ID_UTVIDEO, "utvideo", "UT Video无损", true},
   };
-
+  static constexpr char* kPresetList[] = {
+    "ultrafast", "superfast", "veryfast", "faster", "fast",
+    "medium", "slow", "slower", "veryslow", nullptr
+  };
+  static constexpr char* kTuneList[] = {
+    "stillimage", "animation", "film", "zerolatency", nullptr
+  };
+  static constexpr int kScaleList[] = { 100, 75, 50 };
   static SettingManager* GetInstance();
 
   int fps() const { return fps_; }
   QString FileFormat() const { return file_format_; }
   QString CaptureType() const { return capture_type_; }
   QString VideoEncoder() const { return video_encoder_; }
+  // 是否将鼠标单独记录为轨迹文件，而不是绘制到画面中
+  bool CursorTrack() const { return cursor_track_; }
+
+  // 编码参数
+  QString Preset() const { return preset_; }
+  QString Tune() const { return tune_; }
+  int Crf() const { return crf_; }
+  int BitRate() const { return bit_rate_; }
+  int MaxBFrames() const { return max_b_frames_; }
+  int EncodeThreads() const { return encode_threads_; }
+  int Lookahead() const { return lookahead_; }
+  int KeyFrameInterval() const { return key_frame_interval_; }
+  int Scale() const { return scale_; }
+  bool VariableFrameRate() const { return variable_frame_rate_; }
+  // 编码跟不上时是否自动降低画质
+  bool AdaptiveQuality() const { return adaptive_quality_; }
+  // 是否在独立的进程中编码
+  bool EncoderProcess() const { return encoder_process_; }
+  // 无损编码时每一帧都是关键帧，否则每半秒一个关键帧。
+  // 全关键帧在剪辑软件中定位最快，文件也最大
+  bool LosslessIntraOnly() const { return lossless_intra_only_; }
+  // 回放模式：只在内存中保留最近一段时间的画面，需要时再保存
+  bool ReplayMode() const { return replay_mode_; }
+  // 回放缓冲区保留的时长(秒)和占用内存的上限(MB)
+  int ReplaySeconds() const { return replay_seconds_; }
+  int ReplayMaxMegabytes() const { return replay_max_megabytes_; }
+  // 额外的输出，多个输出用逗号分隔。每一项是kExtraFileFormatList中的后缀，
+  // 表示与录屏文件同名的文件，或者"格式名=地址"，如"mkv,mpegts=pipe:1"
+  QString ExtraOutputs() const { return extra_outputs_; }
+  // 解析ExtraOutputs，output_path是录屏文件的路径。
+  // 忽略无效的项和与录屏文件格式相同的后缀
+  QList<ExtraOutput> MakeExtraOutputs(const QString& output_path) const;
+  // 直播地址，如"srt://192.168.1.2:9000"，为空时不直播。
+  // 直播时使用低延迟的编码参数，同时仍然录制到文件
+  QString StreamUrl() const { return stream_url_; }
+  bool Streaming() const { return !stream_url_.isEmpty(); }
+  // 直播的视频码率(kbps)
+  int StreamBitRate() const { return stream_bit_rate_; }
+  // 多码率输出的画面高度，逗号分隔，如"720,480"，为空时不输出
+  QString Renditions() const { return renditions_; }
+  // 解析Renditions，从大到小排列，忽略无效和重复的值
+  QList<int> RenditionHeights() const;
+
+  // 各类线程的优先级和可以使用的CPU，配置文件中没有设置时使用
+  // base::DefaultThreadRoleConfig的值
+  base::ThreadRoleConfig ThreadRoleSetting(base::ThreadRole role) const;
+
+  // 与当前编码参数一致的性能方案，没有时返回kCustomPerformanceProfile
+  QString PerformanceProfileName() const;
+
+  // 根据当前设置生成编码参数
+  // width、height: 屏幕大小，fps: 帧率
+  VideoConfig MakeVideoConfig(int width, int height, int fps) const;
+
+  // 编码性能校准的结果
+  bool HasCalibration() const { return !calibration_preset_.isEmpty(); }
+  QString CalibrationPreset() const { return calibration_preset_; }
+  int CalibrationThreads() const { return calibration_threads_; }
+  // 实时编码的余量，大于1才能实时编码
+  double CalibrationHeadroom() const { return calibration_headroom_; }
+  // 校准时的分辨率和帧率，如"2560x1440@60"
+  QString CalibrationTarget() const { return calibration_target_; }
 
   AVCodecID VideoCodecID() const;
+  // FFmpeg中编码器的名称，如"libx264"
+  std::string VideoEncoderName() const;
+  bool LosslessEncoder() const;
 
   void SetFps(int new_fps);
   void SetFileFormat(const QString& new_format);
   void SetCaptureType(const QString& new_type);
   void SetVideoEncoder(const QString& new_encoder);
+  void SetCursorTrack(bool cursor_track);
+  void SetPreset(const QString& new_preset);
+  void SetTune(const QString& new_tune);
+  void SetCrf(int new_crf);
+  void SetBitRate(int new_bit_rate);
+  void SetMaxBFrames(int new_max_b_frames);
+  void SetEncodeThreads(int new_threads);
+  void SetLookahead(int new_lookahead);
+  void SetKeyFrameInterval(int new_interval);
+  void SetScale(int new_scale);
+  void SetVariableFrameRate(bool variable_frame_rate);
+  void SetAdaptiveQuality(bool adaptive_quality);
+  void SetEncoderProcess(bool encoder_process);
+  void SetLosslessIntraOnly(bool intra_only);
+  void SetReplayMode(bool replay_mode);
+  void SetReplaySeconds(int seconds);
+  void SetReplayMaxMegabytes(int megabytes);
+  void SetExtraOutputs(const QString& extra_outputs);
+  void SetStreamUrl(const QString& url);
+  void SetStreamBitRate(int bit_rate);
+  void SetRenditions(const QString& renditions);
+  void SetThreadRoleSetting(base::ThreadRole role,
+                            const base::ThreadRoleConfig& config);
+
+  // 将name对应的性能方案应用到所有编码参数，name不存在时返回false
+  bool ApplyPerformanceProfile(const QString& name);
+
+  void SetCalibration(const QString& preset,
+                      int threads,
+                      double headroom,
+                      const QString& target);
 
  private:
   SettingManager();
@@ -52,6 +211,10 @@ class SettingManager {
 
   // 解析设置
   void DecodeConfig();
+  // 解析编码参数
+  void DecodeEncoderConfig();
+  // 解析线程的设置
+  void DecodeThreadRoleConfig();
 
   SettingManager(const SettingManager&) = delete;
   SettingManager& operator=(const SettingManager&) = delete;
@@ -60,6 +223,35 @@ class SettingManager {
   QString file_format_;
   QString capture_type_;
   QString video_encoder_;
+  bool cursor_track_;
+
+  QString preset_;
+  QString tune_;
+  int crf_;
+  int bit_rate_;
+  int max_b_frames_;
+  int encode_threads_;
+  int lookahead_;
+  int key_frame_interval_;
+  int scale_;
+  bool variable_frame_rate_;
+  bool adaptive_quality_;
+  bool encoder_process_;
+  bool lossless_intra_only_;
+  bool replay_mode_;
+  int replay_seconds_;
+  int replay_max_megabytes_;
+  QString extra_outputs_;
+  QString stream_url_;
+  int stream_bit_rate_;
+  QString renditions_;
+  base::ThreadRoleConfig
+      thread_roles_[static_cast<int>(base::ThreadRole::COUNT)];
+
+  QString calibration_preset_;
+  int calibration_threads_;
+  double calibration_headroom_;
+  QString calibration_target_;
 
   QString config_folder_;
   QString config_path_;
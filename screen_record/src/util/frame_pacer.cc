@@ -0,0 +1,195 @@
+﻿#include "screen_record/src/util/frame_pacer.h"
+
+#include <thread>
+
+#include "base/check.h"
+#include "base/strings/stringprintf.h"
+#include "build/build_config.h"
+
+#if defined(OS_WIN)
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+namespace {
+
+// 默认在时间点前2毫秒停止sleep改为自旋，
+// 调高系统定时器精度后Sleep的误差一般在1毫秒左右
+const int64_t kDefaultSpinThresholdUs = 2000;
+
+// 落后不超过1帧时追赶节拍
+const int kDefaultMaxCatchUpFrames = 1;
+
+const int64_t kNanosecondsPerSecond = 1000000000;
+
+int64_t ToMicroseconds(FramePacer::Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+}  // namespace
+
+const int64_t FramePacer::JitterHistogram::kBucketLimits[kBucketCount - 1] = {
+    50, 100, 250, 500, 1000, 2000, 5000, 10000};
+
+FramePacer::JitterHistogram::JitterHistogram() {
+  Clear();
+}
+
+void FramePacer::JitterHistogram::Add(int64_t jitter_us) {
+  int i = 0;
+  while (i < kBucketCount - 1 && jitter_us >= kBucketLimits[i]) {
+    ++i;
+  }
+  ++buckets[i];
+}
+
+void FramePacer::JitterHistogram::Clear() {
+  for (int i = 0; i < kBucketCount; ++i) {
+    buckets[i] = 0;
+  }
+}
+
+FramePacer::Stats::Stats()
+    : frames(0),
+      skipped_frames(0),
+      late_frames(0),
+      mean_jitter_us(0.0),
+      max_jitter_us(0),
+      delivered_fps(0.0) {}
+
+FramePacer::FramePacer(int fps)
+    : fps_(fps),
+      max_catch_up_frames_(kDefaultMaxCatchUpFrames),
+      spin_threshold_(std::chrono::microseconds(kDefaultSpinThresholdUs)),
+      yield_while_spinning_(true),
+      next_index_(0),
+      total_jitter_us_(0),
+      segment_frames_(0),
+      finished_duration_(Clock::duration::zero()),
+      finished_intervals_(0) {
+  DCHECK(fps_ > 0);
+#if defined(OS_WIN)
+  // 默认的定时器精度约为15.6毫秒，Sleep无法满足60帧的间隔
+  timeBeginPeriod(1);
+#endif
+}
+
+FramePacer::~FramePacer() {
+#if defined(OS_WIN)
+  timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::Start() {
+  stats_ = Stats();
+  total_jitter_us_ = 0;
+  finished_duration_ = Clock::duration::zero();
+  finished_intervals_ = 0;
+  segment_frames_ = 0;
+  start_time_ = Clock::now();
+  next_index_ = 0;
+}
+
+void FramePacer::Restart() {
+  if (segment_frames_ > 1) {
+    finished_duration_ += segment_last_time_ - segment_first_time_;
+    finished_intervals_ += segment_frames_ - 1;
+  }
+  segment_frames_ = 0;
+  start_time_ = Clock::now();
+  next_index_ = 0;
+}
+
+FramePacer::Clock::time_point FramePacer::WaitForNextFrame() {
+  Clock::time_point deadline = Deadline(next_index_);
+  Clock::time_point now = Clock::now();
+
+  // 第0帧的时间点就是Start或Restart的时间，不算延迟
+  if (next_index_ > 0 && now > deadline) {
+    // 已经错过了时间点，计算当前时间落在第几帧的间隔内
+    const int64_t elapsed_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_time_)
+            .count();
+    const int64_t current_index = elapsed_ns * fps_ / kNanosecondsPerSecond;
+    if (current_index - next_index_ > max_catch_up_frames_) {
+      // 落后太多，跳过错过的帧，等待下一个时间点
+      stats_.skipped_frames += current_index + 1 - next_index_;
+      next_index_ = current_index + 1;
+      deadline = Deadline(next_index_);
+    } else {
+      ++stats_.late_frames;
+    }
+  }
+
+  // 先sleep到时间点前spin_threshold_，剩下的时间自旋
+  while ((now = Clock::now()) < deadline) {
+    const Clock::duration remaining = deadline - now;
+    if (remaining > spin_threshold_) {
+      std::this_thread::sleep_for(remaining - spin_threshold_);
+    } else if (yield_while_spinning_) {
+      std::this_thread::yield();
+    }
+  }
+
+  const int64_t jitter_us = ToMicroseconds(now - deadline);
+  ++stats_.frames;
+  total_jitter_us_ += jitter_us;
+  stats_.mean_jitter_us =
+      static_cast<double>(total_jitter_us_) / stats_.frames;
+  if (jitter_us > stats_.max_jitter_us) {
+    stats_.max_jitter_us = jitter_us;
+  }
+  stats_.histogram.Add(jitter_us);
+
+  if (segment_frames_ == 0) {
+    segment_first_time_ = now;
+  }
+  segment_last_time_ = now;
+  ++segment_frames_;
+
+  Clock::duration duration = finished_duration_;
+  int64_t intervals = finished_intervals_;
+  if (segment_frames_ > 1) {
+    duration += segment_last_time_ - segment_first_time_;
+    intervals += segment_frames_ - 1;
+  }
+  if (duration > Clock::duration::zero()) {
+    stats_.delivered_fps =
+        intervals / std::chrono::duration<double>(duration).count();
+  }
+
+  ++next_index_;
+  return deadline;
+}
+
+std::string FramePacer::FormatStats() const {
+  std::string result = base::StringPrintf(
+      "目标帧率: %d，实际帧率: %.3f，帧数: %lld，跳过: %lld，延迟: %lld，"
+      "平均抖动: %.1fus，最大抖动: %lldus，抖动分布:",
+      fps_, stats_.delivered_fps, static_cast<long long>(stats_.frames),
+      static_cast<long long>(stats_.skipped_frames),
+      static_cast<long long>(stats_.late_frames), stats_.mean_jitter_us,
+      static_cast<long long>(stats_.max_jitter_us));
+  for (int i = 0; i < JitterHistogram::kBucketCount; ++i) {
+    if (i < JitterHistogram::kBucketCount - 1) {
+      result += base::StringPrintf(
+          " <%lldus:%lld",
+          static_cast<long long>(JitterHistogram::kBucketLimits[i]),
+          static_cast<long long>(stats_.histogram.buckets[i]));
+    } else {
+      result += base::StringPrintf(
+          " >=%lldus:%lld",
+          static_cast<long long>(JitterHistogram::kBucketLimits[i - 1]),
+          static_cast<long long>(stats_.histogram.buckets[i]));
+    }
+  }
+  return result;
+}
+
+FramePacer::Clock::time_point FramePacer::Deadline(int64_t index) const {
+  // 用整数计算，避免帧间隔的舍入误差随帧数累积
+  return start_time_ +
+         std::chrono::duration_cast<Clock::duration>(
+             std::chrono::nanoseconds(index * kNanosecondsPerSecond / fps_));
+}
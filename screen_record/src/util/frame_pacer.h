@@ -0,0 +1,102 @@
+﻿// 截屏节拍控制
+
+#ifndef SCREEN_RECORD_SRC_UTIL_FRAME_PACER_H_
+#define SCREEN_RECORD_SRC_UTIL_FRAME_PACER_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+
+// 按绝对时间点安排每一帧：第n帧的时间点为 start + n / fps，
+// 误差不会随帧数累积。等待时先sleep到时间点前spin_threshold，剩下的时间自旋，
+// 避免sleep精度不足导致的抖动。
+//
+// 截屏耗时超过帧间隔时：
+//   落后不超过max_catch_up_frames帧，立即开始下一帧，追上原来的节拍；
+//   落后更多时跳过错过的帧，从下一个未到的时间点继续，跳过的帧数计入统计。
+class FramePacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // 唤醒时间与预定时间点之差的分布，单位微秒
+  struct JitterHistogram {
+    static const int kBucketCount = 9;
+    // 每个区间的上限，最后一个区间没有上限
+    static const int64_t kBucketLimits[kBucketCount - 1];
+
+    int64_t buckets[kBucketCount];
+
+    JitterHistogram();
+    void Add(int64_t jitter_us);
+    void Clear();
+  };  // struct JitterHistogram
+
+  struct Stats {
+    // 实际开始的帧数
+    int64_t frames;
+    // 因落后太多跳过的帧数
+    int64_t skipped_frames;
+    // 追赶节拍时没有等待直接开始的帧数
+    int64_t late_frames;
+    double mean_jitter_us;
+    int64_t max_jitter_us;
+    // 第一帧到最后一帧的实际帧率
+    double delivered_fps;
+    JitterHistogram histogram;
+
+    Stats();
+  };  // struct Stats
+
+  explicit FramePacer(int fps);
+  ~FramePacer();
+
+  void set_max_catch_up_frames(int frames) { max_catch_up_frames_ = frames; }
+  void set_spin_threshold(Clock::duration threshold) {
+    spin_threshold_ = threshold;
+  }
+  // 自旋时是否让出CPU。让出时其它线程可能运行完整个时间片，
+  // 提高了线程优先级之后应该关闭，否则优先级不起作用
+  void set_yield_while_spinning(bool yield) { yield_while_spinning_ = yield; }
+
+  // 以当前时间作为第0帧的时间点，清空统计
+  void Start();
+  // 以当前时间重新开始节拍，保留统计，用于暂停恢复
+  void Restart();
+
+  // 等待下一帧的时间点，返回这一帧的预定时间点
+  Clock::time_point WaitForNextFrame();
+
+  const Stats& stats() const { return stats_; }
+  // 统计信息的文字描述，用于写日志
+  std::string FormatStats() const;
+
+ private:
+  // 第index帧的预定时间点
+  Clock::time_point Deadline(int64_t index) const;
+
+  const int fps_;
+  int max_catch_up_frames_;
+  Clock::duration spin_threshold_;
+  bool yield_while_spinning_;
+
+  Clock::time_point start_time_;
+  // 下一帧的序号
+  int64_t next_index_;
+
+  Stats stats_;
+  int64_t total_jitter_us_;
+  // 当前这一段（Start或Restart之后）第一帧和最后一帧的唤醒时间
+  Clock::time_point segment_first_time_;
+  Clock::time_point segment_last_time_;
+  int64_t segment_frames_;
+  // 之前各段的总时长和帧间隔数，用于计算实际帧率
+  Clock::duration finished_duration_;
+  int64_t finished_intervals_;
+
+  FramePacer() = delete;
+  FramePacer(const FramePacer&) = delete;
+  FramePacer& operator=(const FramePacer&) = delete;
+};  // class FramePacer
+
+#endif  // SCREEN_RECORD_SRC_UTIL_FRAME_PACER_H_
@@ -0,0 +1,186 @@
+﻿// 命令行录屏程序，不依赖Qt，用于脚本、持续集成和无人值守的录屏
+//
+// 录屏流程与界面程序相同(screen_record/src/recorder.h)，参数来自命令行，如
+//   screen_record_cli --capturer=x11 --fps=30 --duration=60 --output=a.mp4
+// 到达录屏时长或者收到SIGINT(Ctrl+C)、SIGTERM时停止录屏，写完文件后退出，
+// 再次收到信号时立即退出。
+// 在Linux上可以用X11截屏或者用Synthetic生成画面，用--audio=Synthetic或
+// --audio=Wav --audio_file=a.wav代替录音设备，--audio=Synthetic,Wav混音。
+// 在Linux上用根目录的CMakeLists.txt构建，见README.md：
+//   cmake -S . -B out && cmake --build out -j
+
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "build/build_config.h"
+#include "encoder/av_config.h"
+#include "gflags/gflags.h"
+#include "logger/logger.h"
+#include "screen_record/src/argument.h"
+#include "screen_record/src/recorder.h"
+#include "screen_record/src/setting/performance_profile.h"
+
+DEFINE_string(output, "", "录屏文件的路径，为空时在当前目录下按开始时间命名");
+DEFINE_int32(duration, 0, "录屏时长(秒)，0表示一直录到收到退出信号");
+DEFINE_string(profile, "Balanced",
+              "性能方案: Low-CPU、Balanced、Quality、Archive");
+DEFINE_string(source, "",
+              "截屏的来源，X11为显示的名称，如:0，"
+              "Synthetic为画面的尺寸，如1920x1080");
+
+namespace {
+
+const char kFilter[] = "ScreenRecordCli";
+
+// 没有指定--output时的文件格式
+const char kDefaultFileFormat[] = "mp4";
+#if defined(OS_LINUX)
+// Linux上没有指定--capturer时的截屏方式
+const char kDefaultLinuxCapturer[] = "X11";
+#endif
+
+// 主线程检查退出信号和录屏时长的间隔
+const int kPollIntervalMs = 10;
+
+const int kExitSuccess = 0;
+const int kExitInvalidArguments = 2;
+const int kExitRecordFailed = 3;
+
+// 信号处理函数中只修改无锁的原子变量
+std::atomic<bool> g_quit_requested(false);
+
+void HandleQuitSignal(int signal_number) {
+  g_quit_requested = true;
+  // 再次收到信号时按默认方式处理，立即退出
+  signal(signal_number, SIG_DFL);
+}
+
+// output_path所在的目录，保存回放时使用
+std::string DirName(const std::string& output_path) {
+  const size_t pos = output_path.find_last_of("\\/");
+  if (pos == std::string::npos) {
+    return ".";
+  }
+  return output_path.substr(0, pos);
+}
+
+// output_path的后缀，没有后缀时使用默认格式
+std::string FileFormat(const std::string& output_path) {
+  const size_t dot = output_path.rfind('.');
+  const size_t slash = output_path.find_last_of("\\/");
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return kDefaultFileFormat;
+  }
+  return output_path.substr(dot + 1);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const auto process_start = std::chrono::steady_clock::now();
+
+  google::SetUsageMessage("命令行录屏，Ctrl+C停止");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  const PerformanceProfile* profile = FindPerformanceProfile(FLAGS_profile);
+  if (!profile || FLAGS_fps <= 0 || FLAGS_duration < 0 ||
+      FLAGS_audio_period_ms <= 0 || FLAGS_audio_buffers <= 0) {
+    LOG_ERROR(kFilter,
+              "参数错误: fps=%d, duration=%d, profile=%s, audio_period_ms=%d, "
+              "audio_buffers=%d",
+              FLAGS_fps, FLAGS_duration, FLAGS_profile.c_str(),
+              FLAGS_audio_period_ms, FLAGS_audio_buffers);
+    return kExitInvalidArguments;
+  }
+
+  RecorderConfig config;
+  config.capture_type = FLAGS_capturer;
+#if defined(OS_LINUX)
+  // --capturer的默认值是Windows上的GDI
+  if (google::GetCommandLineFlagInfoOrDie("capturer").is_default) {
+    config.capture_type = kDefaultLinuxCapturer;
+  }
+#endif
+  config.capture_source = FLAGS_source;
+  config.fps = FLAGS_fps;
+  config.output_path = FLAGS_output;
+  if (config.output_path.empty()) {
+    config.output_path = Recorder::GenerateOutputPath(".", kDefaultFileFormat);
+  }
+  config.output_dir = DirName(config.output_path);
+  config.file_format = FileFormat(config.output_path);
+  config.make_video_config = [profile](int width, int height, int fps) {
+    VideoConfig video_config;
+    video_config.width = width;
+    video_config.height = height;
+    video_config.fps = fps;
+    video_config.input_pixel_format = AV_PIX_FMT_RGB32;
+    video_config.codec_id = AV_CODEC_ID_H264;
+    video_config.encoder_name = "libx264";
+    ApplyProfileToVideoConfig(*profile, &video_config);
+    return video_config;
+  };
+  config.audio_source = FLAGS_audio;
+  config.audio_file = FLAGS_audio_file;
+  config.audio_period_ms = FLAGS_audio_period_ms;
+  config.audio_buffer_count = FLAGS_audio_buffers;
+  config.audio_mix_latency_ms = FLAGS_audio_mix_latency_ms;
+  config.audio_processing = FLAGS_audio_processing;
+#if defined(OS_WIN)
+  config.capture_voice = true;
+#else
+  config.capture_voice = !config.audio_source.empty();
+#endif
+  config.variable_frame_rate = profile->variable_frame_rate;
+
+  LOG_INFO(kFilter, "截屏方式: %s %s, 帧率: %d, 性能方案: %s, 时长: %ds, "
+           "录音: %s %dms, 输出: %s",
+           config.capture_type.c_str(), config.capture_source.c_str(),
+           config.fps, profile->name, FLAGS_duration,
+           config.capture_voice ? config.audio_source.c_str() : "无",
+           config.audio_period_ms, config.output_path.c_str());
+
+  signal(SIGINT, HandleQuitSignal);
+  signal(SIGTERM, HandleQuitSignal);
+#if defined(OS_WIN)
+  signal(SIGBREAK, HandleQuitSignal);
+#endif
+
+  // 录屏失败时提前结束等待
+  std::atomic<bool> failed(false);
+  Recorder recorder([]() {}, []() {}, [&failed]() { failed = true; },
+                    [](const FinalizeProgress& progress) {
+                      LOG_INFO(kFilter, "正在写入文件: %d%%",
+                               progress.Percent());
+                    });
+  if (!recorder.Start(config)) {
+    return kExitRecordFailed;
+  }
+  const auto record_start = std::chrono::steady_clock::now();
+  LOG_INFO(kFilter, "开始录屏，启动耗时%.1fms",
+           std::chrono::duration<double, std::milli>(record_start -
+                                                     process_start)
+               .count());
+
+  const auto deadline = record_start + std::chrono::seconds(FLAGS_duration);
+  while (!g_quit_requested && !failed &&
+         (FLAGS_duration == 0 || std::chrono::steady_clock::now() < deadline)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMs));
+  }
+  if (g_quit_requested) {
+    LOG_INFO(kFilter, "收到退出信号，停止录屏");
+  }
+
+  // 等待编码线程写完文件
+  recorder.Stop();
+  recorder.WaitForFinalize();
+
+  LOG_INFO(kFilter, "录屏%s: %s", failed ? "失败" : "完成",
+           config.output_path.c_str());
+  return failed ? kExitRecordFailed : kExitSuccess;
+}